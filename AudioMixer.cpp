@@ -0,0 +1,54 @@
+#include "AudioMixer.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MIXER_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MIXER_NEON
+#endif
+
+void AudioMixer::SetWeights(float Weight0, float Weight1)
+{
+    float sum = (Weight0 < 0 ? -Weight0 : Weight0) + (Weight1 < 0 ? -Weight1 : Weight1);
+    if (sum <= 0) {
+        scale0 = scale1 = 0.5f;
+        return;
+    }
+    scale0 = Weight0 / sum;
+    scale1 = Weight1 / sum;
+}
+
+void AudioMixer::Mix(uint8_t* const* Dst, const uint8_t* const* Src, int Planes, int NbSamples) const
+{
+    for (int i = 0; i < Planes; i++) {
+        MixPlane((float*)Dst[i], (const float*)Src[i], scale0, scale1, NbSamples);
+    }
+}
+
+void AudioMixer::MixPlane(float* Dst, const float* Src, float Scale0, float Scale1, int Count)
+{
+    int i = 0;
+#if defined(MIXER_SSE)
+    const __m128 s0 = _mm_set1_ps(Scale0);
+    const __m128 s1 = _mm_set1_ps(Scale1);
+    const __m128 hi = _mm_set1_ps(1.0f);
+    const __m128 lo = _mm_set1_ps(-1.0f);
+    for (; i + 4 <= Count; i += 4) {
+        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(Dst + i), s0), _mm_mul_ps(_mm_loadu_ps(Src + i), s1));
+        _mm_storeu_ps(Dst + i, _mm_max_ps(_mm_min_ps(v, hi), lo));
+    }
+#elif defined(MIXER_NEON)
+    const float32x4_t hi = vdupq_n_f32(1.0f);
+    const float32x4_t lo = vdupq_n_f32(-1.0f);
+    for (; i + 4 <= Count; i += 4) {
+        float32x4_t v = vmlaq_n_f32(vmulq_n_f32(vld1q_f32(Dst + i), Scale0), vld1q_f32(Src + i), Scale1);
+        vst1q_f32(Dst + i, vmaxq_f32(vminq_f32(v, hi), lo));
+    }
+#endif
+    // 剩余不足4个的样本，或没有向量指令时全部样本
+    for (; i < Count; i++) {
+        float v = Dst[i] * Scale0 + Src[i] * Scale1;
+        Dst[i] = v > 1.0f ? 1.0f : (v < -1.0f ? -1.0f : v);
+    }
+}
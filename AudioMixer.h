@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+/// <summary>
+/// 双路音频混音器
+/// 对两路平面浮点(FLTP)样本按固定权重求和并限幅到[-1,1]，在第一路的缓冲区上原地完成，
+/// 按编译目标使用SSE或NEON一次处理4个样本，用于默认混音方式下替代amix滤镜图
+/// </summary>
+class AudioMixer
+{
+public:
+    /// <summary>
+    /// 设置两路权重，与amix一样按权重之和归一化
+    /// </summary>
+    /// <param name="Weight0">第一路(扬声器)权重</param>
+    /// <param name="Weight1">第二路(麦克风)权重</param>
+    void SetWeights(float Weight0, float Weight1);
+
+    /// <summary>
+    /// 混音：Dst = Dst * 权重0 + Src * 权重1
+    /// </summary>
+    /// <param name="Dst">第一路各平面，结果也写在这里</param>
+    /// <param name="Src">第二路各平面</param>
+    /// <param name="Planes">平面数(声道数)</param>
+    /// <param name="NbSamples">每个平面的样本数</param>
+    void Mix(uint8_t* const* Dst, const uint8_t* const* Src, int Planes, int NbSamples) const;
+
+private:
+    static void MixPlane(float* Dst, const float* Src, float Scale0, float Scale1, int Count);
+
+private:
+    float scale0{ 0.5f };
+    float scale1{ 0.5f };
+};
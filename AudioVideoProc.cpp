@@ -41,6 +41,8 @@ extern "C" {
 #include "VideoCapManager.h"
 #include "Tool.h"
 #include "MediaFrameCapture.h"
+#include "MicCapture.h"
+#include "WorkerPool.h"
 #include "Log.h"
 #include "AudioVideoProc.h"
 #include "AudioVideoProcModule.h"
@@ -266,6 +268,16 @@ extern "C" {
             return str.c_str();
         }
 
+        void SetMixWeights(int ModuleNum, float InnerWeight, float MicWeight)
+        {
+            g_MoudleVec[ModuleNum]->SetMixWeights(InnerWeight, MicWeight);
+        }
+
+        int GetMixCostUs(int ModuleNum)
+        {
+            return g_MoudleVec[ModuleNum]->GetMixCostUs();
+        }
+
         void SetMicFilter(int ModuleNum, char* MicFilterString)
         {
             g_MoudleVec[ModuleNum]->SetMicFilter(MicFilterString);
@@ -282,6 +294,210 @@ extern "C" {
             return  g_MoudleVec[ModuleNum]->GetFrameAppendNum();
         }
 
+        int GetDesktopGrabLatency(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetDesktopGrabLatency();
+        }
+
+        void SetDesktopDamage(int ModuleNum, bool IsDesktopDamage) {
+            g_MoudleVec[ModuleNum]->SetDesktopDamage(IsDesktopDamage);
+        }
+
+        bool IsDesktopDamage(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->IsDesktopDamage();
+        }
+
+        int GetDamageSkipFrameNum(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetDamageSkipFrameNum();
+        }
+
+        int GetDamagePartialFrameNum(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetDamagePartialFrameNum();
+        }
+
+        void SetScaleFilter(int ModuleNum, int ScaleFilter) {
+            g_MoudleVec[ModuleNum]->SetScaleFilter(ScaleFilter);
+        }
+
+        int GetScaleFilter(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetScaleFilter();
+        }
+
+        void SetConvertThreadNum(int ThreadNum) {
+            WorkerPool::Default()->SetThreadNum(ThreadNum);
+        }
+
+        int GetConvertThreadNum() {
+            return WorkerPool::Default()->GetThreadNum();
+        }
+
+        void SetPixelFormatMode(int ModuleNum, int Mode) {
+            g_MoudleVec[ModuleNum]->SetPixelFormatMode(Mode);
+        }
+
+        int GetPixelFormatMode(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetPixelFormatMode();
+        }
+
+        int GetVideoPixelFormat(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetVideoPixelFormat();
+        }
+
+        const char* GetVideoConvertLatency(int ModuleNum) {
+            static string convertStr;
+            convertStr.clear();
+            int convertUs, sliceNum;
+            if (g_MoudleVec[ModuleNum]->GetVideoConvertLatency(convertUs, sliceNum)) {
+                convertStr = to_string(convertUs) + g_SplitStr + to_string(sliceNum) + g_SplitStr;
+            }
+            return convertStr.c_str();
+        }
+
+        int GetVideoSourceShareNum(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetVideoSourceShareNum();
+        }
+
+        void AddRecordOutput(int ModuleNum, char* Url) {
+            g_MoudleVec[ModuleNum]->AddRecordOutput(Url);
+        }
+
+        void ClearRecordOutput(int ModuleNum) {
+            g_MoudleVec[ModuleNum]->ClearRecordOutput();
+        }
+
+        int GetRecordOutputNum(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetRecordOutputNum();
+        }
+
+        bool AddRecordRendition(int ModuleNum, int Width, int Height, int BitRate, char* Url) {
+            return g_MoudleVec[ModuleNum]->AddRecordRendition(Width, Height, BitRate, Url);
+        }
+
+        void ClearRecordRendition(int ModuleNum) {
+            g_MoudleVec[ModuleNum]->ClearRecordRendition();
+        }
+
+        int GetRecordRenditionNum(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetRecordRenditionNum();
+        }
+
+        const char* GetRenditionStats(int ModuleNum, int Index) {
+            static string renditionStr;
+            int width, height, bitRate, encodeFrame, scaleUs, encodeUs, frameDropNum, packetDropNum;
+            renditionStr.clear();
+            if (g_MoudleVec[ModuleNum]->GetRenditionStats(Index, width, height, bitRate, encodeFrame, scaleUs, encodeUs, frameDropNum, packetDropNum)) {
+                for (int value : { width, height, bitRate, encodeFrame, scaleUs, encodeUs, frameDropNum, packetDropNum }) {
+                    renditionStr += to_string(value) + g_SplitStr;
+                }
+            }
+            return renditionStr.c_str();
+        }
+
+        void SetOutputQueueSize(int ModuleNum, int QueueSize) {
+            g_MoudleVec[ModuleNum]->SetOutputQueueSize(QueueSize);
+        }
+
+        int GetOutputQueueSize(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetOutputQueueSize();
+        }
+
+        int GetOutputQueueDepth(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetOutputQueueDepth();
+        }
+
+        int GetOutputMaxQueueDepth(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetOutputMaxQueueDepth();
+        }
+
+        int GetOutputWriteUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetOutputWriteUs();
+        }
+
+        int GetOutputDropNum(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetOutputDropNum();
+        }
+
+        void SetSegmentRecord(int ModuleNum, int Seconds, int MaxMB) {
+            g_MoudleVec[ModuleNum]->SetSegmentRecord(Seconds, MaxMB);
+        }
+
+        const char* GetSegmentRecord(int ModuleNum) {
+            static string segmentStr;
+            int seconds, maxMB;
+            g_MoudleVec[ModuleNum]->GetSegmentRecord(seconds, maxMB);
+            segmentStr = to_string(seconds) + g_SplitStr + to_string(maxMB) + g_SplitStr;
+            return segmentStr.c_str();
+        }
+
+        const char* GetSegmentPlaylist(int ModuleNum) {
+            static string playlist;
+            playlist = g_MoudleVec[ModuleNum]->GetSegmentPlaylist();
+            return playlist.c_str();
+        }
+
+        int GetSegmentNum(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetSegmentNum();
+        }
+
+        int GetSegmentRotateUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetSegmentRotateUs();
+        }
+
+        int GetOutputWriteAmplification(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetOutputWriteAmplification();
+        }
+
+        void SetReplayBuffer(int ModuleNum, int Seconds, int MaxMB) {
+            g_MoudleVec[ModuleNum]->SetReplayBuffer(Seconds, MaxMB);
+        }
+
+        int GetReplaySeconds(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetReplaySeconds();
+        }
+
+        bool SaveReplay(int ModuleNum, int Seconds, char* Path) {
+            return g_MoudleVec[ModuleNum]->SaveReplay(Seconds, Path ? Path : "");
+        }
+
+        int GetReplayMemoryKB(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetReplayMemoryKB();
+        }
+
+        int GetReplayDurationMs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetReplayDurationMs();
+        }
+
+        int GetReplaySaveUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetReplaySaveUs();
+        }
+
+        int GetPipComposeUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetPipComposeUs();
+        }
+
+        int GetPipComposeMaxUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetPipComposeMaxUs();
+        }
+
+        void SetOverlayTimestamp(int ModuleNum, int Location, int FontHeight) {
+            g_MoudleVec[ModuleNum]->SetOverlayTimestamp(Location, FontHeight);
+        }
+
+        bool SetOverlayWatermark(int ModuleNum, char* Path, int Location, int Opacity, int WidthPercent) {
+            return g_MoudleVec[ModuleNum]->SetOverlayWatermark(Path ? Path : "", Location, Opacity, WidthPercent);
+        }
+
+        void SetOverlayCursor(int ModuleNum, bool IsShow) {
+            g_MoudleVec[ModuleNum]->SetOverlayCursor(IsShow);
+        }
+
+        int GetOverlayUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetOverlayUs();
+        }
+
+        int GetOverlayAreaPixels(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetOverlayAreaPixels();
+        }
+
         bool GetInnerReadyOk(int ModuleNum) {
             return  g_MoudleVec[ModuleNum]->GetInnerReadyOk();
         }
@@ -542,6 +758,58 @@ extern "C" {
             return g_MoudleVec[ModuleNum]->IsAcceptAppendFrame();
         }
 
+        void SetAppendFramePolicy(int ModuleNum, int Policy) {
+            g_MoudleVec[ModuleNum]->SetAppendFramePolicy(Policy);
+        }
+
+        int GetAppendFramePolicy(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetAppendFramePolicy();
+        }
+
+        int GetFrameSkipNum(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetFrameSkipNum();
+        }
+
+        int GetDuplicateEncodeMs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetDuplicateEncodeMs();
+        }
+
+        void SetVideoFrameQueue(int ModuleNum, int Frames, int Policy) {
+            g_MoudleVec[ModuleNum]->SetVideoFrameQueue(Frames, Policy);
+        }
+
+        const char* GetVideoFrameQueue(int ModuleNum) {
+            static string queueStr;
+            int frames, policy;
+            g_MoudleVec[ModuleNum]->GetVideoFrameQueue(frames, policy);
+            queueStr = to_string(frames) + g_SplitStr + to_string(policy) + g_SplitStr;
+            return queueStr.c_str();
+        }
+
+        void SetAdaptiveBitRate(int ModuleNum, int MinBitRate, int MaxBitRate) {
+            g_MoudleVec[ModuleNum]->SetAdaptiveBitRate(MinBitRate, MaxBitRate);
+        }
+
+        const char* GetAdaptiveBitRate(int ModuleNum) {
+            static string abrStr;
+            int minBitRate, maxBitRate, curBitRate, frameDivisor, downNum, upNum, skipFrame;
+            g_MoudleVec[ModuleNum]->GetAdaptiveBitRate(minBitRate, maxBitRate, curBitRate, frameDivisor, downNum, upNum, skipFrame);
+            abrStr.clear();
+            for (int value : { minBitRate, maxBitRate, curBitRate, frameDivisor, downNum, upNum, skipFrame }) {
+                abrStr += to_string(value) + g_SplitStr;
+            }
+            return abrStr.c_str();
+        }
+
+        const char* GetVideoStageLatency(int ModuleNum) {
+            static string latencyStr;
+            int captureUs, queueUs, encodeUs, totalUs, dropNum;
+            g_MoudleVec[ModuleNum]->GetVideoStageLatency(captureUs, queueUs, encodeUs, totalUs, dropNum);
+            latencyStr = to_string(captureUs) + g_SplitStr + to_string(queueUs) + g_SplitStr + to_string(encodeUs) + g_SplitStr
+                + to_string(totalUs) + g_SplitStr + to_string(dropNum) + g_SplitStr;
+            return latencyStr.c_str();
+        }
+
         bool IsRecording(int ModuleNum) {
             return g_MoudleVec[ModuleNum]->IsRecording();
         }
@@ -602,40 +870,11 @@ extern "C" {
         const char* GetMicList() {
             static string micListStr;
             micListStr.clear();
-
-            avdevice_register_all();
-            
-            // --- 修改开始 ---
-            // 去掉 const
-            AVInputFormat* informat = av_find_input_format("alsa");
-            // --- 修改结束 ---
-            
-            if (!informat) {
-                LOG_WARN("Could not find ALSA input format. Trying PulseAudio.");
-                informat = av_find_input_format("pulse");
-                if(!informat) {
-                    LOG_ERROR("Could not find ALSA or PulseAudio input format for device listing.");
-                    return "";
-                }
-            }
-            
-            AVDeviceInfoList* device_list = nullptr;
-            // --- 修改开始 ---
-            // 现在 informat 是 AVInputFormat*，类型匹配
-            int ret = avdevice_list_input_sources(informat, NULL, NULL, &device_list);
-            // --- 修改结束 ---
-            
-            if (ret < 0) {
-                LOG_ERROR("avdevice_list_input_sources failed: " + to_string(ret));
-                return "";
-            }
-
-            for (int i = 0; i < device_list->nb_devices; i++) {
-                micListStr += device_list->devices[i]->device_description;
+            // 与SetMicPattern模式2的序号一致
+            for (const string& device : MicCapture::ListDevices()) {
+                micListStr += device;
                 micListStr += g_SplitStr;
             }
-
-            avdevice_free_list_devices(&device_list);
             return micListStr.c_str();
         }
 
@@ -647,6 +886,62 @@ extern "C" {
             return g_MoudleVec[ModuleNum]->SetMicPattern(MicPattern, MicNum);
         }
 
+        int GetMicOpenUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetMicOpenUs();
+        }
+
+        int GetMicCloseUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetMicCloseUs();
+        }
+
+        int GetAudioLatencyUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetAudioLatencyUs();
+        }
+
+        int GetAudioMaxLatencyUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetAudioMaxLatencyUs();
+        }
+
+        int GetAudioIdleWakeups(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetAudioIdleWakeups();
+        }
+
+        void SetAudioLatencyBudget(int ModuleNum, int BudgetMs) {
+            g_MoudleVec[ModuleNum]->SetAudioLatencyBudget(BudgetMs);
+        }
+
+        int GetAudioLatencyBudget(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetAudioLatencyBudget();
+        }
+
+        void SetAudioOverflowPolicy(int ModuleNum, int Policy) {
+            g_MoudleVec[ModuleNum]->SetAudioOverflowPolicy(Policy);
+        }
+
+        int GetAudioOverflowPolicy(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetAudioOverflowPolicy();
+        }
+
+        int GetAudioFifoFillMs(int ModuleNum, int FifoIndex) {
+            return g_MoudleVec[ModuleNum]->GetAudioFifoFillMs(FifoIndex);
+        }
+
+        int GetAudioFifoHighWaterMs(int ModuleNum, int FifoIndex) {
+            return g_MoudleVec[ModuleNum]->GetAudioFifoHighWaterMs(FifoIndex);
+        }
+
+        int GetAvSyncOffsetUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetAvSyncOffsetUs();
+        }
+
+        int GetAvSyncMaxOffsetUs(int ModuleNum) {
+            return g_MoudleVec[ModuleNum]->GetAvSyncMaxOffsetUs();
+        }
+
+        int GetAudioDriftPpm(int ModuleNum, int Source) {
+            return g_MoudleVec[ModuleNum]->GetAudioDriftPpm(Source);
+        }
+
         void SetRecordXYWH(int ModuleNum, int X, int Y, int Width, int Height) {
             g_MoudleVec[ModuleNum]->SetRecordXYWH(X, Y, Width, Height);
         }
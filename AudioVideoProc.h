@@ -29,6 +29,7 @@ typedef void (*VideoCapErrCallBack)(int CapErrType);
 /// 2代表麦克风设备突然异常
 /// 3代表扬声器设备打开失败
 /// 4代表麦克风设备打开失败
+/// 5代表音频缓冲区溢出(仅溢出策略为2时，每秒最多一次)
 /// </summary>
 typedef void (*AudioErrCallBack)(int AudioErrType);
 /// <summary>
@@ -199,6 +200,7 @@ extern "C" {
         /// <summary>
         /// 设置混音的滤波字符串，默认为[in0][in1]amix=inputs=2:duration=longest:dropout_transition=0:weights="1 0.25":normalize=0[out]
         /// 其中[in0][in1][out]应该保持 [in0]是扬声器 [in1]是麦克风 [out]是混音输出
+        /// 保持默认时使用内置混音器(权重见SetMixWeights)，只有设置了其他字符串才使用滤镜图
         /// </summary>
         /// <param name="ModuleNum">模块序号</param>
         /// <param name="MixFilterString">滤波字符串</param>
@@ -210,6 +212,19 @@ extern "C" {
         /// <returns></returns>
         AUDIOVIDEOPROC_API const char* GetMixFilter(int ModuleNum);
         /// <summary>
+        /// 设置内置混音器的两路权重，按权重之和归一化，默认扬声器0.5、麦克风2，下次开始录制时生效
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="InnerWeight">扬声器权重</param>
+        /// <param name="MicWeight">麦克风权重</param>
+        AUDIOVIDEOPROC_API void SetMixWeights(int ModuleNum, float InnerWeight, float MicWeight);
+        /// <summary>
+        /// 获取两路混音的耗时，内置混音器与滤镜图都会统计
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>每混一秒音频所花的微秒数</returns>
+        AUDIOVIDEOPROC_API int GetMixCostUs(int ModuleNum);
+        /// <summary>
         /// 设置麦克风处理的滤波字符串，默认为[in]highpass=200,lowpass=3000,afftdn[out]
         /// 其中[in][out]应该保持 [in]是麦克风 [out]是输出
         /// </summary>
@@ -223,12 +238,293 @@ extern "C" {
         /// <returns></returns>
         AUDIOVIDEOPROC_API const char* GetMicFilter(int ModuleNum);
         /// <summary>
-        /// 获取30次采集内的平均补帧数
+        /// 获取30次补帧内平均实际编码的重复帧数，补帧方式为跳过重复帧(默认)时为0，跳过的帧数见GetFrameSkipNum
         /// </summary>
         /// <param name="ModuleNum">模块序号</param>
         /// <returns></returns>
         AUDIOVIDEOPROC_API int GetFrameAppendNum(int ModuleNum);
         /// <summary>
+        /// 获取桌面采集每帧抓取耗时的滑动平均值(微秒)，未在采集桌面时返回-1
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns></returns>
+        AUDIOVIDEOPROC_API int GetDesktopGrabLatency(int ModuleNum);
+        /// <summary>
+        /// 设置桌面采集是否根据XDamage只处理变化区域(默认开启)，画面无变化时不再重复编码，下次开始录制时生效
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="IsDesktopDamage">是否开启</param>
+        AUDIOVIDEOPROC_API void SetDesktopDamage(int ModuleNum, bool IsDesktopDamage);
+        /// <summary>
+        /// 获取桌面采集是否根据XDamage只处理变化区域
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns></returns>
+        AUDIOVIDEOPROC_API bool IsDesktopDamage(int ModuleNum);
+        /// <summary>
+        /// 获取本次录制中桌面无变化而跳过抓取与转换的帧数
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns></returns>
+        AUDIOVIDEOPROC_API int GetDamageSkipFrameNum(int ModuleNum);
+        /// <summary>
+        /// 获取本次录制中只重新抓取并转换了变化区域的帧数
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns></returns>
+        AUDIOVIDEOPROC_API int GetDamagePartialFrameNum(int ModuleNum);
+        /// <summary>
+        /// 设置录制画面缩放时的滤波方式，画面先转换为I420再缩放
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="ScaleFilter">0最近邻(最快) 1水平线性 2双线性(默认) 3盒式(缩小时画质最好)</param>
+        AUDIOVIDEOPROC_API void SetScaleFilter(int ModuleNum, int ScaleFilter);
+        /// <summary>
+        /// 获取录制画面缩放时的滤波方式
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns></returns>
+        AUDIOVIDEOPROC_API int GetScaleFilter(int ModuleNum);
+        /// <summary>
+        /// 设置画面转换与缩放共用的工作线程数，所有模块共享，即时生效
+        /// 转换按偶数行切分为条带，缩放按Y、U、V平面，由调用线程与工作线程并行处理
+        /// </summary>
+        /// <param name="ThreadNum">[0,16]，0为串行(默认)，-1按CPU核数自动选择</param>
+        AUDIOVIDEOPROC_API void SetConvertThreadNum(int ThreadNum);
+        /// <summary>
+        /// 获取画面转换的工作线程数
+        /// </summary>
+        /// <returns></returns>
+        AUDIOVIDEOPROC_API int GetConvertThreadNum();
+        /// <summary>
+        /// 获取画面转换(含缩放)每帧耗时的滑动平均值(微秒)与切分的条带数，可调整SetConvertThreadNum对比
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>"耗时?条带数?"，?为g_SplitStr，未在录制时返回空串</returns>
+        AUDIOVIDEOPROC_API const char* GetVideoConvertLatency(int ModuleNum);
+        /// <summary>
+        /// 设置从采集、画中画、叠加层到编码全程使用的像素格式，下次开始录制时生效
+        /// 自动时编码器与摄像头原始数据都支持NV12则使用NV12(摄像头数据只需拷贝)，其余情况使用I420；
+        /// 指定的格式编码器不支持时按自动处理
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Mode">0自动协商(默认) 1 I420 2 NV12</param>
+        AUDIOVIDEOPROC_API void SetPixelFormatMode(int ModuleNum, int Mode);
+        /// <summary>
+        /// 获取像素格式设置
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>0自动协商 1 I420 2 NV12</returns>
+        AUDIOVIDEOPROC_API int GetPixelFormatMode(int ModuleNum);
+        /// <summary>
+        /// 获取本次(或最近一次)录制协商出的像素格式
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>1 I420 2 NV12</returns>
+        AUDIOVIDEOPROC_API int GetVideoPixelFormat(int ModuleNum);
+        /// <summary>
+        /// 获取与本模块共用同一视频源(同一桌面区域或摄像头)的模块数，共用时只采集、转换一次
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>未在录制视频时返回0</returns>
+        AUDIOVIDEOPROC_API int GetVideoSourceShareNum(int ModuleNum);
+        /// <summary>
+        /// 添加附加输出，与SetRecordFileName/SetRtmpUrl选定的主输出共用同一次编码，
+        /// 每个输出有独立的写入线程，推流卡顿不会阻塞录制文件，下次开始录制时生效
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Url">文件路径或rtmp地址，.ts结尾的文件按MPEG-TS封装</param>
+        AUDIOVIDEOPROC_API void AddRecordOutput(int ModuleNum, char* Url);
+        /// <summary>
+        /// 清空附加输出
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API void ClearRecordOutput(int ModuleNum);
+        /// <summary>
+        /// 获取当前正在写入的输出数(主输出与附加输出)，写入出错的输出不计入
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>未在录制时返回0</returns>
+        AUDIOVIDEOPROC_API int GetRecordOutputNum(int ModuleNum);
+        /// <summary>
+        /// 添加一档多码率输出，同一次采集缩放到指定尺寸后单独编码并写入Url，各档在自己的线程中并行编码，下次开始录制时生效；
+        /// 主输出的尺寸不变，每档由宽高都不小于它且宽高比相同的最小一档缩放，没有时由主画面缩放；
+        /// 比主输出宽或高的档位跳过，宽高比与主输出不同的档位会被拉伸；音频与主输出共用
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Width">宽</param>
+        /// <param name="Height">高</param>
+        /// <param name="BitRate">码率，0为按面积从主输出码率折算</param>
+        /// <param name="Url">文件路径或rtmp地址，与已有的档位相同时覆盖其设置</param>
+        /// <returns>参数无效时返回false</returns>
+        AUDIOVIDEOPROC_API bool AddRecordRendition(int ModuleNum, int Width, int Height, int BitRate, char* Url);
+        /// <summary>
+        /// 清空多码率输出
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API void ClearRecordRendition(int ModuleNum);
+        /// <summary>
+        /// 获取本次录制打开的多码率输出档数，不含主输出
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>未在录制时返回0</returns>
+        AUDIOVIDEOPROC_API int GetRecordRenditionNum(int ModuleNum);
+        /// <summary>
+        /// 获取一档多码率输出的状态
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Index">档位序号，按分辨率从大到小排列</param>
+        /// <returns>"宽?高?码率?编码帧数?平均缩放耗时(微秒)?平均编码耗时(微秒)?队列满丢弃帧数?输出丢包数?"，?为g_SplitStr，Index无效时返回空字符串</returns>
+        AUDIOVIDEOPROC_API const char* GetRenditionStats(int ModuleNum, int Index);
+        /// <summary>
+        /// 设置每个输出端的包队列上限，超出后丢弃视频非关键帧直到下一个关键帧，超出两倍时音视频都丢弃
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="QueueSize">包数，默认256，下次开始录制时生效</param>
+        AUDIOVIDEOPROC_API void SetOutputQueueSize(int ModuleNum, int QueueSize);
+        AUDIOVIDEOPROC_API int GetOutputQueueSize(int ModuleNum);
+        /// <summary>
+        /// 获取各输出端中当前排队包数的最大值
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API int GetOutputQueueDepth(int ModuleNum);
+        /// <summary>
+        /// 获取本次录制各输出端中出现过的最大排队包数
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API int GetOutputMaxQueueDepth(int ModuleNum);
+        /// <summary>
+        /// 获取各输出端中写入包平均耗时的最大值
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒</returns>
+        AUDIOVIDEOPROC_API int GetOutputWriteUs(int ModuleNum);
+        /// <summary>
+        /// 获取各输出端因队列超出上限而丢弃的包数之和
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API int GetOutputDropNum(int ModuleNum);
+        /// <summary>
+        /// 设置录制文件分段，写入线程在关键帧处按时长或大小切换到下一个文件，旧文件的文件尾在后台写入，不阻塞编码
+        /// 分段文件名为录制文件名去掉扩展名后加_00000形式的序号，.mp4为分片MP4(进程崩溃时已写入的部分仍可播放)，.ts为MPEG-TS，
+        /// .ts分段写完后登记到同名的.m3u8索引中(HLS)，.mp4分段不生成索引；只对录制文件生效，下次开始录制时生效
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Seconds">每段秒数，0表示不按时长分段</param>
+        /// <param name="MaxMB">每段大小，0表示不按大小分段，两者都为0时不分段(默认)</param>
+        AUDIOVIDEOPROC_API void SetSegmentRecord(int ModuleNum, int Seconds, int MaxMB);
+        /// <summary>
+        /// 获取录制文件分段设置，其中?是分隔符，通过GetSplitStr函数获取
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>Seconds?MaxMB?</returns>
+        AUDIOVIDEOPROC_API const char* GetSegmentRecord(int ModuleNum);
+        /// <summary>
+        /// 获取分段索引文件的路径
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>未在分段录制或分段不是.ts时为空字符串</returns>
+        AUDIOVIDEOPROC_API const char* GetSegmentPlaylist(int ModuleNum);
+        /// <summary>
+        /// 获取已写完的分段数
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API int GetSegmentNum(int ModuleNum);
+        /// <summary>
+        /// 获取每次切换分段时写入线程的耗时，不含后台写文件尾的时间
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒，滑动平均值</returns>
+        AUDIOVIDEOPROC_API int GetSegmentRotateUs(int ModuleNum);
+        /// <summary>
+        /// 获取写放大，即已关闭的输出文件大小与其中编码数据之比，取各输出端的最大值
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>百分数，如103表示封装开销为3%，还没有关闭的文件时为0</returns>
+        AUDIOVIDEOPROC_API int GetOutputWriteAmplification(int ModuleNum);
+        /// <summary>
+        /// 设置即时回放缓冲区，在内存中按GOP保留最近一段时间的编码包，下次开始录制时生效
+        /// 启用后可通过SetRecordFileName设为空字符串，只录制到回放缓冲区而不写录制文件
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Seconds">保留的秒数，0不启用(默认)</param>
+        /// <param name="MaxMB">内存上限，单个GOP超出上限时整体丢弃</param>
+        AUDIOVIDEOPROC_API void SetReplayBuffer(int ModuleNum, int Seconds, int MaxMB);
+        AUDIOVIDEOPROC_API int GetReplaySeconds(int ModuleNum);
+        /// <summary>
+        /// 把回放缓冲区中最近Seconds秒封装到文件，从不晚于该时刻的关键帧开始，不停止录制也不重新编码
+        /// 在调用线程中同步写完
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Seconds">秒数，0表示缓冲区中的全部内容</param>
+        /// <param name="Path">文件路径，按扩展名决定封装格式</param>
+        /// <returns>是否成功</returns>
+        AUDIOVIDEOPROC_API bool SaveReplay(int ModuleNum, int Seconds, char* Path);
+        /// <summary>
+        /// 获取回放缓冲区当前占用的内存
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>KB</returns>
+        AUDIOVIDEOPROC_API int GetReplayMemoryKB(int ModuleNum);
+        /// <summary>
+        /// 获取回放缓冲区当前缓存的时长
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>毫秒</returns>
+        AUDIOVIDEOPROC_API int GetReplayDurationMs(int ModuleNum);
+        /// <summary>
+        /// 获取最近一次SaveReplay的耗时
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒</returns>
+        AUDIOVIDEOPROC_API int GetReplaySaveUs(int ModuleNum);
+        /// <summary>
+        /// 获取画中画每帧合成耗时，在I420平面上把次要画面拷贝到主画面的角落，次要画面的取帧与缩放在独立线程中，不计入
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒，滑动平均值，未显示次要画面时为0</returns>
+        AUDIOVIDEOPROC_API int GetPipComposeUs(int ModuleNum);
+        /// <summary>
+        /// 获取本次录制中画中画合成耗时的最大值
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒</returns>
+        AUDIOVIDEOPROC_API int GetPipComposeMaxUs(int ModuleNum);
+        /// <summary>
+        /// 设置时间戳叠加层，格式为YYYY-MM-DD HH:MM:SS，录制中设置立即生效
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Location">位置(0不显示，[1-4][从左上角开始，顺时针放置])</param>
+        /// <param name="FontHeight">字高(像素)，0为画面高的1/30</param>
+        AUDIOVIDEOPROC_API void SetOverlayTimestamp(int ModuleNum, int Location, int FontHeight);
+        /// <summary>
+        /// 设置水印叠加层，图片在调用时读入，PNG的透明通道会保留，录制中设置立即生效
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Path">图片路径，为空时不显示</param>
+        /// <param name="Location">位置(0不显示，[1-4][从左上角开始，顺时针放置])</param>
+        /// <param name="Opacity">不透明度[0,100]</param>
+        /// <param name="WidthPercent">水印宽度占画面宽度的百分比[1,100]，高度按比例</param>
+        /// <returns>图片读取失败时返回false，原有水印不变</returns>
+        AUDIOVIDEOPROC_API bool SetOverlayWatermark(int ModuleNum, char* Path, int Location, int Opacity, int WidthPercent);
+        /// <summary>
+        /// 设置是否在录制画面上叠加鼠标指针(XFixes)，只在录制桌面时生效
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="IsShow">是否叠加</param>
+        AUDIOVIDEOPROC_API void SetOverlayCursor(int ModuleNum, bool IsShow);
+        /// <summary>
+        /// 获取叠加层每帧耗时，只在图层包围盒内混合，与叠加面积成正比
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒，滑动平均值，没有图层时为0</returns>
+        AUDIOVIDEOPROC_API int GetOverlayUs(int ModuleNum);
+        /// <summary>
+        /// 获取叠加层最近一帧混合的像素数
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API int GetOverlayAreaPixels(int ModuleNum);
+        /// <summary>
         /// 获取扬声器设备是否已被成功使用
         /// </summary>
         /// <param name="ModuleNum">模块序号</param>
@@ -405,6 +701,65 @@ extern "C" {
         /// <returns></returns>
         AUDIOVIDEOPROC_API bool IsAcceptAppendFrame(int ModuleNum);
         /// <summary>
+        /// 设置补帧方式，录制中设置立即生效
+        /// 采集落后时，跳过重复帧只编码最新一帧，时间戳按实际时刻，生成可变帧率的视频；
+        /// 编码重复帧则每个落后的节拍都编码一次，生成恒定帧率的视频，但会进一步加重落后
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Policy">0跳过重复帧(默认) 1编码重复帧</param>
+        AUDIOVIDEOPROC_API void SetAppendFramePolicy(int ModuleNum, int Policy);
+        /// <summary>
+        /// 获取补帧方式
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>0跳过重复帧 1编码重复帧</returns>
+        AUDIOVIDEOPROC_API int GetAppendFramePolicy(int ModuleNum);
+        /// <summary>
+        /// 获取30次补帧内平均跳过编码的重复帧数
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API int GetFrameSkipNum(int ModuleNum);
+        /// <summary>
+        /// 获取本次录制中编码重复帧花费的总耗时
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>毫秒</returns>
+        AUDIOVIDEOPROC_API int GetDuplicateEncodeMs(int ModuleNum);
+        /// <summary>
+        /// 设置视频采集线程与编码线程之间的帧队列，下次开始录制时生效
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Frames">队列容量[1,30]，默认3</param>
+        /// <param name="Policy">队列满时的处理方式，0丢弃最旧的帧(默认) 1丢弃新帧 2采集线程等待编码线程</param>
+        AUDIOVIDEOPROC_API void SetVideoFrameQueue(int ModuleNum, int Frames, int Policy);
+        /// <summary>
+        /// 获取视频帧队列设置
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>"容量?策略?"，?为g_SplitStr</returns>
+        AUDIOVIDEOPROC_API const char* GetVideoFrameQueue(int ModuleNum);
+        /// <summary>
+        /// 获取视频各阶段的平均耗时(微秒)：采集(含转换、画中画与叠加层)、排队、编码、从开始采集到编码包写出，以及队列满丢弃的帧数
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>"采集?排队?编码?总计?丢帧?"，?为g_SplitStr</returns>
+        AUDIOVIDEOPROC_API const char* GetVideoStageLatency(int ModuleNum);
+        /// <summary>
+        /// 设置推流的自适应码率范围，下次开始录制时生效，只在有rtmp输出端时起作用
+        /// 推流输出端排队积压、丢包或写入变慢时降低码率(重新打开编码器，从关键帧开始)，到下限仍拥塞时降低帧率，
+        /// 持续通畅后先恢复帧率再逐步提高码率；每次调整都写入日志
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="MinBitRate">码率下限</param>
+        /// <param name="MaxBitRate">码率上限，0为不启用(固定码率，默认)</param>
+        AUDIOVIDEOPROC_API void SetAdaptiveBitRate(int ModuleNum, int MinBitRate, int MaxBitRate);
+        /// <summary>
+        /// 获取自适应码率的状态
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>"下限?上限?当前码率?帧率除数?降级次数?恢复次数?降帧率未编码帧数?"，?为g_SplitStr，未启用时当前码率为0</returns>
+        AUDIOVIDEOPROC_API const char* GetAdaptiveBitRate(int ModuleNum);
+        /// <summary>
         /// 是否正在录制/推流中
         /// </summary>
         /// <param name="ModuleNum">模块序号</param>
@@ -454,7 +809,7 @@ extern "C" {
          /// <summary>
         /// 获取麦克风列表字符串，其中?是分隔符，通过GetSplitStr函数获取
         /// </summary>
-        /// <returns>名字0?名字1?名字2?</returns>
+        /// <returns>名字0?名字1?名字2?，名字为plughw:卡号,设备号，下标即麦克风序号</returns>
         AUDIOVIDEOPROC_API const char* GetMicList();
         /// <summary>
         /// 获取麦克风设备当前启用的模式
@@ -471,6 +826,82 @@ extern "C" {
         /// <returns>true成功</returns>
         AUDIOVIDEOPROC_API bool SetMicPattern(int ModuleNum, int MicPattern, int MicNum);
         /// <summary>
+        /// 获取最近一次打开麦克风设备的耗时
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒</returns>
+        AUDIOVIDEOPROC_API int GetMicOpenUs(int ModuleNum);
+        /// <summary>
+        /// 获取最近一次关闭麦克风设备的耗时
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒</returns>
+        AUDIOVIDEOPROC_API int GetMicCloseUs(int ModuleNum);
+        /// <summary>
+        /// 获取音频从采集到送入编码器的延迟滑动平均值
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒</returns>
+        AUDIOVIDEOPROC_API int GetAudioLatencyUs(int ModuleNum);
+        /// <summary>
+        /// 获取音频从采集到送入编码器的最大延迟
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒</returns>
+        AUDIOVIDEOPROC_API int GetAudioMaxLatencyUs(int ModuleNum);
+        /// <summary>
+        /// 获取音频处理线程每秒醒来后无数据可处理的次数
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        AUDIOVIDEOPROC_API int GetAudioIdleWakeups(int ModuleNum);
+        /// <summary>
+        /// 设置每个音频缓冲区的容量，决定了处理线程卡住时最多积压多久的音频
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="BudgetMs">毫秒，默认1000，不小于20，下次开始录制时生效</param>
+        AUDIOVIDEOPROC_API void SetAudioLatencyBudget(int ModuleNum, int BudgetMs);
+        AUDIOVIDEOPROC_API int GetAudioLatencyBudget(int ModuleNum);
+        /// <summary>
+        /// 设置音频缓冲区写满时的处理方式
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Policy">0丢弃新数据，消费线程恢复读取时再丢弃积压的旧数据只保留最近半个容量以追上实时(默认) 1丢弃新数据 2丢弃新数据并通过音频异常回调报告5</param>
+        AUDIOVIDEOPROC_API void SetAudioOverflowPolicy(int ModuleNum, int Policy);
+        AUDIOVIDEOPROC_API int GetAudioOverflowPolicy(int ModuleNum);
+        /// <summary>
+        /// 获取音频缓冲区当前的积压
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="FifoIndex">0扬声器 1麦克风 2麦克风降噪后 3混音后</param>
+        /// <returns>毫秒，未录制时为0</returns>
+        AUDIOVIDEOPROC_API int GetAudioFifoFillMs(int ModuleNum, int FifoIndex);
+        /// <summary>
+        /// 获取本次录制中音频缓冲区出现过的最大积压
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="FifoIndex">0扬声器 1麦克风 2麦克风降噪后 3混音后</param>
+        /// <returns>毫秒</returns>
+        AUDIOVIDEOPROC_API int GetAudioFifoHighWaterMs(int ModuleNum, int FifoIndex);
+        /// <summary>
+        /// 获取音画偏差，即音频时间戳减去其采集时刻的滑动平均值，视频时间戳取自同一起点
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒，正数表示声音比画面晚</returns>
+        AUDIOVIDEOPROC_API int GetAvSyncOffsetUs(int ModuleNum);
+        /// <summary>
+        /// 获取本次录制中音画偏差绝对值的最大值
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <returns>微秒</returns>
+        AUDIOVIDEOPROC_API int GetAvSyncMaxOffsetUs(int ModuleNum);
+        /// <summary>
+        /// 获取估计的声卡时钟相对系统时钟的漂移，录制中按此微调重采样以保持音画同步
+        /// </summary>
+        /// <param name="ModuleNum">模块序号</param>
+        /// <param name="Source">0扬声器 1麦克风</param>
+        /// <returns>百万分之一，正数表示声卡比系统时钟快，开始录制约3秒后才有值</returns>
+        AUDIOVIDEOPROC_API int GetAudioDriftPpm(int ModuleNum, int Source);
+        /// <summary>
         /// 设置录制区域XYWH
         /// </summary>
         /// <param name="ModuleNum">模块序号</param>
@@ -486,7 +917,7 @@ extern "C" {
         /// <returns>X?Y?W?H?</returns>
         AUDIOVIDEOPROC_API const char* GetRecordXYWH(int ModuleNum);
         /// <summary>
-        /// 设置录制视频的固定宽高
+        /// 设置录制视频的固定宽高，同时输出其他尺寸见AddRecordRendition
         /// </summary>
         /// <param name="ModuleNum">模块序号</param>
         /// <param name="Width">视频宽</param>
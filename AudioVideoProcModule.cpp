@@ -1,9 +1,8 @@
 #include <opencv2/opencv.hpp>
 #include <cinttypes>
+#include <cstring>
 #include <unistd.h>
 #include <sys/types.h>
-#include <sys/wait.h>
-#include <signal.h>
 
 extern "C" {
 #include "libavcodec/avcodec.h"
@@ -29,6 +28,18 @@ extern "C" {
 #include "VideoCapManager.h"
 #include "Tool.h"
 #include "MediaFrameCapture.h"
+#include "MicCapture.h"
+#include "SampleRing.h"
+#include "VideoSource.h"
+#include "VideoFramePool.h"
+#include "FrameConverter.h"
+#include "OutputSink.h"
+#include "ReplayBuffer.h"
+#include "PipCompositor.h"
+#include "OverlayEngine.h"
+#include "FrameQueue.h"
+#include "BitrateController.h"
+#include "RenditionEncoder.h"
 #include "Log.h"
 #include "AudioVideoProc.h"
 #include "AudioVideoProcModule.h"
@@ -44,6 +55,18 @@ extern "C" {
 #define AUDIO_FRAME_SIZE (pCodecEncodeCtx_Audio ? pCodecEncodeCtx_Audio->frame_size : 1024)
 #define FINALE_WIDTH (resizeWidth==0?videoWidth:resizeWidth)
 #define FINALE_HEIGHT (resizeHeight==0?videoHeight:resizeHeight)
+// 默认混音滤波字符串，使用它时改由AudioMixer直接混音，权重与其中的weights一致
+#define DEFAULT_MIX_FILTER "[in0][in1]amix=inputs=2:duration=longest:dropout_transition=0:weights=0.5 2[out]"
+// 音频线程等待事件的超时，作为漏掉通知时的兜底
+#define AUDIO_WAIT_MS 100
+// 视频编码线程等待帧队列的超时
+#define VIDEO_ENCODE_WAIT_MS 100
+// 视频编码器
+#define VIDEO_ENCODER_NAME "libopenh264"
+// 自适应码率检查推流输出端拥塞情况的间隔
+#define ABR_CHECK_US 500000
+// 音频时间戳落后采集时刻超过这么多(缓冲区被清空或丢弃过数据)时直接向前对齐，更小的偏差由漂移补偿慢慢修正
+#define AV_SYNC_JUMP_US 200000
 
 using namespace std;
 using namespace cv;
@@ -68,6 +91,91 @@ static string av_err2str_cpp(int errnum) {
     return string(errbuf);
 }
 
+// 准备一个可写的音频帧：首次分配缓冲区，之后复用，只有下游仍持有引用时才重新分配
+static int prepare_audio_frame(AVFrame* Frame, const AVCodecContext* CodecCtx, int NbSamples) {
+    if (!Frame->buf[0] || Frame->nb_samples != NbSamples) {
+        av_frame_unref(Frame);
+        Frame->nb_samples = NbSamples;
+        Frame->channel_layout = CodecCtx->channel_layout;
+        Frame->format = CodecCtx->sample_fmt;
+        Frame->sample_rate = CodecCtx->sample_rate;
+        return av_frame_get_buffer(Frame, 0);
+    }
+    return av_frame_make_writable(Frame);
+}
+
+static long long steady_now_us() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void update_avg_us(atomic<int>& Avg, long long CostUs) {
+    int avg = Avg;
+    Avg = (avg == 0) ? (int)CostUs : avg + ((int)CostUs - avg) / 16;
+}
+
+// 固定码率(CBR)：码率、容差、上下限与VBV缓冲区都跟随目标码率
+static void set_video_bit_rate(AVCodecContext* CodecCtx, int64_t BitRate) {
+    CodecCtx->bit_rate           = BitRate;
+    CodecCtx->bit_rate_tolerance = (int)(BitRate / 2);
+    CodecCtx->rc_max_rate        = BitRate;
+    CodecCtx->rc_min_rate        = BitRate;
+    CodecCtx->rc_buffer_size     = (int)BitRate; // 与 maxrate 配对，消除 VBV 提示
+}
+
+// 按Src的编码参数分配一个未打开的视频编码器上下文，宽高与码率另行指定
+static AVCodecContext* alloc_video_encoder(const AVCodec* Codec, const AVCodecContext* Src, int Width, int Height, int64_t BitRate) {
+    AVCodecContext* ctx = avcodec_alloc_context3(Codec);
+    if (!ctx) {
+        return nullptr;
+    }
+    ctx->codec_id = Src->codec_id;
+    ctx->codec_type = Src->codec_type;
+    ctx->pix_fmt = Src->pix_fmt;
+    ctx->time_base = Src->time_base;
+    ctx->gop_size = Src->gop_size;
+    ctx->max_b_frames = Src->max_b_frames;
+    ctx->thread_count = Src->thread_count;
+    ctx->flags = Src->flags;
+    ctx->width = Width;
+    ctx->height = Height;
+    set_video_bit_rate(ctx, BitRate);
+    return ctx;
+}
+
+// 宽高比相差不超过1%视为相同，偶数对齐带来的误差不算变形
+static bool is_same_aspect(int W1, int H1, int W2, int H2) {
+    long long a = (long long)W1 * H2;
+    long long b = (long long)W2 * H1;
+    return llabs(a - b) * 100 <= max(a, b);
+}
+
+// 按编码器参数创建一个未打开的上下文副本，供不持有编码器的封装使用
+static AVCodecContext* copy_codec_context(const AVCodecContext* Src) {
+    AVCodecContext* ctx = avcodec_alloc_context3(nullptr);
+    AVCodecParameters* par = avcodec_parameters_alloc();
+    if (!ctx || !par
+        || avcodec_parameters_from_context(par, Src) < 0
+        || avcodec_parameters_to_context(ctx, par) < 0) {
+        avcodec_free_context(&ctx);
+        avcodec_parameters_free(&par);
+        return nullptr;
+    }
+    avcodec_parameters_free(&par);
+    ctx->time_base = Src->time_base;
+    return ctx;
+}
+
+// 编码器是否接受该像素格式，未声明格式列表的编码器按只接受YUV420P处理
+static bool is_codec_pix_fmt(const AVCodec* Codec, AVPixelFormat PixFmt) {
+    if (!Codec || !Codec->pix_fmts) {
+        return AV_PIX_FMT_YUV420P == PixFmt;
+    }
+    for (const AVPixelFormat* fmt = Codec->pix_fmts; AV_PIX_FMT_NONE != *fmt; fmt++) {
+        if (*fmt == PixFmt) return true;
+    }
+    return false;
+}
+
 // 假设g_IsDebug在其他地方定义（例如Log.h或Tool.h）
 extern bool g_IsDebug;
 
@@ -115,7 +223,7 @@ bool AudioVideoProcModule::Init() {
     privDataMap["preset"] = "superfast";
     privDataMap["tune"] = "zerolatency";
     nbSample = 48000;
-    mixFilterString = "[in0][in1]amix=inputs=2:duration=longest:dropout_transition=0:weights=0.5 2[out]";
+    mixFilterString = DEFAULT_MIX_FILTER;
     micFilterString = "[in]highpass=200,lowpass=3000,afftdn[out]";
     recordType = RecordType::Stop;
     isRecordVideo = true;
@@ -130,8 +238,11 @@ bool AudioVideoProcModule::Init() {
     isRtmp = false;
     secondaryScreenLocation = 0;//默认不录制次要屏幕
     isAcceptAppendFrame = true;
+    appendFramePolicy = 0;//默认落后时不编码重复帧
+    scaleFilter = static_cast<int>(FrameConverter::ScaleFilter::Bilinear);
     recordThread.reset(nullptr);
     recordThread_Video.reset(nullptr);
+    recordThread_VideoEncode.reset(nullptr);
     recordThread_CapInner.reset(nullptr);
     recordThread_Write.reset(nullptr);
     recordThread_CapMic.reset(nullptr);
@@ -156,11 +267,6 @@ bool AudioVideoProcModule::Init() {
     //创建临界区对象 (使用pthread_mutex替换)
     LOG_INFO("正在创建临界区对象");
     pthread_mutex_init(&csVideo, nullptr);
-    pthread_mutex_init(&csInner, nullptr);
-    pthread_mutex_init(&csMic, nullptr);
-    pthread_mutex_init(&csMicFilter, nullptr);
-    pthread_mutex_init(&csMix, nullptr);
-    pthread_mutex_init(&csWrite, nullptr);
 
 // --- 修改开始 ---
     // 初始化新的micMutex
@@ -231,11 +337,6 @@ void AudioVideoProcModule::UnInit() {
     // 销毁互斥量（确保此时没有线程再使用它们）
     LOG_INFO("尝试销毁临界区对象");
     pthread_mutex_destroy(&csVideo);
-    pthread_mutex_destroy(&csInner);
-    pthread_mutex_destroy(&csMic);
-    pthread_mutex_destroy(&csMicFilter);
-    pthread_mutex_destroy(&csMix);
-    pthread_mutex_destroy(&csWrite);
     // 你的新增 micMutex
     pthread_mutex_destroy(&micMutex_pthread);
 
@@ -266,6 +367,7 @@ bool AudioVideoProcModule::StartRecord(bool IsRtmp, int FrameRate, bool IsRecord
     }
     case RecordType::Pause: {
         recordType = RecordType::Record;
+        NotifyRecordState();
         LOG_INFO("继续录制");
         return true;
     }
@@ -287,6 +389,8 @@ bool AudioVideoProcModule::PauseRecord() {
     case RecordType::Record: {
         recordType = RecordType::Pause;
         isCanCap = 0; // 在暂停时重置就绪标志
+        syncClock.Pause();
+        NotifyRecordState();
         LOG_INFO("已发出暂停请求");
         return true;
     }
@@ -318,6 +422,7 @@ bool AudioVideoProcModule::StopRecord() {
 
     // 发出停止信号
     recordType = RecordType::Stop;
+    NotifyRecordState();
     LOG_INFO("已通知线程停止录制，等待响应中");
 
     // 将线程句柄移到本地，避免后续重复使用
@@ -508,6 +613,15 @@ void AudioVideoProcModule::SetRecordAttr(bool IsRtmp, int FrameRate, bool IsReco
 bool AudioVideoProcModule::IsRtmp()const { return isRtmp; }
 void AudioVideoProcModule::SetAcceptAppendFrame(bool IsAcceptAppendFrame) { isAcceptAppendFrame = IsAcceptAppendFrame; }
 bool AudioVideoProcModule::IsAcceptAppendFrame()const { return isAcceptAppendFrame; }
+void AudioVideoProcModule::SetAppendFramePolicy(int Policy) {
+    if (Policy < 0 || Policy > 1) {
+        LOG_WARN("无效的补帧方式:" + to_string(Policy));
+        return;
+    }
+    appendFramePolicy = Policy;
+    LOG_INFO(string("补帧方式设置为") + ((0 == appendFramePolicy) ? "跳过重复帧" : "编码重复帧"));
+}
+int AudioVideoProcModule::GetAppendFramePolicy()const { return appendFramePolicy; }
 bool AudioVideoProcModule::IsRecording()const { return isCanCap > 0 && recordType != RecordType::Stop; }
 int AudioVideoProcModule::GetRecordAttrFrameRate()const { return frameRate; }
 bool AudioVideoProcModule::GetRecordAttrRecordVideo() const { return isRecordVideo; }
@@ -530,22 +644,156 @@ void AudioVideoProcModule::SetNbSample(int NbSample) { if (NbSample > 0) nbSampl
 int AudioVideoProcModule::GetNbSample()const { return nbSample; }
 void AudioVideoProcModule::SetMixFilter(const string& MixFilterString) { mixFilterString = MixFilterString; }
 string AudioVideoProcModule::GetMixFilter() const { return mixFilterString; }
-void AudioVideoProcModule::SetMicFilter(const string& MicFilterString) { micFilterString = MicFilterString; }
-string AudioVideoProcModule::GetMicFilter() const { return micFilterString; }
 
-int AudioVideoProcModule::GetFrameAppendNum() {
-    if (frameAppendHistory.empty())
+void AudioVideoProcModule::SetMixWeights(float InnerWeight, float MicWeight) {
+    mixWeightInner = InnerWeight;
+    mixWeightMic = MicWeight;
+}
+
+int AudioVideoProcModule::GetMixCostUs() const {
+    // 换算成每混一秒音频所花的时间，录制开始时两者会被清零，各取一次再计算
+    long long samples = mixSamples;
+    long long costUs = mixCostUs;
+    int sampleRate = 0;
+    {
+        lock_guard<mutex> lock(audioRingMutex);
+        sampleRate = audioRingSampleRate;
+    }
+    if (samples <= 0 || sampleRate <= 0) {
         return 0;
-    int all = 0;
-    for (int num : frameAppendHistory) {
-        all += num;
     }
-    return static_cast<int>(all / frameAppendHistory.size());
+    return (int)(costUs * sampleRate / samples);
 }
+void AudioVideoProcModule::SetMicFilter(const string& MicFilterString) { micFilterString = MicFilterString; }
+string AudioVideoProcModule::GetMicFilter() const { return micFilterString; }
+
+int AudioVideoProcModule::GetFrameAppendNum() { return frameAppendAvg; }
+int AudioVideoProcModule::GetFrameSkipNum() { return frameSkipAvg; }
+
+int AudioVideoProcModule::GetDuplicateEncodeMs() const { return static_cast<int>(duplicateEncodeUs / 1000); }
 
 bool AudioVideoProcModule::GetInnerReadyOk() { return pFormatCtxIn_Inner != nullptr; }
-bool AudioVideoProcModule::GetMicReadyOk() { return pFormatCtxIn_Mic != nullptr; }
+bool AudioVideoProcModule::GetMicReadyOk() {
+    pthread_mutex_lock(&micMutex_pthread);
+    bool isOk = micCapture && micCapture->IsOpened();
+    pthread_mutex_unlock(&micMutex_pthread);
+    return isOk;
+}
 int AudioVideoProcModule::GetMicPattern() const { return micPattern; }
+int AudioVideoProcModule::GetMicOpenUs() const { return micOpenUs; }
+int AudioVideoProcModule::GetMicCloseUs() const { return micCloseUs; }
+int AudioVideoProcModule::GetAudioLatencyUs() const { return audioLatencyUs; }
+int AudioVideoProcModule::GetAudioMaxLatencyUs() const { return audioMaxLatencyUs; }
+
+void AudioVideoProcModule::SetAudioLatencyBudget(int BudgetMs)
+{
+    if (BudgetMs < 20) {
+        LOG_WARN("音频缓冲区容量过小:" + to_string(BudgetMs) + "ms");
+        return;
+    }
+    audioLatencyBudgetMs = BudgetMs;
+}
+
+int AudioVideoProcModule::GetAudioLatencyBudget() const { return audioLatencyBudgetMs; }
+
+void AudioVideoProcModule::SetAudioOverflowPolicy(int Policy)
+{
+    if (Policy < 0 || Policy > 2) {
+        LOG_ERROR("音频溢出策略应该在[0,2]之间，0丢弃新数据并在消费时丢弃积压 1丢弃新数据 2丢弃新数据并回调报告");
+        return;
+    }
+    audioOverflowPolicy = Policy;
+}
+
+int AudioVideoProcModule::GetAudioOverflowPolicy() const { return audioOverflowPolicy; }
+
+void AudioVideoProcModule::SetVideoFrameQueue(int Frames, int Policy)
+{
+    if (Frames < 1 || Frames > 30) {
+        LOG_ERROR("视频帧队列容量应该在[1,30]之间");
+        return;
+    }
+    if (Policy < 0 || Policy > 2) {
+        LOG_ERROR("视频帧队列策略应该在[0,2]之间，0丢弃最旧的帧 1丢弃新帧 2采集线程等待");
+        return;
+    }
+    videoQueueFrames = Frames;
+    videoQueuePolicy = Policy;
+}
+
+void AudioVideoProcModule::GetVideoFrameQueue(int& Frames, int& Policy) const
+{
+    Frames = videoQueueFrames;
+    Policy = videoQueuePolicy;
+}
+
+void AudioVideoProcModule::GetVideoStageLatency(int& CaptureUs, int& QueueUs, int& EncodeUs, int& TotalUs, int& DropNum) const
+{
+    CaptureUs = videoCaptureUs;
+    QueueUs = videoQueueUs;
+    EncodeUs = videoEncodeFrameUs;
+    TotalUs = videoLatencyUs;
+    DropNum = videoQueueDropNum;
+}
+
+void AudioVideoProcModule::SetAdaptiveBitRate(int MinBitRate, int MaxBitRate)
+{
+    if (0 == MaxBitRate) {
+        abrMinBitRate = 0;
+        abrMaxBitRate = 0;
+        return;
+    }
+    if (MinBitRate <= 0 || MaxBitRate < MinBitRate) {
+        LOG_ERROR("自适应码率范围无效:" + to_string(MinBitRate) + "-" + to_string(MaxBitRate));
+        return;
+    }
+    abrMinBitRate = MinBitRate;
+    abrMaxBitRate = MaxBitRate;
+}
+
+void AudioVideoProcModule::GetAdaptiveBitRate(int& MinBitRate, int& MaxBitRate, int& CurBitRate, int& FrameDivisor, int& DownNum, int& UpNum, int& SkipFrame) const
+{
+    MinBitRate = abrMinBitRate;
+    MaxBitRate = abrMaxBitRate;
+    CurBitRate = abrBitRate;
+    FrameDivisor = abrFrameDivisor;
+    DownNum = abrDownNum;
+    UpNum = abrUpNum;
+    SkipFrame = abrSkipFrame;
+}
+
+int AudioVideoProcModule::GetAudioFifoFillMs(int FifoIndex) const
+{
+    lock_guard<mutex> lock(audioRingMutex);
+    const SampleRing* ring = GetAudioRing(FifoIndex);
+    if (!ring || audioRingSampleRate <= 0) {
+        return 0;
+    }
+    return (int)((long long)ring->Size() * 1000 / audioRingSampleRate);
+}
+
+int AudioVideoProcModule::GetAudioFifoHighWaterMs(int FifoIndex) const
+{
+    lock_guard<mutex> lock(audioRingMutex);
+    const SampleRing* ring = GetAudioRing(FifoIndex);
+    if (!ring || audioRingSampleRate <= 0) {
+        return 0;
+    }
+    return (int)((long long)ring->GetHighWater() * 1000 / audioRingSampleRate);
+}
+
+int AudioVideoProcModule::GetAvSyncOffsetUs() const { return syncClock.GetOffsetUs(); }
+int AudioVideoProcModule::GetAvSyncMaxOffsetUs() const { return syncClock.GetMaxOffsetUs(); }
+int AudioVideoProcModule::GetAudioDriftPpm(int Source) const { return syncClock.GetDriftPpm(Source); }
+
+int AudioVideoProcModule::GetAudioIdleWakeups() const
+{
+    long long elapsedUs = steady_now_us() - audioStartUs;
+    if (0 == audioStartUs || elapsedUs <= 0) {
+        return 0;
+    }
+    return (int)(audioIdleWakeNum * 1000000ULL / elapsedUs);
+}
 
 bool AudioVideoProcModule::SetMicPattern(const int& MicPattern, const int& MicNum) {
     if (MicPattern < 0 || MicPattern > 2) {
@@ -603,6 +851,360 @@ void AudioVideoProcModule::SetMicRecorderCallBack(void(*dataCallBack)(unsigned c
     dataCallBackVar = dataCallBack;
 }
 
+int AudioVideoProcModule::GetDesktopGrabLatency() const
+{
+    shared_ptr<VideoSource> source = atomic_load(&videoSource);
+    if (!source)
+        return -1;
+    return source->GetAvgGrabUs();
+}
+
+void AudioVideoProcModule::SetDesktopDamage(bool IsDesktopDamage) { isDesktopDamage = IsDesktopDamage; }
+bool AudioVideoProcModule::IsDesktopDamage()const { return isDesktopDamage; }
+int AudioVideoProcModule::GetDamageSkipFrameNum()const { return static_cast<int>(damageSkipFrame); }
+int AudioVideoProcModule::GetDamagePartialFrameNum()const { return static_cast<int>(damagePartialFrame); }
+
+void AudioVideoProcModule::SetScaleFilter(int ScaleFilter)
+{
+    if (ScaleFilter < static_cast<int>(FrameConverter::ScaleFilter::Nearest) || ScaleFilter > static_cast<int>(FrameConverter::ScaleFilter::Box)) {
+        LOG_WARN("无效的缩放滤波方式:" + to_string(ScaleFilter));
+        return;
+    }
+    scaleFilter = ScaleFilter;
+}
+int AudioVideoProcModule::GetScaleFilter()const { return scaleFilter; }
+
+void AudioVideoProcModule::SetPixelFormatMode(int Mode)
+{
+    if (Mode < 0 || Mode > 2) {
+        LOG_WARN("无效的像素格式设置:" + to_string(Mode));
+        return;
+    }
+    pixelFormatMode = Mode;
+}
+int AudioVideoProcModule::GetPixelFormatMode()const { return pixelFormatMode; }
+int AudioVideoProcModule::GetVideoPixelFormat()const { return (AV_PIX_FMT_NV12 == videoPixFmt) ? 2 : 1; }
+
+bool AudioVideoProcModule::GetVideoConvertLatency(int& ConvertUs, int& SliceNum) const
+{
+    shared_ptr<VideoSource> source = atomic_load(&videoSource);
+    if (!source)
+        return false;
+    ConvertUs = source->GetAvgConvertUs();
+    SliceNum = source->GetConvertSliceNum();
+    return true;
+}
+
+int AudioVideoProcModule::GetVideoSourceShareNum() const
+{
+    shared_ptr<VideoSource> source = atomic_load(&videoSource);
+    if (!source)
+        return 0;
+    return VideoSourceManager::Default()->GetShareNum(source->GetKey());
+}
+
+void AudioVideoProcModule::AddRecordOutput(const string& Url)
+{
+    if (Url.empty()) {
+        LOG_WARN("附加输出地址为空");
+        return;
+    }
+    if (find(extraOutputUrls.begin(), extraOutputUrls.end(), Url) == extraOutputUrls.end()) {
+        extraOutputUrls.push_back(Url);
+    }
+    LOG_INFO("已添加附加输出:" + Url + "，当前共" + to_string(extraOutputUrls.size()) + "个");
+}
+
+void AudioVideoProcModule::ClearRecordOutput() { extraOutputUrls.clear(); }
+
+int AudioVideoProcModule::GetRecordOutputNum() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    int num = 0;
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        if (sink->IsOpened() && !sink->IsFailed()) num++;
+    }
+    return num;
+}
+
+bool AudioVideoProcModule::AddRecordRendition(int Width, int Height, int BitRate, const string& Url)
+{
+    if (Url.empty() || Width < 2 || Height < 2 || BitRate < 0) {
+        LOG_WARN("多码率输出参数无效 " + to_string(Width) + "x" + to_string(Height) + "，码率" + to_string(BitRate) + "，地址:" + Url);
+        return false;
+    }
+    RenditionConfig config{ Width - Width % 2, Height - Height % 2, BitRate, Url };
+    auto iter = find_if(renditionConfigs.begin(), renditionConfigs.end(), [&Url](const RenditionConfig& Item) { return Item.url == Url; });
+    if (iter != renditionConfigs.end()) {
+        *iter = config;
+    } else {
+        renditionConfigs.push_back(config);
+    }
+    LOG_INFO("已设置多码率输出:" + to_string(config.width) + "x" + to_string(config.height) + "，码率" + to_string(BitRate) + "，地址:" + Url
+        + "，当前共" + to_string(renditionConfigs.size()) + "档");
+    return true;
+}
+
+void AudioVideoProcModule::ClearRecordRendition() { renditionConfigs.clear(); }
+
+int AudioVideoProcModule::GetRecordRenditionNum() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    return (int)renditions.size();
+}
+
+bool AudioVideoProcModule::GetRenditionStats(int Index, int& Width, int& Height, int& BitRate, int& EncodeFrame, int& ScaleUs, int& EncodeUs, int& FrameDropNum, int& PacketDropNum) const
+{
+    lock_guard<mutex> lock(outputMutex);
+    if (Index < 0 || Index >= (int)renditions.size()) {
+        return false;
+    }
+    const RenditionEncoder& rendition = *renditions[Index];
+    Width = rendition.GetWidth();
+    Height = rendition.GetHeight();
+    BitRate = (int)rendition.GetBitRate();
+    EncodeFrame = (int)rendition.GetEncodeFrameNum();
+    ScaleUs = rendition.GetAvgScaleUs();
+    EncodeUs = rendition.GetAvgEncodeUs();
+    FrameDropNum = (int)rendition.GetDropNum();
+    PacketDropNum = (int)rendition.GetSink()->GetDropNum();
+    return true;
+}
+
+void AudioVideoProcModule::SetOutputQueueSize(int QueueSize)
+{
+    if (QueueSize <= 0) {
+        LOG_WARN("输出队列上限无效:" + to_string(QueueSize));
+        return;
+    }
+    outputQueueSize = QueueSize;
+}
+
+int AudioVideoProcModule::GetOutputQueueSize() const { return outputQueueSize; }
+
+int AudioVideoProcModule::GetOutputQueueDepth() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    int depth = 0;
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        depth = max(depth, sink->GetQueueDepth());
+    }
+    return depth;
+}
+
+int AudioVideoProcModule::GetOutputMaxQueueDepth() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    int depth = 0;
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        depth = max(depth, sink->GetMaxQueueDepth());
+    }
+    return depth;
+}
+
+int AudioVideoProcModule::GetOutputWriteUs() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    int writeUs = 0;
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        writeUs = max(writeUs, sink->GetAvgWriteUs());
+    }
+    return writeUs;
+}
+
+int AudioVideoProcModule::GetOutputDropNum() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    unsigned long long dropNum = 0;
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        dropNum += sink->GetDropNum();
+    }
+    return (int)dropNum;
+}
+
+void AudioVideoProcModule::SetSegmentRecord(int Seconds, int MaxMB)
+{
+    if (Seconds < 0 || MaxMB < 0) {
+        LOG_WARN("录制分段参数无效:" + to_string(Seconds) + "秒，" + to_string(MaxMB) + "MB");
+        return;
+    }
+    segmentSeconds = Seconds;
+    segmentMaxMB = MaxMB;
+}
+
+void AudioVideoProcModule::GetSegmentRecord(int& Seconds, int& MaxMB) const
+{
+    Seconds = segmentSeconds;
+    MaxMB = segmentMaxMB;
+}
+
+string AudioVideoProcModule::GetSegmentPlaylist() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        if (sink->IsSegment()) return sink->GetPlaylistUrl();
+    }
+    return "";
+}
+
+int AudioVideoProcModule::GetSegmentNum() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        if (sink->IsSegment()) return sink->GetSegmentNum();
+    }
+    return 0;
+}
+
+int AudioVideoProcModule::GetSegmentRotateUs() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        if (sink->IsSegment()) return sink->GetAvgRotateUs();
+    }
+    return 0;
+}
+
+int AudioVideoProcModule::GetOutputWriteAmplification() const
+{
+    lock_guard<mutex> lock(outputMutex);
+    int amplification = 0;
+    for (const unique_ptr<OutputSink>& sink : outputSinks) {
+        amplification = max(amplification, sink->GetWriteAmplification());
+    }
+    return amplification;
+}
+
+void AudioVideoProcModule::SetReplayBuffer(int Seconds, int MaxMB)
+{
+    if (Seconds < 0 || MaxMB <= 0) {
+        LOG_WARN("回放缓冲区参数无效:" + to_string(Seconds) + "秒，" + to_string(MaxMB) + "MB");
+        return;
+    }
+    replaySeconds = Seconds;
+    replayMaxMB = MaxMB;
+}
+
+int AudioVideoProcModule::GetReplaySeconds() const { return replaySeconds; }
+
+bool AudioVideoProcModule::SaveReplay(int Seconds, const string& Path)
+{
+    if (Path.empty()) {
+        LOG_WARN("回放保存路径为空");
+        return false;
+    }
+    auto begin = chrono::steady_clock::now();
+    vector<ReplayBuffer::Entry> packets;
+    int durationMs = 0;
+    AVCodecContext* videoCtx = nullptr;
+    AVCodecContext* audioCtx = nullptr;
+    bool isOk = false;
+    {
+        // 只在取包与复制编码器参数时持锁，封装写文件在锁外进行，不阻塞码率调整与停止录制
+        lock_guard<mutex> lock(replayMutex);
+        shared_ptr<ReplayBuffer> buffer = atomic_load(&replayBuffer);
+        if (!buffer || !pCodecEncodeCtx_Video) {
+            LOG_WARN("未在录制或未启用回放缓冲区，无法保存回放");
+            return false;
+        }
+        durationMs = buffer->Snapshot(Seconds, packets);
+        if (packets.empty()) {
+            LOG_WARN("回放缓冲区中还没有关键帧，无法保存回放");
+            return false;
+        }
+        videoCtx = copy_codec_context(pCodecEncodeCtx_Video);
+        audioCtx = pCodecEncodeCtx_Audio ? copy_codec_context(pCodecEncodeCtx_Audio) : nullptr;
+        isOk = videoCtx && (!pCodecEncodeCtx_Audio || audioCtx);
+    }
+    if (!isOk) {
+        LOG_ERROR("复制编码器参数失败，无法保存回放");
+    } else {
+        // 所有包一次性入队，队列上限放宽到包数，保证不会丢包
+        isOk = false;
+        OutputSink sink(Path, (int)packets.size() + 1);
+        if (sink.Open(videoCtx, audioCtx) >= 0) {
+            for (ReplayBuffer::Entry& entry : packets) {
+                sink.Push(entry.packet, entry.isVideo);
+            }
+            sink.Close();
+            isOk = !sink.IsFailed();
+        }
+    }
+    avcodec_free_context(&videoCtx);
+    avcodec_free_context(&audioCtx);
+    for (ReplayBuffer::Entry& entry : packets) {
+        av_packet_free(&entry.packet);
+    }
+    replaySaveUs = (int)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+    if (!isOk) {
+        LOG_ERROR("保存回放(" + Path + ")失败");
+        return false;
+    }
+    LOG_INFO("已保存回放(" + Path + ")，时长" + to_string(durationMs) + "ms，" + to_string(packets.size()) + "个包，耗时" + to_string(replaySaveUs) + "us");
+    return true;
+}
+
+int AudioVideoProcModule::GetReplayMemoryKB()
+{
+    shared_ptr<ReplayBuffer> buffer = atomic_load(&replayBuffer);
+    return buffer ? (int)(buffer->GetBytes() / 1024) : 0;
+}
+
+int AudioVideoProcModule::GetReplayDurationMs()
+{
+    shared_ptr<ReplayBuffer> buffer = atomic_load(&replayBuffer);
+    return buffer ? buffer->GetDurationMs() : 0;
+}
+
+int AudioVideoProcModule::GetReplaySaveUs() const { return replaySaveUs; }
+
+int AudioVideoProcModule::GetPipComposeUs() const { return pipComposeUs; }
+
+int AudioVideoProcModule::GetPipComposeMaxUs() const { return pipComposeMaxUs; }
+
+void AudioVideoProcModule::SetOverlayTimestamp(int Location, int FontHeight)
+{
+    lock_guard<mutex> lock(overlayMutex);
+    overlayTimestampLocation = (Location >= 1 && Location <= 4) ? Location : 0;
+    overlayTimestampHeight = max(0, FontHeight);
+    overlayVersion++;
+    LOG_INFO("时间戳叠加层位置(" + to_string(overlayTimestampLocation) + ") 字高(" + to_string(overlayTimestampHeight) + ")");
+}
+
+bool AudioVideoProcModule::SetOverlayWatermark(const string& Path, int Location, int Opacity, int WidthPercent)
+{
+    Mat watermark;
+    if (!Path.empty() && Location >= 1 && Location <= 4) {
+        // 在调用线程中读入图片，不占用视频线程的时间
+        watermark = imread(Path, IMREAD_UNCHANGED);
+        if (watermark.empty()) {
+            LOG_ERROR("水印图片读取失败:" + Path);
+            return false;
+        }
+    }
+    lock_guard<mutex> lock(overlayMutex);
+    overlayWatermark = watermark;
+    overlayWatermarkLocation = watermark.empty() ? 0 : Location;
+    overlayWatermarkOpacity = max(0, min(100, Opacity));
+    overlayWatermarkWidthPercent = max(1, min(100, WidthPercent));
+    overlayVersion++;
+    LOG_INFO("水印叠加层位置(" + to_string(overlayWatermarkLocation) + ") 不透明度(" + to_string(overlayWatermarkOpacity)
+        + ") 宽度百分比(" + to_string(overlayWatermarkWidthPercent) + ")");
+    return true;
+}
+
+void AudioVideoProcModule::SetOverlayCursor(bool IsShow)
+{
+    lock_guard<mutex> lock(overlayMutex);
+    isOverlayCursor = IsShow;
+    overlayVersion++;
+    LOG_INFO("鼠标指针叠加层(" + to_string(isOverlayCursor) + ")");
+}
+
+int AudioVideoProcModule::GetOverlayUs() const { return overlayRenderUs; }
+
+int AudioVideoProcModule::GetOverlayAreaPixels() const { return overlayAreaPixels; }
+
 // ...[The rest of the file follows]...
 //=========================================主要辅助函数=========================================//
 
@@ -743,174 +1345,50 @@ void AudioVideoProcModule::UnInitAudio() {
         avcodec_free_context(&pCodecDecodeCtx_Inner);
         pCodecDecodeCtx_Inner = nullptr;
     }
-    if (pFormatCtxIn_Inner) {
-        avformat_close_input(&pFormatCtxIn_Inner);
-        pFormatCtxIn_Inner = nullptr;
-    }
-    streamIndexIn_Inner = -1;
-}
-
-bool AudioVideoProcModule::InitAudioMic() {
-// --- 步骤 1: 加锁 ---
-    pthread_mutex_lock(&micMutex_pthread);
-
-    // 步骤 2: 清理旧资源 (将 UnInitAudioMic 的逻辑直接放在这里，避免死锁)
-    if (mic_arecord_pid > 0) {
-        kill(mic_arecord_pid, SIGTERM);
-        waitpid(mic_arecord_pid, NULL, 0); // 阻塞式等待确保进程退出
-        LOG_INFO("旧的 arecord 子进程 (PID: " + to_string(mic_arecord_pid) + ") 已被终止。");
-        mic_arecord_pid = -1;
-    }
-    if (pCodecDecodeCtx_Mic) {
-        avcodec_free_context(&pCodecDecodeCtx_Mic);
-        pCodecDecodeCtx_Mic = nullptr;
-    }
-    if (pFormatCtxIn_Mic) {
-        avformat_close_input(&pFormatCtxIn_Mic);
-        pFormatCtxIn_Mic = nullptr;
-    }
-    streamIndexIn_Mic = -1;
-    
-    // 步骤 3: 准备并执行 arecord 命令
-    const char* device = "hw:0,0"; // 你可以根据需要修改此默认设备
-    if (micPattern == 2) {
-        // (这部分逻辑可以后续添加，暂时使用默认)
-        LOG_INFO("InitAudioMic: 指定麦克风序号 " + to_string(micNum) + " (暂未实现，使用默认设备 " + device + ")");
-    }
-    
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "arecord -f S16_LE -r 48000 -c 2 -D %s", device);
-    LOG_INFO("InitAudioMic: 准备执行管道命令: " + string(cmd));
-
-    int pipefd[2];
-    if (pipe(pipefd) < 0) {
-        LOG_ERROR("InitAudioMic: 创建麦克风管道失败 (pipe error)。");
-        pthread_mutex_unlock(&micMutex_pthread); // 在返回前解锁
-        return false;
-    }
-
-    pid_t pid = fork();
-    if (pid < 0) { // fork 失败
-        LOG_ERROR("InitAudioMic: 创建arecord子进程失败 (fork error)。");
-        close(pipefd[0]);
-        close(pipefd[1]);
-        pthread_mutex_unlock(&micMutex_pthread); // 在返回前解锁
-        return false;
-    }
-
-    if (pid == 0) { // --- 子进程的代码 ---
-        close(pipefd[0]); 
-        dup2(pipefd[1], STDOUT_FILENO);
-        close(pipefd[1]); 
-        execl("/bin/sh", "sh", "-c", cmd, (char*)NULL);
-        exit(127);
-    }
-
-    // --- 父进程的代码 ---
-    mic_arecord_pid = pid;
-    close(pipefd[1]); 
-    
-    // --- 修改开始: 将 "fd:%d" 改为 "pipe:%d" ---
-    char input_pipe_url[64];
-    snprintf(input_pipe_url, sizeof(input_pipe_url), "pipe:%d", pipefd[0]);
-    LOG_INFO("InitAudioMic: 尝试使用管道URL: " + string(input_pipe_url));
-    // --- 修改结束 ---
-    
-    pFormatCtxIn_Mic = avformat_alloc_context();
-    if (!pFormatCtxIn_Mic) {
-        LOG_ERROR("InitAudioMic: avformat_alloc_context 失败。");
-        close(pipefd[0]);
-        // 调用 UnInitAudioMic 来清理子进程
-        pthread_mutex_unlock(&micMutex_pthread); // 解锁后才能调用
-        UnInitAudioMic();
-        return false;
-    }
-    
-    AVInputFormat* informat = av_find_input_format("s16le"); 
-    if (informat == nullptr) {
-        // 如果失败，打印明确的错误信息并退出
-        LOG_ERROR("InitAudioMic 失败: av_find_input_format 无法找到 's16le' demuxer。");
-        LOG_ERROR("这通常意味着链接的FFmpeg库版本不完整或已损坏。");
-        UnInitAudioMic();
-        return false;
-    }else{
-        LOG_ERROR("找到 's16le' demuxer。");
-
-}
-    AVDictionary* options = nullptr;
-    av_dict_set(&options, "ar", "48000", 0);
-    av_dict_set(&options, "ac", "2", 0);
-
-     // --- 修改开始: 使用新的URL ---
-    int ret = avformat_open_input(&pFormatCtxIn_Mic, input_pipe_url, informat, &options);
-
-    //close(pipefd[0]); 
-    if (options) {
-        av_dict_free(&options);
-    }
-
-    if (ret < 0) {
-        LOG_ERROR("从管道打开FFmpeg麦克风输入失败: " + av_err2str_cpp(ret));
-        close(pipefd[0]); // 如果 open 失败，我们需要手动关闭它
-        pthread_mutex_unlock(&micMutex_pthread); // 解锁后才能调用
-        UnInitAudioMic(); 
-        return false;
-    }
-    
-    // (后续逻辑保持不变)
-    ret = avformat_find_stream_info(pFormatCtxIn_Mic, nullptr);
-    if (ret < 0) {
-        LOG_ERROR("查找麦克风流信息失败: " + av_err2str_cpp(ret));
-        UnInitAudioMic();
-        return false;
-    }
-    streamIndexIn_Mic = find_audio_stream(pFormatCtxIn_Mic);
-    if (streamIndexIn_Mic < 0) {
-        LOG_ERROR("在麦克风上找不到音频流");
-        UnInitAudioMic();
-        return false;
+    if (pFormatCtxIn_Inner) {
+        avformat_close_input(&pFormatCtxIn_Inner);
+        pFormatCtxIn_Inner = nullptr;
     }
-    const AVCodec* decoder = avcodec_find_decoder(pFormatCtxIn_Mic->streams[streamIndexIn_Mic]->codecpar->codec_id);
-    pCodecDecodeCtx_Mic = avcodec_alloc_context3(decoder);
-    avcodec_parameters_to_context(pCodecDecodeCtx_Mic, pFormatCtxIn_Mic->streams[streamIndexIn_Mic]->codecpar);
-    ret = avcodec_open2(pCodecDecodeCtx_Mic, decoder, nullptr);
-    if (ret < 0) {
-        LOG_ERROR("打开麦克风解码器失败: " + av_err2str_cpp(ret));
-        UnInitAudioMic();
+    streamIndexIn_Inner = -1;
+}
+
+bool AudioVideoProcModule::InitAudioMic() {
+    // 同一设备不能同时打开两次，先等旧设备关闭
+    UnInitAudioMic();
+    shared_ptr<MicCapture> mic(new MicCapture(), [this](MicCapture* Mic) {
+        if (Mic->IsOpened()) {
+            Mic->Close();
+            micCloseUs = Mic->GetCloseUs();
+        }
+        delete Mic;
+        micClosedEvent.Notify();
+    });
+    bool isOk = mic->Open(micPattern, micNum);
+    micOpenUs = mic->GetOpenUs();
+    if (!isOk) {
+        LOG_ERROR("InitAudioMic: 打开麦克风失败，模式:" + to_string(micPattern) + "，序号:" + to_string(micNum));
         return false;
     }
-    
-    LOG_INFO("成功通过 arecord 管道初始化麦克风。");
-    pthread_mutex_unlock(&micMutex_pthread); // 在成功返回前解锁
+    LOG_INFO("InitAudioMic: 成功初始化麦克风(" + mic->GetDeviceName() + ")。");
+    pthread_mutex_lock(&micMutex_pthread);
+    micCapture = mic;
+    pthread_mutex_unlock(&micMutex_pthread);
     return true;
 }
 
 void AudioVideoProcModule::UnInitAudioMic() {
-    // 加锁
     pthread_mutex_lock(&micMutex_pthread);
-    
-    // 终止 arecord 子进程
-    if (mic_arecord_pid > 0) {
-        kill(mic_arecord_pid, SIGTERM);
-        int status;
-        waitpid(mic_arecord_pid, &status, 0); // 阻塞式等待
-        LOG_INFO("arecord 子进程 (PID: " + to_string(mic_arecord_pid) + ") 已被终止。");
-        mic_arecord_pid = -1;
-    }
-
-    // 释放FFmpeg资源
-    if (pCodecDecodeCtx_Mic) {
-        avcodec_free_context(&pCodecDecodeCtx_Mic);
-        pCodecDecodeCtx_Mic = nullptr;
+    shared_ptr<MicCapture> mic = move(micCapture);
+    pthread_mutex_unlock(&micMutex_pthread);
+    if (!mic) {
+        return;
     }
-    if (pFormatCtxIn_Mic) {
-        avformat_close_input(&pFormatCtxIn_Mic);
-        pFormatCtxIn_Mic = nullptr;
+    // 采集线程可能正持有引用读取，最多阻塞一个读取超时；设备在最后一个引用释放时由删除器关闭并通知
+    uint64_t seq = micClosedEvent.GetSeq();
+    mic.reset();
+    while (!micClosedEvent.Wait(seq, 1000)) {
+        LOG_WARN("UnInitAudioMic: 等待麦克风关闭超过1秒，继续等待");
     }
-    streamIndexIn_Mic = -1;
-    
-    // 解锁
-    pthread_mutex_unlock(&micMutex_pthread);
 }
 
 bool AudioVideoProcModule::StartThreadPre() {
@@ -978,6 +1456,23 @@ bool AudioVideoProcModule::StartThreadPre() {
         LOG_INFO("视频画面宽高已确定并固定为" + to_string(videoWidth) + "x" + to_string(videoHeight));
     }
 
+    // 提前订阅视频源，录制同一画面的模块共用一个源，桌面的MIT-SHM共享内存在整个录制期间复用
+    if (isRecordVideo) {
+        // 摄像头的原始格式要在设备打开后才能取得，先打开视频源再协商格式
+        LOG_INFO("StartThreadPre: 准备视频源...");
+        shared_ptr<VideoSource> source = UpdateVideoSource();
+        bool isSourceOpened = source->Open();
+        NegotiatePixelFormat();
+        // 视频源按像素格式区分，协商结果与订阅时不同则改订新的源
+        if (UpdateVideoSource() != source) {
+            source = atomic_load(&videoSource);
+            isSourceOpened = source->Open();
+        }
+        if (!isSourceOpened) {
+            LOG_WARN("StartThreadPre: 桌面采集器打开失败，将在视频线程中重试");
+        }
+    }
+
     // --- 关键修改: 将所有输入初始化提到最前面 ---
 
     // 步骤 1: 初始化所有需要的音频输入设备
@@ -1047,11 +1542,13 @@ bool AudioVideoProcModule::StartThreadPre() {
 
     LOG_INFO("尝试停止录制线程");
     recordType = RecordType::Stop;
+    NotifyRecordState();
     if (recordThread && recordThread->joinable()) {
         recordThread->join();
     }
     LOG_INFO("即将设置新的录制线程");
     recordType = RecordType::Record;
+    NotifyRecordState();
     recordThread.reset(new thread(&AudioVideoProcModule::RecordThreadRun, this));
     //recording_start_time = std::chrono::steady_clock::now(); // <-- 记录开始时间
     LOG_INFO("录制线程的预开启完成");
@@ -1067,6 +1564,7 @@ END_ERR:
     CloseOutPut(); // <-- 在 UnInitAudio 之前
     UnInitAudio();
     UnInitAudioMic();
+    atomic_store(&videoSource, shared_ptr<VideoSource>());
     LOG_ERROR("录制线程的预开启失败");
     return false;
 }
@@ -1075,8 +1573,48 @@ void AudioVideoProcModule::RecordThreadRun() {
     //准备记录总写入帧数
     allAudioFrame = 0;
     allVideoFrame = 0;
+    damageSkipFrame = 0;
+    damagePartialFrame = 0;
+    appendSkipFrame = 0;
+    appendEncodeFrame = 0;
+    videoEncodeUs = 0;
+    duplicateEncodeUs = 0;
+    videoCaptureUs = 0;
+    videoQueueUs = 0;
+    videoEncodeFrameUs = 0;
+    videoLatencyUs = 0;
+    videoQueueDropNum = 0;
+    abrBitRate = 0;
+    abrFrameDivisor = 1;
+    abrDownNum = 0;
+    abrUpNum = 0;
+    abrSkipFrame = 0;
+    frameAppendHistory.clear();
+    frameSkipHistory.clear();
+    frameAppendSum = 0;
+    frameSkipSum = 0;
+    frameAppendAvg = 0;
+    frameSkipAvg = 0;
+    pipComposeUs = 0;
+    pipComposeMaxUs = 0;
+    overlayRenderUs = 0;
+    overlayAreaPixels = 0;
+    innerCapUs = 0;
+    micCapUs = 0;
+    audioLatencyUs = 0;
+    audioMaxLatencyUs = 0;
+    audioIdleWakeNum = 0;
+    audioStartUs = steady_now_us();
+    last_video_pts = -1;
+    last_audio_pts = -1;
+    syncClock.Reset();
     LOG_INFO("录制线程就绪，正在展开子线程");
-    if(isRecordVideo) recordThread_Video.reset(new thread(&AudioVideoProcModule::RecordThreadRun_Video, this));
+    if(isRecordVideo) {
+        // 采集与编码之间的有界帧队列，编码耗时的尖峰不会推迟下一次采集
+        videoFrameQueue.reset(new FrameQueue(videoQueueFrames, static_cast<FrameQueue::FullPolicy>(videoQueuePolicy)));
+        recordThread_Video.reset(new thread(&AudioVideoProcModule::RecordThreadRun_Video, this));
+        recordThread_VideoEncode.reset(new thread(&AudioVideoProcModule::RecordThreadRun_VideoEncode, this));
+    }
     if(isRecordInner) recordThread_CapInner.reset(new thread(&AudioVideoProcModule::RecordThreadRun_CapInner, this));
     if(isRecordMic) {
         recordThread_CapMic.reset(new thread(&AudioVideoProcModule::RecordThreadRun_CapMic, this));
@@ -1090,14 +1628,20 @@ void AudioVideoProcModule::RecordThreadRun() {
     }
 
     LOG_INFO("录制线程展开子线程完毕");
-    while (recordType != RecordType::Stop) {
-        this_thread::sleep_for(chrono::milliseconds(100));
+    while (true) {
+        uint64_t stateSeq = recordStateEvent.GetSeq();
+        if (recordType == RecordType::Stop) break;
+        recordStateEvent.Wait(stateSeq, AUDIO_WAIT_MS);
     }
     LOG_INFO("录制线程收到停止信号，即将回收所有子线程资源");
     //回收资源
     if (recordThread_Video && recordThread_Video->joinable()) {
         recordThread_Video->join();
     }
+    // 采集线程退出时已关闭帧队列，编码线程编码完剩余的帧后退出
+    if (recordThread_VideoEncode && recordThread_VideoEncode->joinable()) {
+        recordThread_VideoEncode->join();
+    }
     if (recordThread_CapInner && recordThread_CapInner->joinable()) {//
         recordThread_CapInner->join();
     }
@@ -1115,6 +1659,23 @@ void AudioVideoProcModule::RecordThreadRun() {
     }
 
     recordThread_Video.reset();
+    recordThread_VideoEncode.reset();
+    if (videoFrameQueue) {
+        LOG_INFO("视频帧队列容量:" + to_string(videoFrameQueue->GetCapacity()) + "，最大排队帧数:" + to_string(videoFrameQueue->GetHighWater())
+            + "，队列满丢弃帧数:" + to_string(videoFrameQueue->GetDropNum()) + "，采集等待总时长(微秒):" + to_string(videoFrameQueue->GetBlockUs()));
+        LOG_INFO("视频各阶段平均耗时(微秒) 采集:" + to_string(videoCaptureUs) + " 排队:" + to_string(videoQueueUs)
+            + " 编码:" + to_string(videoEncodeFrameUs) + " 采集到写出:" + to_string(videoLatencyUs));
+        videoFrameQueue.reset();
+    }
+    if (abrBitRate > 0) {
+        LOG_INFO("自适应码率 最终码率:" + to_string(abrBitRate) + " 帧率1/" + to_string(abrFrameDivisor) + " 降级次数:" + to_string(abrDownNum)
+            + " 恢复次数:" + to_string(abrUpNum) + " 降帧率未编码帧数:" + to_string(abrSkipFrame));
+    }
+    for (const unique_ptr<RenditionEncoder>& rendition : renditions) {
+        LOG_INFO("多码率输出 " + to_string(rendition->GetWidth()) + "x" + to_string(rendition->GetHeight()) + " 编码帧数:" + to_string(rendition->GetEncodeFrameNum())
+            + " 平均缩放耗时(微秒):" + to_string(rendition->GetAvgScaleUs()) + " 平均编码耗时(微秒):" + to_string(rendition->GetAvgEncodeUs())
+            + " 队列满丢弃帧数:" + to_string(rendition->GetDropNum()) + " 输出: " + rendition->GetUrl());
+    }
     recordThread_CapInner.reset();
     recordThread_CapMic.reset();
     recordThread_FilterMic.reset();
@@ -1130,70 +1691,113 @@ void AudioVideoProcModule::RecordThreadRun() {
     CloseOutPut();
     UnInitAudio();
     UnInitAudioMic();
+    {
+        shared_ptr<VideoSource> source = atomic_load(&videoSource);
+        if (source && -1 == source->GetKey().cameraNum) {
+            LOG_INFO("桌面采集平均抓取耗时(微秒):" + to_string(source->GetAvgGrabUs()) + (source->IsShm() ? " (MIT-SHM)" : " (XGetImage)"));
+        }
+        //最后一个订阅者释放时视频源才真正关闭
+        atomic_store(&videoSource, shared_ptr<VideoSource>());
+    }
     LOG_INFO("录制线程成功退出");
     LOG_INFO("本次共录制视频帧:" + to_string(allVideoFrame));
+    if (damageSkipFrame || damagePartialFrame) {
+        LOG_INFO("本次桌面无变化跳过帧:" + to_string(damageSkipFrame) + "，局部更新帧:" + to_string(damagePartialFrame));
+    }
+    if (appendSkipFrame || appendEncodeFrame) {
+        long long encodeUs = videoEncodeUs;
+        LOG_INFO("本次补帧跳过编码的重复帧:" + to_string(appendSkipFrame) + "，编码的重复帧:" + to_string(appendEncodeFrame)
+            + "，重复帧编码耗时(毫秒):" + to_string(duplicateEncodeUs / 1000)
+            + "，占视频编码耗时的百分比:" + to_string(encodeUs > 0 ? duplicateEncodeUs * 100 / encodeUs : 0));
+    }
     LOG_INFO("本次共录制音频帧:" + to_string(allAudioFrame));
 }
 
 void AudioVideoProcModule::RecordThreadRun_Video() {
     LOG_INFO("录制子线程-视频就绪");
 
-    // X11 屏幕捕获相关变量
-    Display* display = nullptr;
-    Window root_window;
-    XImage* ximage = nullptr;
-
     const int videoFixWidth = FINALE_WIDTH;
     const int videoFixHeight = FINALE_HEIGHT;
     const long videoFixWH = videoFixWidth * videoFixHeight;
     const long videoFixWHOne = videoFixWH / 4;
 
-    // --- 修改：明确变量用途 ---
-    // colorMat 将作为送入libyuv前，统一格式(BGRA)的容器
+    // colorMat 为强制录制画面中截取的区域
     Mat colorMat;
-    // --- 修改结束 ---
     Mat secondaryColorMat;
     Mat blackMat = Mat::zeros(videoFixHeight, videoFixWidth, CV_8UC4);
 
-    // 使用智能指针确保内存在任何情况下都能被释放
-    unique_ptr<uchar[]> ybuffer(new uchar[videoFixWH]);
-    unique_ptr<uchar[]> ubuffer(new uchar[videoFixWHOne]);
-    unique_ptr<uchar[]> vbuffer(new uchar[videoFixWHOne]);
-    unique_ptr<uchar[]> frameBufferBlack(new uchar[videoFixWH * 3 / 2]);
-    unique_ptr<uchar[]> frameBufferColor(new uchar[videoFixWH * 3 / 2]);
-
-    AVPacket* pkt = av_packet_alloc();
-    AVFrame* yuvFrame = av_frame_alloc();
+    // 桌面与摄像头画面由共享视频源采集并转换，这里只为强制录制画面与黑帧保留自己的帧池
+    VideoFramePool framePool;
+    FrameConverter frameConverter;
+    AVFrame* colorFrame = nullptr;  //强制录制画面
+    AVFrame* blackFrame = nullptr;  //黑帧，只转换一次
+    AVFrame* sourceFrame = nullptr; //从视频源取得的帧引用
+    AVFrame* yuvFrame = nullptr;    //本次送入编码器的帧，指向上面三者之一或画中画合成结果
+    ULONGLONG sourceFrameNum = 0;   //取到的视频源新画面数
+    // 次要画面由合成器的线程取帧，合成结果由合成器持有
+    PipCompositor pipCompositor;
+    AVFrame* pipFrame = nullptr;
+    shared_ptr<VideoSource> pipMainSource;  //上一次合成时的主画面源，换源后主画面序号不可比较
+    VideoSource::Key pipKey;
+    bool isPipKeyOk = false;
+    int pipKeyCameraNum = -2, pipKeyWPercent = -1, pipKeyHPercent = -1;
+    // 送入编码线程的帧在队列中另持有一份引用，帧池与各合成器写入前都会换新的缓冲区
+    FrameQueue* frameQueue = videoFrameQueue.get();
+    // 叠加层在最终画面上混合，底图序号在底图内容变化时递增
+    OverlayEngine overlayEngine;
+    int overlayConfigVersion = -1;
+    uint64_t overlayBaseSeq = 0;
+    const uint8_t* overlayBaseData = nullptr;
 
     // --- 你的原始代码 ---
     bool isCapPreNot = true;
-    // --- 修改开始: 为视频线程创建自己的起始时间 ---
-    std::chrono::steady_clock::time_point video_start_time;
-    // --- 修改结束 ---
     auto dwBeginTime = chrono::steady_clock::now();
     //long long frameCount = 0;
     const chrono::milliseconds fps_duration((long long)(1000.0 / frameRate));
     int capErrNum = 0;//无异常
     bool isFixImgYuv = false;
-
-    if (IS_NULL(pkt) || IS_NULL(yuvFrame)) {
-        LOG_ERROR("分配pkt或yuvFrame内存失败");
+    // 上次取得的视频源画面序号，序号不变即桌面无变化
+    uint64_t lastSourceSeq = 0;
+    const chrono::microseconds sourceMaxAge = chrono::duration_cast<chrono::microseconds>(fps_duration) / 2;
+    // 桌面无变化时不再编码，但至少每隔这么久编码一帧，保证推流端能持续收到数据
+    const chrono::milliseconds damageKeepAlive(1000);
+    auto lastEncodeTime = chrono::steady_clock::now();
+
+    if (IS_NULL(frameQueue)) {
+        LOG_ERROR("视频帧队列未创建");
+        goto END;
+    }
+    if (!framePool.Init(videoPixFmt, videoFixWidth, videoFixHeight)) {
+        LOG_ERROR("分配YUV帧池失败");
         goto END;
     }
-    yuvFrame->format = AV_PIX_FMT_YUV420P;
-    yuvFrame->width = videoFixWidth;
-    yuvFrame->height = videoFixHeight;
-    if (av_frame_get_buffer(yuvFrame, 0) < 0) {
+    colorFrame = framePool.GetFrame();
+    blackFrame = framePool.GetFrame();
+    if (IS_NULL(colorFrame) || IS_NULL(blackFrame)) {
         LOG_ERROR("分配YUV帧的内存失败");
         goto END;
     }
+    if (!pipCompositor.Init(videoFixWidth, videoFixHeight, videoPixFmt)) {
+        LOG_WARN("画中画合成器初始化失败，本次录制不显示次要画面");
+    }
+    if (!overlayEngine.Init(videoFixWidth, videoFixHeight, videoPixFmt)) {
+        LOG_WARN("叠加层初始化失败，本次录制不叠加时间戳、水印与鼠标指针");
+    }
 
-    //转换黑屏帧
-    libyuv::ARGBToI420(blackMat.data, videoFixWidth * 4, ybuffer.get(), videoFixWidth, ubuffer.get(), (videoFixWidth + 1) / 2, vbuffer.get(), (videoFixWidth + 1) / 2, videoFixWidth, videoFixHeight);
-    //将上面的yuv数据保存到一个数组里面组成一帧yuv I420 数据 分辨率为w*h
-    memcpy(frameBufferBlack.get(), ybuffer.get(), videoFixWH);
-    memcpy(frameBufferBlack.get() + videoFixWH, ubuffer.get(), videoFixWHOne);
-    memcpy(frameBufferBlack.get() + videoFixWH + videoFixWHOne, vbuffer.get(), videoFixWHOne);
+    //转换黑屏帧，之后colorFrame未就绪或采集失败时都引用它
+    if (AV_PIX_FMT_NV12 == videoPixFmt) {
+        libyuv::ARGBToNV12(blackMat.data, videoFixWidth * 4,
+                           blackFrame->data[0], blackFrame->linesize[0],
+                           blackFrame->data[1], blackFrame->linesize[1],
+                           videoFixWidth, videoFixHeight);
+    } else {
+        libyuv::ARGBToI420(blackMat.data, videoFixWidth * 4,
+                           blackFrame->data[0], blackFrame->linesize[0],
+                           blackFrame->data[1], blackFrame->linesize[1],
+                           blackFrame->data[2], blackFrame->linesize[2],
+                           videoFixWidth, videoFixHeight);
+    }
+    yuvFrame = blackFrame;
 
     LOG_INFO("采集速率(每多少毫秒一帧):" + to_string(1000.0 / frameRate));
     LOG_INFO("videoWidth值为:" + to_string(videoWidth));
@@ -1203,6 +1807,7 @@ void AudioVideoProcModule::RecordThreadRun_Video() {
 
     while (recordType != RecordType::Stop) {
         while (recordType == RecordType::Record) {
+            frameConverter.SetScaleFilter(static_cast<FrameConverter::ScaleFilter>(scaleFilter));
             if (isCapPreNot) {
                 LOG_INFO("视频已就绪，等待其余准备完毕");
                 ++isCanCap;
@@ -1212,15 +1817,18 @@ void AudioVideoProcModule::RecordThreadRun_Video() {
                 //放在这里是为了初始化以及防止暂停后再启动的疯狂补帧
                 dwBeginTime = chrono::steady_clock::now() - fps_duration;
                 LOG_INFO("视频开始录制");
-                // --- 修改开始: 在真正开始录制时，记录视频的起始时间 ---
-                video_start_time = std::chrono::steady_clock::now();
-                // --- 修改结束 ---
+                // 视频与音频共用同一个起点，暂停的时长不计入
+                syncClock.Start();
                 isCapPreNot = false;
             }
 
             auto frameStartTime = chrono::steady_clock::now();
+            // 采集时刻在抓取前确定，与编码何时完成无关
+            long long grabUs = steady_now_us();
+            long long captureUs = syncClock.ToClockUs(grabUs);
             LOG_DEBUG("开始采集一帧视频");
             bool isBlackMatUsed = true;
+            bool isDesktopUnchanged = false;
 
             if (isRecordVideo) {
                 isFixImgYuv = false; // 你的mFixImgData逻辑目前未启用，保持此行为
@@ -1230,162 +1838,186 @@ void AudioVideoProcModule::RecordThreadRun_Video() {
                     if (mFixImgData) {
                         if (mFixImgMatChange) {
                             colorMat = mFixImgMat(Range(recordY, recordY + videoHeight), Range(recordX, recordX + videoWidth));
-                            if (colorMat.cols != videoFixWidth || colorMat.rows != videoFixHeight) {
-                                resize(colorMat, colorMat, Size(videoFixWidth, videoFixHeight));
+                            if (!framePool.MakeWritable(colorFrame, false)
+                                || !frameConverter.Convert(colorMat.data, colorMat.step, colorMat.cols, colorMat.rows, FrameConverter::PixelFormat::BGRA, colorFrame)) {
+                                LOG_ERROR("强制录制画面转换失败");
                             }
-                            libyuv::ARGBToI420(colorMat.data, videoFixWidth * 4, ybuffer.get(), videoFixWidth, ubuffer.get(), (videoFixWidth + 1) / 2, vbuffer.get(), (videoFixWidth + 1) / 2, videoFixWidth, videoFixHeight);
-                            memcpy(frameBufferColor.get(), ybuffer.get(), videoFixWH);
-                            memcpy(frameBufferColor.get() + videoFixWH, ubuffer.get(), videoFixWHOne);
-                            memcpy(frameBufferColor.get() + videoFixWH + videoFixWHOne, vbuffer.get(), videoFixWHOne);
-                            av_image_fill_arrays(yuvFrame->data, yuvFrame->linesize, frameBufferColor.get(), AV_PIX_FMT_YUV420P, videoFixWidth, videoFixHeight, 1);
                             mFixImgMatChange = false;
                         }
                         isFixImgYuv = true;
                         isBlackMatUsed = false;
+                        lastSourceSeq = 0;
                     }
                 }
 
                 if (false == isFixImgYuv) {
-                    //处理主要画面
-                    if (-1 == cameraNum) {
-                        //截屏获取 (X11)
-                        if (!display) {
-                            display = XOpenDisplay(NULL);
-                            if (display) root_window = DefaultRootWindow(display);
-                        }
-                        if (display) {
-                            ximage = XGetImage(display, root_window, recordX, recordY, videoWidth, videoHeight, AllPlanes, ZPixmap);
-                            if (ximage) {
-                                // XImage data is typically BGRA, which is compatible with CV_8UC4
-                                colorMat = Mat(videoHeight, videoWidth, CV_8UC4, ximage->data);
-                                if (colorMat.cols != videoFixWidth || colorMat.rows != videoFixHeight) {
-                                    resize(colorMat, colorMat, Size(videoFixWidth, videoFixHeight));
-                                }
-                                capErrNum = 0;
-                                isBlackMatUsed = false;
-                            }
-                        }
-                    } else { // Camera capture
-                        // --- 修改开始: 增加安全检查和统一数据格式 ---
-                        Mat cameraFrame; // 创建一个临时的Mat来接收摄像头的原始BGR数据
-                        if (VideoCapManager::Default()->GetMatFromCamera(cameraNum, videoWidth, videoHeight, cameraFrame)) {
-                            // 安全检查：确保从摄像头获取的帧不是空的
-                            if (!cameraFrame.empty()) {
-                                // 将摄像头的 BGR (3通道) 转换为 BGRA (4通道)
-                                cvtColor(cameraFrame, colorMat, COLOR_BGR2BGRA);
-                                
-                                // 现在 colorMat 是BGRA格式，可以继续处理
-                                if (colorMat.cols != videoFixWidth || colorMat.rows != videoFixHeight) {
-                                    resize(colorMat, colorMat, Size(videoFixWidth, videoFixHeight));
-                                }
-                                
-                                if (capErrNum == 1) VideoCapManager::Default()->OpenCamera(cameraNum);
-                                capErrNum = 0;
-                                isBlackMatUsed = false;
-                            } else {
-                                LOG_WARN("摄像头(" + to_string(cameraNum) + ") GetMatFromCamera返回true但Mat为空，使用黑帧。");
-                                // isBlackMatUsed 保持为 true
+                    //处理主要画面，同一桌面区域或摄像头由所有订阅的模块共享一次采集与转换
+                    shared_ptr<VideoSource> source = UpdateVideoSource();
+                    uint64_t sourceSeq = 0;
+                    bool isSourcePartial = false;
+                    AVFrame* newFrame = source->Acquire(sourceMaxAge, sourceSeq, isSourcePartial);
+                    if (newFrame) {
+                        if (sourceFrame) av_frame_free(&sourceFrame);
+                        sourceFrame = newFrame;
+                        if (sourceSeq == lastSourceSeq) {
+                            if (-1 == cameraNum) {
+                                // 录制区域无变化，沿用上一帧的YUV数据
+                                isDesktopUnchanged = true;
                             }
                         } else {
-                            if (0 == capErrNum) {
-                                LOG_WARN("摄像头获取Mat失败，即将释放摄像头");
-                                VideoCapManager::Default()->CloseCamera(cameraNum);
-                                capErrNum = 1;
-                                if (videoCapErr) videoCapErr(capErrNum);
+                            if (isSourcePartial) damagePartialFrame++;
+                            sourceFrameNum++;
+                        }
+                        lastSourceSeq = sourceSeq;
+                        if (-1 != cameraNum && capErrNum == 1) {
+                            VideoCapManager::Default()->OpenCamera(cameraNum);
+                            source->ResetCamera();
+                        }
+                        capErrNum = 0;
+                        isBlackMatUsed = false;
+                    } else if (-1 != cameraNum) {
+                        if (0 == capErrNum) {
+                            LOG_WARN("摄像头获取画面失败，即将释放摄像头");
+                            VideoCapManager::Default()->CloseCamera(cameraNum);
+                            capErrNum = 1;
+                            if (videoCapErr) videoCapErr(capErrNum);
+                        }
+                        // isBlackMatUsed 保持为 true
+                    }
+                    //如果次要画面位置不为0且主次画面不同，把次要画面合成到主画面的角落
+                    pipFrame = nullptr;
+                    int location = secondaryScreenLocation;
+                    if (location >= 1 && location <= 4 && secondaryCameraNum != cameraNum && !isBlackMatUsed) {
+                        if (pipKeyCameraNum != secondaryCameraNum || pipKeyWPercent != secondaryWPercent || pipKeyHPercent != secondaryHPercent) {
+                            pipKeyCameraNum = secondaryCameraNum;
+                            pipKeyWPercent = secondaryWPercent;
+                            pipKeyHPercent = secondaryHPercent;
+                            pipKey = VideoSource::Key();
+                            pipKey.cameraNum = secondaryCameraNum;
+                            isPipKeyOk = GetPipSourceSize(pipKey.width, pipKey.height, pipKey.outWidth, pipKey.outHeight);
+                        }
+                        if (isPipKeyOk) {
+                            pipKey.scaleFilter = scaleFilter;
+                            pipKey.isDamage = isDesktopDamage;
+                            pipKey.pixFmt = videoPixFmt;
+                            pipCompositor.SetSource(pipKey, frameRate);
+                            uint64_t mainSeq = (source == pipMainSource) ? lastSourceSeq : 0;
+                            pipMainSource = source;
+                            bool isPipChanged = true;
+                            pipFrame = pipCompositor.Compose(sourceFrame, mainSeq, static_cast<PipCompositor::Location>(location), isPipChanged);
+                            if (pipFrame && isPipChanged) {
+                                // 主画面无变化但次要画面变了，仍需编码
+                                isDesktopUnchanged = false;
                             }
-                            // isBlackMatUsed 保持为 true
+                            pipComposeUs = pipCompositor.GetAvgComposeUs();
+                            pipComposeMaxUs = pipCompositor.GetMaxComposeUs();
                         }
-                        // --- 修改结束 ---
+                    } else {
+                        pipCompositor.ClearSource();
+                        pipMainSource.reset();
                     }
-                    //如果次要画面位置不为0 (logic remains the same, assuming secondary capture works)
-                    // ... [secondary screen logic] ...
                 }
             }
 
-            //拷贝YUV数据到帧
             if (isBlackMatUsed) {
-                LOG_DEBUG("拷贝黑帧");
-                av_image_fill_arrays(yuvFrame->data, yuvFrame->linesize, frameBufferBlack.get(), AV_PIX_FMT_YUV420P, videoFixWidth, videoFixHeight, 1);
-            } else if (!isFixImgYuv) {
-                LOG_DEBUG("拷贝彩帧");
-                // --- 修改开始: 增加最终极的安全检查 ---
-                if (!colorMat.empty() && colorMat.isContinuous() && colorMat.channels() == 4) {
-                    // 根据你之前的测试，桌面录制正常，说明X11的BGRA数据与BGRAToI420是匹配的
-                    // 现在我们已经将摄像头数据也统一为了BGRA，所以这里应该可以正常工作
-                    libyuv::ARGBToI420(colorMat.data, colorMat.step, 
-                                       ybuffer.get(), videoFixWidth, 
-                                       ubuffer.get(), (videoFixWidth + 1) / 2, 
-                                       vbuffer.get(), (videoFixWidth + 1) / 2, 
-                                       videoFixWidth, videoFixHeight);
-
-                    memcpy(frameBufferColor.get(), ybuffer.get(), videoFixWH);
-                    memcpy(frameBufferColor.get() + videoFixWH, ubuffer.get(), videoFixWHOne);
-                    memcpy(frameBufferColor.get() + videoFixWH + videoFixWHOne, vbuffer.get(), videoFixWHOne);
-                    av_image_fill_arrays(yuvFrame->data, yuvFrame->linesize, frameBufferColor.get(), AV_PIX_FMT_YUV420P, videoFixWidth, videoFixHeight, 1);
+                LOG_DEBUG("使用黑帧");
+                yuvFrame = blackFrame;
+            } else if (isFixImgYuv) {
+                LOG_DEBUG("使用强制录制画面");
+                yuvFrame = colorFrame;
+            } else if (pipFrame) {
+                LOG_DEBUG(isDesktopUnchanged ? "画面无变化，沿用上一次的画中画合成结果" : "使用画中画合成结果");
+                yuvFrame = pipFrame;
+            } else {
+                LOG_DEBUG(isDesktopUnchanged ? "桌面无变化，沿用上一帧" : "使用视频源画面");
+                yuvFrame = sourceFrame;
+            }
+
+            //叠加时间戳、水印与鼠标指针，设置变化时才重新栅格化
+            if (overlayConfigVersion != overlayVersion) {
+                OverlayEngine::Config overlayConfig;
+                {
+                    lock_guard<mutex> lock(overlayMutex);
+                    overlayConfigVersion = overlayVersion;
+                    overlayConfig.timestampLocation = overlayTimestampLocation;
+                    overlayConfig.timestampHeight = overlayTimestampHeight;
+                    overlayConfig.watermark = overlayWatermark;
+                    overlayConfig.watermarkLocation = overlayWatermarkLocation;
+                    overlayConfig.watermarkOpacity = overlayWatermarkOpacity;
+                    overlayConfig.watermarkWidthPercent = overlayWatermarkWidthPercent;
+                    overlayConfig.isShowCursor = isOverlayCursor;
+                }
+                overlayEngine.Configure(overlayConfig);
+            }
+            if (overlayEngine.HasLayer()) {
+                if (-1 == cameraNum && !isBlackMatUsed && !isFixImgYuv) {
+                    overlayEngine.SetCursorArea(recordX, recordY, videoWidth, videoHeight);
                 } else {
-                    LOG_ERROR("colorMat 为空、内存不连续或通道数不为4，无法进行YUV转换！使用黑帧替代。");
-                    av_image_fill_arrays(yuvFrame->data, yuvFrame->linesize, frameBufferBlack.get(), AV_PIX_FMT_YUV420P, videoFixWidth, videoFixHeight, 1);
+                    overlayEngine.SetCursorArea(0, 0, 0, 0);
+                }
+                if (!isDesktopUnchanged || yuvFrame->data[0] != overlayBaseData) overlayBaseSeq++;
+                overlayBaseData = yuvFrame->data[0];
+                bool isOverlayChanged = true;
+                AVFrame* overlayFrame = overlayEngine.Render(yuvFrame, overlayBaseSeq, isOverlayChanged);
+                if (overlayFrame) {
+                    yuvFrame = overlayFrame;
+                    // 鼠标移动或时间变化时桌面虽无变化仍需编码
+                    if (isOverlayChanged) isDesktopUnchanged = false;
+                }
+                overlayRenderUs = overlayEngine.GetAvgRenderUs();
+                overlayAreaPixels = overlayEngine.GetAreaPixels();
+            }
+            if (isDesktopUnchanged) damageSkipFrame++;
+
+            if (isDesktopUnchanged && chrono::steady_clock::now() - lastEncodeTime < damageKeepAlive) {
+                // 画面未变化时跳过编码，只推进采集节拍，生成的视频为可变帧率
+                while (chrono::steady_clock::now() >= dwBeginTime) {
+                    dwBeginTime += fps_duration;
                 }
-                // --- 修改结束 ---
             }
-            if (ximage) { XDestroyImage(ximage); ximage = nullptr; }
 
             int handleNum = -1;
+            int skipNum = 0;
             while (chrono::steady_clock::now() >= dwBeginTime && recordType == RecordType::Record) {
                 if (handleNum >= 0 && !isAcceptAppendFrame) break;
                 
                 handleNum++;
                 dwBeginTime += fps_duration;
-                // --- 修改开始: 基于视频自己的起始时间来计算PTS ---
-                auto now = std::chrono::steady_clock::now();
-                auto elapsed_time = std::chrono::duration_cast<std::chrono::microseconds>(now - video_start_time).count();
-                int64_t current_pts = av_rescale_q(elapsed_time, {1, 1000000}, pCodecEncodeCtx_Video->time_base);
-
-                // --- 修改开始: 确保PTS严格递增 ---
-                if (current_pts <= last_video_pts) {
-                    // 如果当前计算出的PTS不比上一个大，就手动加1
-                    current_pts = last_video_pts + 1;
+                if (handleNum > 0 && 0 == appendFramePolicy) {
+                    // 落后时重复帧不再编码，只推进采集节拍；已编码的一帧时间戳为实际时刻，播放端会一直显示到下一帧
+                    skipNum++;
+                    continue;
                 }
-                yuvFrame->pts = current_pts;
-                last_video_pts = current_pts; // 更新上一个PTS
-                 // --- 修改结束 ---
-
-                int ret = avcodec_send_frame(pCodecEncodeCtx_Video, yuvFrame);
-                while (ret >= 0) {
-                    ret = avcodec_receive_packet(pCodecEncodeCtx_Video, pkt);
-                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
-                    else if (ret < 0) {
-                        // 添加错误日志
-                        LOG_WARN("avcodec_receive_packet 失败: " + av_err2str_cpp(ret));
-                        break;
-                    }
-                    
-                    av_packet_rescale_ts(pkt, pCodecEncodeCtx_Video->time_base, pStream_Video->time_base);
-                    // --- 视频流独立归一化 ---
-                    {
-                        std::lock_guard<std::mutex> lock(video_pts_mutex);
-                        if (video_first_dts == AV_NOPTS_VALUE) {
-                            video_first_dts = pkt->dts;
-                            LOG_INFO("视频流的第一个DTS被记录为: " + to_string(video_first_dts));
-                        }
-                    }
-                    pkt->pts -= video_first_dts;
-                    pkt->dts -= video_first_dts;
-                    // --- 修改结束 ---
-                    pkt->stream_index = streamIndex_Video;
-                    
-                    pthread_mutex_lock(&csWrite);
-                    LOG_DEBUG("正在写入一个视频包，pts: " + to_string(pkt->pts)); 
-                    av_interleaved_write_frame(pFormatCtxOut, pkt);
-                    pthread_mutex_unlock(&csWrite);
-                    allVideoFrame++;
-                    av_packet_unref(pkt);
+                // 送入编码线程，重复帧沿用同一采集时刻，由编码线程保证PTS严格递增
+                lastEncodeTime = chrono::steady_clock::now();
+                AVFrame* queueFrame = av_frame_clone(yuvFrame);
+                if (IS_NULL(queueFrame)) {
+                    LOG_WARN("视频帧引用失败，本帧不编码");
+                    continue;
                 }
+                if (0 == handleNum) {
+                    update_avg_us(videoCaptureUs, steady_now_us() - grabUs);
+                }
+                frameQueue->Push(queueFrame, captureUs, grabUs, handleNum > 0);
             }
             if (handleNum > 0) {
-                LOG_DEBUG("正常补帧:" + std::to_string(handleNum));
-                frameAppendHistory.push_back(handleNum);
-                if (frameAppendHistory.size() > 30) frameAppendHistory.pop_front();
+                LOG_DEBUG("正常补帧:" + std::to_string(handleNum - skipNum) + "，跳过重复帧:" + std::to_string(skipNum));
+                appendSkipFrame += skipNum;
+                // 历史只由本线程增删，平均值随之更新后发布给接口线程
+                frameAppendHistory.push_back(handleNum - skipNum);
+                frameAppendSum += handleNum - skipNum;
+                if (frameAppendHistory.size() > 30) {
+                    frameAppendSum -= frameAppendHistory.front();
+                    frameAppendHistory.pop_front();
+                }
+                frameSkipHistory.push_back(skipNum);
+                frameSkipSum += skipNum;
+                if (frameSkipHistory.size() > 30) {
+                    frameSkipSum -= frameSkipHistory.front();
+                    frameSkipHistory.pop_front();
+                }
+                frameAppendAvg = frameAppendSum / static_cast<int>(frameAppendHistory.size());
+                frameSkipAvg = frameSkipSum / static_cast<int>(frameSkipHistory.size());
             }
 
             auto sleep_for = dwBeginTime - chrono::steady_clock::now();
@@ -1399,12 +2031,235 @@ void AudioVideoProcModule::RecordThreadRun_Video() {
 
 END:
     LOG_INFO("录制子线程-视频即将停止并回收资源");
-    if (display) { XCloseDisplay(display); }
-    if (yuvFrame) av_frame_free(&yuvFrame);
-    if (pkt) av_packet_free(&pkt);
+    LOG_INFO("取得视频源新画面数:" + to_string(sourceFrameNum) + "，视频源订阅模块数:" + to_string(GetVideoSourceShareNum()));
+    if (pipCompositor.GetComposeNum() > 0) {
+        LOG_INFO("画中画合成帧数:" + to_string(pipCompositor.GetComposeNum()) + "，沿用帧数:" + to_string(pipCompositor.GetReuseNum())
+            + "，平均合成耗时(微秒):" + to_string(pipCompositor.GetAvgComposeUs()) + "，最大合成耗时(微秒):" + to_string(pipCompositor.GetMaxComposeUs())
+            + "，次要画面平均取帧耗时(微秒):" + to_string(pipCompositor.GetAvgAcquireUs()));
+    }
+    pipCompositor.UnInit();
+    pipMainSource.reset();
+    if (overlayEngine.GetRenderNum() > 0) {
+        LOG_INFO("叠加层混合帧数:" + to_string(overlayEngine.GetRenderNum()) + "，沿用帧数:" + to_string(overlayEngine.GetReuseNum())
+            + "，平均耗时(微秒):" + to_string(overlayEngine.GetAvgRenderUs()) + "，最大耗时(微秒):" + to_string(overlayEngine.GetMaxRenderUs())
+            + "，最近一帧混合像素数:" + to_string(overlayEngine.GetAreaPixels()));
+    }
+    overlayEngine.UnInit();
+    if (frameQueue) frameQueue->Close();
+    if (sourceFrame) av_frame_free(&sourceFrame);
+    if (colorFrame) av_frame_free(&colorFrame);
+    if (blackFrame) av_frame_free(&blackFrame);
+    framePool.UnInit();
     LOG_INFO("录制子线程-视频已退出");
 }
 
+void AudioVideoProcModule::RecordThreadRun_VideoEncode() {
+    LOG_INFO("录制子线程-视频编码就绪");
+    FrameQueue* frameQueue = videoFrameQueue.get();
+    AVPacket* pkt = av_packet_alloc();
+    FrameQueue::Item item;
+    // 自适应码率只依据推流输出端，没有推流输出时不启用
+    unique_ptr<BitrateController> bitrateController;
+    long long abrCheckUs = 0;
+    int64_t abrPendingBitRate = 0;      //等待应用到编码器的码率，0为无
+    unsigned long long abrFrameIndex = 0;
+
+    if (IS_NULL(pkt) || IS_NULL(frameQueue)) {
+        LOG_ERROR("分配视频编码pkt内存失败");
+        if (frameQueue) frameQueue->Close();
+        goto END;
+    }
+    // 各档多码率输出在自己的线程中缩放与编码，由主画面缩放的档位由本线程送帧
+    for (unique_ptr<RenditionEncoder>& rendition : renditions) {
+        rendition->Start();
+    }
+    if (abrMaxBitRate > 0) {
+        bool hasStream = false;
+        for (const unique_ptr<OutputSink>& sink : outputSinks) {
+            if (OutputSink::IsStream(sink->GetUrl())) hasStream = true;
+        }
+        if (hasStream) {
+            // 范围只读取一次，录制期间修改设置从下次开始录制时生效
+            bitrateController.reset(new BitrateController(abrMinBitRate.load(), abrMaxBitRate.load(), pCodecEncodeCtx_Video->bit_rate, outputQueueSize, frameRate));
+            abrBitRate = static_cast<int>(bitrateController->GetBitRate());
+            LOG_INFO("自适应码率已启用，范围" + to_string(bitrateController->GetMinBitRate()) + "-" + to_string(bitrateController->GetMaxBitRate())
+                + "，起始码率" + to_string(abrBitRate));
+        } else {
+            LOG_INFO("没有推流输出端，不启用自适应码率");
+        }
+    }
+
+    // 采集线程关闭队列后仍把已排队的帧编码完
+    while (!frameQueue->IsClosed() || frameQueue->Size() > 0) {
+        if (!frameQueue->Pop(item, VIDEO_ENCODE_WAIT_MS)) {
+            continue;
+        }
+        long long popUs = steady_now_us();
+        update_avg_us(videoQueueUs, popUs - item.pushUs);
+        videoQueueDropNum = static_cast<int>(frameQueue->GetDropNum());
+        // 在降帧率判断之前送出，自适应码率只调整主输出
+        for (RenditionEncoder* rendition : renditionRoots) {
+            AVFrame* renditionFrame = av_frame_clone(item.frame);
+            if (renditionFrame) rendition->Push(renditionFrame, item.captureUs, item.grabUs);
+        }
+
+        if (bitrateController && popUs - abrCheckUs >= ABR_CHECK_US) {
+            abrCheckUs = popUs;
+            // 多个推流输出端时按最拥塞的一个
+            BitrateController::Metrics metrics;
+            for (const unique_ptr<OutputSink>& sink : outputSinks) {
+                if (!OutputSink::IsStream(sink->GetUrl())) continue;
+                metrics.queueDepth = max(metrics.queueDepth, sink->GetQueueDepth());
+                metrics.avgWriteUs = max(metrics.avgWriteUs, sink->GetAvgWriteUs());
+                metrics.dropNum += sink->GetDropNum();
+            }
+            BitrateController::Decision decision = bitrateController->Update(metrics, popUs);
+            if (BitrateController::Decision::Keep != decision) {
+                if (BitrateController::Decision::BitRateDown == decision || BitrateController::Decision::BitRateUp == decision) {
+                    abrPendingBitRate = bitrateController->GetBitRate();
+                }
+                if (BitrateController::Decision::BitRateDown == decision || BitrateController::Decision::FrameRateDown == decision) {
+                    abrDownNum++;
+                } else {
+                    abrUpNum++;
+                }
+                abrBitRate = static_cast<int>(bitrateController->GetBitRate());
+                abrFrameDivisor = bitrateController->GetFrameDivisor();
+                LOG_INFO(string("自适应码率:") + BitrateController::DecisionName(decision) + "，码率" + to_string(abrBitRate)
+                    + "，帧率1/" + to_string(abrFrameDivisor) + "，" + bitrateController->GetReason());
+            }
+        }
+        if (abrPendingBitRate > 0) {
+            ReopenResult result = ReopenVideoEncoder(abrPendingBitRate);
+            if (ReopenResult::Kept == result) {
+                // 控制器与统计退回编码器实际使用的码率
+                bitrateController->SetBitRate(pCodecEncodeCtx_Video->bit_rate);
+                abrBitRate = static_cast<int>(bitrateController->GetBitRate());
+                LOG_WARN("自适应码率调整未生效，码率退回" + to_string(abrBitRate));
+            }
+            if (ReopenResult::Busy != result) {
+                abrPendingBitRate = 0;
+            }
+        }
+        if (abrFrameDivisor > 1 && 0 != (abrFrameIndex++ % abrFrameDivisor)) {
+            // 降帧率时不编码这一帧，上一帧的时间戳为实际时刻，播放端会一直显示到下一帧
+            av_frame_free(&item.frame);
+            abrSkipFrame++;
+            continue;
+        }
+
+        // PTS取采集时刻，确保严格递增
+        int64_t current_pts = av_rescale_q(item.captureUs, {1, 1000000}, pCodecEncodeCtx_Video->time_base);
+        if (current_pts <= last_video_pts) {
+            // 如果当前计算出的PTS不比上一个大，就手动加1
+            current_pts = last_video_pts + 1;
+        }
+        item.frame->pts = current_pts;
+        last_video_pts = current_pts;
+
+        int ret = avcodec_send_frame(pCodecEncodeCtx_Video, item.frame);
+        av_frame_free(&item.frame);
+        while (ret >= 0) {
+            ret = avcodec_receive_packet(pCodecEncodeCtx_Video, pkt);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
+            else if (ret < 0) {
+                LOG_WARN("avcodec_receive_packet 失败: " + av_err2str_cpp(ret));
+                break;
+            }
+            // 时间戳保持以公共起点为零点，B帧导致的负DTS由各输出端整体平移
+            LOG_DEBUG("正在写入一个视频包，pts: " + to_string(pkt->pts));
+            WritePacket(pkt, true);
+            allVideoFrame++;
+            av_packet_unref(pkt);
+        }
+        // 编码耗时，重复帧的部分单独累计
+        long long nowUs = steady_now_us();
+        long long encodeCost = nowUs - popUs;
+        videoEncodeUs += encodeCost;
+        update_avg_us(videoEncodeFrameUs, encodeCost);
+        update_avg_us(videoLatencyUs, nowUs - item.grabUs);
+        if (item.isDuplicate) {
+            duplicateEncodeUs += encodeCost;
+            appendEncodeFrame++;
+        }
+    }
+
+END:
+    // 从大到小依次结束，源档编码完剩余的帧后由它缩放的档位才关闭队列
+    for (unique_ptr<RenditionEncoder>& rendition : renditions) {
+        rendition->Finish();
+    }
+    if (frameQueue) frameQueue->Clear();
+    if (pkt) av_packet_free(&pkt);
+    LOG_INFO("录制子线程-视频编码已退出");
+}
+
+bool AudioVideoProcModule::GetPipSourceSize(int& Width, int& Height, int& OutWidth, int& OutHeight) {
+    // 次要画面由视频源直接缩放到画中画尺寸，I420需偶数宽高
+    int wPercent = max(1, min(100, (int)secondaryWPercent));
+    int hPercent = max(1, min(100, (int)secondaryHPercent));
+    OutWidth = (FINALE_WIDTH * wPercent / 100) & ~1;
+    OutHeight = (FINALE_HEIGHT * hPercent / 100) & ~1;
+    if (OutWidth < 2 || OutHeight < 2) {
+        LOG_WARN("画中画尺寸过小，不显示次要画面");
+        return false;
+    }
+    if (-1 == secondaryCameraNum) {
+        // 次要画面为整个桌面
+        Width = screenW & ~1;
+        Height = screenH & ~1;
+    } else if (!VideoCapManager::Default()->GetCameraWH(secondaryCameraNum, Width, Height)) {
+        LOG_WARN("次要摄像头(" + to_string(secondaryCameraNum) + ")宽高获取失败，不显示次要画面");
+        return false;
+    }
+    return Width > 0 && Height > 0;
+}
+
+void AudioVideoProcModule::NegotiatePixelFormat() {
+    const AVCodec* codec = avcodec_find_encoder_by_name(VIDEO_ENCODER_NAME);
+    const bool isEncodeI420 = is_codec_pix_fmt(codec, AV_PIX_FMT_YUV420P);
+    const bool isEncodeNV12 = is_codec_pix_fmt(codec, AV_PIX_FMT_NV12);
+    int mode = pixelFormatMode;
+    if ((1 == mode && !isEncodeI420) || (2 == mode && !isEncodeNV12)) {
+        LOG_WARN(string("编码器") + VIDEO_ENCODER_NAME + "不支持指定的像素格式，改为自动协商");
+        mode = 0;
+    }
+    if (0 == mode) {
+        // 摄像头原始数据为NV12时全程NV12可以省去平面与半平面之间的转换，桌面BGRA转换为哪种格式耗时相同
+        MediaFrameCapture::RawFormat rawFormat;
+        bool isCameraRaw = (-1 != cameraNum) && VideoCapManager::Default()->GetCameraRawFormat(cameraNum, rawFormat);
+        if (-1 != cameraNum && !isCameraRaw) {
+            LOG_INFO("摄像头(" + to_string(cameraNum) + ")未以V4L2直连模式打开，按桌面方式协商像素格式");
+        }
+        bool isCameraNV12 = isCameraRaw && MediaFrameCapture::RawFormat::NV12 == rawFormat;
+        mode = (isEncodeNV12 && (isCameraNV12 || !isEncodeI420)) ? 2 : 1;
+    }
+    videoPixFmt = (2 == mode) ? AV_PIX_FMT_NV12 : AV_PIX_FMT_YUV420P;
+    LOG_INFO(string("视频像素格式:") + ((2 == mode) ? "NV12" : "I420") + "，设置:" + to_string(pixelFormatMode)
+        + "，编码器支持I420:" + to_string(isEncodeI420) + " NV12:" + to_string(isEncodeNV12));
+}
+
+shared_ptr<VideoSource> AudioVideoProcModule::UpdateVideoSource() {
+    VideoSource::Key key;
+    key.cameraNum = cameraNum;
+    key.x = (-1 == cameraNum) ? recordX : 0;
+    key.y = (-1 == cameraNum) ? recordY : 0;
+    key.width = videoWidth;
+    key.height = videoHeight;
+    key.outWidth = FINALE_WIDTH;
+    key.outHeight = FINALE_HEIGHT;
+    key.scaleFilter = scaleFilter;
+    key.isDamage = isDesktopDamage;
+    key.pixFmt = videoPixFmt;
+    shared_ptr<VideoSource> source = atomic_load(&videoSource);
+    //录制中切换摄像头或缩放方式时改为订阅新的源
+    if (!source || source->GetKey() != key) {
+        source = VideoSourceManager::Default()->Acquire(key);
+        atomic_store(&videoSource, source);
+    }
+    return source;
+}
+
 // ... (The rest of the file follows) ...
 void AudioVideoProcModule::RecordThreadRun_CapInner() {
     LOG_INFO("录制子线程-扬声器采集就绪");
@@ -1422,6 +2277,7 @@ void AudioVideoProcModule::RecordThreadRun_CapInner() {
     }
 
     while (recordType != RecordType::Stop) {
+        uint64_t stateSeq = recordStateEvent.GetSeq();
         while (recordType == RecordType::Record && isRecordInner) {
             //采集前设备检查
             if (!pFormatCtxIn_Inner) {
@@ -1436,8 +2292,8 @@ void AudioVideoProcModule::RecordThreadRun_CapInner() {
             }
 
             if (isCapPreNot) {
-                if (av_audio_fifo_size(pAudioFifo_Inner) > 0) {
-                    av_audio_fifo_drain(pAudioFifo_Inner, av_audio_fifo_size(pAudioFifo_Inner));
+                if (audioRing_Inner->Size() > 0) {
+                    audioRing_Inner->RequestClear();
                     LOG_INFO("由于未录制，扬声器队列缓存已清空");
                 }
                 LOG_INFO("音频已就绪，等待其余准备完毕");
@@ -1446,6 +2302,8 @@ void AudioVideoProcModule::RecordThreadRun_CapInner() {
                     this_thread::sleep_for(chrono::milliseconds(1));
                 }
                 LOG_INFO("音频开始录制");
+                syncClock.Start();
+                syncClock.ResetSource(0);
                 isCapPreNot = false;
             }
 
@@ -1471,9 +2329,14 @@ void AudioVideoProcModule::RecordThreadRun_CapInner() {
 				 }
 				 // --- 修改结束 ---
                                 
-                                pthread_mutex_lock(&csInner);
-                                av_audio_fifo_write(pAudioFifo_Inner, (void**)resampled_frame->data, resampled_frame->nb_samples);
-                                pthread_mutex_unlock(&csInner);
+                                int fifoSize = WriteAudioRing(*audioRing_Inner, resampled_frame);
+                                innerCapUs = steady_now_us();
+                                if (fifoSize >= AUDIO_FRAME_SIZE) mixEvent.Notify();
+                                // 按声卡相对系统时钟的漂移微调重采样，使样本数跟上公共时钟
+                                int sampleDelta = 0, distance = 0;
+                                if (syncClock.UpdateSource(0, innerCapUs, resampled_frame->nb_samples, nbSample, sampleDelta, distance)) {
+                                    swr_set_compensation(pSwrCtx_Inner, sampleDelta, distance);
+                                }
                             }
                         }
                         frame_loop_end: // 标签
@@ -1488,7 +2351,7 @@ void AudioVideoProcModule::RecordThreadRun_CapInner() {
             }
         }
         isCapPreNot = true;
-        this_thread::sleep_for(chrono::milliseconds(100));
+        recordStateEvent.Wait(stateSeq, AUDIO_WAIT_MS);
     }
 END:
     LOG_INFO("录制子线程-扬声器采集即将停止并回收资源");
@@ -1501,24 +2364,25 @@ END:
 void AudioVideoProcModule::RecordThreadRun_CapMic() {
     LOG_INFO("录制子线程-麦克风采集就绪");
     
-    AVPacket* packet = av_packet_alloc();
     AVFrame* resampled_frame = av_frame_alloc();
     SwrContext* pSwrCtx_Mic_local = nullptr; 
+    vector<uint8_t> periodBuf;
+    int frameCapacity = 0;
 
     bool isCapPreNot = true;
 
-    if (!packet || !resampled_frame) {
-        LOG_ERROR("麦克风采集线程无法分配packet或frame内存，即将退出。");
+    if (!resampled_frame) {
+        LOG_ERROR("麦克风采集线程无法分配frame内存，即将退出。");
         goto END;
     }
     
     // --- 关键修改: 在线程启动时，只初始化一次 SwrContext ---
     // 我们不再需要动态重建，因为我们现在100%控制了输入参数
     {
-        // 输入参数 (来自我们启动的 arecord 命令)
+        // 输入参数 (MicCapture固定输出的格式)
         int64_t in_ch_layout = AV_CH_LAYOUT_STEREO;
         AVSampleFormat in_sample_fmt = AV_SAMPLE_FMT_S16;
-        int in_sample_rate = 48000;
+        int in_sample_rate = MicCapture::SAMPLE_RATE;
 
         // 输出参数 (送往AAC编码器)
         int64_t out_ch_layout = pCodecEncodeCtx_Audio->channel_layout;
@@ -1529,6 +2393,8 @@ void AudioVideoProcModule::RecordThreadRun_CapMic() {
             out_ch_layout, out_sample_fmt, out_sample_rate,
             in_ch_layout, in_sample_fmt, in_sample_rate,
             0, NULL);
+        // 采样率相同时也启用重采样，漂移补偿需要它
+        if (pSwrCtx_Mic_local) av_opt_set_int(pSwrCtx_Mic_local, "flags", SWR_FLAG_RESAMPLE, 0);
 
         if (!pSwrCtx_Mic_local || swr_init(pSwrCtx_Mic_local) < 0) {
             LOG_ERROR("RecordThreadRun_CapMic: 无法初始化麦克风重采样上下文！线程退出。");
@@ -1547,61 +2413,77 @@ void AudioVideoProcModule::RecordThreadRun_CapMic() {
                 this_thread::sleep_for(chrono::milliseconds(1));
             }
             LOG_INFO("麦克风开始录制");
+            syncClock.Start();
+            syncClock.ResetSource(1);
             isCapPreNot = false;
         }
 
-        // 直接从管道读取原始PCM数据包
-        int ret = av_read_frame(pFormatCtxIn_Mic, packet);
-        if (ret < 0) {
-            LOG_WARN("av_read_frame from mic pipe failed or stream ended. Exiting thread.");
+        // 只在取设备时持锁，读取在锁外进行，切换麦克风时不必等待读取超时
+        pthread_mutex_lock(&micMutex_pthread);
+        shared_ptr<MicCapture> mic = micCapture;
+        pthread_mutex_unlock(&micMutex_pthread);
+        if (!mic) {
+            // 正在切换麦克风
+            this_thread::sleep_for(chrono::milliseconds(MicCapture::PERIOD_MS));
+            continue;
+        }
+        // 直接从设备读取一个周期的原始PCM数据
+        int periodFrames = mic->GetPeriodFrames();
+        periodBuf.resize(periodFrames * MicCapture::CHANNELS * sizeof(int16_t));
+        int nb_samples_in = mic->Read(periodBuf.data());
+        mic.reset();
+        if (nb_samples_in < 0) {
+            LOG_WARN("麦克风读取失败，采集线程退出。");
             break;
         }
+        if (0 == nb_samples_in) {
+            continue;
+        }
 
-        if (packet->stream_index == streamIndexIn_Mic) {
-            // --- 关键修改: 绕过解码器，直接重采样 packet->data ---
-            
-            // 计算输入packet中有多少个样本
-            // 每个样本 = 2声道 * 16位(2字节) = 4字节
-            const int bytes_per_sample = 4;
-            const int nb_samples_in_packet = packet->size / bytes_per_sample;
-
-            // 准备输出帧
-            resampled_frame->nb_samples = av_rescale_rnd(swr_get_delay(pSwrCtx_Mic_local, 48000) + nb_samples_in_packet, 48000, 48000, AV_ROUND_UP);
-            resampled_frame->sample_rate = pCodecEncodeCtx_Audio->sample_rate;
-            resampled_frame->channel_layout = pCodecEncodeCtx_Audio->channel_layout;
-            resampled_frame->format = pCodecEncodeCtx_Audio->sample_fmt;
-            av_frame_get_buffer(resampled_frame, 0);
-
-            // 直接将 packet->data 指针传递给 swr_convert
-            const uint8_t* in_data[AV_NUM_DATA_POINTERS] = { packet->data };
-            
-            ret = swr_convert(pSwrCtx_Mic_local, 
-                              resampled_frame->data, resampled_frame->nb_samples,
-                              in_data, nb_samples_in_packet);
+        // 准备输出帧：按出现过的最大输出样本数分配，之后复用同一块缓冲区
+        {
+            int outSamples = swr_get_out_samples(pSwrCtx_Mic_local, nb_samples_in);
+            if (outSamples < 0) {
+                LOG_WARN("swr_get_out_samples in CapMic failed: " + av_err2str_cpp(outSamples));
+                continue; // 跳过这一周期
+            }
+            if (outSamples > frameCapacity) frameCapacity = outSamples;
+            int ret = prepare_audio_frame(resampled_frame, pCodecEncodeCtx_Audio, frameCapacity);
+            if (ret < 0) {
+                LOG_WARN("麦克风输出帧分配失败: " + av_err2str_cpp(ret));
+                continue; // 跳过这一周期
+            }
+        }
 
+        {
+            const uint8_t* in_data[AV_NUM_DATA_POINTERS] = { periodBuf.data() };
+            int ret = swr_convert(pSwrCtx_Mic_local,
+                                  resampled_frame->data, resampled_frame->nb_samples,
+                                  in_data, nb_samples_in);
             if (ret < 0) {
                 LOG_ERROR("swr_convert in CapMic failed: " + av_err2str_cpp(ret));
-                av_packet_unref(packet);
-                continue; // 跳过这一帧
+                continue; // 跳过这一周期
             }
-
             // ret 是输出的样本数
             resampled_frame->nb_samples = ret;
+        }
 
-            // 将重采样后的数据写入FIFO
-            pthread_mutex_lock(&csMic);
-            av_audio_fifo_write(pAudioFifo_Mic, (void**)resampled_frame->data, resampled_frame->nb_samples);
-            pthread_mutex_unlock(&csMic);
-            
-            av_frame_unref(resampled_frame); // 释放输出帧的数据缓冲区以备下次使用
-            // --- 修改结束 ---
+        // 将重采样后的数据写入FIFO
+        int fifoSize = WriteAudioRing(*audioRing_Mic, resampled_frame);
+        micCapUs = steady_now_us();
+        if (fifoSize >= AUDIO_FRAME_SIZE) filterMicEvent.Notify();
+        {
+            int sampleDelta = 0, distance = 0;
+            if (syncClock.UpdateSource(1, micCapUs, resampled_frame->nb_samples, pCodecEncodeCtx_Audio->sample_rate, sampleDelta, distance)) {
+                swr_set_compensation(pSwrCtx_Mic_local, sampleDelta, distance);
+            }
         }
-        av_packet_unref(packet);
+
+        resampled_frame->nb_samples = frameCapacity; // 恢复为缓冲区容量，下个周期直接复用
     }
 
 END:
     LOG_INFO("录制子线程-麦克风采集即将停止并回收资源");
-    if (packet) av_packet_free(&packet);
     if (resampled_frame) av_frame_free(&resampled_frame); // 这里只释放 AVFrame 结构体
     if (pSwrCtx_Mic_local) {
         swr_free(&pSwrCtx_Mic_local);
@@ -1614,41 +2496,40 @@ void AudioVideoProcModule::RecordThreadRun_FilterMic() {
     const int frameMicMinSize = AUDIO_FRAME_SIZE;
     AVFrame* frameAudioMic = av_frame_alloc();
     AVFrame* frameOut = av_frame_alloc();
+    bool isWaked = false;
     if (!frameAudioMic || !frameOut) {
         LOG_ERROR("无法为麦克风滤波分配帧内存");
         goto END;
     }
 
     while (recordType != RecordType::Stop) {
+        uint64_t stateSeq = recordStateEvent.GetSeq();
         while (recordType == RecordType::Record) {
-            if (av_audio_fifo_size(pAudioFifo_Mic) >= frameMicMinSize) {
-                frameAudioMic->nb_samples = frameMicMinSize;
-                frameAudioMic->channel_layout = pCodecEncodeCtx_Audio->channel_layout;
-                frameAudioMic->format = pCodecEncodeCtx_Audio->sample_fmt;
-                frameAudioMic->sample_rate = pCodecEncodeCtx_Audio->sample_rate;
-                if (av_frame_get_buffer(frameAudioMic, 0) < 0) {
+            uint64_t seq = filterMicEvent.GetSeq();
+            if (audioRing_Mic->Size() >= frameMicMinSize) {
+                isWaked = false;
+                if (prepare_audio_frame(frameAudioMic, pCodecEncodeCtx_Audio, frameMicMinSize) < 0) {
                     LOG_WARN("frameAudioMic申请内存失败，等待下一次处理重新申请");
                     this_thread::sleep_for(chrono::milliseconds(10));
                     continue;
                 }
-                pthread_mutex_lock(&csMic);
-                av_audio_fifo_read(pAudioFifo_Mic, (void**)frameAudioMic->data, frameMicMinSize);
-                pthread_mutex_unlock(&csMic);
+                audioRing_Mic->Read(frameAudioMic->data, frameMicMinSize);
 
-                if (av_buffersrc_add_frame(pFilterCtxSrcMic_Mic, frameAudioMic) >= 0) {
+                if (av_buffersrc_write_frame(pFilterCtxSrcMic_Mic, frameAudioMic) >= 0) {
                     while (av_buffersink_get_frame(pFilterCtxOutMic_Mic, frameOut) >= 0) {
-                        pthread_mutex_lock(&csMicFilter);
-                        av_audio_fifo_write(pAudioFifo_Mic_Filter, (void**)frameOut->data, frameOut->nb_samples);
-                        pthread_mutex_unlock(&csMicFilter);
+                        int fifoSize = WriteAudioRing(*audioRing_MicFilter, frameOut);
+                        if (fifoSize >= AUDIO_FRAME_SIZE) mixEvent.Notify();
                         av_frame_unref(frameOut);
                     }
                 }
-                av_frame_unref(frameAudioMic);
             } else {
-                this_thread::sleep_for(chrono::milliseconds(10));
+                // 等待采集线程攒够一帧，上一次醒来也没有数据则记为空唤醒
+                if (isWaked) audioIdleWakeNum++;
+                filterMicEvent.Wait(seq, AUDIO_WAIT_MS);
+                isWaked = true;
             }
         }
-        this_thread::sleep_for(chrono::milliseconds(100));
+        recordStateEvent.Wait(stateSeq, AUDIO_WAIT_MS);
     }
 END:
     LOG_INFO("录制子线程-麦克风降噪即将停止并回收资源");
@@ -1664,6 +2545,7 @@ void AudioVideoProcModule::RecordThreadRun_Mix()
     AVFrame* frameAudioInner = av_frame_alloc();
     AVFrame* frameAudioMic = av_frame_alloc();
     AVFrame* frameOut = av_frame_alloc();
+    bool isWaked = false;
     // --- 修改开始: 增加对内存分配失败的检查 ---
     if (!frameAudioInner || !frameAudioMic || !frameOut) {
         LOG_ERROR("混音线程无法分配帧内存，即将退出。");
@@ -1672,127 +2554,104 @@ void AudioVideoProcModule::RecordThreadRun_Mix()
     // --- 修改结束 ---
 
     while (recordType != RecordType::Stop) {
+        uint64_t stateSeq = recordStateEvent.GetSeq();
         while (recordType == RecordType::Record) {
+            uint64_t seq = mixEvent.GetSeq();
             // 检查是否有足够数据进行处理
-            bool hasInnerData = isRecordInner && (av_audio_fifo_size(pAudioFifo_Inner) >= frameMinSize);
-            bool hasMicData = isRecordMic && (av_audio_fifo_size(pAudioFifo_Mic_Filter) >= frameMinSize);
+            bool hasInnerData = isRecordInner && (audioRing_Inner->Size() >= frameMinSize);
+            bool hasMicData = isRecordMic && (audioRing_MicFilter->Size() >= frameMinSize);
+            if (hasInnerData || hasMicData) isWaked = false;
             
             // --- 修改开始: 重构整个处理逻辑 ---
             if (hasInnerData && hasMicData) {
                 // 情况1：两个源都有数据，需要混合
-                LOG_DEBUG("混音开始，队列数据为: 音频(" + to_string(av_audio_fifo_size(pAudioFifo_Inner)) + ") 麦克风(" + to_string(av_audio_fifo_size(pAudioFifo_Mic_Filter)) + ")");
+                LOG_DEBUG("混音开始，队列数据为: 音频(" + to_string(audioRing_Inner->Size()) + ") 麦克风(" + to_string(audioRing_MicFilter->Size()) + ")");
 
                 // 准备扬声器帧
-                frameAudioInner->nb_samples = frameMinSize;
-                frameAudioInner->channel_layout = pCodecEncodeCtx_Audio->channel_layout;
-                frameAudioInner->format = pCodecEncodeCtx_Audio->sample_fmt;
-                frameAudioInner->sample_rate = pCodecEncodeCtx_Audio->sample_rate;
-                if (av_frame_get_buffer(frameAudioInner, 0) < 0) {
+                if (prepare_audio_frame(frameAudioInner, pCodecEncodeCtx_Audio, frameMinSize) < 0) {
                     LOG_WARN("frame_audio_inner申请内存失败");
                     this_thread::sleep_for(chrono::milliseconds(10));
                     continue;
                 }
                 
                 // 准备麦克风帧
-                frameAudioMic->nb_samples = frameMinSize;
-                frameAudioMic->channel_layout = pCodecEncodeCtx_Audio->channel_layout;
-                frameAudioMic->format = pCodecEncodeCtx_Audio->sample_fmt;
-                frameAudioMic->sample_rate = pCodecEncodeCtx_Audio->sample_rate;
-                if (av_frame_get_buffer(frameAudioMic, 0) < 0) {
+                if (prepare_audio_frame(frameAudioMic, pCodecEncodeCtx_Audio, frameMinSize) < 0) {
                     LOG_WARN("frame_audio_mic申请内存失败");
-                    av_frame_unref(frameAudioInner); // 清理已分配的帧
                     this_thread::sleep_for(chrono::milliseconds(10));
                     continue;
                 }
 
                 // 从缓冲区读取数据
-                pthread_mutex_lock(&csInner);
-                av_audio_fifo_read(pAudioFifo_Inner, (void**)(frameAudioInner->data), frameMinSize);
-                pthread_mutex_unlock(&csInner);
-                pthread_mutex_lock(&csMicFilter);
-                av_audio_fifo_read(pAudioFifo_Mic_Filter, (void**)frameAudioMic->data, frameMinSize);
-                pthread_mutex_unlock(&csMicFilter);
-
-                // 将两个帧都送入过滤器
-                int ret = av_buffersrc_add_frame(pFilterCtxSrc_Inner, frameAudioInner);
-                if (ret < 0) LOG_ERROR("向混音器添加扬声器帧失败: " + av_err2str_cpp(ret));
-                
-                ret = av_buffersrc_add_frame(pFilterCtxSrc_Mic, frameAudioMic);
-                if (ret < 0) LOG_ERROR("向混音器添加麦克风帧失败: " + av_err2str_cpp(ret));
-                
-                // 从过滤器获取混合后的结果
-                while (av_buffersink_get_frame(pFilterCtxOut_Mix, frameOut) >= 0) {
-                    pthread_mutex_lock(&csMix);
-                    av_audio_fifo_write(pAudioFifo_Mix, (void**)frameOut->data, frameOut->nb_samples);
-                    pthread_mutex_unlock(&csMix);
-                    av_frame_unref(frameOut);
+                audioRing_Inner->Read(frameAudioInner->data, frameMinSize);
+                audioRing_MicFilter->Read(frameAudioMic->data, frameMinSize);
+
+                auto mixBegin = chrono::steady_clock::now();
+                if (isNativeMix) {
+                    // 默认混音方式直接在扬声器帧上原地加权求和
+                    audioMixer.Mix(frameAudioInner->data, frameAudioMic->data, pCodecEncodeCtx_Audio->channels, frameMinSize);
+                    int fifoSize = WriteAudioRing(*audioRing_Mix, frameAudioInner);
+                    if (fifoSize >= AUDIO_FRAME_SIZE) writeAudioEvent.Notify();
+                } else {
+                    // 将两个帧都送入过滤器
+                    int ret = av_buffersrc_write_frame(pFilterCtxSrc_Inner, frameAudioInner);
+                    if (ret < 0) LOG_ERROR("向混音器添加扬声器帧失败: " + av_err2str_cpp(ret));
+
+                    ret = av_buffersrc_write_frame(pFilterCtxSrc_Mic, frameAudioMic);
+                    if (ret < 0) LOG_ERROR("向混音器添加麦克风帧失败: " + av_err2str_cpp(ret));
+
+                    // 从过滤器获取混合后的结果
+                    while (av_buffersink_get_frame(pFilterCtxOut_Mix, frameOut) >= 0) {
+                        int fifoSize = WriteAudioRing(*audioRing_Mix, frameOut);
+                        if (fifoSize >= AUDIO_FRAME_SIZE) writeAudioEvent.Notify();
+                        av_frame_unref(frameOut);
+                    }
                 }
-                
-                // 清理两个输入帧
-                av_frame_unref(frameAudioInner);
-                av_frame_unref(frameAudioMic);
+                mixCostUs += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - mixBegin).count();
+                mixSamples += frameMinSize;
             }
             else if (hasInnerData) { // 情况2：只有扬声器数据，直接传递，不经过过滤器
-                LOG_DEBUG("音频直通开始，队列数据为:音频(" + to_string(av_audio_fifo_size(pAudioFifo_Inner)) + ")");
+                LOG_DEBUG("音频直通开始，队列数据为:音频(" + to_string(audioRing_Inner->Size()) + ")");
                 
                 // 准备扬声器帧
-                frameAudioInner->nb_samples = frameMinSize;
-                frameAudioInner->channel_layout = pCodecEncodeCtx_Audio->channel_layout;
-                frameAudioInner->format = pCodecEncodeCtx_Audio->sample_fmt;
-                frameAudioInner->sample_rate = pCodecEncodeCtx_Audio->sample_rate;
-                if (av_frame_get_buffer(frameAudioInner, 0) < 0) {
+                if (prepare_audio_frame(frameAudioInner, pCodecEncodeCtx_Audio, frameMinSize) < 0) {
                     LOG_WARN("frame_audio_inner申请内存失败");
                     this_thread::sleep_for(chrono::milliseconds(10));
                     continue;
                 }
                 
                 // 从缓冲区读取数据
-                pthread_mutex_lock(&csInner);
-                av_audio_fifo_read(pAudioFifo_Inner, (void**)(frameAudioInner->data), frameMinSize);
-                pthread_mutex_unlock(&csInner);
+                audioRing_Inner->Read(frameAudioInner->data, frameMinSize);
 
                 // 直接将数据写入下一个缓冲区
-                pthread_mutex_lock(&csMix);
-                av_audio_fifo_write(pAudioFifo_Mix, (void**)frameAudioInner->data, frameAudioInner->nb_samples);
-                pthread_mutex_unlock(&csMix);
-
-                // 清理帧
-                av_frame_unref(frameAudioInner);
+                int fifoSize = WriteAudioRing(*audioRing_Mix, frameAudioInner);
+                if (fifoSize >= AUDIO_FRAME_SIZE) writeAudioEvent.Notify();
             }
             else if (hasMicData) { // 情况3：只有麦克风数据，直接传递，不经过过滤器
-                LOG_DEBUG("麦克风直通开始，队列数据为:麦克风(" + to_string(av_audio_fifo_size(pAudioFifo_Mic_Filter)) + ")");
+                LOG_DEBUG("麦克风直通开始，队列数据为:麦克风(" + to_string(audioRing_MicFilter->Size()) + ")");
                 
                 // 准备麦克风帧
-                frameAudioMic->nb_samples = frameMinSize;
-                frameAudioMic->channel_layout = pCodecEncodeCtx_Audio->channel_layout;
-                frameAudioMic->format = pCodecEncodeCtx_Audio->sample_fmt;
-                frameAudioMic->sample_rate = pCodecEncodeCtx_Audio->sample_rate;
-                if (av_frame_get_buffer(frameAudioMic, 0) < 0) {
+                if (prepare_audio_frame(frameAudioMic, pCodecEncodeCtx_Audio, frameMinSize) < 0) {
                     LOG_WARN("frame_audio_mic申请内存失败");
                     this_thread::sleep_for(chrono::milliseconds(10));
                     continue;
                 }
                 
                 // 从缓冲区读取数据
-                pthread_mutex_lock(&csMicFilter);
-                av_audio_fifo_read(pAudioFifo_Mic_Filter, (void**)frameAudioMic->data, frameMinSize);
-                pthread_mutex_unlock(&csMicFilter);
+                audioRing_MicFilter->Read(frameAudioMic->data, frameMinSize);
                 
                 // 直接将数据写入下一个缓冲区
-                pthread_mutex_lock(&csMix);
-                av_audio_fifo_write(pAudioFifo_Mix, (void**)frameAudioMic->data, frameAudioMic->nb_samples);
-                pthread_mutex_unlock(&csMix);
-
-                // 清理帧
-                av_frame_unref(frameAudioMic);
+                int fifoSize = WriteAudioRing(*audioRing_Mix, frameAudioMic);
+                if (fifoSize >= AUDIO_FRAME_SIZE) writeAudioEvent.Notify();
             }
             else {
-                // 情况4：没有足够的数据，休眠
-                this_thread::sleep_for(chrono::milliseconds(10));
+                // 情况4：没有足够的数据，等待扬声器或降噪线程攒够一帧
+                if (isWaked) audioIdleWakeNum++;
+                mixEvent.Wait(seq, AUDIO_WAIT_MS);
+                isWaked = true;
             }
             // --- 修改结束 ---
         }
-        this_thread::sleep_for(chrono::milliseconds(100));
+        recordStateEvent.Wait(stateSeq, AUDIO_WAIT_MS);
     }
 
 END: // 这是函数末尾的跳转标签和清理代码
@@ -1816,6 +2675,7 @@ void AudioVideoProcModule::RecordThreadRun_Write() {
     const int frameMixMinSize = AUDIO_FRAME_SIZE;
     AVFrame* frame_mix = av_frame_alloc();
     AVPacket* pkt = av_packet_alloc();
+    bool isWaked = false;
     
     // --- 确保指针被成功分配 ---
     if (!frame_mix || !pkt) {
@@ -1824,46 +2684,43 @@ void AudioVideoProcModule::RecordThreadRun_Write() {
     }
 
     while (recordType != RecordType::Stop) {
+        uint64_t stateSeq = recordStateEvent.GetSeq();
         while (recordType == RecordType::Record) {
+            uint64_t seq = writeAudioEvent.GetSeq();
             // 检查音频混合缓冲区中是否有足够的数据构成一个完整的音频帧
-            if (av_audio_fifo_size(pAudioFifo_Mix) >= frameMixMinSize) {
-                // 设置即将被填充的音频帧的参数
-                frame_mix->nb_samples = frameMixMinSize;
-                frame_mix->channel_layout = pCodecEncodeCtx_Audio->channel_layout;
-                frame_mix->format = pCodecEncodeCtx_Audio->sample_fmt;
-                frame_mix->sample_rate = pCodecEncodeCtx_Audio->sample_rate;
-                
-                // 为音频帧分配数据缓冲区
-                iRet = av_frame_get_buffer(frame_mix, 0);
+            if (audioRing_Mix->Size() >= frameMixMinSize) {
+                isWaked = false;
+                // 复用音频帧的数据缓冲区，编码器仍持有上一帧时才重新分配
+                iRet = prepare_audio_frame(frame_mix, pCodecEncodeCtx_Audio, frameMixMinSize);
                 if (iRet < 0) {
-                    LOG_ERROR("音频写入线程 av_frame_get_buffer 失败。");
+                    LOG_ERROR("音频写入线程准备音频帧失败。");
                     this_thread::sleep_for(chrono::milliseconds(10));
                     continue; // 跳过本次循环
                 }
 
                 // 从FIFO中读取数据到音频帧
-                pthread_mutex_lock(&csMix);
-                av_audio_fifo_read(pAudioFifo_Mix, (void**)frame_mix->data, frameMixMinSize);
-                pthread_mutex_unlock(&csMix);
-
-                // --- 你的原始代码：基于全局时钟的时间戳计算 ---
-                // auto now = std::chrono::steady_clock::now();
-            	// auto elapsed_time = std::chrono::duration_cast<std::chrono::microseconds>(now - recording_start_time).count();
-            	// int64_t current_pts = av_rescale_q(elapsed_time, {1, 1000000}, pCodecEncodeCtx_Audio->time_base);
-
-            	// if (current_pts <= last_audio_pts) {
-             	//    current_pts = last_audio_pts + frame_mix->nb_samples; // 音频PTS通常按样本数增加
-            	// }
-            	// frame_mix->pts = current_pts;
-            	// last_audio_pts = current_pts;
-                
-                // --- 新的、更简单的方案：基于样本数生成连续的PTS ---
-                // 这种方法不依赖真实时间，但能保证音频流自身的流畅和连续性
-                if (last_audio_pts < 0) { // 如果是第一帧
-                    last_audio_pts = 0;
+                audioRing_Mix->Read(frame_mix->data, frameMixMinSize);
+                long long latencyUs = UpdateAudioLatency(frameMixMinSize);
+
+                // 基于样本数生成连续的PTS，起点按第一帧的采集时刻对齐到音视频公共起点
+                {
+                    AVRational usTimeBase = { 1, 1000000 };
+                    long long captureUs = (latencyUs > 0) ? syncClock.ToClockUs(steady_now_us() - latencyUs) : syncClock.NowUs();
+                    if (last_audio_pts < 0) {
+                        last_audio_pts = av_rescale_q(max(0LL, captureUs), usTimeBase, pCodecEncodeCtx_Audio->time_base);
+                        LOG_INFO("音频第一帧的时间戳对齐到" + to_string(captureUs) + "us");
+                    } else {
+                        // 缓冲区被清空或溢出丢弃后样本数会落后于采集时刻，此时向前跳过，让画面与声音重新对齐
+                        long long audioUs = av_rescale_q(last_audio_pts, pCodecEncodeCtx_Audio->time_base, usTimeBase);
+                        if (latencyUs > 0 && captureUs - audioUs > AV_SYNC_JUMP_US) {
+                            LOG_WARN("音频时间戳落后采集时刻" + to_string(captureUs - audioUs) + "us，向前对齐");
+                            last_audio_pts = av_rescale_q(captureUs, usTimeBase, pCodecEncodeCtx_Audio->time_base);
+                        }
+                    }
+                    frame_mix->pts = last_audio_pts;
+                    syncClock.UpdateOffset(av_rescale_q(last_audio_pts, pCodecEncodeCtx_Audio->time_base, usTimeBase), captureUs);
+                    last_audio_pts += frame_mix->nb_samples; // 为下一帧准备PTS
                 }
-                frame_mix->pts = last_audio_pts;
-                last_audio_pts += frame_mix->nb_samples; // 为下一帧准备PTS
 
                 // 将音频帧发送给编码器
                 iRet = avcodec_send_frame(pCodecEncodeCtx_Audio, frame_mix);
@@ -1877,46 +2734,31 @@ void AudioVideoProcModule::RecordThreadRun_Write() {
                         break;
                     }
                     
-                    // 将数据包的时间戳从编码器的时间基转换为输出流的时间基
-                    av_packet_rescale_ts(pkt, pCodecEncodeCtx_Audio->time_base, pStream_Audio->time_base);
-			
-                    // --- 音频流独立归一化 ---
-                    {
-                        // 使用 std::lock_guard 来安全地访问共享变量
-                        std::lock_guard<std::mutex> lock(audio_pts_mutex);
-                        // 如果这是整个音频流的第一个数据包
-                        if (audio_first_dts == AV_NOPTS_VALUE) {
-                            // 记录下它的DTS作为时间戳的起点/偏移量
-                            audio_first_dts = pkt->dts;
-                            LOG_INFO("音频流的第一个DTS被记录为: " + to_string(audio_first_dts));
-                        }
-                    }
-                    // 将所有后续数据包的时间戳都减去这个初始偏移量
-                    // 这样可以确保音频流的时间戳从0开始
-                    pkt->pts -= audio_first_dts;
-                    pkt->dts -= audio_first_dts;
-        
-                    pkt->stream_index = streamIndex_Audio;
+                    // 时间戳保持编码器的时间基，由各输出端转换为自己流的时间基
 
-                    // 写入数据包到输出文件/流
-                    pthread_mutex_lock(&csWrite);
-                    av_interleaved_write_frame(pFormatCtxOut, pkt);
-                    pthread_mutex_unlock(&csWrite);
+                    // 写入数据包到所有输出端
+                    WritePacket(pkt, false);
                     allAudioFrame++;
                     av_packet_unref(pkt);
                 }
-                av_frame_unref(frame_mix); // 释放音频帧的数据缓冲区
             } else {
-                // 如果缓冲区中没有足够的数据，则短暂休眠
-                this_thread::sleep_for(chrono::milliseconds(10));
+                // 如果缓冲区中没有足够的数据，则等待混音线程通知
+                if (isWaked) audioIdleWakeNum++;
+                writeAudioEvent.Wait(seq, AUDIO_WAIT_MS);
+                isWaked = true;
             }
         }
-        this_thread::sleep_for(chrono::milliseconds(100));
+        recordStateEvent.Wait(stateSeq, AUDIO_WAIT_MS);
     }
 
 END: // 函数退出时的清理标签
     LOG_INFO("录制子线程-音频写入即将停止并回收资源");
     recordType = RecordType::Stop;
+    NotifyRecordState();
+    LOG_INFO("音频采集到编码的延迟平均" + to_string(audioLatencyUs) + "us，最大" + to_string(audioMaxLatencyUs)
+        + "us，空唤醒" + to_string(GetAudioIdleWakeups()) + "次/秒");
+    LOG_INFO("音画偏差平均" + to_string(syncClock.GetOffsetUs()) + "us，最大" + to_string(syncClock.GetMaxOffsetUs())
+        + "us，声卡漂移 扬声器" + to_string(syncClock.GetDriftPpm(0)) + "ppm 麦克风" + to_string(syncClock.GetDriftPpm(1)) + "ppm");
     if (frame_mix) {
         av_frame_free(&frame_mix);
     }
@@ -1930,32 +2772,46 @@ END: // 函数退出时的清理标签
 int AudioVideoProcModule::OpenOutPut() {
     CloseOutPut();  // 先清理旧的
 
-    // 避免 goto 跨越初始化
-    AVDictionary* vopts = nullptr;
-
     int iRet = 0;
-    const char* outFileName = isRtmp ? pushRtmpUrl.c_str() : recordFileName.c_str();
-    streamIndex_Video = 0;
+    // 录制文件或推流地址为主输出，附加输出与它共用同一次编码
+    vector<string> outUrls{ isRtmp ? pushRtmpUrl : recordFileName };
+    // 启用回放缓冲区且未设置录制文件时只录制到回放缓冲区
+    const bool hasPrimary = !(replaySeconds > 0 && outUrls[0].empty());
+    if (!hasPrimary) {
+        LOG_INFO("OpenOutPut: 未设置录制文件，只录制到回放缓冲区");
+        outUrls.clear();
+    }
+    for (const string& url : extraOutputUrls) {
+        if (find(outUrls.begin(), outUrls.end(), url) == outUrls.end()) outUrls.push_back(url);
+    }
+    // 回放保存为文件时需要全局头，不需要的输出端会自行在关键帧前补上参数集
+    bool isGlobalHeader = replaySeconds > 0;
+    // 多码率输出与主输出共用音频编码器，也参与判断
+    for (const RenditionConfig& config : renditionConfigs) {
+        if (OutputSink::IsGlobalHeader(config.url)) isGlobalHeader = true;
+    }
 
     // 三种模式：系统声 / 麦克风 / 无音频
     const bool wantAudio = (isRecordInner || isRecordMic);
-    streamIndex_Audio = wantAudio ? 1 : -1;
-
-    LOG_INFO("OpenOutPut: 准备打开输出: " + std::string(outFileName));
 
-    // ========== 1) 输出上下文 ==========
-    if (isRtmp) {
-        iRet = avformat_alloc_output_context2(&pFormatCtxOut, nullptr, "flv", outFileName);
-    } else {
-        iRet = avformat_alloc_output_context2(&pFormatCtxOut, nullptr, nullptr, outFileName);
+    // ========== 1) 输出端 ==========
+    for (const string& url : outUrls) {
+        LOG_INFO("OpenOutPut: 准备打开输出: " + url);
+        // 任一封装格式需要全局头时编码器都按全局头输出，其余输出端自行在关键帧前补上参数集
+        if (OutputSink::IsGlobalHeader(url)) isGlobalHeader = true;
+        lock_guard<mutex> lock(outputMutex);
+        outputSinks.emplace_back(new OutputSink(url, outputQueueSize));
     }
-    if (iRet < 0 || !pFormatCtxOut) {
-        LOG_ERROR("输出上下文分配失败(" + std::to_string(iRet) + "): " + av_err2str_cpp(iRet));
-        goto END_ERR;
+    // 分段只对录制文件生效
+    if (hasPrimary && !isRtmp && (segmentSeconds > 0 || segmentMaxMB > 0)) {
+        outputSinks[0]->SetSegment(segmentSeconds, (long long)segmentMaxMB * 1024 * 1024);
+        const string& playlistUrl = outputSinks[0]->GetPlaylistUrl();
+        LOG_INFO("OpenOutPut: 录制文件分段，每段" + to_string(segmentSeconds) + "秒或" + to_string(segmentMaxMB) + "MB"
+            + (playlistUrl.empty() ? string("，非MPEG-TS分段不生成索引") : "，索引:" + playlistUrl));
     }
 
     // ========== 2) 选择视频编码器：libopenh264（只用它，不回退 x264） ==========
-    pCodecEncode_Video = avcodec_find_encoder_by_name("libopenh264");
+    pCodecEncode_Video = avcodec_find_encoder_by_name(VIDEO_ENCODER_NAME);
     if (!pCodecEncode_Video) {
         LOG_ERROR("未找到 libopenh264（请确认 FFmpeg 启用了 --enable-libopenh264 并正确安装 openh264）");
         iRet = AVERROR_ENCODER_NOT_FOUND;
@@ -1963,7 +2819,7 @@ int AudioVideoProcModule::OpenOutPut() {
     }
     LOG_INFO("使用视频编码器：libopenh264");
 
-    // ========== 3) 分配编码器上下文 & 新建视频流 ==========
+    // ========== 3) 分配编码器上下文 ==========
     pCodecEncodeCtx_Video = avcodec_alloc_context3(pCodecEncode_Video);
     if (!pCodecEncodeCtx_Video) {
         LOG_ERROR("分配视频编码器上下文失败");
@@ -1971,14 +2827,6 @@ int AudioVideoProcModule::OpenOutPut() {
         goto END_ERR;
     }
 
-    pStream_Video = avformat_new_stream(pFormatCtxOut, nullptr);
-    if (!pStream_Video) {
-        LOG_ERROR("创建输出视频流失败");
-        iRet = AVERROR(ENOMEM);
-        goto END_ERR;
-    }
-    pStream_Video->id = streamIndex_Video;
-
     // ========== 4) （可选）音频：AAC ==========
     if (wantAudio) {
         pCodecEncode_Audio = avcodec_find_encoder(AV_CODEC_ID_AAC);
@@ -1993,17 +2841,9 @@ int AudioVideoProcModule::OpenOutPut() {
             iRet = AVERROR(ENOMEM);
             goto END_ERR;
         }
-        pStream_Audio = avformat_new_stream(pFormatCtxOut, nullptr);
-        if (!pStream_Audio) {
-            LOG_ERROR("创建输出音频流失败");
-            iRet = AVERROR(ENOMEM);
-            goto END_ERR;
-        }
-        pStream_Audio->id = streamIndex_Audio;
     } else {
         pCodecEncode_Audio = nullptr;
         pCodecEncodeCtx_Audio = nullptr;
-        pStream_Audio = nullptr;
     }
 
     // ========== 5) 填写视频编码参数（CBR + 低延迟友好）==========
@@ -2012,26 +2852,26 @@ int AudioVideoProcModule::OpenOutPut() {
 
     pCodecEncodeCtx_Video->width   = FINALE_WIDTH;
     pCodecEncodeCtx_Video->height  = FINALE_HEIGHT;
-    pCodecEncodeCtx_Video->pix_fmt = AV_PIX_FMT_YUV420P;
+    // 与采集、合成使用同一格式，编码前不再转换
+    pCodecEncodeCtx_Video->pix_fmt = static_cast<AVPixelFormat>(static_cast<int>(videoPixFmt));
 
     // 帧率/时间基
     pCodecEncodeCtx_Video->time_base = AVRational{1, frameRate};
-    pStream_Video->time_base         = pCodecEncodeCtx_Video->time_base;
 
     // 固定码率（CBR）：用 AVCodecContext 字段控制
     pCodecEncodeCtx_Video->flags &= ~AV_CODEC_FLAG_QSCALE; // 不使用 QSCALE
-    pCodecEncodeCtx_Video->bit_rate           = (bitRate > 0 ? bitRate : 2'000'000);
-    pCodecEncodeCtx_Video->bit_rate_tolerance = pCodecEncodeCtx_Video->bit_rate / 2;
-    pCodecEncodeCtx_Video->rc_max_rate        = pCodecEncodeCtx_Video->bit_rate;
-    pCodecEncodeCtx_Video->rc_min_rate        = pCodecEncodeCtx_Video->bit_rate;
-    pCodecEncodeCtx_Video->rc_buffer_size     = pCodecEncodeCtx_Video->bit_rate; // 与 maxrate 配对，消除 VBV 提示
+    set_video_bit_rate(pCodecEncodeCtx_Video, (bitRate > 0 ? bitRate : 2'000'000));
+    if (abrMaxBitRate > 0) {
+        // 启用自适应码率时从限制在范围内的设定码率起步
+        set_video_bit_rate(pCodecEncodeCtx_Video, max<int64_t>(abrMinBitRate, min<int64_t>(abrMaxBitRate, pCodecEncodeCtx_Video->bit_rate)));
+    }
 
     // GOP / B 帧（openh264 通常不使用 B 帧，保持 0）
     pCodecEncodeCtx_Video->gop_size     = (gopSize > 0 ? gopSize : frameRate); // 约 1s 一个关键帧
     pCodecEncodeCtx_Video->max_b_frames = 0;
     pCodecEncodeCtx_Video->thread_count = (threadCount > 0 ? threadCount : 1);
 
-    if (pFormatCtxOut->oformat->flags & AVFMT_GLOBALHEADER) {
+    if (isGlobalHeader) {
         pCodecEncodeCtx_Video->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     }
 
@@ -2052,9 +2892,8 @@ int AudioVideoProcModule::OpenOutPut() {
         pCodecEncodeCtx_Audio->channels       = av_get_channel_layout_nb_channels(pCodecEncodeCtx_Audio->channel_layout);
         pCodecEncodeCtx_Audio->bit_rate       = 64000;
         pCodecEncodeCtx_Audio->time_base      = AVRational{1, pCodecEncodeCtx_Audio->sample_rate};
-        pStream_Audio->time_base              = pCodecEncodeCtx_Audio->time_base;
 
-        if (pFormatCtxOut->oformat->flags & AVFMT_GLOBALHEADER) {
+        if (isGlobalHeader) {
             pCodecEncodeCtx_Audio->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
         }
 
@@ -2064,14 +2903,8 @@ int AudioVideoProcModule::OpenOutPut() {
                  ", bitrate=" + std::to_string(pCodecEncodeCtx_Audio->bit_rate));
     }
 
-    // ========== 7) 仅针对 libopenh264 的私有选项（保守且兼容）==========
-    // 只设置通用且稳定的两个：profile/level；其它参数留空以避免 “unknown option”
-    av_dict_set(&vopts, "profile", "baseline", 0);
-    av_dict_set(&vopts, "level",   "3.1",      0);
-    // （可选）如果想走 CRF/ABR 需查对应 FFmpeg 版本支持的 libopenh264 私有项，这里不强塞
-
-    // ========== 8) 打开编码器 ==========
-    iRet = avcodec_open2(pCodecEncodeCtx_Video, pCodecEncode_Video, &vopts);
+    // ========== 7) 打开编码器 ==========
+    iRet = OpenVideoEncoder(pCodecEncodeCtx_Video);
     if (iRet < 0) {
         LOG_ERROR("打开视频编码器(libopenh264)失败(" + std::to_string(iRet) + "): " + av_err2str_cpp(iRet));
         goto END_ERR;
@@ -2085,48 +2918,176 @@ int AudioVideoProcModule::OpenOutPut() {
         }
     }
 
-    // ========== 9) 将编码参数写入流 ==========
-    iRet = avcodec_parameters_from_context(pStream_Video->codecpar, pCodecEncodeCtx_Video);
-    if (iRet < 0) {
-        LOG_ERROR("从视频上下文中拷贝参数失败(" + std::to_string(iRet) + "): " + av_err2str_cpp(iRet));
-        goto END_ERR;
-    }
-    if (wantAudio) {
-        iRet = avcodec_parameters_from_context(pStream_Audio->codecpar, pCodecEncodeCtx_Audio);
+    // ========== 9) 按编码参数打开各输出端并写文件头 ==========
+    // 主输出打开失败则整体失败；附加输出打开失败只跳过它，不影响录制
+    for (size_t i = 0; i < outputSinks.size(); ) {
+        iRet = outputSinks[i]->Open(pCodecEncodeCtx_Video, pCodecEncodeCtx_Audio);
         if (iRet < 0) {
-            LOG_ERROR("从音频上下文中拷贝参数失败(" + std::to_string(iRet) + "): " + av_err2str_cpp(iRet));
-            goto END_ERR;
+            if (0 == i && hasPrimary) {
+                LOG_ERROR("打开主输出失败(" + std::to_string(iRet) + "): " + av_err2str_cpp(iRet));
+                goto END_ERR;
+            }
+            LOG_WARN("打开附加输出失败，已跳过: " + outputSinks[i]->GetUrl());
+            lock_guard<mutex> lock(outputMutex);
+            outputSinks.erase(outputSinks.begin() + i);
+            continue;
         }
+        ++i;
     }
 
-    // ========== 10) 打开 IO & 写文件头 ==========
-    if (!(pFormatCtxOut->oformat->flags & AVFMT_NOFILE)) {
-        iRet = avio_open(&pFormatCtxOut->pb, outFileName, AVIO_FLAG_WRITE);
-        if (iRet < 0) {
-            LOG_ERROR("avio_open 打开输出失败(" + std::to_string(iRet) + "): " + av_err2str_cpp(iRet));
-            goto END_ERR;
-        }
-    }
+    LOG_INFO("OpenOutPut: 成功打开" + std::to_string(outputSinks.size()) + "个输出端，使用 libopenh264。");
 
-    iRet = avformat_write_header(pFormatCtxOut, nullptr);
-    if (iRet < 0) {
-        LOG_ERROR("写入文件头失败(" + std::to_string(iRet) + "): " + av_err2str_cpp(iRet));
-        goto END_ERR;
+    // ========== 10) 多码率输出 ==========
+    // 打开失败只跳过该档，不影响录制
+    if (!renditionConfigs.empty()) {
+        OpenRenditions(outUrls);
     }
 
-    LOG_INFO("OpenOutPut: 成功写入输出头（" + std::string(isRtmp ? "RTMP/FLV" : pFormatCtxOut->oformat->name) + "），使用 libopenh264。");
+    // ========== 11) 回放缓冲区 ==========
+    if (replaySeconds > 0) {
+        atomic_store(&replayBuffer, make_shared<ReplayBuffer>(pCodecEncodeCtx_Video->time_base.num, pCodecEncodeCtx_Video->time_base.den,
+            wantAudio ? pCodecEncodeCtx_Audio->time_base.num : 1, wantAudio ? pCodecEncodeCtx_Audio->time_base.den : 1,
+            replaySeconds * 1000, (long long)replayMaxMB * 1024 * 1024));
+        LOG_INFO("OpenOutPut: 回放缓冲区保留" + std::to_string(replaySeconds) + "秒，上限" + std::to_string(replayMaxMB) + "MB");
+    }
 
-    if (vopts) { av_dict_free(&vopts); vopts = nullptr; }
     return 0;
 
 END_ERR:
-    if (vopts) { av_dict_free(&vopts); vopts = nullptr; }
     CloseOutPut();
     return (iRet < 0) ? iRet : AVERROR_UNKNOWN;
 }
 
 
+int AudioVideoProcModule::OpenVideoEncoder(AVCodecContext* CodecCtx) {
+    // 仅针对 libopenh264 的私有选项（保守且兼容）
+    // 只设置通用且稳定的两个：profile/level；其它参数留空以避免 “unknown option”
+    AVDictionary* vopts = nullptr;
+    av_dict_set(&vopts, "profile", "baseline", 0);
+    av_dict_set(&vopts, "level",   "3.1",      0);
+    int ret = avcodec_open2(CodecCtx, pCodecEncode_Video, &vopts);
+    av_dict_free(&vopts);
+    return ret;
+}
+
+AudioVideoProcModule::ReopenResult AudioVideoProcModule::ReopenVideoEncoder(int64_t BitRate) {
+    // libopenh264在FFmpeg中不支持运行时修改码率，FFmpeg也不支持关闭后重新打开同一上下文，
+    // 按新码率另开一个编码器，成功后才替换，失败时原编码器不受影响；新编码器的第一帧为关键帧
+    // 保存回放时会复制编码器参数，正在保存则下一帧再试
+    unique_lock<mutex> lock(replayMutex, try_to_lock);
+    if (!lock.owns_lock()) {
+        return ReopenResult::Busy;
+    }
+    auto begin = chrono::steady_clock::now();
+    AVCodecContext* codecCtx = alloc_video_encoder(pCodecEncode_Video, pCodecEncodeCtx_Video,
+        pCodecEncodeCtx_Video->width, pCodecEncodeCtx_Video->height, BitRate);
+    int ret = codecCtx ? OpenVideoEncoder(codecCtx) : AVERROR(ENOMEM);
+    if (ret < 0) {
+        LOG_ERROR("按码率" + to_string(BitRate) + "打开视频编码器失败: " + av_err2str_cpp(ret) + "，继续使用原编码器");
+        avcodec_free_context(&codecCtx);
+        return ReopenResult::Kept;
+    }
+    if (codecCtx->extradata_size != pCodecEncodeCtx_Video->extradata_size
+        || (codecCtx->extradata_size > 0 && memcmp(codecCtx->extradata, pCodecEncodeCtx_Video->extradata, codecCtx->extradata_size) != 0)) {
+        // 已打开的输出端与回放保存的是开始录制时的序列头，新的SPS/PPS只随关键帧带内发送
+        LOG_WARN("新码率编码器的序列头(extradata)与原先不同，输出端文件头中仍是原序列头，大小:"
+            + to_string(pCodecEncodeCtx_Video->extradata_size) + "->" + to_string(codecCtx->extradata_size));
+    }
+    swap(pCodecEncodeCtx_Video, codecCtx);
+    avcodec_free_context(&codecCtx);
+    LOG_INFO("视频编码器已按码率" + to_string(BitRate) + "重新打开，耗时(微秒):"
+        + to_string(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count()));
+    return ReopenResult::Applied;
+}
+
+void AudioVideoProcModule::OpenRenditions(const vector<string>& OutUrls) {
+    // 按面积从大到小排列，每档由已打开的档位中宽高都不小于它且宽高比相同的最小一档缩放，缩放的源越小越省；
+    // 没有这样的档位时由主画面缩放，避免由不同宽高比的档位拉伸或由更窄、更矮的档位放大
+    vector<RenditionConfig> configs = renditionConfigs;
+    stable_sort(configs.begin(), configs.end(), [](const RenditionConfig& A, const RenditionConfig& B) {
+        return (long long)A.width * A.height > (long long)B.width * B.height;
+    });
+    const long long mainArea = (long long)FINALE_WIDTH * FINALE_HEIGHT;
+    for (const RenditionConfig& config : configs) {
+        if (config.width > FINALE_WIDTH || config.height > FINALE_HEIGHT) {
+            LOG_WARN("多码率输出" + to_string(config.width) + "x" + to_string(config.height) + "大于主输出" + to_string(FINALE_WIDTH) + "x"
+                + to_string(FINALE_HEIGHT) + "，已跳过: " + config.url);
+            continue;
+        }
+        if (find(OutUrls.begin(), OutUrls.end(), config.url) != OutUrls.end()) {
+            LOG_WARN("多码率输出与主输出或附加输出地址相同，已跳过: " + config.url);
+            continue;
+        }
+        if (!is_same_aspect(config.width, config.height, FINALE_WIDTH, FINALE_HEIGHT)) {
+            LOG_WARN("多码率输出" + to_string(config.width) + "x" + to_string(config.height) + "与主输出" + to_string(FINALE_WIDTH) + "x"
+                + to_string(FINALE_HEIGHT) + "宽高比不同，画面会被拉伸: " + config.url);
+        }
+        // 除宽高与码率外与主输出的编码参数一致
+        AVCodecContext* codecCtx = alloc_video_encoder(pCodecEncode_Video, pCodecEncodeCtx_Video, config.width, config.height, config.bitRate > 0 ? config.bitRate
+            : max<int64_t>(100000, pCodecEncodeCtx_Video->bit_rate * config.width * config.height / max(1LL, mainArea)));
+        if (!codecCtx) {
+            LOG_WARN("分配多码率输出的编码器上下文失败，已跳过: " + config.url);
+            continue;
+        }
+        int ret = OpenVideoEncoder(codecCtx);
+        if (ret < 0) {
+            LOG_WARN("打开多码率输出的视频编码器失败，已跳过: " + config.url + "，" + av_err2str_cpp(ret));
+            avcodec_free_context(&codecCtx);
+            continue;
+        }
+        unique_ptr<RenditionEncoder> rendition(new RenditionEncoder(config.url, outputQueueSize));
+        if (rendition->Open(codecCtx, pCodecEncodeCtx_Audio, videoQueueFrames, scaleFilter) < 0) {
+            LOG_WARN("打开多码率输出失败，已跳过: " + config.url);
+            continue;
+        }
+        RenditionEncoder* source = nullptr;
+        for (auto iter = renditions.rbegin(); iter != renditions.rend(); ++iter) {
+            RenditionEncoder* candidate = iter->get();
+            if (candidate->GetWidth() >= config.width && candidate->GetHeight() >= config.height
+                && is_same_aspect(candidate->GetWidth(), candidate->GetHeight(), config.width, config.height)) {
+                source = candidate;
+                break;
+            }
+        }
+        if (source) {
+            source->AddNext(rendition.get());
+        }
+        LOG_INFO("多码率输出: " + to_string(config.width) + "x" + to_string(config.height) + "，码率" + to_string(rendition->GetBitRate())
+            + "，由" + (source ? to_string(source->GetWidth()) + "x" + to_string(source->GetHeight()) : string("主画面"))
+            + "缩放，输出: " + config.url);
+        lock_guard<mutex> lock(outputMutex);
+        if (!source) {
+            renditionRoots.push_back(rendition.get());
+        }
+        renditions.push_back(move(rendition));
+    }
+}
+
 void AudioVideoProcModule::CloseOutPut() {
+    //先让各输出端写完队列中的包并写入文件尾，再释放编码器；写文件尾可能较慢，移出容器后在锁外关闭
+    vector<unique_ptr<OutputSink>> closingSinks;
+    vector<unique_ptr<RenditionEncoder>> closingRenditions;
+    {
+        lock_guard<mutex> lock(outputMutex);
+        closingSinks.swap(outputSinks);
+        closingRenditions.swap(renditions);
+        renditionRoots.clear();
+    }
+    if (!closingSinks.empty()) {
+        LOG_INFO("回收输出端");
+        closingSinks.clear();
+    }
+    if (!closingRenditions.empty()) {
+        LOG_INFO("回收多码率输出");
+        closingRenditions.clear();
+    }
+    //等待正在进行的回放保存取完包并复制完编码器参数
+    lock_guard<mutex> lock(replayMutex);
+    shared_ptr<ReplayBuffer> closingReplay = atomic_exchange(&replayBuffer, shared_ptr<ReplayBuffer>());
+    if (closingReplay) {
+        LOG_INFO("回收回放缓冲区，占用" + to_string(closingReplay->GetBytes() / 1024) + "KB");
+        closingReplay.reset();
+    }
     if (pCodecEncodeCtx_Video)
     {
         LOG_INFO("释放视频编码器");
@@ -2146,29 +3107,22 @@ void AudioVideoProcModule::CloseOutPut() {
     //编码器描述符不需要分配，所以不必释放，直接nullptr
     pCodecEncode_Video = nullptr;
     pCodecEncode_Audio = nullptr;
-    //回收输出上下文，结束录制
-    //同时此处av_write_trailer和avformat_free_context也已经做到将流回收
-    if (pFormatCtxOut) {
-        LOG_INFO("回收输出上下文");
-        if (pFormatCtxOut->pb) {
-            av_write_trailer(pFormatCtxOut);
-            avio_close(pFormatCtxOut->pb);
-        }
-        avformat_free_context(pFormatCtxOut);
-        pFormatCtxOut = nullptr;
-        pStream_Video = nullptr;
-        pStream_Audio = nullptr;
-    }
-    //如果没有录制的情况下申请了，那么这样子释放
-    if (pStream_Video) {
-        LOG_INFO("释放视频流");
-        av_freep(&pStream_Video);
-        pStream_Video = nullptr;
-    }
-    if (pStream_Audio) {
-        LOG_INFO("释放音频流");
-        av_freep(&pStream_Audio);
-        pStream_Audio = nullptr;
+}
+
+void AudioVideoProcModule::WritePacket(const AVPacket* Packet, bool IsVideo) {
+    //每个输出端只增加包的引用并放入自己的队列，由各自的写入线程写出
+    for (unique_ptr<OutputSink>& sink : outputSinks) {
+        sink->Push(Packet, IsVideo);
+    }
+    shared_ptr<ReplayBuffer> replay = atomic_load(&replayBuffer);
+    if (replay) {
+        replay->Push(Packet, IsVideo);
+    }
+    if (!IsVideo) {
+        // 多码率输出共用同一路音频编码，视频包由各档自己的编码器产生
+        for (unique_ptr<RenditionEncoder>& rendition : renditions) {
+            rendition->PushAudio(Packet);
+        }
     }
 }
 int AudioVideoProcModule::InitSwrInner() {
@@ -2228,6 +3182,8 @@ int AudioVideoProcModule::InitSwrInner() {
         LOG_ERROR("InitSwrInner: swr_alloc_set_opts 失败。");
         return -1;
     }
+    // 采样率相同时也启用重采样，漂移补偿需要它，否则第一次补偿时会重新初始化并丢掉缓存的样本
+    av_opt_set_int(pSwrCtx_Inner, "flags", SWR_FLAG_RESAMPLE, 0);
     
     int ret = swr_init(pSwrCtx_Inner);
     if (ret < 0) {
@@ -2243,14 +3199,10 @@ void AudioVideoProcModule::UnInitSwrInner() { if(pSwrCtx_Inner) swr_free(&pSwrCt
 int AudioVideoProcModule::InitSwrMic() {
     UnInitSwrMic();
     
-    // --- 关键修改：我们不再信任任何从管道探测到的参数 ---
-    // 因为我们自己通过 arecord 启动了进程，我们100%知道输入的音频参数是什么。
-    
-    // 输入参数 (来自我们启动的 arecord 命令)
-    // command: arecord -f S16_LE -r 48000 -c 2 -D hw:0,0
-    int64_t in_ch_layout = AV_CH_LAYOUT_STEREO;         // 对应 -c 2 (立体声)
-    AVSampleFormat in_sample_fmt = AV_SAMPLE_FMT_S16;   // 对应 -f S16_LE (16位有符号小端整数)
-    int in_sample_rate = 48000;                         // 对应 -r 48000 (采样率)
+    // 输入参数 (MicCapture通过ALSA插件转换后固定输出的格式)
+    int64_t in_ch_layout = AV_CH_LAYOUT_STEREO;         // 立体声
+    AVSampleFormat in_sample_fmt = AV_SAMPLE_FMT_S16;   // 16位有符号小端整数，交错
+    int in_sample_rate = MicCapture::SAMPLE_RATE;       // 采样率
 
     // 输出参数 (送往AAC编码器)
     int64_t out_ch_layout = pCodecEncodeCtx_Audio->channel_layout;
@@ -2287,6 +3239,16 @@ void AudioVideoProcModule::UnInitSwrMic() { if(pSwrCtx_Mic) swr_free(&pSwrCtx_Mi
 int AudioVideoProcModule::InitFilter()
 {
     UnInitFilter();
+    mixCostUs = 0;
+    mixSamples = 0;
+    // 未自定义混音滤波且编码器使用平面浮点格式时不需要滤镜图
+    isNativeMix = (mixFilterString.empty() || mixFilterString == DEFAULT_MIX_FILTER)
+        && AV_SAMPLE_FMT_FLTP == pCodecEncodeCtx_Audio->sample_fmt;
+    if (isNativeMix) {
+        audioMixer.SetWeights(mixWeightInner, mixWeightMic);
+        LOG_INFO("使用内置混音，权重:" + to_string(mixWeightInner) + " " + to_string(mixWeightMic));
+        return 0;
+    }
     const char* filter_desc = mixFilterString.c_str();
     LOG_INFO("混音滤波字符串为:" + mixFilterString);
     int ret = 0;
@@ -2524,65 +3486,105 @@ int AudioVideoProcModule::InitFifo() {
     if (!(isRecordInner || isRecordMic)) {
         return 0;
     }
-    // 2) 保护性检查：输出上下文和音频流必须存在且可用
-    if (!pFormatCtxOut || streamIndex_Audio < 0 ||
-        streamIndex_Audio >= (int)pFormatCtxOut->nb_streams ||
-        !pFormatCtxOut->streams[streamIndex_Audio]) {
-        LOG_ERROR("InitFifo: 音频流无效或不存在。");
+    // 2) 保护性检查：音频编码器必须存在且已打开
+    if (!pCodecEncodeCtx_Audio || !avcodec_is_open(pCodecEncodeCtx_Audio)) {
+        LOG_ERROR("InitFifo: 音频编码器无效或不存在。");
         return AVERROR(EINVAL);
     }
 
-    int iRet = -1;
     UnInitFifo();
-    do {
-        AVStream* astream = pFormatCtxOut->streams[streamIndex_Audio];
-        int fmt = astream->codecpar->format;
-        int ch  = astream->codecpar->channels;
-
-        pAudioFifo_Inner = av_audio_fifo_alloc((AVSampleFormat)fmt, ch, 3000 * AUDIO_FRAME_SIZE);
-        if (!pAudioFifo_Inner) { LOG_ERROR("装载音频缓冲区失败"); break; }
-
-        pAudioFifo_Mic = av_audio_fifo_alloc((AVSampleFormat)fmt, ch, 3000 * AUDIO_FRAME_SIZE);
-        if (!pAudioFifo_Mic) { LOG_ERROR("装载麦克风缓冲区失败"); break; }
+    {
+        AVSampleFormat fmt = pCodecEncodeCtx_Audio->sample_fmt;
+        int ch = pCodecEncodeCtx_Audio->channels;
+        int isPlanar = av_sample_fmt_is_planar(fmt);
+        int planes = isPlanar ? ch : 1;
+        int sampleBytes = av_get_bytes_per_sample(fmt) * (isPlanar ? 1 : ch);
+        // 容量按延迟预算计算，至少能放下几帧以免正常的调度抖动就溢出
+        int capacity = max((int)((long long)audioLatencyBudgetMs * pCodecEncodeCtx_Audio->sample_rate / 1000), 4 * AUDIO_FRAME_SIZE);
+
+        lock_guard<mutex> lock(audioRingMutex);
+        audioRing_Inner.reset(new SampleRing(planes, sampleBytes, capacity));
+        audioRing_Mic.reset(new SampleRing(planes, sampleBytes, capacity));
+        audioRing_MicFilter.reset(new SampleRing(planes, sampleBytes, capacity));
+        audioRing_Mix.reset(new SampleRing(planes, sampleBytes, capacity));
+        for (SampleRing* ring : { audioRing_Inner.get(), audioRing_Mic.get(), audioRing_MicFilter.get(), audioRing_Mix.get() }) {
+            ring->SetTrimOnFull(0 == audioOverflowPolicy);
+        }
+        audioRingSampleRate = pCodecEncodeCtx_Audio->sample_rate;
+        LOG_INFO("音频缓冲区容量:" + to_string(capacity) + "个样本(" + to_string(audioLatencyBudgetMs) + "ms)，溢出策略:" + to_string(audioOverflowPolicy));
+    }
+    return 0;
+}
 
-        pAudioFifo_Mic_Filter = av_audio_fifo_alloc((AVSampleFormat)fmt, ch, 3000 * AUDIO_FRAME_SIZE);
-        if (!pAudioFifo_Mic_Filter) { LOG_ERROR("装载麦克风过滤缓冲区失败"); break; }
+void AudioVideoProcModule::UnInitFifo() {
+    unique_ptr<SampleRing>* rings[] = { &audioRing_Inner, &audioRing_Mic, &audioRing_MicFilter, &audioRing_Mix };
+    const char* ringNames[] = { "扬声器", "麦克风", "麦克风过滤", "混音" };
+    lock_guard<mutex> lock(audioRingMutex);
+    audioRingSampleRate = 0;
+    for (int i = 0; i < 4; i++) {
+        if (*rings[i]) {
+            LOG_INFO("正在卸载" + string(ringNames[i]) + "缓冲区，最大积压样本数:" + to_string((*rings[i])->GetHighWater())
+                + "，溢出丢弃样本数:" + to_string((*rings[i])->GetDropSamples()));
+            rings[i]->reset();
+        }
+    }
+}
 
-        pAudioFifo_Mix = av_audio_fifo_alloc((AVSampleFormat)fmt, ch, 3000 * AUDIO_FRAME_SIZE);
-        if (!pAudioFifo_Mix) { LOG_ERROR("装载混音缓冲区失败"); break; }
+int AudioVideoProcModule::WriteAudioRing(SampleRing& Ring, const AVFrame* Frame) {
+    int written = Ring.Write(Frame->data, Frame->nb_samples);
+    if (written < Frame->nb_samples && 2 == audioOverflowPolicy && audioErr) {
+        // 消费线程卡住时每次写入都会溢出，每秒最多报告一次
+        long long nowUs = steady_now_us();
+        if (nowUs - audioOverflowErrUs >= 1000000) {
+            audioOverflowErrUs = nowUs;
+            LOG_WARN("音频缓冲区溢出，丢弃样本数:" + to_string(Frame->nb_samples - written));
+            audioErr(5);
+        }
+    }
+    return Ring.Size();
+}
 
-        iRet = 0;
-    } while (0);
+const SampleRing* AudioVideoProcModule::GetAudioRing(int FifoIndex) const {
+    switch (FifoIndex) {
+    case 0: return audioRing_Inner.get();
+    case 1: return audioRing_Mic.get();
+    case 2: return audioRing_MicFilter.get();
+    case 3: return audioRing_Mix.get();
+    }
+    return nullptr;
+}
 
-    if (iRet != 0) UnInitFifo();
-    return iRet;
+void AudioVideoProcModule::NotifyRecordState() {
+    // 状态变化时唤醒所有等待中的音频线程，使其立即检查新状态
+    recordStateEvent.Notify();
+    filterMicEvent.Notify();
+    mixEvent.Notify();
+    writeAudioEvent.Notify();
 }
 
-void AudioVideoProcModule::UnInitFifo() {
-    if (pAudioFifo_Inner) {
-        LOG_INFO("正在卸载扬声器缓冲区");
-        av_audio_fifo_drain(pAudioFifo_Inner, av_audio_fifo_size(pAudioFifo_Inner));
-        av_audio_fifo_free(pAudioFifo_Inner);
-        pAudioFifo_Inner = nullptr;
-    }
-    if (pAudioFifo_Mic) {
-        LOG_INFO("正在卸载麦克风缓冲区");
-        av_audio_fifo_drain(pAudioFifo_Mic, av_audio_fifo_size(pAudioFifo_Mic));
-        av_audio_fifo_free(pAudioFifo_Mic);
-        pAudioFifo_Mic = nullptr;
-    }
-    if (pAudioFifo_Mic_Filter) {
-        LOG_INFO("正在卸载麦克风过滤缓冲区");
-        av_audio_fifo_drain(pAudioFifo_Mic_Filter, av_audio_fifo_size(pAudioFifo_Mic_Filter));
-        av_audio_fifo_free(pAudioFifo_Mic_Filter);
-        pAudioFifo_Mic_Filter = nullptr;
-    }
-    if (pAudioFifo_Mix) {
-        LOG_INFO("正在卸载混音缓冲区");
-        av_audio_fifo_drain(pAudioFifo_Mix, av_audio_fifo_size(pAudioFifo_Mix));
-        av_audio_fifo_free(pAudioFifo_Mix);
-        pAudioFifo_Mix = nullptr;
+long long AudioVideoProcModule::UpdateAudioLatency(int FrameSamples) {
+    // 刚读出的一帧是最早的样本，其后排队的样本越多、距最近一次采集越久，它等待得越久
+    int sampleRate = pCodecEncodeCtx_Audio->sample_rate;
+    long long nowUs = steady_now_us();
+    long long mixQueued = audioRing_Mix->Size() + FrameSamples;
+    long long latencyUs = 0;
+    if (isRecordInner && innerCapUs > 0) {
+        long long queued = mixQueued + audioRing_Inner->Size();
+        latencyUs = max(latencyUs, nowUs - innerCapUs + queued * 1000000 / sampleRate);
+    }
+    if (isRecordMic && micCapUs > 0) {
+        long long queued = mixQueued + audioRing_Mic->Size() + audioRing_MicFilter->Size();
+        latencyUs = max(latencyUs, nowUs - micCapUs + queued * 1000000 / sampleRate);
+    }
+    if (latencyUs <= 0) {
+        return 0;
+    }
+    int avg = audioLatencyUs;
+    audioLatencyUs = (avg == 0) ? (int)latencyUs : avg + ((int)latencyUs - avg) / 16;
+    if (latencyUs > audioMaxLatencyUs) {
+        audioMaxLatencyUs = (int)latencyUs;
     }
+    return latencyUs;
 }
 
 //=========================================次要辅助函数=========================================//
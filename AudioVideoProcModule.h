@@ -8,10 +8,14 @@
 #include <memory>
 #include <thread>
 #include <mutex>
+#include <atomic>
 // --- ޸Ŀʼ ---
 // ʹñ׼ͷļ <cstdint> ȷͶͳһ׼ȷ
 #include <cstdint>
 // --- ޸Ľ ---
+#include "SignalEvent.h"
+#include "AudioMixer.h"
+#include "AvSyncClock.h"
 
 // ΪFFmpegOpenCVṩǰͷļ
 struct AVFormatContext;
@@ -21,8 +25,16 @@ struct AVStream;
 struct AVFilterGraph;
 struct AVFilterContext;
 struct SwrContext;
-struct AVAudioFifo;
 namespace cv { class Mat; }
+class VideoSource;
+class OutputSink;
+class RenditionEncoder;
+class ReplayBuffer;
+class MicCapture;
+class SampleRing;
+class FrameQueue;
+struct AVPacket;
+struct AVFrame;
 
 // --- ޸Ŀʼ ---
 // ͳһʹ <cstdint> еı׼
@@ -64,23 +76,13 @@ private:
     // ȷƵһ֡I֡ı־λ
     bool first_frame_sent = false;
 
-    // Ƶʱһı
-    int64_t video_first_dts = -1; 
-    int64_t audio_first_dts = -1;
-    
     // ȷʱı
     int64_t last_video_pts = -1;
     int64_t last_audio_pts = -1;
 
     // --- ޸Ľ ---
-    std::mutex video_pts_mutex;
-    std::mutex audio_pts_mutex;
+    AvSyncClock syncClock;              //ƵƯƲ
     
-    #ifdef __linux__
-    pid_t mic_arecord_pid = -1; // ڴ洢 arecord ӽ̵ID
-    // ʹ FILE* ָ popen صĹܵ
-    //FILE* mic_pipe_handle = nullptr; 
-    #endif
     bool isInit{};				        //ģѾأ
     volatile bool isRecordVideo{};		//Ƿ¼Ƶ
     volatile bool isRecordInner{};		//Ƿ¼
@@ -97,13 +99,24 @@ private:
     int nbSample{};                         //Ƶ
     std::string mixFilterString;                 //˲ַ
     std::string micFilterString;                 //˷˲ַ
-    std::list<int> frameAppendHistory;           //ʷ֡
+    std::list<int> frameAppendHistory;           //ʷ֡(ʵʱظ֡)ֻƵ̷߳
+    std::list<int> frameSkipHistory;             //ʷظֻ֡Ƶ̷߳
+    int frameAppendSum{ 0 };                     //frameAppendHistory֮ͣɾ
+    int frameSkipSum{ 0 };                       //frameSkipHistory֮ͣɾ
+    std::atomic<int> frameAppendAvg{ 0 };        //ʷ֡ƽֵӿ̶߳ȡ
+    std::atomic<int> frameSkipAvg{ 0 };          //ʷظ֡ƽֵӿ̶߳ȡ
+    int appendFramePolicy{ 0 };                  //֡ʽ0ظ֡(ɱ֡) 1ظ֡(㶨֡)
+    std::atomic<long long> videoEncodeUs{ 0 };   //¼Ƶܺʱ(΢)
+    std::atomic<long long> duplicateEncodeUs{ 0 };//лظ֡ϵĺʱ(΢)
+    ULONGLONG appendSkipFrame{};                 //¼ظ֡
+    ULONGLONG appendEncodeFrame{};               //¼Ʊظ֡
     volatile char isCanCap{};               //Ƿ׼¼
     volatile RecordType recordType{};       //¼״̬
     VideoCapErrCallBack videoCapErr{};      //ͷص
     AudioErrCallBack audioErr{};            //Ƶ豸ص
     std::unique_ptr<std::thread> recordThread{};	            //¼߳
     std::unique_ptr<std::thread> recordThread_Video{};	    //¼Ƶ߳
+    std::unique_ptr<std::thread> recordThread_VideoEncode{};	//¼Ƶ֮߳
     std::unique_ptr<std::thread> recordThread_CapInner{};	    //¼Ƶ֮ɼ߳
     std::unique_ptr<std::thread> recordThread_CapMic{};	    //¼˷֮ɼ߳
     std::unique_ptr<std::thread> recordThread_FilterMic{};	//¼˷֮߳
@@ -130,31 +143,47 @@ private:
     int screenW{};              //Ļڿʼ¼ǰԤ׼ʼ
     int screenH{};              //Ļߣڿʼ¼ǰԤ׼ʼ
 
-    AVFormatContext* pFormatCtxOut{};        //ļ
     AVCodec* pCodecEncode_Video{};            //Ƶ
     AVCodec* pCodecEncode_Audio{};            //Ƶ
     AVCodecContext* pCodecEncodeCtx_Video{};  //Ƶ
     AVCodecContext* pCodecEncodeCtx_Audio{};  //Ƶ
-    AVStream* pStream_Audio{};
-    AVStream* pStream_Video{};
-    int streamIndex_Video{};    //
-    int streamIndex_Audio{};    //
+    std::vector<std::unique_ptr<OutputSink>> outputSinks;  //ˣͬһͬʱд
+    //outputSinksrenditions¼߳ɾӿ̶߳ȡͳʱдֻ߳ڴ򿪺󡢹رǰʣ
+    mutable std::mutex outputMutex;
+    std::vector<std::string> extraOutputUrls{};             //¼ļַ֮ĸ
+    int outputQueueSize{ 256 };                             //ÿ˵İޣʼ
+    int segmentSeconds{ 0 };                                //¼ļÿʱ()segmentMaxMBΪ0ʱֶ
+    int segmentMaxMB{ 0 };                                  //¼ļÿδС(MB)
+    std::shared_ptr<ReplayBuffer> replayBuffer;             //ʱطŻδʱΪգͨatomic_load/atomic_store
+    int replaySeconds{ 0 };                                 //طŻʱ()0ʾ
+    int replayMaxMB{ 256 };                                 //طŻڴ(MB)
+    std::mutex replayMutex;                                 //طȡƱڼ䲻ͷŻؿ
+    std::atomic<int> replaySaveUs{ 0 };                     //һαطŵĺʱ(΢)
+
+    //һ
+    struct RenditionConfig
+    {
+        int width;
+        int height;
+        int bitRate;            //0Ϊ
+        std::string url;
+    };
+    std::vector<RenditionConfig> renditionConfigs;          //ã´οʼ¼ʱЧ
+    std::vector<std::unique_ptr<RenditionEncoder>> renditions;  //¼ƴ򿪵ĶӴС
+    std::vector<RenditionEncoder*> renditionRoots;          //ŵĵλƵ߳֡൵λԴ֡
     
     // ʹFFmpeg滻WindowsƵӿ
     AVFormatContext* pFormatCtxIn_Inner{};
     AVCodecContext* pCodecDecodeCtx_Inner{};
     int streamIndexIn_Inner = -1;
-    AVFormatContext* pFormatCtxIn_Mic{};
-    AVCodecContext* pCodecDecodeCtx_Mic{};
-    int streamIndexIn_Mic = -1;
+    //˷ɼֱӶȡALSA豸ָ뱾micMutex_pthread
+    //ɼ̳߳ȡúȡ豸һùر
+    std::shared_ptr<MicCapture> micCapture;
+    std::atomic<int> micOpenUs{ 0 };            //һδ˷ĺʱ(΢)
+    std::atomic<int> micCloseUs{ 0 };           //һιر˷ĺʱ(΢)
 
     //ٽ (ʹpthread_mutex_t滻CRITICAL_SECTION)
     pthread_mutex_t csVideo{};
-    pthread_mutex_t csInner{};
-    pthread_mutex_t csMic{};
-    pthread_mutex_t csMicFilter{};
-    pthread_mutex_t csMix{};
-    pthread_mutex_t csWrite{};
 
     AVFilterGraph* pFilterGraph{};
     AVFilterContext* pFilterCtxSrc_Inner{};
@@ -167,10 +196,55 @@ private:
 
     SwrContext* pSwrCtx_Inner{};            //Ƶز
     SwrContext* pSwrCtx_Mic{};              //˷ز
-    AVAudioFifo* pAudioFifo_Inner{};        //Ƶ
-    AVAudioFifo* pAudioFifo_Mic{};          //Ƶ
-    AVAudioFifo* pAudioFifo_Mic_Filter{};   //Ƶ
-    AVAudioFifo* pAudioFifo_Mix{};          //Ƶ
+    //Ƶÿֻһд̺߳һȡ̣߳
+    std::unique_ptr<SampleRing> audioRing_Inner;        //ɼ -> 
+    std::unique_ptr<SampleRing> audioRing_Mic;          //˷ɼ -> 
+    std::unique_ptr<SampleRing> audioRing_MicFilter;    // -> 
+    std::unique_ptr<SampleRing> audioRing_Mix;          // -> 
+    //ĸָ뱾audioRingSampleRateInitFifo/UnInitFifoؽӿ̶߳ȡѹʱƵֻ֮߳ʣ
+    mutable std::mutex audioRingMutex;
+    int audioRingSampleRate{ 0 };                       //ƵĲʣڰΪʱ(ѹʱ)
+    AudioMixer audioMixer;                              //Ĭϻʽʹõû
+    bool isNativeMix{ false };                          //¼Ƿʹû˾ͼ
+    float mixWeightInner{ 0.5f };                       //ûȨ
+    float mixWeightMic{ 2.0f };                         //û˷Ȩ
+    std::atomic<long long> mixCostUs{ 0 };              //·ۼƺʱ(΢)
+    std::atomic<long long> mixSamples{ 0 };             //·ۼ
+    int audioLatencyBudgetMs{ 1000 };                   //ÿƵ()
+    int audioOverflowPolicy{ 0 };                       //ƵдʱĴʽSetAudioOverflowPolicy
+
+    //Ƶɼ֮߳߳֡У¼ڼЧ
+    std::unique_ptr<FrameQueue> videoFrameQueue;
+    int videoQueueFrames{ 3 };                          //֡
+    int videoQueuePolicy{ 0 };                          //֡ʱĴʽSetVideoFrameQueue
+    std::atomic<int> videoCaptureUs{ 0 };               //ӿʼɼӵĺʱ(΢)ƽ
+    std::atomic<int> videoQueueUs{ 0 };                 //֡ڶеȴʱ(΢)ƽ
+    std::atomic<int> videoEncodeFrameUs{ 0 };           //ÿ֡дĺʱ(΢)ƽ
+    std::atomic<int> videoLatencyUs{ 0 };               //ӿʼɼдʱ(΢)ƽ
+    std::atomic<int> videoQueueDropNum{ 0 };            //֡֡
+
+    //ӦʣƵ̸߳˵ӵ
+    std::atomic<int> abrMinBitRate{ 0 };                //ޣ0Ϊ
+    std::atomic<int> abrMaxBitRate{ 0 };                //
+    std::atomic<int> abrBitRate{ 0 };                   //ǰʣδʱΪ0
+    std::atomic<int> abrFrameDivisor{ 1 };              //֡ʳ1Ϊȫ֡
+    std::atomic<int> abrDownNum{ 0 };                   //¼ƽʻ֡ʵĴ
+    std::atomic<int> abrUpNum{ 0 };                     //¼ʻָ֡ʵĴ
+    std::atomic<int> abrSkipFrame{ 0 };                 //֡δ֡
+    std::atomic<long long> audioOverflowErrUs{ 0 };     //һͨaudioErrʱ(steady_clock΢)
+
+    //Ƶˮ¼д󻺳һ֡ʱ
+    SignalEvent recordStateEvent;           //¼״̬仯(ʼֹͣͣ)
+    SignalEvent filterMicEvent;             //˷绺һ֡ѽ߳
+    SignalEvent mixEvent;                   //󻺳һ֡ѻ߳
+    SignalEvent writeAudioEvent;            //һ֡Ƶ߳
+    SignalEvent micClosedEvent;             //˷豸رղͷţUnInitAudioMic
+    std::atomic<long long> innerCapUs{ 0 }; //һдʱ(steady_clock΢)
+    std::atomic<long long> micCapUs{ 0 };   //һд˷绺ʱ(steady_clock΢)
+    std::atomic<long long> audioStartUs{ 0 };           //Ƶ߳̿ʼʱ(steady_clock΢)
+    std::atomic<int> audioLatencyUs{ 0 };               //ɼӳٻƽֵ(΢)
+    std::atomic<int> audioMaxLatencyUs{ 0 };            //ɼӳ(΢)
+    std::atomic<unsigned long long> audioIdleWakeNum{ 0 };  //Ƶ߳ݿɴĴ
 
     //д֡
     ULONGLONG allVideoFrame{};
@@ -186,6 +260,30 @@ private:
     cv::Mat mFixImgMat;
     std::mutex mFixImgDataMutex; //¼ƻ
 
+    //ƵԴStartThreadPreжģ¼ƽͷţֻ߳ͨstd::atomic_loadȡ
+    std::shared_ptr<VideoSource> videoSource;
+    bool isDesktopDamage{ true };           //ɼǷXDamageδ仯֡
+    ULONGLONG damageSkipFrame{};            //ޱ仯ת֡
+    ULONGLONG damagePartialFrame{};         //ֻת˱仯֡
+    int scaleFilter{};                      //˲ʽFrameConverter::ScaleFilter
+    int pixelFormatMode{ 0 };               //ڲظʽ 0ԶЭ 1 I420 2 NV12SetPixelFormatMode
+    std::atomic<int> videoPixFmt{ 0 };      //¼Э̳ظʽ(AVPixelFormat)ɼϳ붼ʹ
+    std::atomic<int> pipComposeUs{ 0 };     //лÿ֡ϳɺʱĻƽֵ(΢)
+    std::atomic<int> pipComposeMaxUs{ 0 };  //лϳɺʱֵ(΢)
+
+    //ӲãƵ߳ڰ汾仯ʱȡ߲դ
+    std::mutex overlayMutex;
+    int overlayTimestampLocation{ 0 };      //ʱλã0ʾ[1-4]Ͻǿʼ˳ʱ
+    int overlayTimestampHeight{ 0 };        //ʱָ()0Զ
+    cv::Mat overlayWatermark;               //ˮӡͼʱ
+    int overlayWatermarkLocation{ 0 };
+    int overlayWatermarkOpacity{ 100 };
+    int overlayWatermarkWidthPercent{ 15 };
+    bool isOverlayCursor{ false };          //Ƿָ
+    std::atomic<int> overlayVersion{ 0 };
+    std::atomic<int> overlayRenderUs{ 0 };  //Ӳÿ֡ʱĻƽֵ(΢)
+    std::atomic<int> overlayAreaPixels{ 0 };//Ӳһ֡ϵ
+
 public:
     /// <summary>
     /// װģԳʼ
@@ -326,6 +424,19 @@ public:
     /// <returns></returns>
     bool IsAcceptAppendFrame()const;
     /// <summary>
+    /// ò֡ʽ0ظ֡(Ĭϣɱ֡ʣʱֻһ֡) 1ظ֡(㶨֡)
+    /// </summary>
+    void SetAppendFramePolicy(int Policy);
+    int GetAppendFramePolicy()const;
+    /// <summary>
+    /// ȡ30β֡ƽظ֡
+    /// </summary>
+    int GetFrameSkipNum();
+    /// <summary>
+    /// ȡ¼бظ֡ܺʱ()
+    /// </summary>
+    int GetDuplicateEncodeMs()const;
+    /// <summary>
     /// Ƿ¼/
     /// </summary>
     /// <returns>һStartRecordܹǷѾ¼Ĳֵ</returns>
@@ -434,6 +545,14 @@ public:
     /// </summary>
     std::string GetMixFilter()const;
     /// <summary>
+    /// û·ȨأȨ֮͹һ´οʼ¼ʱЧ
+    /// </summary>
+    void SetMixWeights(float InnerWeight, float MicWeight);
+    /// <summary>
+    /// ȡ·ÿһƵ΢
+    /// </summary>
+    int GetMixCostUs()const;
+    /// <summary>
     /// ˷紦˲ַ
     /// </summary>
     void SetMicFilter(const std::string& MicFilterString);
@@ -442,7 +561,7 @@ public:
     /// </summary>
     std::string GetMicFilter()const;
     /// <summary>
-    /// ȡ30βɼڵƽ֡
+    /// ȡ30β֡ƽʵʱظ֡ظ֡ʱΪ0
     /// </summary>
     int GetFrameAppendNum();
     /// <summary>
@@ -462,6 +581,75 @@ public:
     /// </summary>
     bool SetMicPattern(const int& MicPattern, const int& MicNum = 0);
     /// <summary>
+    /// ȡһδ˷豸ĺʱ(΢)
+    /// </summary>
+    int GetMicOpenUs()const;
+    /// <summary>
+    /// ȡһιر˷豸ĺʱ(΢)
+    /// </summary>
+    int GetMicCloseUs()const;
+    /// <summary>
+    /// ȡƵӲɼӳٻƽֵ(΢)Ŷɼʱ̹
+    /// </summary>
+    int GetAudioLatencyUs()const;
+    /// <summary>
+    /// ȡƵӲɼӳ(΢)
+    /// </summary>
+    int GetAudioMaxLatencyUs()const;
+    /// <summary>
+    /// ȡƵ߳ÿݿɴĴ
+    /// </summary>
+    int GetAudioIdleWakeups()const;
+    /// <summary>
+    /// ÿƵ()߳̿סʱѹõƵ´οʼ¼ʱЧ
+    /// </summary>
+    void SetAudioLatencyBudget(int BudgetMs);
+    int GetAudioLatencyBudget()const;
+    /// <summary>
+    /// ƵдʱĴʽ 0ݣָ̻߳ȡʱٶѹֻ 1 2ݲͨƵ쳣ص5
+    /// </summary>
+    void SetAudioOverflowPolicy(int Policy);
+    int GetAudioOverflowPolicy()const;
+    /// <summary>
+    /// Ƶɼ֮֡УFramesΪ[1,30]PolicyΪʱĴʽ
+    /// 0ɵ֡ 1֡ 2ɼ̵߳ȴ´οʼ¼ʱЧ
+    /// </summary>
+    void SetVideoFrameQueue(int Frames, int Policy);
+    void GetVideoFrameQueue(int& Frames, int& Policy)const;
+    /// <summary>
+    /// ȡƵ׶εƽʱ(΢)ɼŶӡ롢ɼдԼ֡
+    /// </summary>
+    void GetVideoStageLatency(int& CaptureUs, int& QueueUs, int& EncodeUs, int& TotalUs, int& DropNum)const;
+    /// <summary>
+    /// ӦʷΧMaxBitRateΪ0ʱ(̶)´οʼ¼ʱЧ
+    /// Ŷӻѹдʱʣӵʱ֡ʣͨ𲽻ָ
+    /// </summary>
+    void SetAdaptiveBitRate(int MinBitRate, int MaxBitRate);
+    /// <summary>
+    /// ȡӦʵ״̬
+    /// </summary>
+    void GetAdaptiveBitRate(int& MinBitRate, int& MaxBitRate, int& CurBitRate, int& FrameDivisor, int& DownNum, int& UpNum, int& SkipFrame)const;
+    /// <summary>
+    /// ȡƵǰĻѹ()FifoIndex 0 1˷ 2˷罵 3δ¼ʱΪ0
+    /// </summary>
+    int GetAudioFifoFillMs(int FifoIndex)const;
+    /// <summary>
+    /// ȡ¼Ƶֹѹ()FifoIndexͬGetAudioFifoFillMs
+    /// </summary>
+    int GetAudioFifoHighWaterMs(int FifoIndex)const;
+    /// <summary>
+    /// ȡƫĻƽֵ(΢)Ƶʱȥɼʱ̣ʾȻ
+    /// </summary>
+    int GetAvSyncOffsetUs()const;
+    /// <summary>
+    /// ȡ¼ƫֵֵ(΢)
+    /// </summary>
+    int GetAvSyncMaxOffsetUs()const;
+    /// <summary>
+    /// ȡƵʱƯ(֮һ)Source 0 1˷
+    /// </summary>
+    int GetAudioDriftPpm(int Source)const;
+    /// <summary>
     /// ¼XYWH
     /// </summary>
     void SetRecordXYWH(const int& X, const int& Y, const int& Width, const int& Height);
@@ -485,6 +673,177 @@ public:
     /// ¼ʱ˷ݻص
     /// </summary>
     void SetMicRecorderCallBack(void (*dataCallBack)(unsigned char* dataBuf, UINT32 numFramesToRead));
+    /// <summary>
+    /// ȡɼÿ֡ץȡʱĻƽֵ(΢)δڲɼʱ-1
+    /// </summary>
+    int GetDesktopGrabLatency()const;
+    /// <summary>
+    /// ɼǷXDamageֻ仯´οʼ¼ʱЧ
+    /// </summary>
+    void SetDesktopDamage(bool IsDesktopDamage);
+    bool IsDesktopDamage()const;
+    /// <summary>
+    /// ȡ¼ޱ仯ץȡת֡
+    /// </summary>
+    int GetDamageSkipFrameNum()const;
+    /// <summary>
+    /// ȡ¼ֻץȡת˱仯֡
+    /// </summary>
+    int GetDamagePartialFrameNum()const;
+    /// <summary>
+    /// ûŵ˲ʽ 0 1ˮƽ 2˫ 3ʽ
+    /// </summary>
+    void SetScaleFilter(int ScaleFilter);
+    int GetScaleFilter()const;
+    /// <summary>
+    /// ȡת()ÿ֡ʱĻƽֵ(΢)зֵδ¼ʱfalse
+    /// </summary>
+    bool GetVideoConvertLatency(int& ConvertUs, int& SliceNum)const;
+    /// <summary>
+    /// ôӲɼϳɵʹõظʽ 0Զ(Ĭ) 1 I420 2 NV12´οʼ¼ʱЧ
+    /// Զʱͷԭʼݶ֧NV12ʹNV12ʹI420ָĸʽ֧ʱԶ
+    /// </summary>
+    void SetPixelFormatMode(int Mode);
+    int GetPixelFormatMode()const;
+    /// <summary>
+    /// ȡ¼ʵʹõظʽ 1 I420 2 NV12
+    /// </summary>
+    int GetVideoPixelFormat()const;
+    /// <summary>
+    /// ȡǰƵԴĶģģ¼ͬһʱֻɼתһΣδ¼Ƶʱ0
+    /// </summary>
+    int GetVideoSourceShareNum()const;
+    /// <summary>
+    /// Ӹ(ļ·rtmpַ.tsβΪMPEG-TS)¼ļ/һα룬´οʼ¼ʱЧ
+    /// </summary>
+    void AddRecordOutput(const std::string& Url);
+    /// <summary>
+    /// ո
+    /// </summary>
+    void ClearRecordOutput();
+    /// <summary>
+    /// ȡǰдд˲
+    /// </summary>
+    int GetRecordOutputNum()const;
+    /// <summary>
+    /// һͬһ·ɼŵóߴ󵥶벢дUrl´οʼ¼ʱЧ
+    /// ʹSetRecordFixSize/¼ĳߴ磻ÿɿ߶Сҿ߱ͬСһţûʱţ
+    /// ߵĵλ߱ͬĵλᱻ첢¼
+    /// </summary>
+    /// <param name="Width">ż</param>
+    /// <param name="Height">ߣż</param>
+    /// <param name="BitRate">ʣ0Ϊ</param>
+    /// <param name="Url">ļ·ַеĵλͬʱ</param>
+    /// <returns>Чʱfalse</returns>
+    bool AddRecordRendition(int Width, int Height, int BitRate, const std::string& Url);
+    /// <summary>
+    /// ն
+    /// </summary>
+    void ClearRecordRendition();
+    /// <summary>
+    /// ȡ¼ƴ򿪵Ķ
+    /// </summary>
+    int GetRecordRenditionNum()const;
+    /// <summary>
+    /// ȡһ״̬IndexֱʴӴС
+    /// </summary>
+    /// <returns>IndexЧʱfalse</returns>
+    bool GetRenditionStats(int Index, int& Width, int& Height, int& BitRate, int& EncodeFrame, int& ScaleUs, int& EncodeUs, int& FrameDropNum, int& PacketDropNum)const;
+    /// <summary>
+    /// ÿ˵İޣƵǹؼֱ֡һؼ֡ʱƵ´οʼ¼ʱЧ
+    /// </summary>
+    void SetOutputQueueSize(int QueueSize);
+    int GetOutputQueueSize()const;
+    /// <summary>
+    /// ȡеǰŶӰֵ
+    /// </summary>
+    int GetOutputQueueDepth()const;
+    /// <summary>
+    /// ȡгֹŶӰ
+    /// </summary>
+    int GetOutputMaxQueueDepth()const;
+    /// <summary>
+    /// ȡдƽʱֵ(΢)
+    /// </summary>
+    int GetOutputWriteUs()const;
+    /// <summary>
+    /// ȡг޶İ֮
+    /// </summary>
+    int GetOutputDropNum()const;
+    /// <summary>
+    /// ¼ļֶΣÿڹؼ֡ʱСл.mp4ΪƬMP4.tsΪMPEG-TSͬm3u8
+    /// ߶Ϊ0ʱֶΣֻ¼ļЧ´οʼ¼ʱЧ
+    /// </summary>
+    void SetSegmentRecord(int Seconds, int MaxMB);
+    void GetSegmentRecord(int& Seconds, int& MaxMB)const;
+    /// <summary>
+    /// ȡֶļ·δֶ¼ƻֶβMPEG-TSʱΪ
+    /// </summary>
+    std::string GetSegmentPlaylist()const;
+    /// <summary>
+    /// ȡдķֶ
+    /// </summary>
+    int GetSegmentNum()const;
+    /// <summary>
+    /// ȡлֶʱд̺߳ʱĻƽֵ(΢)
+    /// </summary>
+    int GetSegmentRotateUs()const;
+    /// <summary>
+    /// ȡѹرļдŴ(ļС֮ȵİٷ)еֵ
+    /// </summary>
+    int GetOutputWriteAmplification()const;
+    /// <summary>
+    /// üʱطŻڴбSecondsıڴMaxMBSecondsΪ0ʱã´οʼ¼ʱЧ
+    /// ú¼ļΪգʱֻ¼ƵطŻ
+    /// </summary>
+    void SetReplayBuffer(int Seconds, int MaxMB);
+    int GetReplaySeconds()const;
+    /// <summary>
+    /// ѻطŻSeconds(Ӳڸʱ̵Ĺؼ֡ʼ)װļֹͣ¼Ҳ±
+    /// </summary>
+    bool SaveReplay(int Seconds, const std::string& Path);
+    /// <summary>
+    /// ȡطŻǰռõڴ(KB)
+    /// </summary>
+    int GetReplayMemoryKB();
+    /// <summary>
+    /// ȡطŻǰʱ()
+    /// </summary>
+    int GetReplayDurationMs();
+    /// <summary>
+    /// ȡһαطŵĺʱ(΢)
+    /// </summary>
+    int GetReplaySaveUs()const;
+    /// <summary>
+    /// ȡлÿ֡ϳɺʱĻƽֵ(΢)Ҫȡ֡ڶ߳У
+    /// </summary>
+    int GetPipComposeUs()const;
+    /// <summary>
+    /// ȡ¼ллϳɺʱֵ(΢)
+    /// </summary>
+    int GetPipComposeMaxUs()const;
+    /// <summary>
+    /// ʱӲ㣬LocationΪ0ʱʾ[1-4]Ͻǿʼ˳ʱãFontHeightΪָ()0Զ
+    /// </summary>
+    void SetOverlayTimestamp(int Location, int FontHeight);
+    /// <summary>
+    /// ˮӡӲ㣬ͼƬ(֧͸ͨ)PathΪջLocationΪ0ʱʾ
+    /// </summary>
+    /// <param name="Opacity">͸[0,100]</param>
+    /// <param name="WidthPercent">ˮӡռȵİٷֱ[1,100]</param>
+    bool SetOverlayWatermark(const std::string& Path, int Location, int Opacity, int WidthPercent);
+    /// <summary>
+    /// Ƿָ룬ֻ¼ʱЧ
+    /// </summary>
+    void SetOverlayCursor(bool IsShow);
+    /// <summary>
+    /// ȡӲÿ֡ʱĻƽֵ(΢)
+    /// </summary>
+    int GetOverlayUs()const;
+    /// <summary>
+    /// ȡӲһ֡ϵ
+    /// </summary>
+    int GetOverlayAreaPixels()const;
 
 private:
     //=========================================Ҫ=========================================//
@@ -497,6 +856,22 @@ private:
     bool StartThreadPre();
     void RecordThreadRun();
     void RecordThreadRun_Video();
+    void RecordThreadRun_VideoEncode();
+    std::shared_ptr<VideoSource> UpdateVideoSource();
+    void NegotiatePixelFormat();
+    int OpenVideoEncoder(AVCodecContext* CodecCtx);
+    /// <summary>
+    /// ´ƵĽ
+    /// </summary>
+    enum class ReopenResult
+    {
+        Applied,    //滻Ϊʴ򿪵ı
+        Busy,       //ڱطţԺ
+        Kept,       //ʴʧܣʹԭ
+    };
+    ReopenResult ReopenVideoEncoder(int64_t BitRate);
+    void OpenRenditions(const std::vector<std::string>& OutUrls);
+    bool GetPipSourceSize(int& Width, int& Height, int& OutWidth, int& OutHeight);
     void RecordThreadRun_CapInner();
     void RecordThreadRun_CapMic();
     void RecordThreadRun_FilterMic();
@@ -504,6 +879,7 @@ private:
     void RecordThreadRun_Write();
     int OpenOutPut();
     void CloseOutPut();
+    void WritePacket(const AVPacket* Packet, bool IsVideo);
     int InitSwrInner();
     void UnInitSwrInner();
     int InitSwrMic();
@@ -514,6 +890,10 @@ private:
     void UnInitFilterMic();
     int InitFifo();
     void UnInitFifo();
+    void NotifyRecordState();
+    long long UpdateAudioLatency(int FrameSamples);
+    int WriteAudioRing(SampleRing& Ring, const AVFrame* Frame);
+    const SampleRing* GetAudioRing(int FifoIndex)const;     //÷audioRingMutex
     //=========================================Ҫ=========================================//
     int find_audio_stream(AVFormatContext *fmt_ctx);
     //=========================================û=========================================//
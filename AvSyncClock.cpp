@@ -0,0 +1,146 @@
+#include "AvSyncClock.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+// 开始采集后先观察这么久，把期间的平均偏差当作固定的采集延迟，之后只修正相对它的变化
+#define SYNC_LEARN_US 3000000
+// 每隔这么久重新计算一次补偿量
+#define SYNC_ADJUST_US 1000000
+// 偏差按这么多秒的速度收敛，同时抵消持续的漂移
+#define SYNC_CORRECT_SECONDS 10
+// 每次补偿量在这么多秒的样本内生效，调整间隔比它短，补偿不会中断
+#define SYNC_DISTANCE_SECONDS 10
+// 补偿上限(百万分之一)，常见声卡的漂移远小于此，变调不可闻
+#define SYNC_MAX_PPM 1000
+
+static long long steady_now_us() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void AvSyncClock::Reset()
+{
+    lock_guard<std::mutex> lock(mutex);
+    epochUs = 0;
+    pauseUs = 0;
+    for (SourceState& source : sources) {
+        source.baseUs = -1;
+        source.samples = 0;
+        source.errUs = 0;
+        source.errBaseUs = 0;
+        source.isLearned = false;
+        source.adjustUs = 0;
+        source.compensation = 0;
+        source.driftPpm = 0;
+    }
+    offsetUs = 0;
+    maxOffsetUs = 0;
+    isOffsetInit = false;
+}
+
+void AvSyncClock::Start()
+{
+    lock_guard<std::mutex> lock(mutex);
+    long long nowUs = steady_now_us();
+    if (0 == epochUs) {
+        epochUs = nowUs;
+    } else if (pauseUs > 0) {
+        epochUs += nowUs - pauseUs;
+    }
+    pauseUs = 0;
+}
+
+void AvSyncClock::Pause()
+{
+    lock_guard<std::mutex> lock(mutex);
+    if (epochUs > 0 && 0 == pauseUs) {
+        pauseUs = steady_now_us();
+    }
+}
+
+long long AvSyncClock::NowUs() const
+{
+    return ToClockUs(steady_now_us());
+}
+
+long long AvSyncClock::ToClockUs(long long SteadyUs) const
+{
+    long long epoch = epochUs;
+    return (0 == epoch) ? 0 : SteadyUs - epoch;
+}
+
+bool AvSyncClock::UpdateSource(int Source, long long SteadyUs, int Samples, int SampleRate, int& SampleDelta, int& Distance)
+{
+    if (Source < 0 || Source >= SOURCE_NUM || Samples <= 0 || SampleRate <= 0) {
+        return false;
+    }
+    SourceState& source = sources[Source];
+    long long nowUs = ToClockUs(SteadyUs);
+    if (source.baseUs < 0) {
+        source.baseUs = nowUs - (long long)Samples * 1000000 / SampleRate;
+        source.samples = 0;
+        source.isLearned = false;
+    }
+    source.samples += Samples;
+    // 样本数对应的时长比实际经过的时长多，说明声卡比系统时钟快
+    double errUs = (double)source.samples * 1000000 / SampleRate - (double)(nowUs - source.baseUs);
+    source.errUs = (source.samples == Samples) ? errUs : source.errUs + (errUs - source.errUs) / 64;
+
+    if (!source.isLearned) {
+        if (nowUs - source.baseUs < SYNC_LEARN_US) {
+            return false;
+        }
+        source.errBaseUs = source.errUs;
+        source.isLearned = true;
+        source.adjustUs = nowUs;
+        return false;
+    }
+    if (nowUs - source.adjustUs < SYNC_ADJUST_US) {
+        return false;
+    }
+    source.adjustUs = nowUs;
+
+    // 比例控制：每秒增删的样本数与累计偏差成正比，样本数是补偿后的，补偿的效果会反映到下一次偏差里
+    double driftSamples = (source.errUs - source.errBaseUs) * SampleRate / 1000000;
+    double maxCompensation = (double)SampleRate * SYNC_MAX_PPM / 1000000;
+    source.compensation = max(-maxCompensation, min(maxCompensation, -driftSamples / SYNC_CORRECT_SECONDS));
+    source.driftPpm = (int)lround(-source.compensation * 1000000 / SampleRate);
+    SampleDelta = (int)lround(source.compensation * SYNC_DISTANCE_SECONDS);
+    Distance = SampleRate * SYNC_DISTANCE_SECONDS;
+    return true;
+}
+
+void AvSyncClock::ResetSource(int Source)
+{
+    if (Source < 0 || Source >= SOURCE_NUM) {
+        return;
+    }
+    SourceState& source = sources[Source];
+    source.baseUs = -1;
+    source.samples = 0;
+    source.errUs = 0;
+    source.isLearned = false;
+}
+
+void AvSyncClock::UpdateOffset(long long AudioUs, long long CaptureUs)
+{
+    int offset = (int)(AudioUs - CaptureUs);
+    int avg = offsetUs;
+    offsetUs = isOffsetInit ? avg + (offset - avg) / 16 : offset;
+    isOffsetInit = true;
+    if (abs(offset) > maxOffsetUs) {
+        maxOffsetUs = abs(offset);
+    }
+}
+
+int AvSyncClock::GetDriftPpm(int Source) const
+{
+    if (Source < 0 || Source >= SOURCE_NUM) {
+        return 0;
+    }
+    return sources[Source].driftPpm;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+
+/// <summary>
+/// 音画同步时钟
+/// 视频与音频时间戳都以同一个起点为零点(暂停的时长不计入)。
+/// 各音频采集线程按采集时刻记录送出的样本数，估计声卡时钟相对系统时钟的漂移，
+/// 给出重采样器的补偿量(swr_set_compensation)，使音频样本数跟上系统时钟；
+/// 编码线程记录每帧音频时间戳与其采集时刻之差作为实测的音画偏差
+/// </summary>
+class AvSyncClock
+{
+public:
+    static const int SOURCE_NUM = 2;        //音频源数，0扬声器 1麦克风
+
+    AvSyncClock() = default;
+    AvSyncClock(const AvSyncClock&) = delete;
+    AvSyncClock& operator=(const AvSyncClock&) = delete;
+
+    /// <summary>
+    /// 清空起点与统计，应在录制线程展开子线程之前调用
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// 各录制线程就绪后调用，第一次调用确定起点，暂停后再次调用时把暂停的时长从起点中扣除
+    /// </summary>
+    void Start();
+
+    /// <summary>
+    /// 暂停录制时调用
+    /// </summary>
+    void Pause();
+
+    /// <summary>
+    /// 获取当前时刻相对起点的微秒数
+    /// </summary>
+    long long NowUs() const;
+
+    /// <summary>
+    /// 把steady_clock微秒换算成相对起点的微秒数
+    /// </summary>
+    long long ToClockUs(long long SteadyUs) const;
+
+    /// <summary>
+    /// 采集线程每送出一批重采样后的样本调用一次，只能由该音频源的采集线程调用
+    /// </summary>
+    /// <param name="Source">音频源，0扬声器 1麦克风</param>
+    /// <param name="SteadyUs">这批样本最后一个样本的采集时刻(steady_clock微秒)</param>
+    /// <param name="Samples">样本数</param>
+    /// <param name="SampleRate">采样率</param>
+    /// <param name="SampleDelta">需要补偿时输出，在Distance个样本内增加(正)或删除(负)的样本数</param>
+    /// <param name="Distance">需要补偿时输出</param>
+    /// <returns>需要调用swr_set_compensation时返回true</returns>
+    bool UpdateSource(int Source, long long SteadyUs, int Samples, int SampleRate, int& SampleDelta, int& Distance);
+
+    /// <summary>
+    /// 采集暂停后重新开始时调用，重新学习采集延迟，保留当前的补偿量
+    /// </summary>
+    void ResetSource(int Source);
+
+    /// <summary>
+    /// 编码线程每送入一帧音频调用一次
+    /// </summary>
+    /// <param name="AudioUs">该帧的音频时间戳(微秒)</param>
+    /// <param name="CaptureUs">该帧第一个样本的采集时刻，相对起点的微秒数</param>
+    void UpdateOffset(long long AudioUs, long long CaptureUs);
+
+    /// <summary>
+    /// 获取音频时间戳减去采集时刻的滑动平均值(微秒)，正数表示声音比画面晚
+    /// </summary>
+    int GetOffsetUs() const { return offsetUs; }
+    /// <summary>
+    /// 获取本次录制中音画偏差绝对值的最大值(微秒)
+    /// </summary>
+    int GetMaxOffsetUs() const { return maxOffsetUs; }
+    /// <summary>
+    /// 获取估计的声卡时钟漂移(百万分之一)，正数表示声卡比系统时钟快
+    /// </summary>
+    int GetDriftPpm(int Source) const;
+
+private:
+    struct SourceState
+    {
+        long long baseUs{ -1 };         //第一批样本中第一个样本的时刻，相对起点
+        long long samples{ 0 };         //此后送出的样本数
+        double errUs{ 0 };              //样本数对应时长减去实际经过时长，已平滑
+        double errBaseUs{ 0 };          //学习期结束时的偏差，视为固定的采集延迟
+        bool isLearned{ false };
+        long long adjustUs{ 0 };        //最近一次调整补偿的时刻
+        double compensation{ 0 };       //当前每秒增删的样本数
+        std::atomic<int> driftPpm{ 0 };
+    };
+
+    std::mutex mutex;                       //只保护Start与Pause
+    std::atomic<long long> epochUs{ 0 };    //起点(steady_clock微秒)，0表示未开始
+    long long pauseUs{ 0 };                 //暂停的时刻，0表示未暂停
+    SourceState sources[SOURCE_NUM];
+    std::atomic<int> offsetUs{ 0 };
+    std::atomic<int> maxOffsetUs{ 0 };
+    bool isOffsetInit{ false };
+};
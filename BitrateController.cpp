@@ -0,0 +1,106 @@
+#include "BitrateController.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// 每次调整后至少间隔这么久再调整，编码器重开会产生关键帧，过于频繁反而加重拥塞
+#define ABR_COOLDOWN_US 2000000
+// 连续通畅这么久才提高码率或恢复帧率
+#define ABR_CLEAR_HOLD_US 5000000
+// 码率到下限后连续拥塞这么多次检查才降帧率
+#define ABR_FRAME_DOWN_CHECKS 3
+// 帧率除数上限
+#define ABR_MAX_FRAME_DIVISOR 4
+// 拥塞时码率乘以 ABR_DOWN_PERCENT / 100
+#define ABR_DOWN_PERCENT 70
+// 通畅时每次增加上限的 ABR_UP_PERCENT / 100
+#define ABR_UP_PERCENT 10
+
+BitrateController::BitrateController(int64_t MinBitRate, int64_t MaxBitRate, int64_t StartBitRate, int MaxQueue, int FrameRate)
+    : minBitRate(MinBitRate)
+    , maxBitRate(max(MinBitRate, MaxBitRate))
+    , highWater(max(4, MaxQueue / 4))
+    , lowWater(max(1, MaxQueue / 16))
+    , frameIntervalUs(1000000 / max(1, FrameRate))
+    , bitRate(max(MinBitRate, min(max(MinBitRate, MaxBitRate), StartBitRate)))
+{
+}
+
+void BitrateController::SetBitRate(int64_t BitRate)
+{
+    bitRate = max(minBitRate, min(maxBitRate, BitRate));
+}
+
+const char* BitrateController::DecisionName(Decision Value)
+{
+    switch (Value) {
+    case Decision::BitRateDown:
+        return "降码率";
+    case Decision::BitRateUp:
+        return "升码率";
+    case Decision::FrameRateDown:
+        return "降帧率";
+    case Decision::FrameRateUp:
+        return "恢复帧率";
+    default:
+        return "保持";
+    }
+}
+
+BitrateController::Decision BitrateController::Update(const Metrics& Current, long long NowUs)
+{
+    const bool isDrop = Current.dropNum > lastDropNum;
+    lastDropNum = Current.dropNum;
+    // 队列积压、有丢包，或单个包的写入耗时已超过帧间隔(此时写入必然跟不上)都视为拥塞
+    const bool isCongested = isDrop || Current.queueDepth >= highWater || Current.avgWriteUs > frameIntervalUs;
+    const bool isClear = !isDrop && Current.queueDepth <= lowWater && Current.avgWriteUs <= frameIntervalUs / 2;
+    const bool isCooling = 0 != lastChangeUs && NowUs - lastChangeUs < ABR_COOLDOWN_US;
+
+    reason = "排队" + to_string(Current.queueDepth) + "/" + to_string(highWater) + "，写入" + to_string(Current.avgWriteUs)
+        + "us/" + to_string(frameIntervalUs) + "us" + (isDrop ? "，有丢包" : "");
+
+    if (isCongested) {
+        clearSinceUs = 0;
+        if (isCooling) {
+            return Decision::Keep;
+        }
+        if (bitRate > minBitRate) {
+            congestedNum = 0;
+            bitRate = max(minBitRate, bitRate * ABR_DOWN_PERCENT / 100);
+            lastChangeUs = NowUs;
+            return Decision::BitRateDown;
+        }
+        if (++congestedNum >= ABR_FRAME_DOWN_CHECKS && frameDivisor < ABR_MAX_FRAME_DIVISOR) {
+            congestedNum = 0;
+            frameDivisor *= 2;
+            lastChangeUs = NowUs;
+            return Decision::FrameRateDown;
+        }
+        return Decision::Keep;
+    }
+    congestedNum = 0;
+    if (!isClear) {
+        clearSinceUs = 0;
+        return Decision::Keep;
+    }
+    if (0 == clearSinceUs) {
+        clearSinceUs = NowUs;
+    }
+    if (isCooling || NowUs - clearSinceUs < ABR_CLEAR_HOLD_US) {
+        return Decision::Keep;
+    }
+    // 先恢复帧率再提高码率，每次调整后重新计算通畅时长
+    clearSinceUs = NowUs;
+    if (frameDivisor > 1) {
+        frameDivisor /= 2;
+        lastChangeUs = NowUs;
+        return Decision::FrameRateUp;
+    }
+    if (bitRate < maxBitRate) {
+        bitRate = min(maxBitRate, bitRate + max<int64_t>(1, maxBitRate * ABR_UP_PERCENT / 100));
+        lastChangeUs = NowUs;
+        return Decision::BitRateUp;
+    }
+    return Decision::Keep;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+/// <summary>
+/// 自适应码率控制器
+/// 根据推流输出端的排队包数、写入耗时与丢包数判断上行是否拥塞：
+/// 拥塞时按比例降低码率(乘性减)，到达下限仍拥塞时把编码帧率减半；
+/// 持续通畅一段时间后先恢复帧率，再逐步提高码率(加性增)，每次调整后有冷却时间避免来回振荡。
+/// 只做决策，不持有编码器，由编码线程定期调用并应用结果
+/// </summary>
+class BitrateController
+{
+public:
+    /// <summary>
+    /// 一次检查的结果
+    /// </summary>
+    enum class Decision
+    {
+        Keep = 0,           //保持不变
+        BitRateDown = 1,    //降低码率
+        BitRateUp = 2,      //提高码率
+        FrameRateDown = 3,  //码率已到下限，帧率减半
+        FrameRateUp = 4,    //恢复帧率
+    };
+
+    /// <summary>
+    /// 输出端的拥塞指标
+    /// </summary>
+    struct Metrics
+    {
+        int queueDepth{ 0 };                //当前排队包数
+        int avgWriteUs{ 0 };                //每包写入耗时的滑动平均值(微秒)
+        unsigned long long dropNum{ 0 };    //累计丢弃的包数
+    };
+
+    /// <summary>
+    /// 创建控制器
+    /// </summary>
+    /// <param name="MinBitRate">码率下限</param>
+    /// <param name="MaxBitRate">码率上限</param>
+    /// <param name="StartBitRate">初始码率，会被限制在上下限之间</param>
+    /// <param name="MaxQueue">输出端包队列上限，用于换算拥塞水位</param>
+    /// <param name="FrameRate">编码帧率，用于判断写入是否跟得上</param>
+    BitrateController(int64_t MinBitRate, int64_t MaxBitRate, int64_t StartBitRate, int MaxQueue, int FrameRate);
+
+    /// <summary>
+    /// 按最新指标检查一次
+    /// </summary>
+    /// <param name="Current">输出端指标</param>
+    /// <param name="NowUs">当前时刻(steady_clock微秒)</param>
+    /// <returns>需要应用的决策，码率与帧率除数已更新为新值</returns>
+    Decision Update(const Metrics& Current, long long NowUs);
+
+    int64_t GetBitRate() const { return bitRate; }
+    /// <summary>
+    /// 编码器未能按决策的码率重新打开时，把码率退回编码器实际使用的值，会被限制在上下限之间
+    /// </summary>
+    void SetBitRate(int64_t BitRate);
+    int64_t GetMinBitRate() const { return minBitRate; }
+    int64_t GetMaxBitRate() const { return maxBitRate; }
+    /// <summary>
+    /// 获取帧率除数，1为全帧率，2为每两帧编码一帧
+    /// </summary>
+    int GetFrameDivisor() const { return frameDivisor; }
+    /// <summary>
+    /// 获取最近一次决策的说明，用于日志
+    /// </summary>
+    const std::string& GetReason() const { return reason; }
+
+    static const char* DecisionName(Decision Value);
+
+private:
+    const int64_t minBitRate;
+    const int64_t maxBitRate;
+    const int highWater;                //排队包数达到此值视为拥塞
+    const int lowWater;                 //排队包数不超过此值视为通畅
+    const int frameIntervalUs;
+    int64_t bitRate;
+    int frameDivisor{ 1 };
+    unsigned long long lastDropNum{ 0 };
+    long long lastChangeUs{ 0 };        //上一次调整的时刻
+    long long clearSinceUs{ 0 };        //连续通畅的起点，0表示当前不通畅
+    int congestedNum{ 0 };              //码率到下限后连续拥塞的检查次数
+    std::string reason;
+};
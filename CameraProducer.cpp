@@ -0,0 +1,145 @@
+#include "CameraProducer.h"
+#include "Log.h"
+
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+// 至少保留的帧缓冲数量：一块最新帧、一块正在写入、一块给仍在读取上一帧的消费者
+#define CAMERA_SLOT_COUNT 3
+// 连续读取失败时的退避时间
+#define CAMERA_RETRY_MS 10
+
+const cv::Mat& CameraFrame::GetBgr() const
+{
+    if (!isRaw) {
+        return bgr;
+    }
+    lock_guard<mutex> lock(decodeMutex);
+    if (!isDecoded) {
+        MediaFrameCapture::decodeRaw(raw, decoded);
+        isDecoded = true;
+    }
+    return decoded;
+}
+
+CameraProducer::CameraProducer(shared_ptr<MediaFrameCapture> Capture)
+    : capture(move(Capture))
+{
+}
+
+CameraProducer::~CameraProducer()
+{
+    Stop();
+}
+
+void CameraProducer::Start()
+{
+    if (isRunning) {
+        return;
+    }
+    isRunning = true;
+    thread.reset(new std::thread(&CameraProducer::Run, this));
+}
+
+void CameraProducer::Stop()
+{
+    isRunning = false;
+    waitCond.notify_all();
+    if (thread && thread->joinable()) {
+        thread->join();
+    }
+    thread.reset();
+    atomic_store(&latest, shared_ptr<CameraFrame>());
+    slots.clear();
+}
+
+shared_ptr<const CameraFrame> CameraProducer::GetLatest() const
+{
+    return atomic_load(&latest);
+}
+
+shared_ptr<const CameraFrame> CameraProducer::WaitNewer(uint64_t Seq, int TimeoutMs) const
+{
+    shared_ptr<const CameraFrame> frame = atomic_load(&latest);
+    if (frame && frame->seq > Seq) {
+        return frame;
+    }
+    unique_lock<mutex> lock(waitMutex);
+    waitCond.wait_for(lock, chrono::milliseconds(TimeoutMs), [&]() {
+        frame = atomic_load(&latest);
+        return !isRunning || (frame && frame->seq > Seq);
+    });
+    if (frame && frame->seq > Seq) {
+        return frame;
+    }
+    return nullptr;
+}
+
+shared_ptr<CameraFrame> CameraProducer::AcquireSlot()
+{
+    // 只被slots持有的缓冲没有任何消费者在用，消费者只能经由latest拿到新引用，所以可以安全复用
+    shared_ptr<CameraFrame> current = atomic_load(&latest);
+    for (auto& slot : slots) {
+        if (slot != current && slot.use_count() == 1) {
+            slot->isDecoded = false;
+            slot->decoded.release();
+            return slot;
+        }
+    }
+    slots.push_back(make_shared<CameraFrame>());
+    if (slots.size() > CAMERA_SLOT_COUNT * 2) {
+        LOG_WARN("摄像头帧缓冲已增至" + to_string(slots.size()) + "块，可能有消费者长期持有旧帧");
+    }
+    return slots.back();
+}
+
+void CameraProducer::Publish(const shared_ptr<CameraFrame>& Frame)
+{
+    Frame->seq = ++seq;
+    atomic_store(&latest, Frame);
+    {
+        // 加锁后再通知，避免等待方在检查条件与进入等待之间错过通知
+        lock_guard<mutex> lock(waitMutex);
+    }
+    waitCond.notify_all();
+}
+
+void CameraProducer::Run()
+{
+    LOG_INFO("摄像头生产线程启动");
+    for (int i = 0; i < CAMERA_SLOT_COUNT; ++i) {
+        slots.push_back(make_shared<CameraFrame>());
+    }
+    int failNum = 0;
+    while (isRunning) {
+        shared_ptr<CameraFrame> frame = AcquireSlot();
+        bool isOk = false;
+        if (capture->isNative()) {
+            // 驱动缓冲区在回调返回后即归还，这里拷贝一次原始数据(YUYV/NV12/MJPEG)供所有消费者共享
+            isOk = capture->readRaw([&](const MediaFrameCapture::RawFrame& raw) {
+                frame->rawData.resize(raw.bytes);
+                memcpy(frame->rawData.data(), raw.data, raw.bytes);
+                frame->raw = raw;
+                frame->raw.data = frame->rawData.data();
+            });
+            frame->isRaw = true;
+        }
+        else {
+            isOk = capture->read(frame->bgr);
+            frame->isRaw = false;
+        }
+        if (isOk) {
+            failNum = 0;
+            Publish(frame);
+        }
+        else {
+            if (0 == failNum++) {
+                LOG_WARN("摄像头生产线程读取失败");
+            }
+            this_thread::sleep_for(chrono::milliseconds(CAMERA_RETRY_MS));
+        }
+    }
+    LOG_INFO("摄像头生产线程退出");
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "MediaFrameCapture.h"
+
+/// <summary>
+/// 摄像头共享帧，由生产线程写入后只读，通过shared_ptr在多个消费者之间共享
+/// </summary>
+struct CameraFrame
+{
+    uint64_t seq{ 0 };                  //帧序号，从1开始递增
+    bool isRaw{ false };                //true时数据在raw中，否则在bgr中
+    MediaFrameCapture::RawFrame raw{};  //原始帧，data指向rawData
+    std::vector<uint8_t> rawData;
+    cv::Mat bgr;                        //OpenCV回退模式读到的BGR图像
+
+    /// <summary>
+    /// 获取BGR图像，原始帧在第一次获取时才解码，之后所有消费者共用解码结果
+    /// </summary>
+    const cv::Mat& GetBgr() const;
+
+private:
+    friend class CameraProducer;
+    mutable std::mutex decodeMutex;
+    mutable cv::Mat decoded;
+    mutable bool isDecoded{ false };
+};
+
+/// <summary>
+/// 摄像头生产线程
+/// 每个打开的摄像头只有一个线程在读取，最新帧以原子方式发布，
+/// 消费者无需持有VideoCapManager的锁即可取得最新帧或等待更新的帧，
+/// 帧缓冲在不被任何消费者引用时循环复用(至少三块，即三缓冲)
+/// </summary>
+class CameraProducer
+{
+public:
+    explicit CameraProducer(std::shared_ptr<MediaFrameCapture> Capture);
+    ~CameraProducer();
+    CameraProducer(const CameraProducer&) = delete;
+    CameraProducer& operator=(const CameraProducer&) = delete;
+
+    void Start();
+    void Stop();
+
+    /// <summary>
+    /// 获取最新一帧，尚无帧时返回空
+    /// </summary>
+    std::shared_ptr<const CameraFrame> GetLatest() const;
+
+    /// <summary>
+    /// 等待序号大于Seq的帧
+    /// </summary>
+    /// <param name="Seq">已经取得的帧序号，0表示任意一帧</param>
+    /// <param name="TimeoutMs">超时时间(毫秒)</param>
+    /// <returns>超时或已停止时返回空</returns>
+    std::shared_ptr<const CameraFrame> WaitNewer(uint64_t Seq, int TimeoutMs) const;
+
+private:
+    void Run();
+    std::shared_ptr<CameraFrame> AcquireSlot();
+    void Publish(const std::shared_ptr<CameraFrame>& Frame);
+
+private:
+    std::shared_ptr<MediaFrameCapture> capture;
+    std::unique_ptr<std::thread> thread;
+    std::atomic<bool> isRunning{ false };
+    std::shared_ptr<CameraFrame> latest;                //只通过std::atomic_load/atomic_store访问
+    std::vector<std::shared_ptr<CameraFrame>> slots;    //可复用的帧缓冲，仅生产线程访问
+    uint64_t seq{ 0 };
+    mutable std::mutex waitMutex;                       //仅用于等待新帧，不保护帧数据
+    mutable std::condition_variable waitCond;
+};
@@ -0,0 +1,345 @@
+#include "DesktopCapture.h"
+#include "Log.h"
+
+#include <chrono>
+#include <mutex>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+// Linux平台特定的头文件
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+
+using namespace std;
+
+// 变化区域过多或面积过大时，逐块XGetSubImage不如一次性整帧抓取
+#define DAMAGE_MAX_RECTS 16
+#define DAMAGE_MAX_AREA_PERCENT 50
+
+// XShmAttach的错误是异步返回的，需要临时替换错误处理函数来捕获
+static bool g_ShmAttachFailed = false;
+static int ShmErrorHandler(Display*, XErrorEvent*)
+{
+    g_ShmAttachFailed = true;
+    return 0;
+}
+
+DesktopCapture::DesktopCapture()
+{
+}
+
+DesktopCapture::~DesktopCapture()
+{
+    Close();
+}
+
+bool DesktopCapture::Open(int X, int Y, int Width, int Height, bool UseDamage)
+{
+    Close();
+    if (Width <= 0 || Height <= 0) {
+        LOG_ERROR("桌面采集区域无效 " + to_string(Width) + "x" + to_string(Height));
+        return false;
+    }
+    x = X;
+    y = Y;
+    width = Width;
+    height = Height;
+
+    display = XOpenDisplay(NULL);
+    if (!display) {
+        LOG_ERROR("无法打开X Display，桌面采集不可用");
+        return false;
+    }
+    rootWindow = DefaultRootWindow(display);
+
+    if (OpenShm()) {
+        LOG_INFO("桌面采集使用MIT-SHM共享内存 (" + to_string(width) + "x" + to_string(height) + ")");
+    }
+    else {
+        LOG_WARN("MIT-SHM不可用，桌面采集回退到XGetImage");
+    }
+    if (UseDamage) {
+        if (OpenDamage()) {
+            LOG_INFO("桌面采集已订阅XDamage，将只抓取变化区域");
+        }
+        else {
+            LOG_WARN("XDamage不可用，桌面采集每帧整帧抓取");
+        }
+    }
+    needFullGrab = true;
+    return true;
+}
+
+bool DesktopCapture::OpenDamage()
+{
+    int errorBase = 0;
+    if (!XDamageQueryExtension(display, &damageEventBase, &errorBase)) {
+        LOG_INFO("X服务不支持XDamage扩展");
+        return false;
+    }
+    int fixesEventBase = 0;
+    if (!XFixesQueryExtension(display, &fixesEventBase, &errorBase)) {
+        LOG_INFO("X服务不支持XFixes扩展");
+        return false;
+    }
+    int major = 0, minor = 0;
+    // 必须先协商版本，否则服务端会拒绝后续请求
+    XDamageQueryVersion(display, &major, &minor);
+    XFixesQueryVersion(display, &major, &minor);
+
+    // NonEmpty模式下每次清空后只上报一次事件，变化区域本身通过XDamageSubtract取出
+    damage = XDamageCreate(display, rootWindow, XDamageReportNonEmpty);
+    damageRegion = XFixesCreateRegion(display, nullptr, 0);
+    if (!damage || !damageRegion) {
+        CloseDamage();
+        return false;
+    }
+    isDamage = true;
+    return true;
+}
+
+void DesktopCapture::CloseDamage()
+{
+    if (display) {
+        if (damage) XDamageDestroy(display, damage);
+        if (damageRegion) XFixesDestroyRegion(display, damageRegion);
+    }
+    damage = 0;
+    damageRegion = 0;
+    isDamage = false;
+}
+
+bool DesktopCapture::OpenShm()
+{
+    if (!XShmQueryExtension(display)) {
+        LOG_INFO("X服务不支持MIT-SHM扩展");
+        return false;
+    }
+    XShmSegmentInfo* info = new XShmSegmentInfo{};
+    info->shmid = -1;
+    info->shmaddr = nullptr;
+    shmInfo = info;
+
+    const int screen = DefaultScreen(display);
+    image = XShmCreateImage(display, DefaultVisual(display, screen), DefaultDepth(display, screen),
+        ZPixmap, nullptr, info, width, height);
+    if (!image) {
+        LOG_WARN("XShmCreateImage 失败");
+        CloseShm();
+        return false;
+    }
+    if (image->bits_per_pixel != 32) {
+        LOG_WARN("桌面色深为 " + to_string(image->bits_per_pixel) + " 位，MIT-SHM只支持32位BGRA");
+        CloseShm();
+        return false;
+    }
+
+    info->shmid = shmget(IPC_PRIVATE, image->bytes_per_line * image->height, IPC_CREAT | 0600);
+    if (info->shmid < 0) {
+        LOG_WARN("shmget 申请共享内存失败");
+        CloseShm();
+        return false;
+    }
+    info->shmaddr = image->data = static_cast<char*>(shmat(info->shmid, nullptr, 0));
+    if (info->shmaddr == reinterpret_cast<char*>(-1)) {
+        LOG_WARN("shmat 映射共享内存失败");
+        info->shmaddr = image->data = nullptr;
+        CloseShm();
+        return false;
+    }
+    info->readOnly = False;
+
+    XSync(display, False);
+    Status attached = False;
+    bool isAttachFailed = false;
+    {
+        // 错误处理函数与标志都是进程级的，多个模块同时打开共享视频源时须串行，
+        // 否则可能恢复成Xlib默认的处理函数(遇到BadAccess直接退出进程)或把ShmErrorHandler遗留下来
+        static std::mutex attachMutex;
+        lock_guard<std::mutex> lock(attachMutex);
+        g_ShmAttachFailed = false;
+        XErrorHandler oldHandler = XSetErrorHandler(ShmErrorHandler);
+        attached = XShmAttach(display, info);
+        XSync(display, False);
+        XSetErrorHandler(oldHandler);
+        isAttachFailed = g_ShmAttachFailed;
+    }
+    // 标记删除，进程异常退出时共享内存也会被系统回收
+    shmctl(info->shmid, IPC_RMID, nullptr);
+    if (!attached || isAttachFailed) {
+        LOG_WARN("XShmAttach 失败(可能是远程显示)");
+        CloseShm();
+        return false;
+    }
+    isShm = true;
+    return true;
+}
+
+void DesktopCapture::CloseShm()
+{
+    XShmSegmentInfo* info = static_cast<XShmSegmentInfo*>(shmInfo);
+    if (info && isShm && display) {
+        XShmDetach(display, info);
+        XSync(display, False);
+    }
+    if (image) {
+        // 共享内存由shmdt释放，避免XDestroyImage去free它
+        if (info) image->data = nullptr;
+        XDestroyImage(image);
+        image = nullptr;
+    }
+    if (info) {
+        if (info->shmaddr) shmdt(info->shmaddr);
+        if (info->shmid >= 0) shmctl(info->shmid, IPC_RMID, nullptr);
+        delete info;
+        shmInfo = nullptr;
+    }
+    isShm = false;
+}
+
+void DesktopCapture::Close()
+{
+    CloseDamage();
+    if (shmInfo) {
+        CloseShm();
+    }
+    if (image) {
+        XDestroyImage(image);
+        image = nullptr;
+    }
+    if (display) {
+        XCloseDisplay(display);
+        display = nullptr;
+    }
+    lastGrabUs = 0;
+    avgGrabUs = 0;
+}
+
+bool DesktopCapture::Grab(uint8_t*& Data, int& Stride)
+{
+    if (!display) {
+        return false;
+    }
+    auto startTime = chrono::steady_clock::now();
+    if (!GrabFull()) {
+        return false;
+    }
+    UpdateGrabCost(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime).count());
+    Data = reinterpret_cast<uint8_t*>(image->data);
+    Stride = image->bytes_per_line;
+    return true;
+}
+
+DesktopCapture::GrabResult DesktopCapture::GrabDamage(uint8_t*& Data, int& Stride, vector<DamageRect>& Rects)
+{
+    Rects.clear();
+    if (!isDamage) {
+        return Grab(Data, Stride) ? GrabResult::Full : GrabResult::Failed;
+    }
+    auto startTime = chrono::steady_clock::now();
+    GrabResult result = GrabResult::Full;
+    long long area = 0;
+    // 先取出变化区域再抓取，抓取期间发生的变化会留到下一帧
+    FetchDamage(Rects, area);
+    if (needFullGrab || !image
+        || Rects.size() > DAMAGE_MAX_RECTS
+        || area * 100 > static_cast<long long>(width) * height * DAMAGE_MAX_AREA_PERCENT) {
+        Rects.clear();
+    }
+    else if (Rects.empty()) {
+        result = GrabResult::Unchanged;
+    }
+    else {
+        result = GrabResult::Partial;
+        for (const DamageRect& rect : Rects) {
+            // 直接写入已有图像的对应位置，SHM模式下图像数据也在客户端内存中
+            if (!XGetSubImage(display, rootWindow, x + rect.x, y + rect.y, rect.width, rect.height,
+                AllPlanes, ZPixmap, image, rect.x, rect.y)) {
+                LOG_WARN("XGetSubImage 抓取变化区域失败，改为整帧抓取");
+                Rects.clear();
+                result = GrabResult::Full;
+                break;
+            }
+        }
+    }
+
+    if (GrabResult::Full == result) {
+        if (!GrabFull()) {
+            // 变化区域已经取出，失败后必须整帧重抓才能保证图像完整
+            needFullGrab = true;
+            return GrabResult::Failed;
+        }
+        needFullGrab = false;
+    }
+    if (GrabResult::Unchanged != result) {
+        UpdateGrabCost(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime).count());
+    }
+    Data = reinterpret_cast<uint8_t*>(image->data);
+    Stride = image->bytes_per_line;
+    return result;
+}
+
+bool DesktopCapture::FetchDamage(vector<DamageRect>& Rects, long long& Area)
+{
+    // 丢弃已上报的通知事件，避免事件队列堆积
+    XEvent event;
+    while (XCheckTypedEvent(display, damageEventBase + XDamageNotify, &event)) {
+    }
+    XDamageSubtract(display, damage, None, damageRegion);
+
+    int count = 0;
+    XRectangle* rects = XFixesFetchRegion(display, damageRegion, &count);
+    if (!rects) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        // 与录制区域求交，并转换为相对录制区域的坐标
+        int left = max<int>(rects[i].x, x);
+        int top = max<int>(rects[i].y, y);
+        int right = min<int>(rects[i].x + rects[i].width, x + width);
+        int bottom = min<int>(rects[i].y + rects[i].height, y + height);
+        if (right <= left || bottom <= top) {
+            continue;
+        }
+        Rects.push_back({ left - x, top - y, right - left, bottom - top });
+        Area += static_cast<long long>(right - left) * (bottom - top);
+    }
+    XFree(rects);
+    return true;
+}
+
+bool DesktopCapture::GrabFull()
+{
+    if (isShm) {
+        if (!XShmGetImage(display, rootWindow, image, x, y, AllPlanes)) {
+            LOG_WARN("XShmGetImage 失败");
+            return false;
+        }
+    }
+    else if (image) {
+        // 非共享内存模式下复用已有图像，省去每帧的分配与释放
+        if (!XGetSubImage(display, rootWindow, x, y, width, height, AllPlanes, ZPixmap, image, 0, 0)) {
+            LOG_WARN("XGetSubImage 失败");
+            return false;
+        }
+    }
+    else {
+        image = XGetImage(display, rootWindow, x, y, width, height, AllPlanes, ZPixmap);
+        if (!image) {
+            LOG_WARN("XGetImage 失败");
+            return false;
+        }
+    }
+    return true;
+}
+
+void DesktopCapture::UpdateGrabCost(int64_t CostUs)
+{
+    lastGrabUs = static_cast<int>(CostUs);
+    // 指数滑动平均，权重1/16
+    int avg = avgGrabUs;
+    avgGrabUs = (avg == 0) ? static_cast<int>(CostUs) : static_cast<int>(avg + (CostUs - avg) / 16);
+}
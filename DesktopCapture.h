@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <vector>
+
+// X11类型前向声明，避免在头文件中引入Xlib的宏定义(None/Status/Bool等)
+struct _XDisplay;
+struct _XImage;
+
+/// <summary>
+/// 桌面采集类
+/// 优先使用MIT-SHM共享内存(XShmGetImage)反复抓取到同一块内存中，
+/// 当X服务不支持MIT-SHM(如远程显示)时回退到XGetImage/XGetSubImage
+/// 支持XDamage时可只抓取发生变化的区域
+/// </summary>
+class DesktopCapture
+{
+public:
+    /// <summary>
+    /// 变化区域，坐标相对于录制区域左上角
+    /// </summary>
+    struct DamageRect
+    {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    /// <summary>
+    /// 增量抓取的结果
+    /// </summary>
+    enum class GrabResult
+    {
+        Failed,     //抓取失败
+        Unchanged,  //录制区域无变化，图像保持上一帧
+        Partial,    //只重新抓取了变化区域
+        Full,       //重新抓取了整个录制区域
+    };
+
+    DesktopCapture();
+    ~DesktopCapture();
+    DesktopCapture(const DesktopCapture&) = delete;
+    DesktopCapture& operator=(const DesktopCapture&) = delete;
+
+    /// <summary>
+    /// 打开X Display并为指定录制区域准备采集图像
+    /// </summary>
+    /// <param name="X">录制区域X</param>
+    /// <param name="Y">录制区域Y</param>
+    /// <param name="Width">录制区域宽</param>
+    /// <param name="Height">录制区域高</param>
+    /// <param name="UseDamage">是否订阅XDamage以支持增量抓取</param>
+    /// <returns>是否打开成功</returns>
+    bool Open(int X, int Y, int Width, int Height, bool UseDamage = true);
+
+    /// <summary>
+    /// 分离共享内存并关闭X Display
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// 抓取一帧，数据为BGRA格式，在下一次Grab或Close之前有效
+    /// </summary>
+    /// <param name="Data">存储图像数据地址</param>
+    /// <param name="Stride">存储图像每行字节数</param>
+    /// <returns>是否抓取成功</returns>
+    bool Grab(uint8_t*& Data, int& Stride);
+
+    /// <summary>
+    /// 根据XDamage上报的变化区域增量抓取一帧，未启用XDamage时等同于Grab
+    /// 除Failed外Data都指向完整的录制区域图像
+    /// </summary>
+    /// <param name="Data">存储图像数据地址</param>
+    /// <param name="Stride">存储图像每行字节数</param>
+    /// <param name="Rects">Partial时存储本次重新抓取的区域</param>
+    /// <returns>抓取结果</returns>
+    GrabResult GrabDamage(uint8_t*& Data, int& Stride, std::vector<DamageRect>& Rects);
+
+    /// <summary>
+    /// 要求下一次GrabDamage重新抓取整个录制区域
+    /// </summary>
+    void RequestFullGrab() { needFullGrab = true; }
+
+    bool IsOpened() const { return nullptr != display; }
+    /// <summary>
+    /// 当前是否正在使用MIT-SHM共享内存
+    /// </summary>
+    bool IsShm() const { return isShm; }
+    /// <summary>
+    /// 当前是否已订阅XDamage
+    /// </summary>
+    bool IsDamage() const { return isDamage; }
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+
+    /// <summary>
+    /// 获取最近一帧的抓取耗时(微秒)
+    /// </summary>
+    int GetLastGrabUs() const { return lastGrabUs; }
+    /// <summary>
+    /// 获取抓取耗时的滑动平均值(微秒)
+    /// </summary>
+    int GetAvgGrabUs() const { return avgGrabUs; }
+
+private:
+    bool OpenShm();
+    void CloseShm();
+    bool OpenDamage();
+    void CloseDamage();
+    bool GrabFull();
+    bool FetchDamage(std::vector<DamageRect>& Rects, long long& Area);
+    void UpdateGrabCost(int64_t CostUs);
+
+private:
+    _XDisplay* display{ nullptr };
+    unsigned long rootWindow{ 0 };
+    _XImage* image{ nullptr };          //采集图像，SHM模式下数据位于共享内存中
+    void* shmInfo{ nullptr };           //XShmSegmentInfo，需要与image同生命周期
+    bool isShm{ false };
+    unsigned long damage{ 0 };          //XDamage句柄
+    unsigned long damageRegion{ 0 };    //XFixes区域，用于取出累计的变化区域
+    int damageEventBase{ 0 };
+    bool isDamage{ false };
+    bool needFullGrab{ true };
+    int x{ 0 };
+    int y{ 0 };
+    int width{ 0 };
+    int height{ 0 };
+    std::atomic<int> lastGrabUs{ 0 };
+    std::atomic<int> avgGrabUs{ 0 };
+};
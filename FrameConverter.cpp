@@ -0,0 +1,268 @@
+#include "FrameConverter.h"
+#include "WorkerPool.h"
+#include "Log.h"
+
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+extern "C" {
+#include "libavutil/frame.h"
+}
+extern "C" {
+#include <libyuv.h>
+}
+
+using namespace std;
+
+// 每个条带的最少行数，过小时线程调度的开销超过收益
+#define CONVERT_MIN_SLICE_ROWS 64
+
+FrameConverter::FrameConverter()
+{
+}
+
+FrameConverter::~FrameConverter()
+{
+}
+
+bool FrameConverter::Convert(const uint8_t* Src, int SrcStride, int SrcWidth, int SrcHeight, PixelFormat SrcFormat, AVFrame* Dst, size_t SrcBytes)
+{
+    if (!Src || !Dst || SrcWidth <= 0 || SrcHeight <= 0) {
+        return false;
+    }
+    auto startTime = chrono::steady_clock::now();
+    bool isOk = ConvertFrame(Src, SrcStride, SrcWidth, SrcHeight, SrcFormat, Dst, SrcBytes);
+    int costUs = static_cast<int>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime).count());
+    int avg = avgConvertUs;
+    avgConvertUs = (0 == avg) ? costUs : avg + (costUs - avg) / 16;
+    return isOk;
+}
+
+bool FrameConverter::Scale(const AVFrame* Src, AVFrame* Dst)
+{
+    if (!Src || !Dst || Src->format != Dst->format) {
+        return false;
+    }
+    auto startTime = chrono::steady_clock::now();
+    bool isOk = (AV_PIX_FMT_NV12 == Dst->format)
+        ? ScaleNV12(Src->data[0], Src->linesize[0], Src->data[1], Src->linesize[1], Src->width, Src->height, Dst)
+        : ScaleI420(Src->data[0], Src->linesize[0], Src->data[1], Src->data[2], Src->linesize[1], Src->width, Src->height, Dst);
+    int costUs = static_cast<int>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - startTime).count());
+    int avg = avgConvertUs;
+    avgConvertUs = (0 == avg) ? costUs : avg + (costUs - avg) / 16;
+    return isOk;
+}
+
+bool FrameConverter::ConvertFrame(const uint8_t* Src, int SrcStride, int SrcWidth, int SrcHeight, PixelFormat SrcFormat, AVFrame* Dst, size_t SrcBytes)
+{
+    // NV12源的UV平面紧跟在Y平面之后，行宽与Y相同
+    const uint8_t* srcUV = Src + static_cast<size_t>(SrcStride) * SrcHeight;
+    const bool isDstNV12 = (AV_PIX_FMT_NV12 == Dst->format);
+    if (isDstNV12 && PixelFormat::BGR24 == SrcFormat) {
+        // BGR24经I420中转，U、V各一个平面，各条带按起始行使用其中互不重叠的一段
+        const size_t chromaSize = static_cast<size_t>((SrcWidth + 1) / 2) * ((SrcHeight + 1) / 2) * 2;
+        if (chromaBuffer.size() != chromaSize) {
+            chromaBuffer.resize(chromaSize);
+        }
+    }
+    if (SrcWidth == Dst->width && SrcHeight == Dst->height) {
+        // 尺寸一致时直接写入目标帧
+        if (isDstNV12) {
+            return RunSliced(SrcHeight, SrcFormat, [&](int Top, int Rows) {
+                return ToNV12(Src, SrcStride, srcUV, SrcBytes, Top, SrcWidth, Rows, SrcFormat,
+                    Dst->data[0] + static_cast<size_t>(Top) * Dst->linesize[0], Dst->linesize[0],
+                    Dst->data[1] + static_cast<size_t>(Top / 2) * Dst->linesize[1], Dst->linesize[1]);
+            });
+        }
+        return RunSliced(SrcHeight, SrcFormat, [&](int Top, int Rows) {
+            return ToI420(Src, SrcStride, srcUV, SrcBytes, Top, SrcWidth, Rows, SrcFormat,
+                Dst->data[0] + static_cast<size_t>(Top) * Dst->linesize[0], Dst->linesize[0],
+                Dst->data[1] + static_cast<size_t>(Top / 2) * Dst->linesize[1], Dst->linesize[1],
+                Dst->data[2] + static_cast<size_t>(Top / 2) * Dst->linesize[2], Dst->linesize[2]);
+        });
+    }
+
+    // 中间结果与目标帧格式相同，缩放时不再需要平面与半平面之间的转换
+    const int strideY = SrcWidth;
+    const int strideUV = isDstNV12 ? (SrcWidth + 1) & ~1 : (SrcWidth + 1) / 2;
+    const size_t sizeY = static_cast<size_t>(strideY) * SrcHeight;
+    const size_t sizeUV = static_cast<size_t>(strideUV) * ((SrcHeight + 1) / 2);
+    const size_t bufferSize = sizeY + sizeUV * (isDstNV12 ? 1 : 2);
+    if (yuvBuffer.size() != bufferSize) {
+        yuvBuffer.resize(bufferSize);
+    }
+    uint8_t* y = yuvBuffer.data();
+    uint8_t* u = y + sizeY;
+    uint8_t* v = u + sizeUV;
+    if (isDstNV12) {
+        bool isOk = RunSliced(SrcHeight, SrcFormat, [&](int Top, int Rows) {
+            return ToNV12(Src, SrcStride, srcUV, SrcBytes, Top, SrcWidth, Rows, SrcFormat,
+                y + static_cast<size_t>(Top) * strideY, strideY, u + static_cast<size_t>(Top / 2) * strideUV, strideUV);
+        });
+        return isOk && ScaleNV12(y, strideY, u, strideUV, SrcWidth, SrcHeight, Dst);
+    }
+    bool isOk = RunSliced(SrcHeight, SrcFormat, [&](int Top, int Rows) {
+        return ToI420(Src, SrcStride, srcUV, SrcBytes, Top, SrcWidth, Rows, SrcFormat,
+            y + static_cast<size_t>(Top) * strideY, strideY,
+            u + static_cast<size_t>(Top / 2) * strideUV, strideUV,
+            v + static_cast<size_t>(Top / 2) * strideUV, strideUV);
+    });
+    return isOk && ScaleI420(y, strideY, u, v, strideUV, SrcWidth, SrcHeight, Dst);
+}
+
+bool FrameConverter::RunSliced(int Height, PixelFormat SrcFormat, const function<bool(int Top, int Rows)>& Task)
+{
+    WorkerPool* pool = WorkerPool::Default();
+    int slices = min(pool->GetThreadNum() + 1, Height / CONVERT_MIN_SLICE_ROWS);
+    if (PixelFormat::MJPEG == SrcFormat || slices <= 1) {
+        // MJPEG需整帧解码
+        sliceNum = 1;
+        return Task(0, Height);
+    }
+    sliceNum = slices;
+    // 条带行数取偶数，色度行不会跨条带，最后一条带吸收余下的行
+    const int sliceRows = (Height / slices) & ~1;
+    atomic<bool> isOk{ true };
+    pool->ParallelFor(slices, [&](int Index) {
+        int top = Index * sliceRows;
+        int rows = (Index == slices - 1) ? Height - top : sliceRows;
+        if (!Task(top, rows)) isOk = false;
+    });
+    return isOk;
+}
+
+bool FrameConverter::ScaleI420(const uint8_t* Y, int StrideY, const uint8_t* U, const uint8_t* V, int StrideUV, int SrcWidth, int SrcHeight, AVFrame* Dst)
+{
+    libyuv::FilterMode filter = static_cast<libyuv::FilterMode>(scaleFilter);
+    if (0 == WorkerPool::Default()->GetThreadNum()) {
+        int ret = libyuv::I420Scale(Y, StrideY, U, StrideUV, V, StrideUV, SrcWidth, SrcHeight,
+            Dst->data[0], Dst->linesize[0], Dst->data[1], Dst->linesize[1], Dst->data[2], Dst->linesize[2],
+            Dst->width, Dst->height, filter);
+        if (ret != 0) {
+            LOG_WARN("I420Scale 失败 " + to_string(SrcWidth) + "x" + to_string(SrcHeight) + " -> " + to_string(Dst->width) + "x" + to_string(Dst->height));
+            return false;
+        }
+        return true;
+    }
+    // 按行切分缩放时条带边界的滤波取样与整帧不同，会出现接缝，因此按平面并行，结果与I420Scale一致
+    const int srcHalfWidth = (SrcWidth + 1) / 2;
+    const int srcHalfHeight = (SrcHeight + 1) / 2;
+    const int dstHalfWidth = (Dst->width + 1) / 2;
+    const int dstHalfHeight = (Dst->height + 1) / 2;
+    WorkerPool::Default()->ParallelFor(3, [&](int Index) {
+        if (0 == Index) {
+            libyuv::ScalePlane(Y, StrideY, SrcWidth, SrcHeight, Dst->data[0], Dst->linesize[0], Dst->width, Dst->height, filter);
+        } else if (1 == Index) {
+            libyuv::ScalePlane(U, StrideUV, srcHalfWidth, srcHalfHeight, Dst->data[1], Dst->linesize[1], dstHalfWidth, dstHalfHeight, filter);
+        } else {
+            libyuv::ScalePlane(V, StrideUV, srcHalfWidth, srcHalfHeight, Dst->data[2], Dst->linesize[2], dstHalfWidth, dstHalfHeight, filter);
+        }
+    });
+    return true;
+}
+
+bool FrameConverter::ScaleNV12(const uint8_t* Y, int StrideY, const uint8_t* UV, int StrideUV, int SrcWidth, int SrcHeight, AVFrame* Dst)
+{
+    libyuv::FilterMode filter = static_cast<libyuv::FilterMode>(scaleFilter);
+    if (0 == WorkerPool::Default()->GetThreadNum()) {
+        int ret = libyuv::NV12Scale(Y, StrideY, UV, StrideUV, SrcWidth, SrcHeight,
+            Dst->data[0], Dst->linesize[0], Dst->data[1], Dst->linesize[1], Dst->width, Dst->height, filter);
+        if (ret != 0) {
+            LOG_WARN("NV12Scale 失败 " + to_string(SrcWidth) + "x" + to_string(SrcHeight) + " -> " + to_string(Dst->width) + "x" + to_string(Dst->height));
+            return false;
+        }
+        return true;
+    }
+    // 与I420一样按平面并行，UV交错平面按像素对缩放
+    atomic<bool> isOk{ true };
+    WorkerPool::Default()->ParallelFor(2, [&](int Index) {
+        if (0 == Index) {
+            libyuv::ScalePlane(Y, StrideY, SrcWidth, SrcHeight, Dst->data[0], Dst->linesize[0], Dst->width, Dst->height, filter);
+        } else if (libyuv::UVScale(UV, StrideUV, (SrcWidth + 1) / 2, (SrcHeight + 1) / 2,
+            Dst->data[1], Dst->linesize[1], (Dst->width + 1) / 2, (Dst->height + 1) / 2, filter) != 0) {
+            isOk = false;
+        }
+    });
+    if (!isOk) {
+        LOG_WARN("UVScale 失败 " + to_string(SrcWidth) + "x" + to_string(SrcHeight) + " -> " + to_string(Dst->width) + "x" + to_string(Dst->height));
+    }
+    return isOk;
+}
+
+bool FrameConverter::ToI420(const uint8_t* Src, int SrcStride, const uint8_t* SrcUV, size_t SrcBytes, int Top, int Width, int Height, PixelFormat SrcFormat,
+    uint8_t* DstY, int StrideY, uint8_t* DstU, int StrideU, uint8_t* DstV, int StrideV)
+{
+    const uint8_t* src = Src + static_cast<size_t>(Top) * SrcStride;
+    int ret = -1;
+    switch (SrcFormat) {
+    case PixelFormat::BGRA:
+        // libyuv的ARGB即内存中的B,G,R,A顺序
+        ret = libyuv::ARGBToI420(src, SrcStride, DstY, StrideY, DstU, StrideU, DstV, StrideV, Width, Height);
+        break;
+    case PixelFormat::BGR24:
+        // libyuv的RGB24即内存中的B,G,R顺序，与OpenCV的BGR一致，无需先cvtColor到BGRA
+        ret = libyuv::RGB24ToI420(src, SrcStride, DstY, StrideY, DstU, StrideU, DstV, StrideV, Width, Height);
+        break;
+    case PixelFormat::YUYV:
+        ret = libyuv::YUY2ToI420(src, SrcStride, DstY, StrideY, DstU, StrideU, DstV, StrideV, Width, Height);
+        break;
+    case PixelFormat::NV12:
+        ret = libyuv::NV12ToI420(src, SrcStride, SrcUV + static_cast<size_t>(Top / 2) * SrcStride, SrcStride,
+            DstY, StrideY, DstU, StrideU, DstV, StrideV, Width, Height);
+        break;
+    case PixelFormat::MJPEG:
+        // libyuv未启用JPEG时摄像头不会协商MJPEG原始数据，见MediaFrameCapture::setupNative
+#ifdef HAVE_LIBYUV_JPEG
+        ret = libyuv::MJPGToI420(Src, SrcBytes, DstY, StrideY, DstU, StrideU, DstV, StrideV, Width, Height, Width, Height);
+#endif
+        break;
+    }
+    if (ret != 0) {
+        LOG_WARN("转换I420失败，源格式:" + to_string(static_cast<int>(SrcFormat)));
+        return false;
+    }
+    return true;
+}
+
+bool FrameConverter::ToNV12(const uint8_t* Src, int SrcStride, const uint8_t* SrcUV, size_t SrcBytes, int Top, int Width, int Height, PixelFormat SrcFormat,
+    uint8_t* DstY, int StrideY, uint8_t* DstUV, int StrideUV)
+{
+    const uint8_t* src = Src + static_cast<size_t>(Top) * SrcStride;
+    int ret = -1;
+    switch (SrcFormat) {
+    case PixelFormat::BGRA:
+        ret = libyuv::ARGBToNV12(src, SrcStride, DstY, StrideY, DstUV, StrideUV, Width, Height);
+        break;
+    case PixelFormat::BGR24: {
+        // OpenCV回退模式没有直接到NV12的转换，经I420中转
+        const int halfWidth = (Width + 1) / 2;
+        uint8_t* chromaU = chromaBuffer.data() + static_cast<size_t>(Top / 2) * halfWidth;
+        uint8_t* chromaV = chromaU + chromaBuffer.size() / 2;
+        ret = libyuv::RGB24ToI420(src, SrcStride, DstY, StrideY, chromaU, halfWidth, chromaV, halfWidth, Width, Height);
+        if (0 == ret) {
+            libyuv::MergeUVPlane(chromaU, halfWidth, chromaV, halfWidth, DstUV, StrideUV, halfWidth, (Height + 1) / 2);
+        }
+        break;
+    }
+    case PixelFormat::YUYV:
+        ret = libyuv::YUY2ToNV12(src, SrcStride, DstY, StrideY, DstUV, StrideUV, Width, Height);
+        break;
+    case PixelFormat::NV12:
+        // 源与目标格式一致，只需逐平面拷贝
+        libyuv::CopyPlane(src, SrcStride, DstY, StrideY, Width, Height);
+        libyuv::CopyPlane(SrcUV + static_cast<size_t>(Top / 2) * SrcStride, SrcStride, DstUV, StrideUV, (Width + 1) & ~1, (Height + 1) / 2);
+        ret = 0;
+        break;
+    case PixelFormat::MJPEG:
+#ifdef HAVE_LIBYUV_JPEG
+        ret = libyuv::MJPGToNV12(Src, SrcBytes, DstY, StrideY, DstUV, StrideUV, Width, Height, Width, Height);
+#endif
+        break;
+    }
+    if (ret != 0) {
+        LOG_WARN("转换NV12失败，源格式:" + to_string(static_cast<int>(SrcFormat)));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+// FFmpeg类型前向声明
+struct AVFrame;
+
+/// <summary>
+/// 先转换后缩放的画面转换器
+/// 在源分辨率下把采集数据转换为目标帧的格式(I420或NV12)，再缩放各平面到目标帧，
+/// 与先在BGRA上缩放再转换相比，缩放时每像素只需处理1.5字节而不是4字节。
+/// 工作线程池开启时，转换按偶数行切分为条带并行，缩放按Y、U、V三个平面并行
+/// </summary>
+class FrameConverter
+{
+public:
+    /// <summary>
+    /// 源数据格式
+    /// </summary>
+    enum class PixelFormat
+    {
+        BGRA,   //X11桌面、强制录制画面
+        BGR24,  //OpenCV解码后的摄像头画面
+        YUYV,   //V4L2摄像头原始数据
+        NV12,   //V4L2摄像头原始数据
+        MJPEG,  //V4L2摄像头压缩数据，需要同时给出数据长度
+    };
+
+    /// <summary>
+    /// 缩放滤波方式，数值与libyuv::FilterMode一致
+    /// </summary>
+    enum class ScaleFilter
+    {
+        Nearest = 0,    //最近邻，最快
+        Linear = 1,     //仅水平方向线性插值
+        Bilinear = 2,   //双线性
+        Box = 3,        //盒式滤波，缩小时画质最好
+    };
+
+    FrameConverter();
+    ~FrameConverter();
+    FrameConverter(const FrameConverter&) = delete;
+    FrameConverter& operator=(const FrameConverter&) = delete;
+
+    void SetScaleFilter(ScaleFilter Filter) { scaleFilter = Filter; }
+    ScaleFilter GetScaleFilter() const { return scaleFilter; }
+
+    /// <summary>
+    /// 获取每帧转换耗时的滑动平均值(微秒)
+    /// </summary>
+    int GetAvgConvertUs() const { return avgConvertUs; }
+    /// <summary>
+    /// 获取最近一次转换切分的条带数
+    /// </summary>
+    int GetSliceNum() const { return sliceNum; }
+
+    /// <summary>
+    /// 转换并缩放一帧到目标I420帧，目标帧的宽高即输出宽高
+    /// </summary>
+    /// <param name="Src">源数据</param>
+    /// <param name="SrcStride">源数据每行字节数</param>
+    /// <param name="SrcWidth">源宽</param>
+    /// <param name="SrcHeight">源高</param>
+    /// <param name="SrcFormat">源数据格式</param>
+    /// <param name="Dst">已分配好缓冲区的YUV420P或NV12目标帧</param>
+    /// <param name="SrcBytes">源数据字节数，仅MJPEG需要</param>
+    /// <returns>是否转换成功</returns>
+    bool Convert(const uint8_t* Src, int SrcStride, int SrcWidth, int SrcHeight, PixelFormat SrcFormat, AVFrame* Dst, size_t SrcBytes = 0);
+
+    /// <summary>
+    /// 把一帧YUV420P或NV12缩放到目标帧，两帧格式须相同，用于多码率输出逐级缩小
+    /// </summary>
+    /// <param name="Src">源帧</param>
+    /// <param name="Dst">已分配好缓冲区的目标帧，宽高即输出宽高</param>
+    /// <returns>格式不一致或缩放失败时返回false</returns>
+    bool Scale(const AVFrame* Src, AVFrame* Dst);
+
+private:
+    bool ConvertFrame(const uint8_t* Src, int SrcStride, int SrcWidth, int SrcHeight, PixelFormat SrcFormat, AVFrame* Dst, size_t SrcBytes);
+    /// <summary>
+    /// 按偶数行切分为条带，在工作线程池上执行Task(条带首行, 行数)
+    /// </summary>
+    bool RunSliced(int Height, PixelFormat SrcFormat, const std::function<bool(int Top, int Rows)>& Task);
+    bool ScaleI420(const uint8_t* Y, int StrideY, const uint8_t* U, const uint8_t* V, int StrideUV, int SrcWidth, int SrcHeight, AVFrame* Dst);
+    bool ScaleNV12(const uint8_t* Y, int StrideY, const uint8_t* UV, int StrideUV, int SrcWidth, int SrcHeight, AVFrame* Dst);
+    // 转换源数据中从Top行开始的Height行，SrcUV为NV12源的UV平面起点
+    bool ToI420(const uint8_t* Src, int SrcStride, const uint8_t* SrcUV, size_t SrcBytes, int Top, int Width, int Height, PixelFormat SrcFormat,
+        uint8_t* DstY, int StrideY, uint8_t* DstU, int StrideU, uint8_t* DstV, int StrideV);
+    bool ToNV12(const uint8_t* Src, int SrcStride, const uint8_t* SrcUV, size_t SrcBytes, int Top, int Width, int Height, PixelFormat SrcFormat,
+        uint8_t* DstY, int StrideY, uint8_t* DstUV, int StrideUV);
+
+private:
+    ScaleFilter scaleFilter{ ScaleFilter::Bilinear };
+    std::vector<uint8_t> yuvBuffer;     //源分辨率下与目标帧同格式的中间结果，尺寸不变时复用
+    std::vector<uint8_t> chromaBuffer;  //BGR24转NV12时I420中转的U、V平面，尺寸不变时复用
+    std::atomic<int> avgConvertUs{ 0 };
+    std::atomic<int> sliceNum{ 1 };
+};
@@ -0,0 +1,100 @@
+#include "FrameQueue.h"
+
+#include <chrono>
+#include <algorithm>
+
+extern "C" {
+#include "libavutil/frame.h"
+}
+
+using namespace std;
+
+// 阻塞策略下每次等待的上限，期间队列被关闭也能及时返回
+#define FRAME_QUEUE_BLOCK_WAIT_MS 100
+
+static long long steady_now_us() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameQueue::FrameQueue(int Capacity, FullPolicy Policy)
+    : capacity(max(1, Capacity))
+    , policy(Policy)
+{
+}
+
+FrameQueue::~FrameQueue()
+{
+    Clear();
+}
+
+bool FrameQueue::Push(AVFrame* Frame, long long CaptureUs, long long GrabUs, bool IsDuplicate)
+{
+    unique_lock<std::mutex> lock(mutex);
+    if ((int)items.size() >= capacity && !isClosed) {
+        if (FullPolicy::DropNewest == policy) {
+            lock.unlock();
+            av_frame_free(&Frame);
+            dropNum++;
+            return false;
+        }
+        if (FullPolicy::DropOldest == policy) {
+            av_frame_free(&items.front().frame);
+            items.pop_front();
+            dropNum++;
+        } else {
+            long long waitStart = steady_now_us();
+            while ((int)items.size() >= capacity && !isClosed) {
+                notFull.wait_for(lock, chrono::milliseconds(FRAME_QUEUE_BLOCK_WAIT_MS));
+            }
+            blockUs += steady_now_us() - waitStart;
+        }
+    }
+    if (isClosed) {
+        lock.unlock();
+        av_frame_free(&Frame);
+        return false;
+    }
+    items.push_back(Item{ Frame, CaptureUs, steady_now_us(), GrabUs, IsDuplicate });
+    size = (int)items.size();
+    if (size > highWater) highWater = (int)size;
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+}
+
+bool FrameQueue::Pop(Item& Out, int TimeoutMs)
+{
+    unique_lock<std::mutex> lock(mutex);
+    if (items.empty()) {
+        notEmpty.wait_for(lock, chrono::milliseconds(TimeoutMs), [this] { return !items.empty() || isClosed; });
+    }
+    if (items.empty()) {
+        return false;
+    }
+    Out = items.front();
+    items.pop_front();
+    size = (int)items.size();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+}
+
+void FrameQueue::Close()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        isClosed = true;
+    }
+    notEmpty.notify_all();
+    notFull.notify_all();
+}
+
+void FrameQueue::Clear()
+{
+    lock_guard<std::mutex> lock(mutex);
+    for (Item& item : items) {
+        av_frame_free(&item.frame);
+    }
+    items.clear();
+    size = 0;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+// FFmpeg类型前向声明
+struct AVFrame;
+
+/// <summary>
+/// 有界视频帧队列
+/// 采集线程把引用计数的I420帧连同采集时刻入队，编码线程出队编码，
+/// 编码器在关键帧等处的耗时尖峰只会让队列暂时变长，不会推迟下一次采集；
+/// 队列满时按策略丢弃最旧的帧、丢弃新帧或让采集线程等待
+/// </summary>
+class FrameQueue
+{
+public:
+    /// <summary>
+    /// 队列满时的策略
+    /// </summary>
+    enum class FullPolicy
+    {
+        DropOldest = 0,     //丢弃最旧的帧，保证画面实时
+        DropNewest = 1,     //丢弃新帧，已入队的帧都会被编码
+        Block = 2,          //采集线程等待，不丢帧但采集会随编码一起落后
+    };
+
+    /// <summary>
+    /// 队列中的一帧
+    /// </summary>
+    struct Item
+    {
+        AVFrame* frame;
+        long long captureUs;    //采集时刻，相对音视频公共起点的微秒数
+        long long pushUs;       //入队时刻(steady_clock微秒)
+        long long grabUs;       //开始采集的时刻(steady_clock微秒)
+        bool isDuplicate;       //是否为补帧产生的重复帧
+    };
+
+    FrameQueue(int Capacity, FullPolicy Policy);
+    ~FrameQueue();
+    FrameQueue(const FrameQueue&) = delete;
+    FrameQueue& operator=(const FrameQueue&) = delete;
+
+    /// <summary>
+    /// 入队，队列接管Frame的所有权，只能由采集线程调用
+    /// </summary>
+    /// <returns>入队的帧被丢弃或队列已关闭时返回false</returns>
+    bool Push(AVFrame* Frame, long long CaptureUs, long long GrabUs, bool IsDuplicate);
+
+    /// <summary>
+    /// 出队，队列为空时最多等待TimeoutMs，只能由编码线程调用
+    /// </summary>
+    /// <returns>取到帧返回true，调用者负责av_frame_free</returns>
+    bool Pop(Item& Out, int TimeoutMs);
+
+    /// <summary>
+    /// 关闭队列，唤醒所有等待者，之后入队的帧直接释放，已入队的帧仍可出队
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// 释放队列中剩余的帧
+    /// </summary>
+    void Clear();
+
+    bool IsClosed() const { return isClosed; }
+    int Size() const { return size; }
+    int GetCapacity() const { return capacity; }
+    FullPolicy GetPolicy() const { return policy; }
+    /// <summary>
+    /// 获取出现过的最大排队帧数
+    /// </summary>
+    int GetHighWater() const { return highWater; }
+    /// <summary>
+    /// 获取因队列满而丢弃的帧数
+    /// </summary>
+    unsigned long long GetDropNum() const { return dropNum; }
+    /// <summary>
+    /// 获取采集线程因队列满而等待的总时长(微秒)
+    /// </summary>
+    long long GetBlockUs() const { return blockUs; }
+
+private:
+    const int capacity;
+    const FullPolicy policy;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<Item> items;
+    std::atomic<bool> isClosed{ false };
+    std::atomic<int> size{ 0 };
+    std::atomic<int> highWater{ 0 };
+    std::atomic<unsigned long long> dropNum{ 0 };
+    std::atomic<long long> blockUs{ 0 };
+};
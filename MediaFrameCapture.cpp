@@ -2,9 +2,32 @@
 #include "Log.h" // 假设Log.h是跨平台的
 
 #include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
 
 using namespace std;
 
+// 驱动缓冲区数量，太少会在编码卡顿时丢帧，太多会增加延迟
+#define V4L2_BUFFER_COUNT 4
+// 等待一帧的超时时间
+#define V4L2_READ_TIMEOUT_MS 2000
+
+// ioctl被信号打断时重试
+static int xioctl(int fd, unsigned long request, void* arg)
+{
+    int ret;
+    do {
+        ret = ioctl(fd, request, arg);
+    } while (ret == -1 && errno == EINTR);
+    return ret;
+}
+
 MediaFrameCapture::MediaFrameCapture()
     : mCapture(nullptr), isOpen(false), mWidth(0), mHeight(0)
 {
@@ -39,35 +62,21 @@ bool MediaFrameCapture::open(uint32_t index)
         }
 
         LOG_INFO("Attempting to open camera index: " + to_string(index));
-        
-        mCapture = new cv::VideoCapture();
-        // 明确使用V4L2后端
-        if (!mCapture->open(index, cv::CAP_V4L2)) {
-            LOG_ERROR("Failed to open camera index: " + to_string(index));
-            delete mCapture;
-            mCapture = nullptr;
-            // lock_guard 会在函数返回时自动解锁
-            return false;
-        }
 
-        if (!mCapture->isOpened()) {
-            LOG_ERROR("Camera index " + to_string(index) + " could not be opened.");
-            delete mCapture;
-            mCapture = nullptr;
+        mIndex = index;
+        // 优先直接使用V4L2 mmap采集，不支持时再交给OpenCV
+        if (openNative(index)) {
+            isOpen = true;
+            mDeviceId = "/dev/video" + to_string(index);
+            LOG_INFO("Successfully opened camera " + mDeviceId + " with native V4L2 mmap, default resolution " + to_string(mWidth) + "x" + to_string(mHeight));
+        }
+    }
+    if (!isNative()) {
+        std::lock_guard<std::mutex> lock(mutexVar);
+        if (!openCapture(index)) {
             // lock_guard 会在函数返回时自动解锁
             return false;
         }
-
-        // 在持有锁的情况下，安全地修改所有成员变量
-        isOpen = true;
-        mDeviceId = "/dev/video" + to_string(index);
-        
-        // 获取并存储默认的宽高
-        mWidth = static_cast<uint32_t>(mCapture->get(cv::CAP_PROP_FRAME_WIDTH));
-        mHeight = static_cast<uint32_t>(mCapture->get(cv::CAP_PROP_FRAME_HEIGHT));
-        
-        LOG_INFO("Successfully opened camera " + mDeviceId + " with default resolution " + to_string(mWidth) + "x" + to_string(mHeight));
-
     } // 锁(lock_guard)在这里结束作用域并自动释放
 
     // --- 修改结束 ---
@@ -86,6 +95,7 @@ bool MediaFrameCapture::open(uint32_t index)
 void MediaFrameCapture::release()
 {
     std::lock_guard<std::mutex> lock(mutexVar);
+    closeNative();
     if (mCapture != nullptr) {
         LOG_INFO("Releasing camera.");
         mCapture->release();
@@ -101,6 +111,17 @@ void MediaFrameCapture::release()
 bool MediaFrameCapture::setupDevice(int width, int height)
 {
     std::lock_guard<std::mutex> lock(mutexVar);
+    if (isNative()) {
+        if (setupNative(width, height)) {
+            return true;
+        }
+        // 直连模式协商不出可用的格式或无法开始采集时，与打开时一样回退到OpenCV，由它负责解码
+        LOG_WARN("Native V4L2 setup failed on /dev/video" + to_string(mIndex) + ", fallback to OpenCV");
+        closeNative();
+        if (!openCapture(mIndex)) {
+            return false;
+        }
+    }
     if (!mCapture || !mCapture->isOpened()) {
         LOG_ERROR("Cannot setup device, camera is not open.");
         return false;
@@ -137,6 +158,20 @@ bool MediaFrameCapture::read(cv::Mat& oneFrame)
     if (!isOpened()) {
         return false;
     }
+    if (isNative()) {
+        // 为兼容原有接口，把原始数据解码为BGR
+        int bufIndex = -1;
+        size_t bytes = 0;
+        int64_t timestampUs = 0;
+        if (!dequeue(bufIndex, bytes, timestampUs)) {
+            return false;
+        }
+        RawFrame frame{ static_cast<const uint8_t*>(mBuffers[bufIndex].first), bytes,
+            static_cast<int>(mWidth), static_cast<int>(mHeight), static_cast<int>(mStride), mFormat, timestampUs };
+        decodeRaw(frame, oneFrame);
+        enqueue(bufIndex);
+        return !oneFrame.empty();
+    }
     try {
         if (!mCapture->read(oneFrame)) {
             LOG_WARN("Failed to read frame from camera.");
@@ -149,11 +184,293 @@ bool MediaFrameCapture::read(cv::Mat& oneFrame)
     return !oneFrame.empty();
 }
 
+bool MediaFrameCapture::readRaw(const std::function<void(const RawFrame&)>& onFrame)
+{
+    std::lock_guard<std::mutex> lock(mutexVar);
+    if (!isNative() || !mStreaming) {
+        return false;
+    }
+    int bufIndex = -1;
+    size_t bytes = 0;
+    int64_t timestampUs = 0;
+    if (!dequeue(bufIndex, bytes, timestampUs)) {
+        return false;
+    }
+    RawFrame frame{ static_cast<const uint8_t*>(mBuffers[bufIndex].first), bytes,
+        static_cast<int>(mWidth), static_cast<int>(mHeight), static_cast<int>(mStride), mFormat, timestampUs };
+    onFrame(frame);
+    enqueue(bufIndex);
+    return true;
+}
+
+bool MediaFrameCapture::decodeRaw(const RawFrame& frame, cv::Mat& oneFrame)
+{
+    uint8_t* data = const_cast<uint8_t*>(frame.data);
+    try {
+        switch (frame.format) {
+        case RawFormat::YUYV:
+            cv::cvtColor(cv::Mat(frame.height, frame.width, CV_8UC2, data, frame.stride), oneFrame, cv::COLOR_YUV2BGR_YUYV);
+            break;
+        case RawFormat::NV12:
+            cv::cvtColor(cv::Mat(frame.height * 3 / 2, frame.width, CV_8UC1, data, frame.stride), oneFrame, cv::COLOR_YUV2BGR_NV12);
+            break;
+        case RawFormat::MJPEG:
+            oneFrame = cv::imdecode(cv::Mat(1, static_cast<int>(frame.bytes), CV_8UC1, data), cv::IMREAD_COLOR);
+            break;
+        }
+    } catch (const cv::Exception& e) {
+        LOG_ERROR("OpenCV exception while decoding V4L2 frame: " + string(e.what()));
+        oneFrame.release();
+    }
+    return !oneFrame.empty();
+}
+
+bool MediaFrameCapture::openCapture(uint32_t index)
+{
+    mCapture = new cv::VideoCapture();
+    // 明确使用V4L2后端
+    if (!mCapture->open(index, cv::CAP_V4L2)) {
+        LOG_ERROR("Failed to open camera index: " + to_string(index));
+        delete mCapture;
+        mCapture = nullptr;
+        return false;
+    }
+
+    if (!mCapture->isOpened()) {
+        LOG_ERROR("Camera index " + to_string(index) + " could not be opened.");
+        delete mCapture;
+        mCapture = nullptr;
+        return false;
+    }
+
+    // 在持有锁的情况下，安全地修改所有成员变量
+    isOpen = true;
+    mDeviceId = "/dev/video" + to_string(index);
+
+    // 获取并存储默认的宽高
+    mWidth = static_cast<uint32_t>(mCapture->get(cv::CAP_PROP_FRAME_WIDTH));
+    mHeight = static_cast<uint32_t>(mCapture->get(cv::CAP_PROP_FRAME_HEIGHT));
+
+    LOG_INFO("Successfully opened camera " + mDeviceId + " with default resolution " + to_string(mWidth) + "x" + to_string(mHeight));
+    return true;
+}
+
 bool MediaFrameCapture::isOpened() const
 {
+    if (isNative()) {
+        return mStreaming;
+    }
     return mCapture != nullptr && mCapture->isOpened();
 }
 
+// --- Native V4L2 ---
+
+bool MediaFrameCapture::openNative(uint32_t index)
+{
+    const string path = "/dev/video" + to_string(index);
+    int fd = ::open(path.c_str(), O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        LOG_WARN("Native V4L2: failed to open " + path + ": " + strerror(errno));
+        return false;
+    }
+    v4l2_capability cap{};
+    if (xioctl(fd, VIDIOC_QUERYCAP, &cap) < 0
+        || !(cap.capabilities & V4L2_CAP_VIDEO_CAPTURE)
+        || !(cap.capabilities & V4L2_CAP_STREAMING)) {
+        LOG_WARN("Native V4L2: " + path + " does not support capture streaming, fallback to OpenCV");
+        ::close(fd);
+        return false;
+    }
+    v4l2_format fmt{};
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd, VIDIOC_G_FMT, &fmt) < 0) {
+        LOG_WARN("Native V4L2: VIDIOC_G_FMT failed on " + path);
+        ::close(fd);
+        return false;
+    }
+    mFd = fd;
+    mWidth = fmt.fmt.pix.width;
+    mHeight = fmt.fmt.pix.height;
+    return true;
+}
+
+void MediaFrameCapture::closeNative()
+{
+    if (mFd < 0) {
+        return;
+    }
+    stopStreaming();
+    ::close(mFd);
+    mFd = -1;
+}
+
+bool MediaFrameCapture::setupNative(int width, int height)
+{
+    stopStreaming();
+    if (width <= 0 || height <= 0) {
+        LOG_INFO("Using default resolution.");
+        width = static_cast<int>(mWidth);
+        height = static_cast<int>(mHeight);
+    } else {
+        LOG_INFO("Setting resolution to " + to_string(width) + "x" + to_string(height));
+    }
+
+    // 指定分辨率时与原OpenCV路径一致优先MJPEG以降低USB带宽，其次是可直接转I420的非压缩格式；
+    // libyuv未启用JPEG时无法在原始数据路径上解码MJPEG，只协商非压缩格式，都不支持时回退OpenCV解码
+    vector<pair<uint32_t, RawFormat>> candidates = {
+#ifdef HAVE_LIBYUV_JPEG
+        { V4L2_PIX_FMT_MJPEG, RawFormat::MJPEG },
+#endif
+        { V4L2_PIX_FMT_YUYV, RawFormat::YUYV },
+        { V4L2_PIX_FMT_NV12, RawFormat::NV12 },
+    };
+    // 分辨率不变时保持设备当前的格式
+    v4l2_format current{};
+    current.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (mWidth == static_cast<uint32_t>(width) && mHeight == static_cast<uint32_t>(height)
+        && xioctl(mFd, VIDIOC_G_FMT, &current) == 0) {
+        for (size_t i = 1; i < candidates.size(); ++i) {
+            if (candidates[i].first == current.fmt.pix.pixelformat) {
+                swap(candidates[0], candidates[i]);
+                break;
+            }
+        }
+    }
+    bool isFormatOk = false;
+    v4l2_format fmt{};
+    for (const auto& candidate : candidates) {
+        fmt = {};
+        fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        fmt.fmt.pix.width = width;
+        fmt.fmt.pix.height = height;
+        fmt.fmt.pix.pixelformat = candidate.first;
+        fmt.fmt.pix.field = V4L2_FIELD_ANY;
+        if (xioctl(mFd, VIDIOC_S_FMT, &fmt) == 0 && fmt.fmt.pix.pixelformat == candidate.first) {
+            mFormat = candidate.second;
+            isFormatOk = true;
+            break;
+        }
+    }
+    if (!isFormatOk) {
+        LOG_WARN("Native V4L2: device supports none of the native formats");
+        return false;
+    }
+    mWidth = fmt.fmt.pix.width;
+    mHeight = fmt.fmt.pix.height;
+    mStride = fmt.fmt.pix.bytesperline;
+    if (mStride == 0) {
+        mStride = (RawFormat::YUYV == mFormat) ? mWidth * 2 : mWidth;
+    }
+
+    if (width > 0 && (static_cast<int>(mWidth) != width || static_cast<int>(mHeight) != height)) {
+        LOG_WARN("Requested resolution " + to_string(width) + "x" + to_string(height) +
+                 " is not supported. Using " + to_string(mWidth) + "x" + to_string(mHeight) + " instead.");
+    } else {
+        LOG_INFO("Actual resolution set to " + to_string(mWidth) + "x" + to_string(mHeight));
+    }
+    return startStreaming();
+}
+
+bool MediaFrameCapture::startStreaming()
+{
+    v4l2_requestbuffers req{};
+    req.count = V4L2_BUFFER_COUNT;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(mFd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2) {
+        LOG_ERROR("Native V4L2: VIDIOC_REQBUFS failed");
+        return false;
+    }
+    for (uint32_t i = 0; i < req.count; ++i) {
+        v4l2_buffer buf{};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(mFd, VIDIOC_QUERYBUF, &buf) < 0) {
+            LOG_ERROR("Native V4L2: VIDIOC_QUERYBUF failed");
+            stopStreaming();
+            return false;
+        }
+        void* addr = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, buf.m.offset);
+        if (addr == MAP_FAILED) {
+            LOG_ERROR("Native V4L2: mmap failed");
+            stopStreaming();
+            return false;
+        }
+        mBuffers.emplace_back(addr, buf.length);
+        if (xioctl(mFd, VIDIOC_QBUF, &buf) < 0) {
+            LOG_ERROR("Native V4L2: VIDIOC_QBUF failed");
+            stopStreaming();
+            return false;
+        }
+    }
+    v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(mFd, VIDIOC_STREAMON, &type) < 0) {
+        LOG_ERROR("Native V4L2: VIDIOC_STREAMON failed");
+        stopStreaming();
+        return false;
+    }
+    mStreaming = true;
+    return true;
+}
+
+void MediaFrameCapture::stopStreaming()
+{
+    if (mStreaming) {
+        v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(mFd, VIDIOC_STREAMOFF, &type);
+        mStreaming = false;
+    }
+    for (auto& buffer : mBuffers) {
+        munmap(buffer.first, buffer.second);
+    }
+    mBuffers.clear();
+    if (mFd >= 0) {
+        // 释放驱动端的缓冲区，之后才能修改格式
+        v4l2_requestbuffers req{};
+        req.count = 0;
+        req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        req.memory = V4L2_MEMORY_MMAP;
+        xioctl(mFd, VIDIOC_REQBUFS, &req);
+    }
+}
+
+bool MediaFrameCapture::dequeue(int& bufIndex, size_t& bytes, int64_t& timestampUs)
+{
+    pollfd pfd{ mFd, POLLIN, 0 };
+    int ret = poll(&pfd, 1, V4L2_READ_TIMEOUT_MS);
+    if (ret <= 0) {
+        LOG_WARN("Native V4L2: timeout while waiting for frame.");
+        return false;
+    }
+    v4l2_buffer buf{};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(mFd, VIDIOC_DQBUF, &buf) < 0) {
+        LOG_WARN("Native V4L2: VIDIOC_DQBUF failed: " + string(strerror(errno)));
+        return false;
+    }
+    if (buf.index >= mBuffers.size() || (buf.flags & V4L2_BUF_FLAG_ERROR) || buf.bytesused == 0) {
+        enqueue(buf.index);
+        return false;
+    }
+    bufIndex = static_cast<int>(buf.index);
+    bytes = buf.bytesused;
+    timestampUs = static_cast<int64_t>(buf.timestamp.tv_sec) * 1000000 + buf.timestamp.tv_usec;
+    return true;
+}
+
+void MediaFrameCapture::enqueue(int bufIndex)
+{
+    v4l2_buffer buf{};
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = bufIndex;
+    if (xioctl(mFd, VIDIOC_QBUF, &buf) < 0) {
+        LOG_WARN("Native V4L2: VIDIOC_QBUF failed");
+    }
+}
+
 // --- Linux Static Functions ---
 
 std::vector<std::string> MediaFrameCapture::getDeviceList()
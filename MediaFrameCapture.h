@@ -5,10 +5,40 @@
 #include <vector>
 #include <set>
 #include <mutex>
+#include <functional>
 
+/// <summary>
+/// ͷɼ
+/// ֱʹV4L2mmapɼYUYV/NV12/MJPEGԭʼݣ
+/// 豸޷ֱЭ̲õĸʽʱ˵cv::VideoCapture
+/// </summary>
 class MediaFrameCapture
 {
 public:
+    /// <summary>
+    /// ԭʼ֡ݸʽ
+    /// </summary>
+    enum class RawFormat
+    {
+        YUYV,
+        NV12,
+        MJPEG,
+    };
+
+    /// <summary>
+    /// ԭʼֱָ֡mmapֻڻصڼЧ
+    /// </summary>
+    struct RawFrame
+    {
+        const uint8_t* data;
+        size_t bytes;           //ЧֽMJPEGʱΪѹݳ
+        int width;
+        int height;
+        int stride;             //ÿֽMJPEGʱ
+        RawFormat format;
+        int64_t timestampUs;    //Ĳɼʱ(΢룬CLOCK_MONOTONIC)
+    };
+
     MediaFrameCapture();
     ~MediaFrameCapture();
 
@@ -38,6 +68,31 @@ public:
     /// <param name="mat">ȡõһ֡</param>
     /// <returns>Ƿɹȡ</returns>
     bool read(cv::Mat& mat);
+
+    /// <summary>
+    /// ȡһ֡ԭʼݣκν뿽V4L2ֱģʽ
+    /// </summary>
+    /// <param name="onFrame">ȡһ֡Ļصصغ󻺳黹</param>
+    /// <returns>Ƿɹȡ</returns>
+    bool readRaw(const std::function<void(const RawFrame&)>& onFrame);
+
+    /// <summary>
+    /// ԭʼ֡ΪBGR
+    /// </summary>
+    /// <param name="frame">ԭʼ֡</param>
+    /// <param name="oneFrame">BGRͼ</param>
+    /// <returns>Ƿɹ</returns>
+    static bool decodeRaw(const RawFrame& frame, cv::Mat& oneFrame);
+
+    /// <summary>
+    /// ǰǷʹV4L2ֱģʽ
+    /// </summary>
+    bool isNative() const { return mFd >= 0; }
+
+    /// <summary>
+    /// ֱģʽԭʼʽ
+    /// </summary>
+    RawFormat getRawFormat() const { return mFormat; }
     
     uint32_t getWidth() const { return mWidth; }
     uint32_t getHeight() const { return mHeight; }
@@ -59,13 +114,31 @@ public:
     static std::set<std::pair<int, int>> getDeviceWHList(int capNum);
 
 private:
-    // OpenCV Ƶָ
+    bool openCapture(uint32_t index);
+    bool openNative(uint32_t index);
+    void closeNative();
+    bool setupNative(int width, int height);
+    bool startStreaming();
+    void stopStreaming();
+    bool dequeue(int& bufIndex, size_t& bytes, int64_t& timestampUs);
+    void enqueue(int bufIndex);
+
+private:
+    // OpenCV Ƶָ룬V4L2ֱʱʹ
     cv::VideoCapture* mCapture{ nullptr };
 
+    // V4L2ֱ
+    int mFd{ -1 };
+    std::vector<std::pair<void*, size_t>> mBuffers;     //mmapӳ
+    bool mStreaming{ false };
+    RawFormat mFormat{ RawFormat::YUYV };
+    uint32_t mStride{ 0 };
+
     // ĳԱ
     std::mutex mutexVar;
     bool isOpen{ false };
     uint32_t mWidth{ 0 };
     uint32_t mHeight{ 0 };
     std::string mDeviceId{ "" };
+    uint32_t mIndex{ 0 };       //ͷţֱʧʱڻOpenCV
 };
@@ -0,0 +1,155 @@
+#include "MicCapture.h"
+#include "Log.h"
+
+#include <chrono>
+#include <alsa/asoundlib.h>
+
+using namespace std;
+
+// 设备缓冲总时长，约为4个周期
+#define MIC_BUFFER_US 40000
+// 单次等待数据的超时，录制停止时采集线程最迟在此时间后检查到
+#define MIC_WAIT_MS 100
+
+MicCapture::~MicCapture()
+{
+    Close();
+}
+
+vector<string> MicCapture::ListDevices()
+{
+    vector<string> devices;
+    int card = -1;
+    while (snd_card_next(&card) >= 0 && card >= 0) {
+        snd_ctl_t* ctl = nullptr;
+        string ctlName = "hw:" + to_string(card);
+        if (snd_ctl_open(&ctl, ctlName.c_str(), 0) < 0) {
+            continue;
+        }
+        snd_pcm_info_t* info = nullptr;
+        snd_pcm_info_malloc(&info);
+        int device = -1;
+        while (snd_ctl_pcm_next_device(ctl, &device) >= 0 && device >= 0) {
+            snd_pcm_info_set_device(info, device);
+            snd_pcm_info_set_subdevice(info, 0);
+            snd_pcm_info_set_stream(info, SND_PCM_STREAM_CAPTURE);
+            if (snd_ctl_pcm_info(ctl, info) >= 0) {
+                devices.push_back("plughw:" + to_string(card) + "," + to_string(device));
+            }
+        }
+        snd_pcm_info_free(info);
+        snd_ctl_close(ctl);
+    }
+    return devices;
+}
+
+bool MicCapture::Open(int MicPattern, int MicNum)
+{
+    Close();
+    auto begin = chrono::steady_clock::now();
+    bool isOk = false;
+    if (2 == MicPattern) {
+        vector<string> devices = ListDevices();
+        if (MicNum >= 0 && MicNum < (int)devices.size()) {
+            isOk = OpenDevice(devices[MicNum]);
+        } else {
+            LOG_ERROR("麦克风序号" + to_string(MicNum) + "不存在，当前共" + to_string(devices.size()) + "个采集设备");
+        }
+    } else {
+        isOk = OpenDevice("default");
+        // 自动选择时默认设备不可用则依次尝试每个采集设备
+        if (!isOk && 1 == MicPattern) {
+            for (const string& device : ListDevices()) {
+                if (OpenDevice(device)) {
+                    isOk = true;
+                    break;
+                }
+            }
+        }
+    }
+    openUs = (int)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+    if (isOk) {
+        LOG_INFO("麦克风(" + deviceName + ")已打开，周期" + to_string(periodFrames) + "帧，耗时" + to_string(openUs) + "us");
+    }
+    return isOk;
+}
+
+bool MicCapture::OpenDevice(const string& Name)
+{
+    int iRet = snd_pcm_open(&pcm, Name.c_str(), SND_PCM_STREAM_CAPTURE, 0);
+    if (iRet < 0) {
+        LOG_WARN("打开麦克风(" + Name + ")失败: " + string(snd_strerror(iRet)));
+        pcm = nullptr;
+        return false;
+    }
+    // 允许ALSA插件做格式与采样率转换，输出固定为48000Hz S16交错立体声
+    iRet = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+        CHANNELS, SAMPLE_RATE, 1, MIC_BUFFER_US);
+    if (iRet < 0) {
+        LOG_WARN("设置麦克风(" + Name + ")参数失败: " + string(snd_strerror(iRet)));
+        goto END_ERR;
+    }
+    {
+        snd_pcm_uframes_t bufferSize = 0;
+        snd_pcm_uframes_t periodSize = 0;
+        if (snd_pcm_get_params(pcm, &bufferSize, &periodSize) < 0 || 0 == periodSize) {
+            periodSize = SAMPLE_RATE * PERIOD_MS / 1000;
+        }
+        periodFrames = (int)periodSize;
+    }
+    iRet = snd_pcm_start(pcm);
+    if (iRet < 0) {
+        LOG_WARN("启动麦克风(" + Name + ")失败: " + string(snd_strerror(iRet)));
+        goto END_ERR;
+    }
+    deviceName = Name;
+    overrunNum = 0;
+    return true;
+
+END_ERR:
+    snd_pcm_close(pcm);
+    pcm = nullptr;
+    return false;
+}
+
+void MicCapture::Close()
+{
+    if (!pcm) {
+        return;
+    }
+    auto begin = chrono::steady_clock::now();
+    snd_pcm_drop(pcm);
+    snd_pcm_close(pcm);
+    pcm = nullptr;
+    closeUs = (int)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+    LOG_INFO("麦克风(" + deviceName + ")已关闭，耗时" + to_string(closeUs) + "us，溢出" + to_string(overrunNum) + "次");
+}
+
+int MicCapture::Read(uint8_t* Buf)
+{
+    if (!pcm) {
+        return -ENODEV;
+    }
+    int iRet = snd_pcm_wait(pcm, MIC_WAIT_MS);
+    if (0 == iRet) {
+        return 0;
+    }
+    snd_pcm_sframes_t frames = (iRet < 0) ? iRet : snd_pcm_readi(pcm, Buf, periodFrames);
+    if (frames >= 0) {
+        return (int)frames;
+    }
+    if (-EAGAIN == frames) {
+        return 0;
+    }
+    if (-EPIPE == frames) {
+        overrunNum++;
+    }
+    // 溢出或挂起后恢复并重新启动，本周期的数据丢弃
+    iRet = snd_pcm_recover(pcm, (int)frames, 1);
+    if (iRet < 0) {
+        LOG_ERROR("麦克风(" + deviceName + ")读取失败: " + string(snd_strerror(iRet)));
+        return iRet;
+    }
+    snd_pcm_start(pcm);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// ALSA类型前向声明
+typedef struct _snd_pcm snd_pcm_t;
+
+/// <summary>
+/// 麦克风采集
+/// 在进程内通过ALSA PCM接口按周期读取S16交错立体声数据，无需子进程、管道与解封装
+/// </summary>
+class MicCapture
+{
+public:
+    static const int SAMPLE_RATE = 48000;   //采样率
+    static const int CHANNELS = 2;          //声道数，采样格式固定为S16交错
+    static const int PERIOD_MS = 10;        //每个周期的时长
+
+    MicCapture() = default;
+    ~MicCapture();
+    MicCapture(const MicCapture&) = delete;
+    MicCapture& operator=(const MicCapture&) = delete;
+
+    /// <summary>
+    /// 列出可采集的设备，格式为plughw:卡号,设备号，序号即指定麦克风时的序号
+    /// </summary>
+    static std::vector<std::string> ListDevices();
+
+    /// <summary>
+    /// 按麦克风模式打开设备
+    /// </summary>
+    /// <param name="MicPattern">0采用默认麦克风 1自动选择可用麦克风 2采用指定序号的麦克风</param>
+    /// <param name="MicNum">指定的麦克风序号，对应ListDevices的下标</param>
+    /// <returns>是否成功</returns>
+    bool Open(int MicPattern, int MicNum);
+
+    /// <summary>
+    /// 丢弃未读取的数据并关闭设备
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// 读取一个周期的数据，最多阻塞100毫秒
+    /// </summary>
+    /// <param name="Buf">至少GetPeriodFrames()*CHANNELS*2字节</param>
+    /// <returns>读到的帧数，超时或已从溢出中恢复时为0，设备出错时小于0</returns>
+    int Read(uint8_t* Buf);
+
+    bool IsOpened() const { return nullptr != pcm; }
+    const std::string& GetDeviceName() const { return deviceName; }
+    int GetPeriodFrames() const { return periodFrames; }
+    /// <summary>
+    /// 获取最近一次打开设备的耗时(微秒)
+    /// </summary>
+    int GetOpenUs() const { return openUs; }
+    /// <summary>
+    /// 获取最近一次关闭设备的耗时(微秒)
+    /// </summary>
+    int GetCloseUs() const { return closeUs; }
+    /// <summary>
+    /// 获取打开后发生的溢出次数
+    /// </summary>
+    int GetOverrunNum() const { return overrunNum; }
+
+private:
+    bool OpenDevice(const std::string& Name);
+
+private:
+    snd_pcm_t* pcm{ nullptr };
+    std::string deviceName;
+    int periodFrames{ 0 };
+    int openUs{ 0 };
+    int closeUs{ 0 };
+    int overrunNum{ 0 };
+};
@@ -0,0 +1,542 @@
+#include "OutputSink.h"
+#include "Log.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libavutil/opt.h"
+}
+
+using namespace std;
+
+static string av_err2str_cpp(int errnum) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(errnum, errbuf, sizeof(errbuf));
+    return string(errbuf);
+}
+
+OutputSink::OutputSink(const string& Url, int MaxQueue) : url(Url), maxQueue(MaxQueue > 0 ? MaxQueue : 1)
+{
+}
+
+OutputSink::~OutputSink()
+{
+    Close();
+}
+
+string OutputSink::GuessFormatName(const string& Url)
+{
+    if (IsStream(Url)) {
+        return "flv";
+    }
+    if (Url.size() > 3 && 0 == Url.compare(Url.size() - 3, 3, ".ts")) {
+        return "mpegts";
+    }
+    return "";
+}
+
+bool OutputSink::IsStream(const string& Url)
+{
+    return 0 == Url.compare(0, 7, "rtmp://") || 0 == Url.compare(0, 8, "rtmps://");
+}
+
+bool OutputSink::IsGlobalHeader(const string& Url)
+{
+    string formatName = GuessFormatName(Url);
+    const AVOutputFormat* format = av_guess_format(formatName.empty() ? nullptr : formatName.c_str(), Url.c_str(), nullptr);
+    return format && (format->flags & AVFMT_GLOBALHEADER);
+}
+
+void OutputSink::SetSegment(int Seconds, long long MaxBytes)
+{
+    segmentUs = (Seconds > 0) ? (long long)Seconds * 1000000 : 0;
+    segmentMaxBytes = (MaxBytes > 0) ? MaxBytes : 0;
+    if (!IsSegment()) {
+        playlistUrl.clear();
+        return;
+    }
+    size_t dot = url.find_last_of('.');
+    size_t slash = url.find_last_of('/');
+    if (string::npos != dot && (string::npos == slash || dot > slash)) {
+        segmentStem = url.substr(0, dot);
+        segmentExt = url.substr(dot);
+    } else {
+        segmentStem = url;
+        segmentExt = ".ts";
+    }
+    // HLS v3只接受MPEG-TS分段；分片MP4分段各自带moov，需v7与EXT-X-MAP初始化段，这里不生成索引，各分段仍可单独播放
+    if (".ts" == segmentExt) {
+        playlistUrl = segmentStem + ".m3u8";
+    } else {
+        playlistUrl.clear();
+    }
+}
+
+string OutputSink::GetSegmentUrl(int Index) const
+{
+    char index[16];
+    snprintf(index, sizeof(index), "_%05d", Index);
+    return segmentStem + index + segmentExt;
+}
+
+int OutputSink::Open(const AVCodecContext* VideoCtx, const AVCodecContext* AudioCtx)
+{
+    Close();
+    int iRet = 0;
+    videoPar = avcodec_parameters_alloc();
+    audioPar = AudioCtx ? avcodec_parameters_alloc() : nullptr;
+    if (!videoPar || (AudioCtx && !audioPar)) {
+        iRet = AVERROR(ENOMEM);
+        goto END_ERR;
+    }
+    iRet = avcodec_parameters_from_context(videoPar, VideoCtx);
+    if (iRet < 0) goto END_ERR;
+    videoTimeBaseNum = VideoCtx->time_base.num;
+    videoTimeBaseDen = VideoCtx->time_base.den;
+    if (AudioCtx) {
+        iRet = avcodec_parameters_from_context(audioPar, AudioCtx);
+        if (iRet < 0) goto END_ERR;
+        audioTimeBaseNum = AudioCtx->time_base.num;
+        audioTimeBaseDen = AudioCtx->time_base.den;
+    }
+    hasAudio = nullptr != AudioCtx;
+
+    segmentIndex = 0;
+    segmentStartUs = -1;
+    segmentLastUs = 0;
+    segmentBytes = 0;
+    segments.clear();
+    segmentNum = 0;
+    avgRotateUs = 0;
+    maxRotateUs = 0;
+    closedFileBytes = 0;
+    closedPayloadBytes = 0;
+    iRet = OpenFile(IsSegment() ? GetSegmentUrl(0) : url, formatCtx, videoStream, audioStream);
+    if (iRet < 0) goto END_ERR;
+
+    // 编码器按全局头输出时关键帧内不再带SPS/PPS，不使用全局头的封装(如MPEG-TS)需要补回
+    if (!(formatCtx->oformat->flags & AVFMT_GLOBALHEADER) && VideoCtx->extradata_size > 0) {
+        iRet = InitExtraDataFilter(VideoCtx);
+        if (iRet < 0) goto END_ERR;
+    }
+
+    isFailed = false;
+    isVideoDropping = false;
+    writeNum = 0;
+    dropNum = 0;
+    maxQueueDepth = 0;
+    avgWriteUs = 0;
+    maxWriteUs = 0;
+    isRunning = true;
+    thread.reset(new std::thread(&OutputSink::Run, this));
+    LOG_INFO("输出端(" + url + ")已打开，封装格式:" + string(formatCtx->oformat->name)
+        + (IsSegment() ? "，分段索引:" + playlistUrl : ""));
+    return 0;
+
+END_ERR:
+    if (formatCtx) CloseFile(formatCtx);
+    videoStream = nullptr;
+    audioStream = nullptr;
+    if (extraDataBsf) av_bsf_free(&extraDataBsf);
+    avcodec_parameters_free(&videoPar);
+    avcodec_parameters_free(&audioPar);
+    return iRet;
+}
+
+int OutputSink::OpenFile(const string& FileUrl, AVFormatContext*& Ctx, AVStream*& VideoStream, AVStream*& AudioStream)
+{
+    string formatName = GuessFormatName(FileUrl);
+    int iRet = avformat_alloc_output_context2(&Ctx, nullptr, formatName.empty() ? nullptr : formatName.c_str(), FileUrl.c_str());
+    if (iRet < 0 || !Ctx) {
+        LOG_ERROR("输出端(" + FileUrl + ")分配上下文失败: " + av_err2str_cpp(iRet));
+        Ctx = nullptr;
+        return iRet < 0 ? iRet : AVERROR_UNKNOWN;
+    }
+
+    AVDictionary* opts = nullptr;
+    VideoStream = nullptr;
+    AudioStream = nullptr;
+    do {
+        VideoStream = avformat_new_stream(Ctx, nullptr);
+        if (!VideoStream) {
+            iRet = AVERROR(ENOMEM);
+            break;
+        }
+        VideoStream->id = VideoStream->index;
+        iRet = avcodec_parameters_copy(VideoStream->codecpar, videoPar);
+        if (iRet < 0) break;
+        VideoStream->time_base = AVRational{ videoTimeBaseNum, videoTimeBaseDen };
+
+        if (audioPar) {
+            AudioStream = avformat_new_stream(Ctx, nullptr);
+            if (!AudioStream) {
+                iRet = AVERROR(ENOMEM);
+                break;
+            }
+            AudioStream->id = AudioStream->index;
+            iRet = avcodec_parameters_copy(AudioStream->codecpar, audioPar);
+            if (iRet < 0) break;
+            AudioStream->time_base = AVRational{ audioTimeBaseNum, audioTimeBaseDen };
+        }
+
+        if (!(Ctx->oformat->flags & AVFMT_NOFILE)) {
+            iRet = avio_open(&Ctx->pb, FileUrl.c_str(), AVIO_FLAG_WRITE);
+            if (iRet < 0) {
+                LOG_ERROR("输出端(" + FileUrl + ")avio_open失败: " + av_err2str_cpp(iRet));
+                break;
+            }
+        }
+
+        if (IsSegment() && "mpegts" == formatName) {
+            // TS分段拼成一条连续的流播放，时间戳沿用编码器的，不能每段都平移到0
+        } else {
+            // 音视频时间戳以同一起点为零点，B帧与AAC编码延迟带来的负时间戳由所有流一起平移，不破坏对齐
+            Ctx->avoid_negative_ts = AVFMT_AVOID_NEG_TS_MAKE_ZERO;
+        }
+        if (IsSegment() && 0 == strcmp(Ctx->oformat->name, "mp4")) {
+            // 分片MP4在每个关键帧处写出moof，进程崩溃时已写入的部分仍可播放
+            av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        }
+        iRet = avformat_write_header(Ctx, &opts);
+        if (iRet < 0) {
+            LOG_ERROR("输出端(" + FileUrl + ")写入文件头失败: " + av_err2str_cpp(iRet));
+            break;
+        }
+        iRet = 0;
+    } while (0);
+
+    if (opts) av_dict_free(&opts);
+    if (iRet < 0) {
+        if (Ctx->pb) avio_closep(&Ctx->pb);
+        avformat_free_context(Ctx);
+        Ctx = nullptr;
+        VideoStream = nullptr;
+        AudioStream = nullptr;
+    }
+    return iRet;
+}
+
+long long OutputSink::CloseFile(AVFormatContext*& Ctx)
+{
+    long long fileBytes = 0;
+    if (Ctx->pb) {
+        av_write_trailer(Ctx);
+        fileBytes = avio_tell(Ctx->pb);
+        avio_closep(&Ctx->pb);
+    }
+    avformat_free_context(Ctx);
+    Ctx = nullptr;
+    return fileBytes;
+}
+
+void OutputSink::Close()
+{
+    isRunning = false;
+    {
+        lock_guard<mutex> lock(waitMutex);
+    }
+    waitCond.notify_all();
+    if (thread && thread->joinable()) {
+        thread->join();
+    }
+    thread.reset();
+    // 写入线程退出后队列中只剩下出错后未写入的包
+    queue.Clear();
+    JoinCloseThread();
+
+    if (formatCtx) {
+        long long payloadBytes = segmentBytes;
+        long long fileBytes = CloseFile(formatCtx);
+        videoStream = nullptr;
+        audioStream = nullptr;
+        if (IsSegment()) {
+            if (segmentBytes > 0) {
+                lock_guard<mutex> lock(playlistMutex);
+                segments.push_back(Segment{ GetSegmentUrl(segmentIndex).substr(segmentStem.find_last_of('/') + 1),
+                    max(0LL, segmentLastUs - segmentStartUs) / 1000000.0, segmentBytes });
+                segmentNum = (int)segments.size();
+            }
+            WritePlaylist(true);
+        }
+        closedFileBytes += fileBytes;
+        closedPayloadBytes += payloadBytes;
+        LOG_INFO("输出端(" + url + ")已关闭，共写入" + to_string(writeNum) + "个包，丢弃" + to_string(dropNum)
+            + "个包，最大排队" + to_string(maxQueueDepth) + "个包，写入平均耗时" + to_string(avgWriteUs)
+            + "us，最大耗时" + to_string(maxWriteUs) + "us，写放大" + to_string(GetWriteAmplification()) + "%"
+            + (IsSegment() ? "，共" + to_string(segmentNum) + "个分段，切换平均耗时" + to_string(avgRotateUs)
+                + "us，最大耗时" + to_string(maxRotateUs) + "us" : ""));
+    }
+    if (extraDataBsf) {
+        av_bsf_free(&extraDataBsf);
+    }
+    avcodec_parameters_free(&videoPar);
+    avcodec_parameters_free(&audioPar);
+}
+
+void OutputSink::Push(const AVPacket* Packet, bool IsVideo)
+{
+    if (!isRunning || isFailed || (!IsVideo && !hasAudio)) {
+        return;
+    }
+    if (IsDrop(Packet, IsVideo)) {
+        dropNum++;
+        return;
+    }
+    AVPacket* packet = av_packet_clone(Packet);
+    if (!packet) {
+        return;
+    }
+    queue.Push(packet, IsVideo);
+    int depth = queue.Size();
+    int maxDepth = maxQueueDepth;
+    while (depth > maxDepth && !maxQueueDepth.compare_exchange_weak(maxDepth, depth)) {
+    }
+    // 写入线程忙时不去碰锁，只有它在等待时才唤醒
+    if (isWaiting) {
+        lock_guard<mutex> lock(waitMutex);
+        waitCond.notify_one();
+    }
+}
+
+bool OutputSink::IsDrop(const AVPacket* Packet, bool IsVideo)
+{
+    int depth = queue.Size();
+    if (depth >= maxQueue * 2) {
+        // 输出端已严重堵塞，音频也丢弃，视频需要等下一个关键帧才能继续
+        if (IsVideo) isVideoDropping = true;
+        return true;
+    }
+    if (!IsVideo) {
+        return false;
+    }
+    bool isKey = (Packet->flags & AV_PKT_FLAG_KEY) != 0;
+    if (isKey) {
+        isVideoDropping = false;
+        return false;
+    }
+    // 丢了一个非关键帧后，之后的帧解码都依赖它，只能丢到下一个关键帧
+    if (isVideoDropping || depth >= maxQueue) {
+        isVideoDropping = true;
+        return true;
+    }
+    return false;
+}
+
+void OutputSink::Run()
+{
+    AVPacket* packet = nullptr;
+    bool isVideo = false;
+    while (true) {
+        if (!queue.Pop(packet, isVideo)) {
+            // 停止时先写完已经排队的包，保证文件尾之前的数据完整
+            if (!isRunning) {
+                break;
+            }
+            unique_lock<mutex> lock(waitMutex);
+            isWaiting = true;
+            // 设置等待标志与生产者入队之间存在竞争，超时作为兜底
+            waitCond.wait_for(lock, chrono::milliseconds(100), [this] { return queue.Size() > 0 || !isRunning; });
+            isWaiting = false;
+            continue;
+        }
+        if (isFailed) {
+            av_packet_free(&packet);
+            continue;
+        }
+        auto begin = chrono::steady_clock::now();
+        Write(packet, isVideo);
+        UpdateWriteUs(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count());
+        av_packet_free(&packet);
+    }
+}
+
+void OutputSink::UpdateWriteUs(long long CostUs)
+{
+    int costUs = (int)CostUs;
+    int avg = avgWriteUs;
+    avgWriteUs = (avg == 0) ? costUs : avg + (costUs - avg) / 16;
+    if (costUs > maxWriteUs) {
+        maxWriteUs = costUs;
+    }
+}
+
+long long OutputSink::ToUs(const AVPacket* Packet, bool IsVideo) const
+{
+    int64_t ts = (AV_NOPTS_VALUE != Packet->dts) ? Packet->dts : Packet->pts;
+    if (AV_NOPTS_VALUE == ts) {
+        return segmentLastUs;
+    }
+    AVRational timeBase = IsVideo ? AVRational{ videoTimeBaseNum, videoTimeBaseDen } : AVRational{ audioTimeBaseNum, audioTimeBaseDen };
+    return av_rescale_q(ts, timeBase, AVRational{ 1, 1000000 });
+}
+
+void OutputSink::Write(AVPacket* Packet, bool IsVideo)
+{
+    if (IsSegment()) {
+        long long us = ToUs(Packet, IsVideo);
+        if (segmentStartUs < 0) {
+            segmentStartUs = us;
+        }
+        // 只在视频关键帧处切换，保证每个分段都能独立解码
+        bool isKey = IsVideo && (Packet->flags & AV_PKT_FLAG_KEY);
+        if (isKey && segmentBytes > 0
+            && ((segmentUs > 0 && us - segmentStartUs >= segmentUs) || (segmentMaxBytes > 0 && segmentBytes >= segmentMaxBytes))) {
+            Rotate(us);
+        }
+        segmentLastUs = max(segmentLastUs, us);
+    }
+    int packetSize = Packet->size;
+
+    AVStream* stream = IsVideo ? videoStream : audioStream;
+    if (IsVideo) {
+        av_packet_rescale_ts(Packet, AVRational{ videoTimeBaseNum, videoTimeBaseDen }, stream->time_base);
+    } else {
+        av_packet_rescale_ts(Packet, AVRational{ audioTimeBaseNum, audioTimeBaseDen }, stream->time_base);
+    }
+    Packet->stream_index = stream->index;
+
+    int iRet = 0;
+    if (IsVideo && extraDataBsf) {
+        iRet = av_bsf_send_packet(extraDataBsf, Packet);
+        while (iRet >= 0) {
+            iRet = av_bsf_receive_packet(extraDataBsf, Packet);
+            if (iRet < 0) {
+                iRet = (iRet == AVERROR(EAGAIN)) ? 0 : iRet;
+                break;
+            }
+            iRet = av_interleaved_write_frame(formatCtx, Packet);
+            if (iRet >= 0) writeNum++;
+        }
+    } else {
+        iRet = av_interleaved_write_frame(formatCtx, Packet);
+        if (iRet >= 0) writeNum++;
+    }
+    if (iRet >= 0) {
+        segmentBytes += packetSize;
+    }
+    if (iRet < 0) {
+        // 出错后不再写入，但不影响其他输出端
+        LOG_ERROR("输出端(" + url + ")写入失败，之后的数据将被丢弃: " + av_err2str_cpp(iRet));
+        isFailed = true;
+    }
+}
+
+int OutputSink::InitExtraDataFilter(const AVCodecContext* VideoCtx)
+{
+    const AVBitStreamFilter* filter = av_bsf_get_by_name("dump_extra");
+    if (!filter) {
+        LOG_WARN("输出端(" + url + ")找不到dump_extra，关键帧将不带SPS/PPS");
+        return 0;
+    }
+    int iRet = av_bsf_alloc(filter, &extraDataBsf);
+    if (iRet < 0) return iRet;
+    iRet = avcodec_parameters_from_context(extraDataBsf->par_in, VideoCtx);
+    if (iRet < 0) return iRet;
+    extraDataBsf->time_base_in = VideoCtx->time_base;
+    av_opt_set(extraDataBsf->priv_data, "freq", "keyframe", 0);
+    return av_bsf_init(extraDataBsf);
+}
+
+void OutputSink::Rotate(long long KeyUs)
+{
+    auto begin = chrono::steady_clock::now();
+    AVFormatContext* nextCtx = nullptr;
+    AVStream* nextVideoStream = nullptr;
+    AVStream* nextAudioStream = nullptr;
+    string nextUrl = GetSegmentUrl(segmentIndex + 1);
+    if (OpenFile(nextUrl, nextCtx, nextVideoStream, nextAudioStream) < 0) {
+        // 打开下一段失败时继续写当前段，到下一个周期再尝试
+        LOG_WARN("输出端(" + url + ")切换分段失败，继续写入当前分段");
+        segmentStartUs = KeyUs;
+        return;
+    }
+    Segment info{ GetSegmentUrl(segmentIndex).substr(segmentStem.find_last_of('/') + 1),
+        max(0LL, KeyUs - segmentStartUs) / 1000000.0, segmentBytes };
+    AVFormatContext* prevCtx = formatCtx;
+    formatCtx = nextCtx;
+    videoStream = nextVideoStream;
+    audioStream = nextAudioStream;
+    segmentIndex++;
+    segmentStartUs = KeyUs;
+    segmentBytes = 0;
+
+    // 旧分段的文件尾交给关闭线程写，写入线程马上继续写新分段
+    JoinCloseThread();
+    closeThread.reset(new std::thread(&OutputSink::CloseSegment, this, prevCtx, info));
+
+    int costUs = (int)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+    int avg = avgRotateUs;
+    avgRotateUs = (avg == 0) ? costUs : avg + (costUs - avg) / 16;
+    if (costUs > maxRotateUs) {
+        maxRotateUs = costUs;
+    }
+}
+
+void OutputSink::CloseSegment(AVFormatContext* Ctx, Segment Info)
+{
+    auto begin = chrono::steady_clock::now();
+    long long fileBytes = CloseFile(Ctx);
+    closedFileBytes += fileBytes;
+    closedPayloadBytes += Info.payloadBytes;
+    {
+        lock_guard<mutex> lock(playlistMutex);
+        segments.push_back(Info);
+        segmentNum = (int)segments.size();
+    }
+    WritePlaylist(false);
+    LOG_INFO("输出端(" + url + ")分段" + Info.name + "已写完，时长" + to_string(Info.duration) + "秒，"
+        + to_string(fileBytes) + "字节，写文件尾耗时"
+        + to_string(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count()) + "us");
+}
+
+void OutputSink::JoinCloseThread()
+{
+    if (closeThread && closeThread->joinable()) {
+        closeThread->join();
+    }
+    closeThread.reset();
+}
+
+void OutputSink::WritePlaylist(bool IsEnd)
+{
+    if (playlistUrl.empty()) {
+        return;
+    }
+    lock_guard<mutex> lock(playlistMutex);
+    double targetDuration = 1;
+    for (const Segment& segment : segments) {
+        targetDuration = max(targetDuration, segment.duration);
+    }
+    // 先写临时文件再改名，读者不会看到写了一半的索引
+    string tmpUrl = playlistUrl + ".tmp";
+    ofstream out(tmpUrl, ios::trunc);
+    if (!out) {
+        LOG_WARN("输出端(" + url + ")无法写入分段索引:" + tmpUrl);
+        return;
+    }
+    out << "#EXTM3U\n#EXT-X-VERSION:3\n#EXT-X-TARGETDURATION:" << (int)ceil(targetDuration) << "\n#EXT-X-MEDIA-SEQUENCE:0\n";
+    out << fixed << setprecision(3);
+    for (const Segment& segment : segments) {
+        out << "#EXTINF:" << segment.duration << ",\n" << segment.name << "\n";
+    }
+    if (IsEnd) {
+        out << "#EXT-X-ENDLIST\n";
+    }
+    out.close();
+    if (rename(tmpUrl.c_str(), playlistUrl.c_str()) != 0) {
+        LOG_WARN("输出端(" + url + ")更新分段索引失败:" + playlistUrl);
+    }
+}
+
+int OutputSink::GetWriteAmplification() const
+{
+    long long payloadBytes = closedPayloadBytes;
+    return payloadBytes > 0 ? (int)(closedFileBytes * 100 / payloadBytes) : 0;
+}
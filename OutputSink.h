@@ -0,0 +1,207 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "PacketQueue.h"
+
+// FFmpeg类型前向声明
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVStream;
+struct AVPacket;
+struct AVBSFContext;
+struct AVCodecParameters;
+
+/// <summary>
+/// 输出端
+/// 同一组编码后的音视频包可以同时送往多个输出端(MP4文件、FLV/RTMP、MPEG-TS)，
+/// 每个输出端有自己的封装上下文、包队列与写入线程，某个网络输出卡住时不会阻塞其他输出
+/// 编码线程只做无锁入队，队列超出上限时优先丢弃视频非关键帧(并丢到下一个关键帧为止)，
+/// 超出两倍上限时任何包都丢弃
+/// 可选分段模式：写入线程在视频关键帧处按时长或大小切换到下一个文件，旧文件的文件尾由关闭线程写入，
+/// 切换不阻塞编码线程；MP4分段使用分片MP4(frag_keyframe)，进程崩溃时已写入的数据仍可播放；
+/// MPEG-TS分段写完后登记到同名的m3u8索引中
+/// </summary>
+class OutputSink
+{
+public:
+    /// <summary>
+    /// 创建输出端
+    /// </summary>
+    /// <param name="Url">文件路径或推流地址</param>
+    /// <param name="MaxQueue">包队列上限</param>
+    OutputSink(const std::string& Url, int MaxQueue);
+    ~OutputSink();
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    /// <summary>
+    /// 根据地址推断封装格式名：rtmp为flv，.ts为mpegts，其余为空由FFmpeg按扩展名推断
+    /// </summary>
+    static std::string GuessFormatName(const std::string& Url);
+
+    /// <summary>
+    /// 是否为推流地址(rtmp/rtmps)，自适应码率只依据推流输出端的拥塞情况
+    /// </summary>
+    static bool IsStream(const std::string& Url);
+
+    /// <summary>
+    /// 该地址对应的封装格式是否要求编码器输出全局头，需在打开编码器之前判断
+    /// </summary>
+    static bool IsGlobalHeader(const std::string& Url);
+
+    /// <summary>
+    /// 启用分段模式，需在Open之前调用；分段文件名为地址去掉扩展名后加_序号，.ts分段的索引为同名的.m3u8
+    /// </summary>
+    /// <param name="Seconds">每段时长，0表示不按时长分段</param>
+    /// <param name="MaxBytes">每段大小，0表示不按大小分段</param>
+    void SetSegment(int Seconds, long long MaxBytes);
+
+    /// <summary>
+    /// 按编码器参数创建流、写入文件头并启动写入线程
+    /// </summary>
+    /// <param name="VideoCtx">已打开的视频编码器</param>
+    /// <param name="AudioCtx">已打开的音频编码器，无音频时为nullptr</param>
+    /// <returns>0成功，否则为FFmpeg错误码</returns>
+    int Open(const AVCodecContext* VideoCtx, const AVCodecContext* AudioCtx);
+
+    /// <summary>
+    /// 写完队列中剩余的包、写入文件尾并关闭
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// 送入一个编码包，时间戳为编码器时间基；包数据只增加引用不拷贝
+    /// </summary>
+    /// <param name="Packet">编码包</param>
+    /// <param name="IsVideo">是否视频包</param>
+    void Push(const AVPacket* Packet, bool IsVideo);
+
+    const std::string& GetUrl() const { return url; }
+    bool IsOpened() const { return nullptr != formatCtx; }
+    /// <summary>
+    /// 写入是否已出错，出错后的包直接丢弃
+    /// </summary>
+    bool IsFailed() const { return isFailed; }
+    /// <summary>
+    /// 获取已写入的包数
+    /// </summary>
+    unsigned long long GetWriteNum() const { return writeNum; }
+    /// <summary>
+    /// 获取当前排队的包数
+    /// </summary>
+    int GetQueueDepth() const { return queue.Size(); }
+    /// <summary>
+    /// 获取本次录制中出现过的最大排队包数
+    /// </summary>
+    int GetMaxQueueDepth() const { return maxQueueDepth; }
+    /// <summary>
+    /// 获取每次写入包耗时的滑动平均值(微秒)
+    /// </summary>
+    int GetAvgWriteUs() const { return avgWriteUs; }
+    /// <summary>
+    /// 获取单次写入包的最大耗时(微秒)
+    /// </summary>
+    int GetMaxWriteUs() const { return maxWriteUs; }
+    /// <summary>
+    /// 获取因队列超出上限而丢弃的包数
+    /// </summary>
+    unsigned long long GetDropNum() const { return dropNum; }
+    bool IsSegment() const { return segmentUs > 0 || segmentMaxBytes > 0; }
+    /// <summary>
+    /// 获取分段索引文件的路径，非分段模式或非MPEG-TS分段为空
+    /// </summary>
+    const std::string& GetPlaylistUrl() const { return playlistUrl; }
+    /// <summary>
+    /// 获取已写完的分段数
+    /// </summary>
+    int GetSegmentNum() const { return segmentNum; }
+    /// <summary>
+    /// 获取切换分段时写入线程耗时的滑动平均值(微秒)，不含关闭线程写文件尾的时间
+    /// </summary>
+    int GetAvgRotateUs() const { return avgRotateUs; }
+    /// <summary>
+    /// 获取切换分段时写入线程的最大耗时(微秒)
+    /// </summary>
+    int GetMaxRotateUs() const { return maxRotateUs; }
+    /// <summary>
+    /// 获取写放大，即已关闭文件的大小与其中包数据之比的百分数，还没有关闭的文件时为0
+    /// </summary>
+    int GetWriteAmplification() const;
+
+private:
+    struct Segment
+    {
+        std::string name;           //不含目录的文件名
+        double duration;            //秒
+        long long payloadBytes;     //包数据字节数
+    };
+
+    void Run();
+    bool IsDrop(const AVPacket* Packet, bool IsVideo);
+    void UpdateWriteUs(long long CostUs);
+    void Write(AVPacket* Packet, bool IsVideo);
+    int InitExtraDataFilter(const AVCodecContext* VideoCtx);
+    int OpenFile(const std::string& FileUrl, AVFormatContext*& Ctx, AVStream*& VideoStream, AVStream*& AudioStream);
+    long long CloseFile(AVFormatContext*& Ctx);
+    std::string GetSegmentUrl(int Index) const;
+    long long ToUs(const AVPacket* Packet, bool IsVideo) const;
+    void Rotate(long long KeyUs);
+    void CloseSegment(AVFormatContext* Ctx, Segment Info);
+    void JoinCloseThread();
+    void WritePlaylist(bool IsEnd);
+
+private:
+    const std::string url;
+    AVFormatContext* formatCtx{ nullptr };
+    AVStream* videoStream{ nullptr };
+    AVStream* audioStream{ nullptr };
+    AVBSFContext* extraDataBsf{ nullptr };  //封装格式不使用全局头时在关键帧前补上SPS/PPS
+    AVCodecParameters* videoPar{ nullptr }; //编码参数，分段模式下每个文件都按它创建流
+    AVCodecParameters* audioPar{ nullptr };
+    bool hasAudio{ false };
+    int videoTimeBaseNum{ 0 };              //编码器时间基，写入前转换到流的时间基
+    int videoTimeBaseDen{ 1 };
+    int audioTimeBaseNum{ 0 };
+    int audioTimeBaseDen{ 1 };
+
+    std::unique_ptr<std::thread> thread;
+    PacketQueue queue;
+    const int maxQueue;
+    std::atomic<bool> isRunning{ false };
+    std::atomic<bool> isFailed{ false };
+    std::atomic<bool> isVideoDropping{ false };   //丢弃过视频非关键帧，后续视频帧丢到下一个关键帧为止
+    std::atomic<bool> isWaiting{ false };         //写入线程是否在等待新包，生产者只在此时才去唤醒
+    std::mutex waitMutex;                         //仅用于写入线程等待新包，不保护队列
+    std::condition_variable waitCond;
+    std::atomic<unsigned long long> writeNum{ 0 };
+    std::atomic<unsigned long long> dropNum{ 0 };
+    std::atomic<int> maxQueueDepth{ 0 };
+    std::atomic<int> avgWriteUs{ 0 };
+    std::atomic<int> maxWriteUs{ 0 };
+
+    //分段模式，以下除统计值外只在写入线程中访问
+    long long segmentUs{ 0 };               //每段时长(微秒)
+    long long segmentMaxBytes{ 0 };         //每段大小
+    std::string segmentStem;                //地址去掉扩展名的部分
+    std::string segmentExt;                 //扩展名，含点
+    std::string playlistUrl;                //索引文件
+    int segmentIndex{ 0 };                  //当前分段序号
+    long long segmentStartUs{ -1 };         //当前分段第一个包的时间戳(微秒)
+    long long segmentLastUs{ 0 };           //当前分段最后一个包的时间戳(微秒)
+    long long segmentBytes{ 0 };            //当前分段已写入的包数据字节数
+    std::unique_ptr<std::thread> closeThread;   //为切换下来的旧分段写文件尾
+    std::mutex playlistMutex;               //保护segments，写入线程收尾与关闭线程都会登记分段
+    std::vector<Segment> segments;          //已写完的分段
+    std::atomic<int> segmentNum{ 0 };
+    std::atomic<int> avgRotateUs{ 0 };
+    std::atomic<int> maxRotateUs{ 0 };
+    std::atomic<long long> closedFileBytes{ 0 };    //已关闭文件的总大小
+    std::atomic<long long> closedPayloadBytes{ 0 }; //已关闭文件中包数据的总大小
+};
@@ -0,0 +1,419 @@
+#include "OverlayEngine.h"
+#include "Log.h"
+
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#include <algorithm>
+#include <libyuv.h>
+
+extern "C" {
+#include "libavutil/frame.h"
+}
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+
+using namespace std;
+
+// 图层与画面边缘的距离占画面短边的比例(1/N)
+#define OVERLAY_MARGIN_DIVISOR 40
+// 时间戳格式为 YYYY-MM-DD HH:MM:SS
+#define OVERLAY_TIMESTAMP_LEN 19
+
+static const char OVERLAY_GLYPHS[] = "0123456789-: ";
+
+static int elapsed_us(const chrono::steady_clock::time_point& Start) {
+    return (int)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - Start).count();
+}
+
+static int glyph_index(char Ch) {
+    const char* pos = strchr(OVERLAY_GLYPHS, Ch);
+    return (pos && Ch) ? (int)(pos - OVERLAY_GLYPHS) : -1;
+}
+
+OverlayEngine::~OverlayEngine()
+{
+    UnInit();
+}
+
+bool OverlayEngine::Init(int Width, int Height, int PixFmt)
+{
+    UnInit();
+    if (!framePool.Init(PixFmt, Width, Height)) {
+        LOG_ERROR("分配叠加层帧池失败");
+        return false;
+    }
+    outFrame = framePool.GetFrame();
+    if (!outFrame) {
+        LOG_ERROR("分配叠加层帧的内存失败");
+        framePool.UnInit();
+        return false;
+    }
+    width = Width;
+    height = Height;
+    isNV12 = (AV_PIX_FMT_NV12 == PixFmt);
+    avgRenderUs = 0;
+    maxRenderUs = 0;
+    areaPixels = 0;
+    renderNum = 0;
+    reuseNum = 0;
+    return true;
+}
+
+void OverlayEngine::UnInit()
+{
+    if (outFrame) av_frame_free(&outFrame);
+    framePool.UnInit();
+    if (display) {
+        XCloseDisplay(display);
+        display = nullptr;
+    }
+    watermarkTile = Tile();
+    for (Tile& glyph : glyphTiles) glyph = Tile();
+    cursorTile = Tile();
+    cursorSerial = 0;
+    isShowCursor = false;
+    hasLayer = false;
+    lastBaseSeq = 0;
+    lastLayers.clear();
+}
+
+bool OverlayEngine::MakeTile(const cv::Mat& Image, int Opacity, bool IsNV12, Tile& Out)
+{
+    Out = Tile();
+    if (Image.empty()) {
+        return false;
+    }
+    cv::Mat bgra;
+    if (4 == Image.channels()) {
+        bgra = Image;
+    } else if (3 == Image.channels()) {
+        cv::cvtColor(Image, bgra, cv::COLOR_BGR2BGRA);
+    } else if (1 == Image.channels()) {
+        cv::cvtColor(Image, bgra, cv::COLOR_GRAY2BGRA);
+    } else {
+        return false;
+    }
+    // I420色度按2x2采样，贴图补齐为偶数宽高，补出的像素完全透明
+    int w = (bgra.cols + 1) & ~1;
+    int h = (bgra.rows + 1) & ~1;
+    if (w != bgra.cols || h != bgra.rows) {
+        cv::Mat padded;
+        cv::copyMakeBorder(bgra, padded, 0, h - bgra.rows, 0, w - bgra.cols, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0, 0));
+        bgra = padded;
+    }
+    Out.width = w;
+    Out.height = h;
+    Out.y.resize(w * h);
+    Out.u.resize((w / 2) * (h / 2));
+    Out.v.resize((w / 2) * (h / 2));
+    Out.a.resize(w * h);
+    // OpenCV的BGRA与libyuv的ARGB内存顺序一致
+    libyuv::ARGBToI420(bgra.data, (int)bgra.step,
+                       Out.y.data(), w, Out.u.data(), w / 2, Out.v.data(), w / 2,
+                       w, h);
+    libyuv::ARGBExtractAlpha(bgra.data, (int)bgra.step, Out.a.data(), w, w, h);
+    if (Opacity < 100) {
+        for (uint8_t& alpha : Out.a) {
+            alpha = (uint8_t)(alpha * max(0, Opacity) / 100);
+        }
+    }
+    if (IsNV12) {
+        // 色度透明度取2x2的平均值，与I420Blend的取样一致
+        Out.uv.resize(w * (h / 2));
+        Out.uvA.resize(w * (h / 2));
+        libyuv::MergeUVPlane(Out.u.data(), w / 2, Out.v.data(), w / 2, Out.uv.data(), w, w / 2, h / 2);
+        for (int row = 0; row < h / 2; row++) {
+            const uint8_t* a0 = Out.a.data() + (row * 2) * w;
+            const uint8_t* a1 = a0 + w;
+            uint8_t* dst = Out.uvA.data() + row * w;
+            for (int col = 0; col < w; col += 2) {
+                dst[col] = dst[col + 1] = (uint8_t)((a0[col] + a0[col + 1] + a1[col] + a1[col + 1] + 2) / 4);
+            }
+        }
+    }
+    return true;
+}
+
+void OverlayEngine::PlaceAt(int Location, int TileWidth, int TileHeight, int& X, int& Y) const
+{
+    int margin = (min(width, height) / OVERLAY_MARGIN_DIVISOR) & ~1;
+    bool isRight = (2 == Location || 3 == Location);
+    bool isBottom = (3 == Location || 4 == Location);
+    X = isRight ? (width - margin - TileWidth) & ~1 : margin;
+    Y = isBottom ? (height - margin - TileHeight) & ~1 : margin;
+}
+
+void OverlayEngine::BuildWatermark(const Config& Setting)
+{
+    watermarkTile = Tile();
+    if (Setting.watermarkLocation < 1 || Setting.watermarkLocation > 4 || Setting.watermark.empty()) {
+        return;
+    }
+    int percent = max(1, min(100, Setting.watermarkWidthPercent));
+    int tileWidth = max(2, width * percent / 100);
+    int tileHeight = max(2, (int)((long long)Setting.watermark.rows * tileWidth / Setting.watermark.cols));
+    cv::Mat scaled;
+    cv::resize(Setting.watermark, scaled, cv::Size(tileWidth, tileHeight), 0, 0,
+               (tileWidth < Setting.watermark.cols) ? cv::INTER_AREA : cv::INTER_LINEAR);
+    if (!MakeTile(scaled, max(0, min(100, Setting.watermarkOpacity)), isNV12, watermarkTile)) {
+        LOG_WARN("水印栅格化失败");
+        return;
+    }
+    PlaceAt(Setting.watermarkLocation, watermarkTile.width, watermarkTile.height, watermarkX, watermarkY);
+    LOG_INFO("水印已栅格化为" + to_string(watermarkTile.width) + "x" + to_string(watermarkTile.height) + "的YUV贴图");
+}
+
+void OverlayEngine::BuildTimestamp(const Config& Setting)
+{
+    for (Tile& glyph : glyphTiles) glyph = Tile();
+    if (Setting.timestampLocation < 1 || Setting.timestampLocation > 4) {
+        return;
+    }
+    int fontHeight = (Setting.timestampHeight > 0) ? Setting.timestampHeight : max(8, height / 30);
+    int thickness = max(1, fontHeight / 12);
+    int outline = max(1, thickness);
+    double scale = cv::getFontScaleFromHeight(cv::FONT_HERSHEY_SIMPLEX, fontHeight, thickness);
+    // 所有字形使用相同的格宽，时间变化时位置不变
+    int cellWidth = 0;
+    int baseline = 0;
+    for (int i = 0; i < GLYPH_NUM; i++) {
+        cv::Size size = cv::getTextSize(string(1, OVERLAY_GLYPHS[i]), cv::FONT_HERSHEY_SIMPLEX, scale, thickness + outline * 2, &baseline);
+        cellWidth = max(cellWidth, size.width);
+    }
+    int cellHeight = fontHeight + baseline + outline * 2;
+    for (int i = 0; i < GLYPH_NUM; i++) {
+        string text(1, OVERLAY_GLYPHS[i]);
+        cv::Size size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, scale, thickness, &baseline);
+        cv::Mat cell(cellHeight, cellWidth, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+        cv::Point org((cellWidth - size.width) / 2, outline + fontHeight);
+        // 黑色描边保证在任何背景上都清晰
+        cv::putText(cell, text, org, cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(0, 0, 0, 255), thickness + outline * 2, cv::LINE_AA);
+        cv::putText(cell, text, org, cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(255, 255, 255, 255), thickness, cv::LINE_AA);
+        MakeTile(cell, 100, isNV12, glyphTiles[i]);
+    }
+    PlaceAt(Setting.timestampLocation, glyphTiles[0].width * OVERLAY_TIMESTAMP_LEN, glyphTiles[0].height, timestampX, timestampY);
+    LOG_INFO("时间戳字形缓存已生成，字高" + to_string(fontHeight) + "，格宽" + to_string(glyphTiles[0].width));
+}
+
+void OverlayEngine::Configure(const Config& Setting)
+{
+    if (!outFrame) {
+        return;
+    }
+    BuildWatermark(Setting);
+    BuildTimestamp(Setting);
+    isShowCursor = Setting.isShowCursor;
+    if (isShowCursor && !display) {
+        display = XOpenDisplay(nullptr);
+        int eventBase = 0, errorBase = 0, major = 2, minor = 0;
+        if (display && XFixesQueryExtension(display, &eventBase, &errorBase)) {
+            // 必须先协商版本，XFixesGetCursorImage需要2.0以上
+            XFixesQueryVersion(display, &major, &minor);
+        }
+        if (!display || major < 2) {
+            LOG_WARN("XFixes不可用，不叠加鼠标指针");
+            if (display) XCloseDisplay(display);
+            display = nullptr;
+            isShowCursor = false;
+        }
+    }
+    cursorSerial = 0;
+    cursorTile = Tile();
+    hasLayer = !watermarkTile.IsEmpty() || !glyphTiles[0].IsEmpty() || isShowCursor;
+    // 贴图已重新生成，下一帧整帧拷贝底图
+    lastBaseSeq = 0;
+    lastLayers.clear();
+}
+
+void OverlayEngine::SetCursorArea(int X, int Y, int Width, int Height)
+{
+    if (X == areaX && Y == areaY && Width == areaWidth && Height == areaHeight) {
+        return;
+    }
+    areaX = X;
+    areaY = Y;
+    areaWidth = Width;
+    areaHeight = Height;
+    // 缩放比例可能变化，指针贴图需重新生成
+    cursorSerial = 0;
+}
+
+bool OverlayEngine::UpdateCursor(Placement& Out)
+{
+    if (!isShowCursor || !display || areaWidth <= 0 || areaHeight <= 0) {
+        return false;
+    }
+    XFixesCursorImage* image = XFixesGetCursorImage(display);
+    if (!image) {
+        return false;
+    }
+    double scaleX = (double)width / areaWidth;
+    double scaleY = (double)height / areaHeight;
+    if (image->cursor_serial != cursorSerial || cursorTile.IsEmpty()) {
+        // 指针形状变化时才重新栅格化，XFixes像素为预乘透明度的ARGB，每个像素占一个long
+        cv::Mat argb(image->height, image->width, CV_8UC4);
+        for (int row = 0; row < image->height; row++) {
+            uint32_t* dst = argb.ptr<uint32_t>(row);
+            const unsigned long* src = image->pixels + row * image->width;
+            for (int col = 0; col < image->width; col++) {
+                dst[col] = (uint32_t)src[col];
+            }
+        }
+        libyuv::ARGBUnattenuate(argb.data, (int)argb.step, argb.data, (int)argb.step, argb.cols, argb.rows);
+        cv::Mat scaled = argb;
+        int scaledWidth = max(2, (int)(image->width * scaleX + 0.5));
+        int scaledHeight = max(2, (int)(image->height * scaleY + 0.5));
+        if (scaledWidth != image->width || scaledHeight != image->height) {
+            cv::resize(argb, scaled, cv::Size(scaledWidth, scaledHeight), 0, 0, cv::INTER_AREA);
+        }
+        MakeTile(scaled, 100, isNV12, cursorTile);
+        cursorHotX = (int)(image->xhot * scaleX);
+        cursorHotY = (int)(image->yhot * scaleY);
+        cursorSerial = image->cursor_serial;
+    }
+    int x = (int)((image->x - areaX) * scaleX) - cursorHotX;
+    int y = (int)((image->y - areaY) * scaleY) - cursorHotY;
+    XFree(image);
+    if (cursorTile.IsEmpty() || x >= width || y >= height || x + cursorTile.width <= 0 || y + cursorTile.height <= 0) {
+        return false;
+    }
+    // 位置按偶数对齐以便色度平面对齐
+    Out = Placement{ &cursorTile, x & ~1, y & ~1, cursorTile.width, cursorTile.height, cursorSerial };
+    return true;
+}
+
+void OverlayEngine::CollectLayers(vector<Placement>& Layers)
+{
+    Layers.clear();
+    if (!watermarkTile.IsEmpty()) {
+        Layers.push_back(Placement{ &watermarkTile, watermarkX, watermarkY, watermarkTile.width, watermarkTile.height, 0 });
+    }
+    if (!glyphTiles[0].IsEmpty()) {
+        time_t now = time(nullptr);
+        struct tm local;
+        localtime_r(&now, &local);
+        char text[OVERLAY_TIMESTAMP_LEN + 8];
+        strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+        int x = timestampX;
+        for (int i = 0; text[i] && i < OVERLAY_TIMESTAMP_LEN; i++) {
+            int index = glyph_index(text[i]);
+            // 空格是完全透明的，不必混合
+            if (index >= 0 && ' ' != text[i]) {
+                Layers.push_back(Placement{ &glyphTiles[index], x, timestampY, glyphTiles[index].width, glyphTiles[index].height, 0 });
+            }
+            x += glyphTiles[0].width;
+        }
+    }
+    Placement cursor{};
+    if (UpdateCursor(cursor)) {
+        Layers.push_back(cursor);
+    }
+}
+
+bool OverlayEngine::Clip(const Placement& Layer, int& X, int& Y, int& TileX, int& TileY, int& W, int& H) const
+{
+    X = max(0, Layer.x);
+    Y = max(0, Layer.y);
+    TileX = X - Layer.x;
+    TileY = Y - Layer.y;
+    W = (min(Layer.x + Layer.width, width) - X) & ~1;
+    H = (min(Layer.y + Layer.height, height) - Y) & ~1;
+    return W > 0 && H > 0;
+}
+
+int OverlayEngine::Blend(AVFrame* Dst, const Placement& Layer)
+{
+    int x, y, tileX, tileY, w, h;
+    if (!Clip(Layer, x, y, tileX, tileY, w, h)) {
+        return 0;
+    }
+    const Tile& tile = *Layer.tile;
+    if (isNV12) {
+        // dst = tile * alpha + dst * (1 - alpha)，Y与交错UV分别原地混合
+        uint8_t* dstY = Dst->data[0] + y * Dst->linesize[0] + x;
+        uint8_t* dstUV = Dst->data[1] + (y / 2) * Dst->linesize[1] + x;
+        int tileUV = (tileY / 2) * tile.width + tileX;
+        libyuv::BlendPlane(tile.y.data() + tileY * tile.width + tileX, tile.width, dstY, Dst->linesize[0],
+                           tile.a.data() + tileY * tile.width + tileX, tile.width, dstY, Dst->linesize[0], w, h);
+        libyuv::BlendPlane(tile.uv.data() + tileUV, tile.width, dstUV, Dst->linesize[1],
+                           tile.uvA.data() + tileUV, tile.width, dstUV, Dst->linesize[1], w, h / 2);
+        return w * h;
+    }
+    int tileUV = (tileY / 2) * (tile.width / 2) + tileX / 2;
+    uint8_t* dstY = Dst->data[0] + y * Dst->linesize[0] + x;
+    uint8_t* dstU = Dst->data[1] + (y / 2) * Dst->linesize[1] + x / 2;
+    uint8_t* dstV = Dst->data[2] + (y / 2) * Dst->linesize[2] + x / 2;
+    // dst = tile * alpha + dst * (1 - alpha)，原地混合
+    libyuv::I420Blend(tile.y.data() + tileY * tile.width + tileX, tile.width,
+                      tile.u.data() + tileUV, tile.width / 2,
+                      tile.v.data() + tileUV, tile.width / 2,
+                      dstY, Dst->linesize[0], dstU, Dst->linesize[1], dstV, Dst->linesize[2],
+                      tile.a.data() + tileY * tile.width + tileX, tile.width,
+                      dstY, Dst->linesize[0], dstU, Dst->linesize[1], dstV, Dst->linesize[2],
+                      w, h);
+    return w * h;
+}
+
+void OverlayEngine::Restore(AVFrame* Dst, const AVFrame* Base, const Placement& Layer)
+{
+    int x, y, tileX, tileY, w, h;
+    if (!Clip(Layer, x, y, tileX, tileY, w, h)) {
+        return;
+    }
+    VideoFramePool::CopyRect(Base, x, y, Dst, x, y, w, h);
+}
+
+AVFrame* OverlayEngine::Render(const AVFrame* Base, uint64_t BaseSeq, bool& IsChanged)
+{
+    IsChanged = true;
+    if (!outFrame || !hasLayer || !Base || Base->width != width || Base->height != height || Base->format != outFrame->format) {
+        return nullptr;
+    }
+    auto renderStart = chrono::steady_clock::now();
+    vector<Placement> layers;
+    CollectLayers(layers);
+    if (layers.empty()) {
+        lastBaseSeq = 0;
+        lastLayers.clear();
+        return nullptr;
+    }
+    bool isBaseSame = (0 != BaseSeq && BaseSeq == lastBaseSeq);
+    if (isBaseSame && layers == lastLayers) {
+        // 底图与所有图层都未变化，沿用上一次的结果
+        IsChanged = false;
+        reuseNum++;
+        return outFrame;
+    }
+    if (isBaseSame) {
+        // 底图未变化，只把上一次混合过的区域从底图恢复，编码器仍持有旧缓冲区时才整帧拷贝
+        if (!framePool.MakeWritable(outFrame, true)) {
+            lastBaseSeq = 0;
+            return nullptr;
+        }
+        for (const Placement& layer : lastLayers) {
+            Restore(outFrame, Base, layer);
+        }
+    } else {
+        if (!framePool.MakeWritable(outFrame, false)) {
+            lastBaseSeq = 0;
+            return nullptr;
+        }
+        VideoFramePool::CopyRect(Base, 0, 0, outFrame, 0, 0, width, height);
+    }
+    int area = 0;
+    for (const Placement& layer : layers) {
+        area += Blend(outFrame, layer);
+    }
+    lastLayers.swap(layers);
+    lastBaseSeq = BaseSeq;
+
+    int cost = elapsed_us(renderStart);
+    int avg = avgRenderUs;
+    avgRenderUs = (0 == avg) ? cost : avg + (cost - avg) / 16;
+    if (cost > maxRenderUs) maxRenderUs = cost;
+    areaPixels = area;
+    renderNum++;
+    return outFrame;
+}
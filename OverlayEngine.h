@@ -0,0 +1,175 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+#include "VideoFramePool.h"
+
+// FFmpeg与X11类型前向声明
+struct AVFrame;
+struct _XDisplay;
+
+/// <summary>
+/// 叠加层引擎
+/// 在I420或NV12帧上叠加水印、时间戳与鼠标指针，不经过BGRA。
+/// 各图层在设置时一次性栅格化为带透明度的YUV贴图(时间戳为数字与分隔符的字形缓存，鼠标指针按XFixes的序号缓存)，
+/// 每帧只在贴图的包围盒内混合；底图未变化时只把上一帧的包围盒从底图恢复后重新混合，
+/// 耗时与叠加面积成正比，与画面大小无关
+/// </summary>
+class OverlayEngine
+{
+public:
+    /// <summary>
+    /// 图层设置，位置与次要画面一致：0不显示，[1-4]从左上角开始顺时针放置
+    /// </summary>
+    struct Config
+    {
+        int timestampLocation{ 0 };
+        int timestampHeight{ 0 };           //时间戳字高(像素)，0为画面高的1/30
+        cv::Mat watermark;                  //水印图像，BGRA/BGR/灰度
+        int watermarkLocation{ 0 };
+        int watermarkOpacity{ 100 };        //水印不透明度[0,100]
+        int watermarkWidthPercent{ 15 };    //水印宽度占画面宽度的百分比[1,100]
+        bool isShowCursor{ false };
+    };
+
+    OverlayEngine() = default;
+    ~OverlayEngine();
+    OverlayEngine(const OverlayEngine&) = delete;
+    OverlayEngine& operator=(const OverlayEngine&) = delete;
+
+    /// <summary>
+    /// 按画面宽高与格式(AVPixelFormat，YUV420P或NV12)初始化输出帧池
+    /// </summary>
+    bool Init(int Width, int Height, int PixFmt);
+
+    /// <summary>
+    /// 释放帧、贴图与X Display
+    /// </summary>
+    void UnInit();
+
+    /// <summary>
+    /// 应用图层设置，重新栅格化所有静态图层，只应在设置变化时调用
+    /// </summary>
+    void Configure(const Config& Setting);
+
+    /// <summary>
+    /// 设置画面对应的桌面区域，用于把鼠标指针坐标换算到画面上，宽或高为0时不画鼠标指针(如录制摄像头时)
+    /// </summary>
+    void SetCursorArea(int X, int Y, int Width, int Height);
+
+    /// <summary>
+    /// 是否有需要叠加的图层
+    /// </summary>
+    bool HasLayer() const { return hasLayer; }
+
+    /// <summary>
+    /// 在底图上叠加所有图层
+    /// </summary>
+    /// <param name="Base">底图，只读，可以是共享视频源的帧</param>
+    /// <param name="BaseSeq">底图序号，序号不变即底图无变化，0表示未知，总是整帧拷贝</param>
+    /// <param name="IsChanged">返回结果是否与上一次不同</param>
+    /// <returns>叠加后的帧，由本对象持有，下次调用前有效；没有可见图层或失败时返回nullptr，调用者直接使用底图</returns>
+    AVFrame* Render(const AVFrame* Base, uint64_t BaseSeq, bool& IsChanged);
+
+    /// <summary>
+    /// 获取每帧叠加耗时的滑动平均值(微秒)
+    /// </summary>
+    int GetAvgRenderUs() const { return avgRenderUs; }
+    /// <summary>
+    /// 获取叠加耗时的最大值(微秒)
+    /// </summary>
+    int GetMaxRenderUs() const { return maxRenderUs; }
+    /// <summary>
+    /// 获取最近一次混合的像素数
+    /// </summary>
+    int GetAreaPixels() const { return areaPixels; }
+    /// <summary>
+    /// 获取实际叠加次数与沿用上一次结果的次数
+    /// </summary>
+    unsigned long long GetRenderNum() const { return renderNum; }
+    unsigned long long GetReuseNum() const { return reuseNum; }
+
+private:
+    /// <summary>
+    /// 带透明度的YUV贴图，宽高为偶数
+    /// </summary>
+    struct Tile
+    {
+        int width{ 0 };
+        int height{ 0 };
+        std::vector<uint8_t> y;
+        std::vector<uint8_t> u;
+        std::vector<uint8_t> v;
+        std::vector<uint8_t> a;         //与Y同尺寸
+        std::vector<uint8_t> uv;        //NV12时的交错UV，每行width字节
+        std::vector<uint8_t> uvA;       //与uv同尺寸的透明度，每个像素对的两个字节相同
+        bool IsEmpty() const { return 0 == width || 0 == height; }
+    };
+
+    /// <summary>
+    /// 本帧贴图的位置
+    /// </summary>
+    struct Placement
+    {
+        const Tile* tile;
+        int x;
+        int y;
+        int width;                      //放置时贴图的宽高，贴图重新生成后仍能恢复原来的区域
+        int height;
+        unsigned long version;          //贴图内容的版本，鼠标指针为XFixes序号，其余为0
+        bool operator==(const Placement& Other) const {
+            return tile == Other.tile && x == Other.x && y == Other.y
+                && width == Other.width && height == Other.height && version == Other.version;
+        }
+    };
+
+    static bool MakeTile(const cv::Mat& Image, int Opacity, bool IsNV12, Tile& Out);
+    void BuildWatermark(const Config& Setting);
+    void BuildTimestamp(const Config& Setting);
+    bool UpdateCursor(Placement& Out);
+    void CollectLayers(std::vector<Placement>& Layers);
+    void PlaceAt(int Location, int TileWidth, int TileHeight, int& X, int& Y) const;
+    bool Clip(const Placement& Layer, int& X, int& Y, int& TileX, int& TileY, int& W, int& H) const;
+    int Blend(AVFrame* Dst, const Placement& Layer);
+    void Restore(AVFrame* Dst, const AVFrame* Base, const Placement& Layer);
+
+private:
+    VideoFramePool framePool;
+    AVFrame* outFrame{ nullptr };
+    int width{ 0 };
+    int height{ 0 };
+    bool isNV12{ false };
+    bool hasLayer{ false };
+
+    Tile watermarkTile;
+    int watermarkX{ 0 };
+    int watermarkY{ 0 };
+
+    static const int GLYPH_NUM = 13;    //0-9、'-'、':'、空格
+    std::array<Tile, GLYPH_NUM> glyphTiles;
+    int timestampX{ 0 };
+    int timestampY{ 0 };
+
+    bool isShowCursor{ false };
+    _XDisplay* display{ nullptr };
+    unsigned long cursorSerial{ 0 };
+    Tile cursorTile;
+    int cursorHotX{ 0 };                //热点，已换算到画面比例
+    int cursorHotY{ 0 };
+    int areaX{ 0 };
+    int areaY{ 0 };
+    int areaWidth{ 0 };
+    int areaHeight{ 0 };
+
+    uint64_t lastBaseSeq{ 0 };
+    std::vector<Placement> lastLayers;
+
+    std::atomic<int> avgRenderUs{ 0 };
+    std::atomic<int> maxRenderUs{ 0 };
+    std::atomic<int> areaPixels{ 0 };
+    std::atomic<unsigned long long> renderNum{ 0 };
+    std::atomic<unsigned long long> reuseNum{ 0 };
+};
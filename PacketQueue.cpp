@@ -0,0 +1,56 @@
+#include "PacketQueue.h"
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+}
+
+using namespace std;
+
+PacketQueue::PacketQueue()
+{
+    Node* stub = new Node();
+    head.store(stub, memory_order_relaxed);
+    tail = stub;
+}
+
+PacketQueue::~PacketQueue()
+{
+    Clear();
+    delete tail;
+}
+
+void PacketQueue::Push(AVPacket* Packet, bool IsVideo)
+{
+    Node* node = new Node();
+    node->packet = Packet;
+    node->isVideo = IsVideo;
+    // 先抢占队尾再链接，两步之间消费者只会看到队列暂时"变短"，不会读到未完成的节点
+    Node* prev = head.exchange(node, memory_order_acq_rel);
+    prev->next.store(node, memory_order_release);
+    size.fetch_add(1, memory_order_relaxed);
+}
+
+bool PacketQueue::Pop(AVPacket*& Packet, bool& IsVideo)
+{
+    Node* next = tail->next.load(memory_order_acquire);
+    if (!next) {
+        return false;
+    }
+    // 取出数据后next成为新的哨兵节点
+    Packet = next->packet;
+    IsVideo = next->isVideo;
+    next->packet = nullptr;
+    delete tail;
+    tail = next;
+    size.fetch_sub(1, memory_order_relaxed);
+    return true;
+}
+
+void PacketQueue::Clear()
+{
+    AVPacket* packet = nullptr;
+    bool isVideo = false;
+    while (Pop(packet, isVideo)) {
+        av_packet_free(&packet);
+    }
+}
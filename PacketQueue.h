@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+
+// FFmpeg类型前向声明
+struct AVPacket;
+
+/// <summary>
+/// 多生产者单消费者的无锁编码包队列
+/// 视频、音频编码线程各自入队只需一次原子交换，不会因为写入线程正在写盘或发送而等待，
+/// 只有唯一的写入线程出队
+/// </summary>
+class PacketQueue
+{
+public:
+    PacketQueue();
+    ~PacketQueue();
+    PacketQueue(const PacketQueue&) = delete;
+    PacketQueue& operator=(const PacketQueue&) = delete;
+
+    /// <summary>
+    /// 入队，可由多个线程同时调用，队列接管Packet的所有权
+    /// </summary>
+    void Push(AVPacket* Packet, bool IsVideo);
+
+    /// <summary>
+    /// 出队，只能由唯一的消费线程调用
+    /// </summary>
+    /// <returns>队列为空时返回false</returns>
+    bool Pop(AVPacket*& Packet, bool& IsVideo);
+
+    /// <summary>
+    /// 释放队列中剩余的包，只能由消费线程或在没有生产者时调用
+    /// </summary>
+    void Clear();
+
+    /// <summary>
+    /// 获取当前排队的包数，并发入队时为近似值
+    /// </summary>
+    int Size() const { return size.load(std::memory_order_relaxed); }
+
+private:
+    struct Node
+    {
+        std::atomic<Node*> next{ nullptr };
+        AVPacket* packet{ nullptr };
+        bool isVideo{ false };
+    };
+
+    std::atomic<Node*> head;    //生产者一侧，最新入队的节点
+    Node* tail;                 //消费者一侧，哨兵节点，它的next才是队首
+    std::atomic<int> size{ 0 };
+};
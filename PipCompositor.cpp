@@ -0,0 +1,253 @@
+#include "PipCompositor.h"
+#include "Log.h"
+
+#include <algorithm>
+
+extern "C" {
+#include "libavutil/frame.h"
+}
+
+using namespace std;
+
+// 次要画面与主画面边缘的距离占主画面短边的比例(1/N)
+#define PIP_MARGIN_DIVISOR 40
+
+static int elapsed_us(const chrono::steady_clock::time_point& Start) {
+    return (int)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - Start).count();
+}
+
+PipCompositor::~PipCompositor()
+{
+    UnInit();
+}
+
+bool PipCompositor::Init(int Width, int Height, int PixFmt)
+{
+    UnInit();
+    if (!framePool.Init(PixFmt, Width, Height)) {
+        LOG_ERROR("分配画中画帧池失败");
+        return false;
+    }
+    outFrame = framePool.GetFrame();
+    if (!outFrame) {
+        LOG_ERROR("分配画中画帧的内存失败");
+        framePool.UnInit();
+        return false;
+    }
+    width = Width;
+    height = Height;
+    lastMainSeq = 0;
+    lastSubSeq = 0;
+    lastLocation = Location::None;
+    lastWidth = 0;
+    lastHeight = 0;
+    avgComposeUs = 0;
+    maxComposeUs = 0;
+    avgAcquireUs = 0;
+    composeNum = 0;
+    reuseNum = 0;
+    return true;
+}
+
+void PipCompositor::UnInit()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        isStop = true;
+        hasKey = false;
+    }
+    cond.notify_all();
+    if (thread) {
+        if (thread->joinable()) thread->join();
+        thread.reset();
+    }
+    lock_guard<std::mutex> lock(mutex);
+    isStop = false;
+    if (subFrame) av_frame_free(&subFrame);
+    if (outFrame) av_frame_free(&outFrame);
+    framePool.UnInit();
+}
+
+void PipCompositor::SetSource(const VideoSource::Key& SourceKey, int FrameRate)
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (hasKey && key == SourceKey && frameRate == FrameRate) {
+            return;
+        }
+        if (!hasKey || key != SourceKey) {
+            // 换源后旧画面的尺寸或内容已不对，等新源的第一帧
+            if (subFrame) av_frame_free(&subFrame);
+            LOG_INFO("画中画次要画面改为" + string((-1 == SourceKey.cameraNum) ? "桌面" : "摄像头(" + to_string(SourceKey.cameraNum) + ")")
+                + "，尺寸" + to_string(SourceKey.outWidth) + "x" + to_string(SourceKey.outHeight));
+        }
+        key = SourceKey;
+        hasKey = true;
+        frameRate = max(1, FrameRate);
+    }
+    cond.notify_all();
+    if (!thread) {
+        thread.reset(new std::thread(&PipCompositor::ThreadRun, this));
+    }
+}
+
+void PipCompositor::ClearSource()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (!hasKey) {
+            return;
+        }
+        hasKey = false;
+        if (subFrame) av_frame_free(&subFrame);
+    }
+    cond.notify_all();
+}
+
+void PipCompositor::ThreadRun()
+{
+    LOG_INFO("画中画取帧线程已启动");
+    shared_ptr<VideoSource> source;
+    uint64_t lastSourceSeq = 0;
+    bool isAcquireErr = false;
+    while (true) {
+        VideoSource::Key currentKey;
+        chrono::microseconds interval;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            if (!hasKey && !isStop && source) {
+                // 不再显示次要画面时退订，最后一个订阅者退订后视频源随之关闭
+                lock.unlock();
+                source.reset();
+                lock.lock();
+            }
+            cond.wait(lock, [this] { return isStop || hasKey; });
+            if (isStop) break;
+            currentKey = key;
+            interval = chrono::microseconds(1000000 / frameRate);
+        }
+        if (!source || source->GetKey() != currentKey) {
+            source = VideoSourceManager::Default()->Acquire(currentKey);
+            lastSourceSeq = 0;
+        }
+
+        // 摄像头尚无画面时可能在此等待，只影响次要画面
+        auto acquireStart = chrono::steady_clock::now();
+        uint64_t seq = 0;
+        bool isPartial = false;
+        AVFrame* frame = source->Acquire(interval / 2, seq, isPartial);
+        int cost = elapsed_us(acquireStart);
+        int avg = avgAcquireUs;
+        avgAcquireUs = (0 == avg) ? cost : avg + (cost - avg) / 16;
+        if (!frame && !isAcquireErr) {
+            LOG_WARN("画中画次要画面取帧失败，继续使用上一帧");
+        }
+        isAcquireErr = !frame;
+
+        unique_lock<std::mutex> lock(mutex);
+        if (frame) {
+            if (hasKey && key == currentKey && seq != lastSourceSeq) {
+                if (subFrame) av_frame_free(&subFrame);
+                subFrame = frame;
+                subSeq++;
+                lastSourceSeq = seq;
+            } else {
+                av_frame_free(&frame);
+            }
+        }
+        cond.wait_until(lock, acquireStart + interval, [this, &currentKey] { return isStop || !hasKey || key != currentKey; });
+    }
+    source.reset();
+    LOG_INFO("画中画取帧线程已退出");
+}
+
+void PipCompositor::Paste(AVFrame* Dst, const AVFrame* Sub, Location Where, const AVFrame* Main)
+{
+    // I420与NV12色度都按2x2采样，位置与尺寸都按偶数对齐
+    int margin = (min(width, height) / PIP_MARGIN_DIVISOR) & ~1;
+    int subWidth = max(min(Sub->width, width - margin * 2) & ~1, 0);
+    int subHeight = max(min(Sub->height, height - margin * 2) & ~1, 0);
+    bool isRight = (Location::RightTop == Where || Location::RightBottom == Where);
+    bool isBottom = (Location::RightBottom == Where || Location::LeftBottom == Where);
+    int left = isRight ? (width - margin - subWidth) & ~1 : margin;
+    int top = isBottom ? (height - margin - subHeight) & ~1 : margin;
+    if (Main && lastWidth > 0 && lastHeight > 0) {
+        // Dst中仍是上一次的次要画面，它的尺寸可能与这次不同，先用主画面恢复新旧两个区域的外接矩形，旧画面不会残留
+        int unionLeft = (subWidth > 0) ? min(left, lastLeft) : lastLeft;
+        int unionTop = (subHeight > 0) ? min(top, lastTop) : lastTop;
+        int unionRight = (subWidth > 0) ? max(left + subWidth, lastLeft + lastWidth) : lastLeft + lastWidth;
+        int unionBottom = (subHeight > 0) ? max(top + subHeight, lastTop + lastHeight) : lastTop + lastHeight;
+        VideoFramePool::CopyRect(Main, unionLeft, unionTop, Dst, unionLeft, unionTop, unionRight - unionLeft, unionBottom - unionTop);
+    }
+    lastWidth = 0;
+    lastHeight = 0;
+    if (subWidth <= 0 || subHeight <= 0) {
+        return;
+    }
+    VideoFramePool::CopyRect(Sub, 0, 0, Dst, left, top, subWidth, subHeight);
+    lastLeft = left;
+    lastTop = top;
+    lastWidth = subWidth;
+    lastHeight = subHeight;
+}
+
+AVFrame* PipCompositor::Compose(const AVFrame* MainFrame, uint64_t MainSeq, Location Where, bool& IsChanged)
+{
+    IsChanged = true;
+    if (!outFrame || !MainFrame || Location::None == Where
+        || MainFrame->width != width || MainFrame->height != height || MainFrame->format != outFrame->format) {
+        return nullptr;
+    }
+    AVFrame* sub = nullptr;
+    uint64_t seq = 0;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (subFrame) sub = av_frame_clone(subFrame);
+        seq = subSeq;
+    }
+    if (!sub) {
+        lastMainSeq = 0;
+        return nullptr;
+    }
+
+    auto composeStart = chrono::steady_clock::now();
+    bool isMainSame = (0 != MainSeq && MainSeq == lastMainSeq && Where == lastLocation);
+    if (isMainSame && seq == lastSubSeq) {
+        // 两者都未变化，沿用上一次的合成结果
+        av_frame_free(&sub);
+        IsChanged = false;
+        reuseNum++;
+        return outFrame;
+    }
+    bool isOk = false;
+    if (isMainSame) {
+        // 只有次要画面变化，保留主画面只重写角落(含恢复上一次次要画面的区域)，编码器仍持有旧缓冲区时才整帧拷贝
+        isOk = framePool.MakeWritable(outFrame, true);
+    } else if (framePool.MakeWritable(outFrame, false)) {
+        isOk = VideoFramePool::CopyRect(MainFrame, 0, 0, outFrame, 0, 0, width, height);
+    }
+    if (isOk && !isMainSame) {
+        // 整帧已从主画面拷贝，没有需要恢复的旧区域
+        lastWidth = 0;
+        lastHeight = 0;
+    }
+    if (isOk && sub->format == outFrame->format) {
+        Paste(outFrame, sub, Where, isMainSame ? MainFrame : nullptr);
+    }
+    av_frame_free(&sub);
+    if (!isOk) {
+        LOG_ERROR("画中画合成失败，本帧使用主画面");
+        lastMainSeq = 0;
+        return nullptr;
+    }
+    lastMainSeq = MainSeq;
+    lastSubSeq = seq;
+    lastLocation = Where;
+
+    int cost = elapsed_us(composeStart);
+    int avg = avgComposeUs;
+    avgComposeUs = (0 == avg) ? cost : avg + (cost - avg) / 16;
+    if (cost > maxComposeUs) maxComposeUs = cost;
+    composeNum++;
+    return outFrame;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include "VideoSource.h"
+#include "VideoFramePool.h"
+
+// FFmpeg类型前向声明
+struct AVFrame;
+
+/// <summary>
+/// 画中画合成器
+/// 次要画面由独立线程按帧率从共享视频源取得(已由视频源直接缩放到画中画尺寸、与主画面同格式的I420或NV12帧)，
+/// 主画面所在的视频线程只取其最新一帧，摄像头读取、解码与缩放都不会拖慢主画面；
+/// 合成直接在YUV平面上进行，主画面与次要画面都不经过BGRA，
+/// 两者都未变化时沿用上一次的合成结果，只有次要画面变化时只重写角落区域
+/// </summary>
+class PipCompositor
+{
+public:
+    /// <summary>
+    /// 次要画面位置，从左上角开始顺时针放置，与SecondaryScreenLocation一致
+    /// </summary>
+    enum class Location
+    {
+        None = 0,
+        LeftTop = 1,
+        RightTop = 2,
+        RightBottom = 3,
+        LeftBottom = 4
+    };
+
+    PipCompositor() = default;
+    ~PipCompositor();
+    PipCompositor(const PipCompositor&) = delete;
+    PipCompositor& operator=(const PipCompositor&) = delete;
+
+    /// <summary>
+    /// 按主画面格式初始化输出帧池
+    /// </summary>
+    /// <param name="Width">主画面宽</param>
+    /// <param name="Height">主画面高</param>
+    /// <param name="PixFmt">主画面格式(AVPixelFormat)，YUV420P或NV12，次要画面须为同一格式</param>
+    /// <returns>是否成功</returns>
+    bool Init(int Width, int Height, int PixFmt);
+
+    /// <summary>
+    /// 停止取帧线程并释放所有帧
+    /// </summary>
+    void UnInit();
+
+    /// <summary>
+    /// 设置次要画面的视频源，Key的输出宽高即画中画的尺寸，与当前源相同时不做任何事；
+    /// 第一次调用时启动取帧线程
+    /// </summary>
+    /// <param name="SourceKey">次要画面的视频源</param>
+    /// <param name="FrameRate">取帧的帧率</param>
+    void SetSource(const VideoSource::Key& SourceKey, int FrameRate);
+
+    /// <summary>
+    /// 不再显示次要画面，释放视频源，取帧线程空闲等待
+    /// </summary>
+    void ClearSource();
+
+    /// <summary>
+    /// 把次要画面的最新一帧合成到主画面的指定角落，不会等待次要画面
+    /// </summary>
+    /// <param name="MainFrame">主画面，只读，可以是共享视频源的帧</param>
+    /// <param name="MainSeq">主画面序号，序号不变即主画面无变化，0表示未知，总是重新合成</param>
+    /// <param name="Where">次要画面位置</param>
+    /// <param name="IsChanged">返回合成结果是否与上一次不同</param>
+    /// <returns>合成后的帧，由本对象持有，下次调用前有效；次要画面尚无可用帧时返回nullptr，调用者直接使用主画面</returns>
+    AVFrame* Compose(const AVFrame* MainFrame, uint64_t MainSeq, Location Where, bool& IsChanged);
+
+    /// <summary>
+    /// 获取每帧合成耗时的滑动平均值(微秒)
+    /// </summary>
+    int GetAvgComposeUs() const { return avgComposeUs; }
+    /// <summary>
+    /// 获取合成耗时的最大值(微秒)
+    /// </summary>
+    int GetMaxComposeUs() const { return maxComposeUs; }
+    /// <summary>
+    /// 获取取帧线程每次从视频源取帧耗时的滑动平均值(微秒)，这部分不计入主画面的耗时
+    /// </summary>
+    int GetAvgAcquireUs() const { return avgAcquireUs; }
+    /// <summary>
+    /// 获取实际合成次数与沿用上一次合成结果的次数
+    /// </summary>
+    unsigned long long GetComposeNum() const { return composeNum; }
+    unsigned long long GetReuseNum() const { return reuseNum; }
+
+private:
+    void ThreadRun();
+    void Paste(AVFrame* Dst, const AVFrame* Sub, Location Where, const AVFrame* Main);
+
+private:
+    VideoFramePool framePool;
+    AVFrame* outFrame{ nullptr };           //合成结果，由framePool取出
+    int width{ 0 };
+    int height{ 0 };
+    uint64_t lastMainSeq{ 0 };              //上一次合成时的主画面序号，0表示尚未合成
+    uint64_t lastSubSeq{ 0 };
+    Location lastLocation{ Location::None };
+    int lastLeft{ 0 };                      //上一次贴入次要画面的区域，宽高为0表示没有
+    int lastTop{ 0 };
+    int lastWidth{ 0 };
+    int lastHeight{ 0 };
+
+    // 以下由取帧线程与视频线程共享
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::unique_ptr<std::thread> thread;
+    bool isStop{ false };
+    VideoSource::Key key;
+    bool hasKey{ false };
+    int frameRate{ 0 };
+    AVFrame* subFrame{ nullptr };           //次要画面最新一帧的引用
+    uint64_t subSeq{ 0 };                   //次要画面序号，换源时继续递增，保证与上一次不同
+
+    std::atomic<int> avgComposeUs{ 0 };
+    std::atomic<int> maxComposeUs{ 0 };
+    std::atomic<int> avgAcquireUs{ 0 };
+    std::atomic<unsigned long long> composeNum{ 0 };
+    std::atomic<unsigned long long> reuseNum{ 0 };
+};
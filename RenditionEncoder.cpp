@@ -0,0 +1,165 @@
+#include "RenditionEncoder.h"
+#include "OutputSink.h"
+#include "FrameQueue.h"
+#include "Log.h"
+
+#include <chrono>
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavutil/frame.h"
+}
+
+using namespace std;
+
+// 帧队列为空时每次等待的上限，期间队列被关闭也能及时返回
+#define RENDITION_WAIT_MS 100
+
+static string av_err2str_cpp(int errnum) {
+    char errbuf[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(errnum, errbuf, sizeof(errbuf));
+    return string(errbuf);
+}
+
+static long long steady_now_us() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+RenditionEncoder::RenditionEncoder(const string& Url, int MaxQueue)
+    : url(Url)
+    , sink(new OutputSink(Url, MaxQueue))
+{
+}
+
+RenditionEncoder::~RenditionEncoder()
+{
+    Finish();
+    // 先写完输出端，再释放编码器
+    sink.reset();
+    framePool.UnInit();
+    if (codecCtx) {
+        avcodec_free_context(&codecCtx);
+    }
+}
+
+int RenditionEncoder::Open(AVCodecContext* VideoCtx, const AVCodecContext* AudioCtx, int QueueFrames, int ScaleFilter)
+{
+    codecCtx = VideoCtx;
+    if (!codecCtx) {
+        return AVERROR(EINVAL);
+    }
+    if (!framePool.Init(codecCtx->pix_fmt, codecCtx->width, codecCtx->height)) {
+        LOG_ERROR("分配多码率输出帧池失败 " + to_string(codecCtx->width) + "x" + to_string(codecCtx->height));
+        return AVERROR(ENOMEM);
+    }
+    converter.SetScaleFilter(static_cast<FrameConverter::ScaleFilter>(ScaleFilter));
+    queue.reset(new FrameQueue(QueueFrames, FrameQueue::FullPolicy::DropOldest));
+    int ret = sink->Open(codecCtx, AudioCtx);
+    if (ret < 0) {
+        LOG_ERROR("打开多码率输出失败(" + url + "): " + av_err2str_cpp(ret));
+    }
+    return ret;
+}
+
+void RenditionEncoder::Start()
+{
+    if (!queue || thread) {
+        return;
+    }
+    thread.reset(new std::thread(&RenditionEncoder::Run, this));
+}
+
+void RenditionEncoder::Finish()
+{
+    if (queue) {
+        queue->Close();
+    }
+    if (thread && thread->joinable()) {
+        thread->join();
+    }
+    thread.reset();
+}
+
+bool RenditionEncoder::Push(AVFrame* Frame, long long CaptureUs, long long GrabUs)
+{
+    if (!queue) {
+        av_frame_free(&Frame);
+        return false;
+    }
+    return queue->Push(Frame, CaptureUs, GrabUs, false);
+}
+
+void RenditionEncoder::PushAudio(const AVPacket* Packet)
+{
+    sink->Push(Packet, false);
+}
+
+int RenditionEncoder::GetWidth() const { return codecCtx ? codecCtx->width : 0; }
+int RenditionEncoder::GetHeight() const { return codecCtx ? codecCtx->height : 0; }
+int64_t RenditionEncoder::GetBitRate() const { return codecCtx ? codecCtx->bit_rate : 0; }
+unsigned long long RenditionEncoder::GetDropNum() const { return queue ? queue->GetDropNum() : 0; }
+
+void RenditionEncoder::Run()
+{
+    AVPacket* pkt = av_packet_alloc();
+    FrameQueue::Item item;
+    bool isScaleErrLogged = false;
+    if (!pkt) {
+        LOG_ERROR("分配多码率输出pkt内存失败(" + url + ")");
+        queue->Close();
+        queue->Clear();
+        return;
+    }
+
+    // 源档关闭队列后仍把已排队的帧编码完
+    while (!queue->IsClosed() || queue->Size() > 0) {
+        if (!queue->Pop(item, RENDITION_WAIT_MS)) {
+            continue;
+        }
+        AVFrame* frame = framePool.GetFrame();
+        bool isOk = frame && converter.Scale(item.frame, frame);
+        av_frame_free(&item.frame);
+        if (!isOk) {
+            if (!isScaleErrLogged) {
+                LOG_WARN("多码率输出缩放失败，跳过该帧(" + url + ")");
+                isScaleErrLogged = true;
+            }
+            if (frame) av_frame_free(&frame);
+            continue;
+        }
+        // 先交给由本档缩放的各档，再编码本档，各档的编码并行
+        for (RenditionEncoder* next : nextList) {
+            AVFrame* nextFrame = av_frame_clone(frame);
+            if (nextFrame) next->Push(nextFrame, item.captureUs, item.grabUs);
+        }
+
+        long long encodeStartUs = steady_now_us();
+        // PTS取采集时刻，与主输出一致，确保严格递增
+        int64_t pts = av_rescale_q(item.captureUs, { 1, 1000000 }, codecCtx->time_base);
+        if (pts <= lastPts) {
+            pts = lastPts + 1;
+        }
+        frame->pts = pts;
+        lastPts = pts;
+
+        int ret = avcodec_send_frame(codecCtx, frame);
+        av_frame_free(&frame);
+        while (ret >= 0) {
+            ret = avcodec_receive_packet(codecCtx, pkt);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
+            else if (ret < 0) {
+                LOG_WARN("多码率输出 avcodec_receive_packet 失败(" + url + "): " + av_err2str_cpp(ret));
+                break;
+            }
+            sink->Push(pkt, true);
+            av_packet_unref(pkt);
+        }
+        encodeFrameNum++;
+        int costUs = static_cast<int>(steady_now_us() - encodeStartUs);
+        int avg = avgEncodeUs;
+        avgEncodeUs = (0 == avg) ? costUs : avg + (costUs - avg) / 16;
+    }
+
+    queue->Clear();
+    av_packet_free(&pkt);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include "FrameConverter.h"
+#include "VideoFramePool.h"
+
+// FFmpeg类型前向声明
+struct AVFrame;
+struct AVPacket;
+struct AVCodecContext;
+class OutputSink;
+class FrameQueue;
+
+/// <summary>
+/// 多码率输出中的一档
+/// 同一路采集画面按分辨率从大到小逐级缩放：每档由宽高都不小于它且宽高比相同的最小一档缩放，没有时由主画面缩放，
+/// 每档有自己的帧队列、缩放帧池、编码器与输出端，在自己的线程中缩放后先交给由它缩放的各档再编码本档，
+/// 各档之间并行；队列满时丢弃最旧的帧，某档编码跟不上不会拖慢主输出与其他档
+/// 音频与主输出共用同一路编码，由模块转发
+/// </summary>
+class RenditionEncoder
+{
+public:
+    /// <summary>
+    /// 创建一档输出
+    /// </summary>
+    /// <param name="Url">文件路径或推流地址</param>
+    /// <param name="MaxQueue">输出端包队列上限</param>
+    RenditionEncoder(const std::string& Url, int MaxQueue);
+    ~RenditionEncoder();
+    RenditionEncoder(const RenditionEncoder&) = delete;
+    RenditionEncoder& operator=(const RenditionEncoder&) = delete;
+
+    /// <summary>
+    /// 准备帧池与帧队列并打开输出端，不论成功与否都接管VideoCtx
+    /// </summary>
+    /// <param name="VideoCtx">已按本档宽高与码率打开的视频编码器</param>
+    /// <param name="AudioCtx">已打开的音频编码器，无音频时为nullptr</param>
+    /// <param name="QueueFrames">帧队列容量</param>
+    /// <param name="ScaleFilter">缩放滤波方式，见FrameConverter::ScaleFilter</param>
+    /// <returns>0成功，否则为FFmpeg错误码</returns>
+    int Open(AVCodecContext* VideoCtx, const AVCodecContext* AudioCtx, int QueueFrames, int ScaleFilter);
+
+    /// <summary>
+    /// 添加由本档缩放的一档，本档缩放后的画面再交给它缩放，需在Start之前调用
+    /// </summary>
+    void AddNext(RenditionEncoder* Next) { nextList.push_back(Next); }
+
+    /// <summary>
+    /// 启动缩放与编码线程
+    /// </summary>
+    void Start();
+
+    /// <summary>
+    /// 关闭帧队列，等待线程把已排队的帧编码完后退出；
+    /// 须按从大到小的顺序调用，源档退出后不会再向本档送帧
+    /// </summary>
+    void Finish();
+
+    /// <summary>
+    /// 送入源档的画面，接管Frame的所有权，只能由源档的线程(由主画面缩放时为主编码线程)调用
+    /// </summary>
+    /// <returns>被丢弃或队列已关闭时返回false</returns>
+    bool Push(AVFrame* Frame, long long CaptureUs, long long GrabUs);
+
+    /// <summary>
+    /// 送入一个音频包，与主输出共用同一路音频编码
+    /// </summary>
+    void PushAudio(const AVPacket* Packet);
+
+    const std::string& GetUrl() const { return url; }
+    const OutputSink* GetSink() const { return sink.get(); }
+    int GetWidth() const;
+    int GetHeight() const;
+    int64_t GetBitRate() const;
+    /// <summary>
+    /// 获取已编码的帧数
+    /// </summary>
+    unsigned long long GetEncodeFrameNum() const { return encodeFrameNum; }
+    /// <summary>
+    /// 获取每帧缩放耗时的滑动平均值(微秒)
+    /// </summary>
+    int GetAvgScaleUs() const { return converter.GetAvgConvertUs(); }
+    /// <summary>
+    /// 获取每帧编码耗时的滑动平均值(微秒)，不含缩放
+    /// </summary>
+    int GetAvgEncodeUs() const { return avgEncodeUs; }
+    /// <summary>
+    /// 获取因帧队列满而丢弃的帧数
+    /// </summary>
+    unsigned long long GetDropNum() const;
+
+private:
+    void Run();
+
+private:
+    const std::string url;
+    std::unique_ptr<OutputSink> sink;
+    std::unique_ptr<FrameQueue> queue;
+    AVCodecContext* codecCtx{ nullptr };
+    VideoFramePool framePool;           //本档尺寸的帧，送入编码器与下一档时只增加引用
+    FrameConverter converter;
+    std::vector<RenditionEncoder*> nextList;   //由本档缩放的各档
+    std::unique_ptr<std::thread> thread;
+    int64_t lastPts{ -1 };
+    std::atomic<unsigned long long> encodeFrameNum{ 0 };
+    std::atomic<int> avgEncodeUs{ 0 };
+};
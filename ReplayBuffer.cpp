@@ -0,0 +1,122 @@
+#include "ReplayBuffer.h"
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavutil/mathematics.h"
+}
+
+using namespace std;
+
+ReplayBuffer::ReplayBuffer(int VideoTimeBaseNum, int VideoTimeBaseDen, int AudioTimeBaseNum, int AudioTimeBaseDen, int DurationMs, long long MaxBytes)
+    : videoTimeBaseNum(VideoTimeBaseNum)
+    , videoTimeBaseDen(VideoTimeBaseDen)
+    , audioTimeBaseNum(AudioTimeBaseNum)
+    , audioTimeBaseDen(AudioTimeBaseDen)
+    , keepUs((long long)DurationMs * 1000)
+    , maxBytes(MaxBytes)
+{
+}
+
+ReplayBuffer::~ReplayBuffer()
+{
+    Clear();
+}
+
+long long ReplayBuffer::ToUs(const AVPacket* Packet, bool IsVideo) const
+{
+    int64_t ts = (AV_NOPTS_VALUE != Packet->dts) ? Packet->dts : Packet->pts;
+    if (AV_NOPTS_VALUE == ts) {
+        return items.empty() ? 0 : items.back().us;
+    }
+    AVRational timeBase = IsVideo ? AVRational{ videoTimeBaseNum, videoTimeBaseDen } : AVRational{ audioTimeBaseNum, audioTimeBaseDen };
+    return av_rescale_q(ts, timeBase, AVRational{ 1, 1000000 });
+}
+
+void ReplayBuffer::Push(const AVPacket* Packet, bool IsVideo)
+{
+    lock_guard<std::mutex> lock(mutex);
+    bool isKey = IsVideo && (Packet->flags & AV_PKT_FLAG_KEY);
+    if (isWaitKey) {
+        if (!isKey) {
+            return;
+        }
+        isWaitKey = false;
+    }
+    AVPacket* packet = av_packet_clone(Packet);
+    if (!packet) {
+        return;
+    }
+    items.push_back(Item{ packet, IsVideo, isKey, ToUs(Packet, IsVideo) });
+    bytes += packet->size;
+    Trim();
+    durationMs = items.empty() ? 0 : (int)((items.back().us - items.front().us) / 1000);
+}
+
+void ReplayBuffer::PopFront()
+{
+    // 淘汰队首的整个GOP，直到下一个视频关键帧成为队首
+    do {
+        bytes -= items.front().packet->size;
+        av_packet_free(&items.front().packet);
+        items.pop_front();
+    } while (!items.empty() && !items.front().isKey);
+}
+
+void ReplayBuffer::Trim()
+{
+    while (bytes > maxBytes && !items.empty()) {
+        PopFront();
+    }
+    if (items.empty()) {
+        isWaitKey = true;
+        return;
+    }
+    // 去掉队首GOP后剩余的时长仍不少于保留时长时才淘汰它
+    while (true) {
+        size_t next = 1;
+        while (next < items.size() && !items[next].isKey) {
+            next++;
+        }
+        if (next >= items.size() || items.back().us - items[next].us < keepUs) {
+            break;
+        }
+        PopFront();
+    }
+}
+
+int ReplayBuffer::Snapshot(int Seconds, vector<Entry>& Packets)
+{
+    Packets.clear();
+    lock_guard<std::mutex> lock(mutex);
+    if (items.empty()) {
+        return 0;
+    }
+    // 队首必为关键帧，找到不晚于起始时刻的最后一个关键帧
+    size_t start = 0;
+    if (Seconds > 0) {
+        long long startUs = items.back().us - (long long)Seconds * 1000000;
+        for (size_t i = 1; i < items.size() && items[i].us <= startUs; i++) {
+            if (items[i].isKey) start = i;
+        }
+    }
+    Packets.reserve(items.size() - start);
+    for (size_t i = start; i < items.size(); i++) {
+        AVPacket* packet = av_packet_clone(items[i].packet);
+        if (packet) {
+            Packets.push_back(Entry{ packet, items[i].isVideo });
+        }
+    }
+    return (int)((items.back().us - items[start].us) / 1000);
+}
+
+void ReplayBuffer::Clear()
+{
+    lock_guard<std::mutex> lock(mutex);
+    for (Item& item : items) {
+        av_packet_free(&item.packet);
+    }
+    items.clear();
+    isWaitKey = true;
+    bytes = 0;
+    durationMs = 0;
+}
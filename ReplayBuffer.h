@@ -0,0 +1,95 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+// FFmpeg类型前向声明
+struct AVPacket;
+
+/// <summary>
+/// 即时回放缓冲区
+/// 在内存中保留最近一段时间的编码包(只增加引用不拷贝)，按GOP整体淘汰，队首总是视频关键帧，
+/// 需要时取出最近N秒直接封装成文件，不影响正在进行的录制，也不需要重新编码
+/// 受时长与内存两个上限约束，单个GOP就超出内存上限时整体丢弃并等待下一个关键帧
+/// </summary>
+class ReplayBuffer
+{
+public:
+    /// <summary>
+    /// 缓冲区中的一个包
+    /// </summary>
+    struct Entry
+    {
+        AVPacket* packet;
+        bool isVideo;
+    };
+
+    /// <summary>
+    /// 创建回放缓冲区
+    /// </summary>
+    /// <param name="VideoTimeBaseNum">视频编码器时间基</param>
+    /// <param name="VideoTimeBaseDen"></param>
+    /// <param name="AudioTimeBaseNum">音频编码器时间基，无音频时任意</param>
+    /// <param name="AudioTimeBaseDen"></param>
+    /// <param name="DurationMs">至少保留的时长</param>
+    /// <param name="MaxBytes">包数据的内存上限</param>
+    ReplayBuffer(int VideoTimeBaseNum, int VideoTimeBaseDen, int AudioTimeBaseNum, int AudioTimeBaseDen, int DurationMs, long long MaxBytes);
+    ~ReplayBuffer();
+    ReplayBuffer(const ReplayBuffer&) = delete;
+    ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+
+    /// <summary>
+    /// 送入一个编码包，时间戳为编码器时间基，视频与音频编码线程都会调用
+    /// </summary>
+    void Push(const AVPacket* Packet, bool IsVideo);
+
+    /// <summary>
+    /// 取出最近Seconds秒的包，从不晚于该时刻的视频关键帧开始，包只增加引用，由调用者释放
+    /// </summary>
+    /// <returns>取出的时长(毫秒)，没有可用的关键帧时为0</returns>
+    int Snapshot(int Seconds, std::vector<Entry>& Packets);
+
+    /// <summary>
+    /// 释放所有包
+    /// </summary>
+    void Clear();
+
+    /// <summary>
+    /// 获取当前缓存的包数据字节数
+    /// </summary>
+    long long GetBytes() const { return bytes; }
+    /// <summary>
+    /// 获取当前缓存的时长(毫秒)
+    /// </summary>
+    int GetDurationMs() const { return durationMs; }
+    long long GetMaxBytes() const { return maxBytes; }
+
+private:
+    struct Item
+    {
+        AVPacket* packet;
+        bool isVideo;
+        bool isKey;
+        long long us;           //时间戳(微秒)
+    };
+
+    long long ToUs(const AVPacket* Packet, bool IsVideo) const;
+    void PopFront();
+    void Trim();
+
+private:
+    const int videoTimeBaseNum;
+    const int videoTimeBaseDen;
+    const int audioTimeBaseNum;
+    const int audioTimeBaseDen;
+    const long long keepUs;
+    const long long maxBytes;
+
+    std::mutex mutex;
+    std::deque<Item> items;
+    bool isWaitKey{ true };                 //队首必须是视频关键帧，在此之前到达的包都丢弃
+    std::atomic<long long> bytes{ 0 };
+    std::atomic<int> durationMs{ 0 };
+};
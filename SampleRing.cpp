@@ -0,0 +1,83 @@
+#include "SampleRing.h"
+
+#include <cstring>
+
+using namespace std;
+
+SampleRing::SampleRing(int Planes, int SampleBytes, int Capacity)
+    : planes(Planes), sampleBytes(SampleBytes), capacity(Capacity)
+{
+    buffers.resize(planes);
+    for (vector<uint8_t>& buffer : buffers) {
+        buffer.resize((size_t)capacity * sampleBytes);
+    }
+}
+
+int SampleRing::Write(const uint8_t* const* Data, int NbSamples)
+{
+    uint64_t w = writePos.load(memory_order_relaxed);
+    uint64_t r = readPos.load(memory_order_acquire);
+    int space = capacity - (int)(w - r);
+    int num = NbSamples < space ? NbSamples : space;
+    if (num < NbSamples) {
+        dropSamples += NbSamples - num;
+    }
+    if (num <= 0) {
+        return 0;
+    }
+    // 写入位置到缓冲区末尾放不下时分两段拷贝
+    int offset = (int)(w % capacity);
+    int first = capacity - offset < num ? capacity - offset : num;
+    for (int i = 0; i < planes; i++) {
+        memcpy(buffers[i].data() + (size_t)offset * sampleBytes, Data[i], (size_t)first * sampleBytes);
+        if (num > first) {
+            memcpy(buffers[i].data(), Data[i] + (size_t)first * sampleBytes, (size_t)(num - first) * sampleBytes);
+        }
+    }
+    writePos.store(w + num, memory_order_release);
+    int fill = (int)(w + num - r);
+    if (fill > highWater) {
+        highWater = fill;
+    }
+    return num;
+}
+
+int SampleRing::Read(uint8_t* const* Data, int NbSamples)
+{
+    if (isClearRequested.exchange(false)) {
+        readPos.store(writePos.load(memory_order_acquire), memory_order_release);
+    }
+    uint64_t r = readPos.load(memory_order_relaxed);
+    uint64_t w = writePos.load(memory_order_acquire);
+    if (isTrimOnFull && (int)(w - r) >= capacity) {
+        // 消费者跟不上时丢掉积压的旧数据，把延迟拉回半个容量
+        uint64_t skip = (w - r) - capacity / 2;
+        r += skip;
+        dropSamples += skip;
+        readPos.store(r, memory_order_release);
+    }
+    if ((int)(w - r) < NbSamples) {
+        return 0;
+    }
+    int offset = (int)(r % capacity);
+    int first = capacity - offset < NbSamples ? capacity - offset : NbSamples;
+    for (int i = 0; i < planes; i++) {
+        memcpy(Data[i], buffers[i].data() + (size_t)offset * sampleBytes, (size_t)first * sampleBytes);
+        if (NbSamples > first) {
+            memcpy(Data[i] + (size_t)first * sampleBytes, buffers[i].data(), (size_t)(NbSamples - first) * sampleBytes);
+        }
+    }
+    readPos.store(r + NbSamples, memory_order_release);
+    return NbSamples;
+}
+
+int SampleRing::Size() const
+{
+    if (isClearRequested) {
+        return 0;
+    }
+    // 先取读位置再取写位置，保证差值不为负
+    uint64_t r = readPos.load(memory_order_acquire);
+    uint64_t w = writePos.load(memory_order_acquire);
+    return (int)(w - r);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+/// <summary>
+/// 单生产者单消费者的无锁音频样本环形缓冲区
+/// 按平面存放样本(交错格式视为一个平面)，容量固定，读写位置各占一个缓存行，
+/// 消费者可以直接读入预先分配好的AVFrame，读写都不加锁也不分配内存
+/// </summary>
+class SampleRing
+{
+public:
+    /// <summary>
+    /// 创建缓冲区
+    /// </summary>
+    /// <param name="Planes">平面数，平面格式为声道数，交错格式为1</param>
+    /// <param name="SampleBytes">每个平面中一个样本的字节数，交错格式为每样本字节数乘以声道数</param>
+    /// <param name="Capacity">容量(样本数)</param>
+    SampleRing(int Planes, int SampleBytes, int Capacity);
+    SampleRing(const SampleRing&) = delete;
+    SampleRing& operator=(const SampleRing&) = delete;
+
+    /// <summary>
+    /// 写入样本，只能由生产线程调用
+    /// </summary>
+    /// <param name="Data">各平面数据</param>
+    /// <param name="NbSamples">样本数</param>
+    /// <returns>实际写入的样本数，空间不足时多出的样本被丢弃并计数</returns>
+    int Write(const uint8_t* const* Data, int NbSamples);
+
+    /// <summary>
+    /// 读取样本，只能由消费线程调用
+    /// </summary>
+    /// <param name="Data">各平面目标地址</param>
+    /// <param name="NbSamples">样本数</param>
+    /// <returns>不足NbSamples时不读取并返回0，否则返回NbSamples</returns>
+    int Read(uint8_t* const* Data, int NbSamples);
+
+    /// <summary>
+    /// 获取可读的样本数，任意线程可调用，并发读写时为近似值
+    /// </summary>
+    int Size() const;
+
+    /// <summary>
+    /// 请求清空，任意线程可调用，由消费线程在下次读取时执行
+    /// </summary>
+    void RequestClear() { isClearRequested = true; }
+
+    /// <summary>
+    /// 设置缓冲区写满后是否由消费线程在下次读取时丢弃积压的旧数据，只保留最近一半容量的样本；
+    /// 写满期间写入的新样本仍会被丢弃，读写位置各自只由一个线程推进
+    /// </summary>
+    void SetTrimOnFull(bool IsTrimOnFull) { isTrimOnFull = IsTrimOnFull; }
+
+    /// <summary>
+    /// 获取出现过的最大可读样本数
+    /// </summary>
+    int GetHighWater() const { return highWater; }
+
+    int GetCapacity() const { return capacity; }
+
+    /// <summary>
+    /// 获取因空间不足而丢弃的样本数(包括写满后丢弃的最旧样本)
+    /// </summary>
+    unsigned long long GetDropSamples() const { return dropSamples; }
+
+private:
+    const int planes;
+    const int sampleBytes;
+    const int capacity;
+    std::vector<std::vector<uint8_t>> buffers;  //每个平面一块
+
+    alignas(64) std::atomic<uint64_t> writePos{ 0 };    //生产者写入的累计样本数
+    alignas(64) std::atomic<uint64_t> readPos{ 0 };     //消费者读取的累计样本数
+    alignas(64) std::atomic<bool> isClearRequested{ false };
+    std::atomic<bool> isTrimOnFull{ false };
+    std::atomic<int> highWater{ 0 };
+    std::atomic<unsigned long long> dropSamples{ 0 };
+};
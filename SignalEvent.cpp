@@ -0,0 +1,21 @@
+#include "SignalEvent.h"
+
+#include <chrono>
+
+using namespace std;
+
+void SignalEvent::Notify()
+{
+    {
+        // 持锁修改序号，避免等待者检查序号后、进入等待前错过通知
+        lock_guard<std::mutex> lock(mutex);
+        seq++;
+    }
+    cond.notify_all();
+}
+
+bool SignalEvent::Wait(uint64_t Seq, int TimeoutMs)
+{
+    unique_lock<std::mutex> lock(mutex);
+    return cond.wait_for(lock, chrono::milliseconds(TimeoutMs), [this, Seq] { return seq != Seq; });
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+/// <summary>
+/// 通知事件
+/// 生产者写入数据后调用Notify，消费者先取序号再检查数据，不足时按该序号等待，
+/// 检查与等待之间发生的通知不会丢失
+/// </summary>
+class SignalEvent
+{
+public:
+    SignalEvent() = default;
+    SignalEvent(const SignalEvent&) = delete;
+    SignalEvent& operator=(const SignalEvent&) = delete;
+
+    /// <summary>
+    /// 获取当前通知序号，应在检查数据之前获取
+    /// </summary>
+    uint64_t GetSeq() const { return seq; }
+
+    /// <summary>
+    /// 通知所有等待者
+    /// </summary>
+    void Notify();
+
+    /// <summary>
+    /// 等待序号变化
+    /// </summary>
+    /// <param name="Seq">检查数据之前取得的序号</param>
+    /// <param name="TimeoutMs">超时时间</param>
+    /// <returns>序号已变化返回true，超时返回false</returns>
+    bool Wait(uint64_t Seq, int TimeoutMs);
+
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::atomic<uint64_t> seq{ 0 };
+};
@@ -1,6 +1,7 @@
 #include <opencv2/opencv.hpp>
 #include "VideoCapManager.h"
 #include "MediaFrameCapture.h"
+#include "CameraProducer.h"
 #include "Log.h"
 // --- 修改开始 ---
 // 包含 AudioVideoProc.h 以获取 ULONGLONG 的定义
@@ -9,6 +10,9 @@
 using namespace std;
 using namespace cv;
 
+// 等待生产线程发布一帧的超时时间
+#define CAMERA_WAIT_MS 2000
+
 // --- 修改开始: 移除静态指针的定义 ---
 // VideoCapManager* VideoCapManager::self{ nullptr };
 // --- 修改结束 ---
@@ -65,6 +69,9 @@ bool VideoCapManager::OpenCamera(int CapNum, int W, int H)
 			return false;
 		}
 		videoCapMap[CapNum].first = 1;
+		// 每个摄像头只由一个生产线程读取，所有使用者共享它发布的帧
+		producerMap[CapNum] = std::make_shared<CameraProducer>(videpCap);
+		producerMap[CapNum]->Start();
 		LOG_INFO("摄像头(" + to_string(CapNum) + ")打开成功...分辨率为(" + to_string(videpCap->getWidth()) + "x" + to_string(videpCap->getHeight()) + ")");
         	// --- 修改结束 ---
 		return true;
@@ -130,6 +137,7 @@ void VideoCapManager::CloseCamera(int CapNum)
 	}
 	//如果关闭导致归零，那么释放摄像头
 	if ((--videoCapMap[CapNum].first) == 0) {
+		StopProducer(CapNum);
 		videoCapMap[CapNum].second->release();
 		LOG_INFO("摄像头(" + to_string(CapNum) + ")权重归0，摄像头已释放");
 	}
@@ -158,6 +166,7 @@ void VideoCapManager::RemoveCamera(int CapNum)
 		return;
 	}
 	videoCapMap[CapNum].first = 0;
+	StopProducer(CapNum);
 	videoCapMap[CapNum].second->release();
 	LOG_INFO("摄像头(" + to_string(CapNum) + ")已经强行释放，权重归零");
 }
@@ -170,7 +179,7 @@ bool VideoCapManager::GetMatFromCamera(int CapNum, cv::Mat& MatFromCap)
 bool VideoCapManager::GetMatFromCamera(int CapNum, int CapWidth, int CapHeight, cv::Mat& MatFromCap)
 {
 	// --- 修改开始: 锁定整个函数 ---
-	std::lock_guard<std::mutex> autoMutex{ videoCapMutex };
+	std::unique_lock<std::mutex> autoMutex{ videoCapMutex };
     	// --- 修改结束 ---
     
 	//如果没有这个摄像头或者权重为0
@@ -192,6 +201,11 @@ bool VideoCapManager::GetMatFromCamera(int CapNum, int CapWidth, int CapHeight,
 		LOG_ERROR("摄像头(" + to_string(CapNum) + ")未打开");
 		return false;
 	}
+	std::shared_ptr<CameraProducer> producer = GetProducer(CapNum);
+	if (!producer) {
+		LOG_ERROR("摄像头(" + to_string(CapNum) + ")没有生产线程");
+		return false;
+	}
 	//如果亮度异常，即断联
 	//if (isMindCapAttrWarn && -1 == (videoCap.get(cv::CAP_PROP_BRIGHTNESS))) {
 	//	LOG_ERROR("摄像头(" + to_string(CapNum) + ")亮度异常");
@@ -209,13 +223,21 @@ bool VideoCapManager::GetMatFromCamera(int CapNum, int CapWidth, int CapHeight,
 		videoCap->setupDevice(CapWidth, CapHeight);
 		isChange = true;
 	}
+	else {
+		//分辨率不变时直接取生产线程的最新帧，不再持有管理器锁，也不会触发额外的物理读取
+		autoMutex.unlock();
+	}
 	const time_t&& startTime = time(NULL);
+	uint64_t seq = 0;
 	do {
-		videoCap->read(MatFromCap);
-		if (MatFromCap.empty()) {
+		std::shared_ptr<const CameraFrame> frame = producer->WaitNewer(seq, CAMERA_WAIT_MS);
+		if (!frame || frame->GetBgr().empty()) {
 			LOG_ERROR("摄像头(" + to_string(CapNum) + ")返回Mat为空");
 			return false;
 		}
+		seq = frame->seq;
+		//共享帧只读，拷贝给调用者以便其自由修改(如去黑边)
+		frame->GetBgr().copyTo(MatFromCap);
 		//如果没有改变分辨率，那么直接返回当前的Mat
 		if (!isChange)
 			break;
@@ -223,6 +245,10 @@ bool VideoCapManager::GetMatFromCamera(int CapNum, int CapWidth, int CapHeight,
 			LOG_ERROR("摄像头(" + to_string(CapNum) + ")因持续获取无效Mat而失败");
 			return false;
 		}
+		//切换分辨率前读到的旧帧直接跳过
+		if (MatFromCap.cols != static_cast<int>(videoCap->getWidth()) || MatFromCap.rows != static_cast<int>(videoCap->getHeight())) {
+			continue;
+		}
 		//随机获取像素，如果都为205或者0，那么就意味着摄像头还未完全激活
 		int colorNum = MatFromCap.data[0];
 		//不是问题像素，那么直接退出
@@ -261,6 +287,50 @@ bool VideoCapManager::GetMatFromCamera(int CapNum, int CapWidth, int CapHeight,
 	return true;
 }
 
+bool VideoCapManager::GetRawFromCamera(int CapNum, const std::function<void(const MediaFrameCapture::RawFrame&)>& OnFrame)
+{
+	std::shared_ptr<const CameraFrame> frame = WaitFrameFromCamera(CapNum, 0, CAMERA_WAIT_MS);
+	//OpenCV回退模式下没有原始帧，由调用者改用GetMatFromCamera
+	if (!frame || !frame->isRaw) {
+		return false;
+	}
+	OnFrame(frame->raw);
+	return true;
+}
+
+std::shared_ptr<const CameraFrame> VideoCapManager::WaitFrameFromCamera(int CapNum, uint64_t Seq, int TimeoutMs)
+{
+	std::shared_ptr<CameraProducer> producer;
+	{
+		std::lock_guard<std::mutex> autoMutex{ videoCapMutex };
+		if (0 == videoCapMap.count(CapNum) || videoCapMap[CapNum].first == 0) {
+			return nullptr;
+		}
+		producer = GetProducer(CapNum);
+	}
+	if (!producer) {
+		return nullptr;
+	}
+	return producer->WaitNewer(Seq, TimeoutMs);
+}
+
+std::shared_ptr<CameraProducer> VideoCapManager::GetProducer(int CapNum)
+{
+	auto iter = producerMap.find(CapNum);
+	return (iter == producerMap.end()) ? nullptr : iter->second;
+}
+
+void VideoCapManager::StopProducer(int CapNum)
+{
+	auto iter = producerMap.find(CapNum);
+	if (iter == producerMap.end()) {
+		return;
+	}
+	//生产线程不会获取videoCapMutex，持锁等待其退出不会死锁
+	iter->second->Stop();
+	producerMap.erase(iter);
+}
+
 bool VideoCapManager::GetCameraWH(int CapNum, int& W, int& H)
 {
 	// --- 修改开始: 锁定整个函数 ---
@@ -291,6 +361,21 @@ bool VideoCapManager::GetCameraWH(int CapNum, int& W, int& H)
 	return true;
 }
 
+bool VideoCapManager::GetCameraRawFormat(int CapNum, MediaFrameCapture::RawFormat& Format)
+{
+	std::lock_guard<std::mutex> autoMutex{ videoCapMutex };
+	auto iter = videoCapMap.find(CapNum);
+	if (iter == videoCapMap.end() || 0 == iter->second.first) {
+		return false;
+	}
+	auto& videoCap = iter->second.second;
+	if (!videoCap->isOpened() || !videoCap->isNative()) {
+		return false;
+	}
+	Format = videoCap->getRawFormat();
+	return true;
+}
+
 int VideoCapManager::CheckCamera(int CapNum)
 {
 	// --- 修改开始: 锁定整个函数 ---
@@ -320,7 +405,11 @@ int VideoCapManager::CheckCamera(int CapNum)
 	//	return 4;
 	//}
 	cv::Mat mat;
-	videoCap->read(mat);
+	std::shared_ptr<CameraProducer> producer = GetProducer(CapNum);
+	std::shared_ptr<const CameraFrame> frame = producer ? producer->WaitNewer(0, CAMERA_WAIT_MS) : nullptr;
+	if (frame) {
+		mat = frame->GetBgr();
+	}
 	//图像为空异常
 	if (mat.empty()) {
 		return 5;
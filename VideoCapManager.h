@@ -1,10 +1,13 @@
 #pragma once
 #include <map>
 #include <mutex>
+#include <functional>
 #include <opencv2/opencv.hpp> // OpenCVͷļʶcv::Mat
+// ԭʼ֡صҪMediaFrameCapture::RawFrame
+#include "MediaFrameCapture.h"
 
-// MediaFrameCapture ֻҪǰ㹻ˣԱѭ
-class MediaFrameCapture;
+class CameraProducer;
+struct CameraFrame;
 class VideoCapManager
 {
 private:
@@ -44,7 +47,7 @@ public:
 	void RemoveCamera(int CapNum);
 
 	/// <summary>
-	/// Ѿ򿪵ͷȡMat
+	/// Ѿ򿪵ͷȡMatȡõ̷߳һ֡Ŀ
 	/// </summary>
 	/// <param name="CapNum">ͷ</param>
 	/// <param name="MatFromCap">Matͼ</param>
@@ -57,6 +60,21 @@ public:
 		/// <param name="CapHeight">ͼֱָʸ(0ǰ)</param>
 	/// <param name="MatFromCap">Matͼ</param>
 	bool GetMatFromCamera(int CapNum, int CapWidth, int CapHeight, cv::Mat& MatFromCap);
+	/// <summary>
+	/// Ѿ򿪵ͷȡԭʼ֡뿽V4L2ֱͷ
+	/// </summary>
+	/// <param name="CapNum">ͷ</param>
+	/// <param name="OnFrame">ȡһ֡Ļصֻ֡ڻصڼЧ</param>
+	/// <returns>Ƿɹȡ</returns>
+	bool GetRawFromCamera(int CapNum, const std::function<void(const MediaFrameCapture::RawFrame&)>& OnFrame);
+	/// <summary>
+	/// ȴͷ̷߳ŴSeq֡й߿ɹͬһͷȫ֡
+	/// </summary>
+	/// <param name="CapNum">ͷ</param>
+	/// <param name="Seq">Ѿȡõ֡ţ0ʾµһ֡</param>
+	/// <param name="TimeoutMs">ʱʱ()</param>
+	/// <returns>ʧܻʱؿ</returns>
+	std::shared_ptr<const CameraFrame> WaitFrameFromCamera(int CapNum, uint64_t Seq, int TimeoutMs);
 
 	/// <summary>
 	/// ȡѾͷ
@@ -67,6 +85,14 @@ public:
 	/// <returns>Ƿɹȡ</returns>
 	bool GetCameraWH(int CapNum, int& W, int& H);
 
+	/// <summary>
+	/// ȡѾͷԭʼݸʽ
+	/// </summary>
+	/// <param name="CapNum">ͷ</param>
+	/// <param name="Format">洢ʽ</param>
+	/// <returns>V4L2ֱģʽ(OpenCV)ͷδʱfalse</returns>
+	bool GetCameraRawFormat(int CapNum, MediaFrameCapture::RawFormat& Format);
+
 	/// <summary>
 	/// ָͷ״̬
 	/// </summary>
@@ -90,10 +116,16 @@ public:
 	/// ȡǰǷͷԾ棬ᣬΪȡͷ
 	/// </summary>
 	bool GetMindCapAttrWarn();
+private:
+	std::shared_ptr<CameraProducer> GetProducer(int CapNum);
+	void StopProducer(int CapNum);
+
 private:
 	// --- ޸Ŀʼ: mapд洢ָ룬Ƕ ---
 	std::map<int, std::pair<int, std::shared_ptr<MediaFrameCapture>>> videoCapMap;
     // --- ޸Ľ ---
+	// ÿѴͷ̣߳ȡ֡ʱֻڲڼvideoCapMutex
+	std::map<int, std::shared_ptr<CameraProducer>> producerMap;
 	//std::mutex videoCapMutex;
 	bool isMindCapAttrWarn;
 	// --- ޸Ŀʼ: һĻ ---
@@ -0,0 +1,139 @@
+#include "VideoFramePool.h"
+#include "Log.h"
+
+extern "C" {
+#include "libavutil/buffer.h"
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+}
+extern "C" {
+#include <libyuv.h>
+}
+
+using namespace std;
+
+// 与av_frame_get_buffer一致的对齐，便于libyuv与编码器使用SIMD
+#define FRAME_POOL_ALIGN 32
+
+VideoFramePool::VideoFramePool()
+{
+}
+
+VideoFramePool::~VideoFramePool()
+{
+    UnInit();
+}
+
+bool VideoFramePool::Init(int PixFmt, int Width, int Height)
+{
+    UnInit();
+    frameBytes = av_image_get_buffer_size(static_cast<AVPixelFormat>(PixFmt), Width, Height, FRAME_POOL_ALIGN);
+    if (frameBytes <= 0) {
+        LOG_ERROR("视频帧池参数无效 " + to_string(Width) + "x" + to_string(Height));
+        frameBytes = 0;
+        return false;
+    }
+    pool = av_buffer_pool_init(frameBytes, av_buffer_alloc);
+    if (!pool) {
+        LOG_ERROR("创建视频帧池失败");
+        frameBytes = 0;
+        return false;
+    }
+    pixFmt = PixFmt;
+    width = Width;
+    height = Height;
+    return true;
+}
+
+void VideoFramePool::UnInit()
+{
+    if (pool) {
+        av_buffer_pool_uninit(&pool);
+    }
+    frameBytes = 0;
+}
+
+AVFrame* VideoFramePool::GetFrame()
+{
+    if (!pool) {
+        return nullptr;
+    }
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return nullptr;
+    }
+    if (!FillFrame(frame)) {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+    return frame;
+}
+
+bool VideoFramePool::MakeWritable(AVFrame* Frame, bool IsKeepData)
+{
+    if (!Frame) {
+        return false;
+    }
+    if (Frame->buf[0] && av_frame_is_writable(Frame)) {
+        return true;
+    }
+    AVFrame* newFrame = GetFrame();
+    if (!newFrame) {
+        return false;
+    }
+    if (IsKeepData && Frame->buf[0]) {
+        av_frame_copy(newFrame, Frame);
+    }
+    av_frame_copy_props(newFrame, Frame);
+    av_frame_unref(Frame);
+    av_frame_move_ref(Frame, newFrame);
+    av_frame_free(&newFrame);
+    return true;
+}
+
+bool VideoFramePool::CopyRect(const AVFrame* Src, int SrcX, int SrcY, AVFrame* Dst, int DstX, int DstY, int Width, int Height)
+{
+    if (!Src || !Dst || Src->format != Dst->format || Width <= 0 || Height <= 0) {
+        return false;
+    }
+    const uint8_t* srcY = Src->data[0] + SrcY * Src->linesize[0] + SrcX;
+    uint8_t* dstY = Dst->data[0] + DstY * Dst->linesize[0] + DstX;
+    if (AV_PIX_FMT_NV12 == Dst->format) {
+        // UV交错存放，每行字节数与Y相同
+        libyuv::CopyPlane(srcY, Src->linesize[0], dstY, Dst->linesize[0], Width, Height);
+        libyuv::CopyPlane(Src->data[1] + (SrcY / 2) * Src->linesize[1] + SrcX, Src->linesize[1],
+                          Dst->data[1] + (DstY / 2) * Dst->linesize[1] + DstX, Dst->linesize[1],
+                          Width, Height / 2);
+        return true;
+    }
+    if (AV_PIX_FMT_YUV420P == Dst->format) {
+        libyuv::I420Copy(srcY, Src->linesize[0],
+                         Src->data[1] + (SrcY / 2) * Src->linesize[1] + SrcX / 2, Src->linesize[1],
+                         Src->data[2] + (SrcY / 2) * Src->linesize[2] + SrcX / 2, Src->linesize[2],
+                         dstY, Dst->linesize[0],
+                         Dst->data[1] + (DstY / 2) * Dst->linesize[1] + DstX / 2, Dst->linesize[1],
+                         Dst->data[2] + (DstY / 2) * Dst->linesize[2] + DstX / 2, Dst->linesize[2],
+                         Width, Height);
+        return true;
+    }
+    return false;
+}
+
+bool VideoFramePool::FillFrame(AVFrame* Frame)
+{
+    Frame->buf[0] = av_buffer_pool_get(pool);
+    if (!Frame->buf[0]) {
+        LOG_ERROR("视频帧池取出缓冲区失败");
+        return false;
+    }
+    Frame->format = pixFmt;
+    Frame->width = width;
+    Frame->height = height;
+    // 各平面指针直接指向池中的缓冲区，之后的转换结果不再需要额外拷贝
+    if (av_image_fill_arrays(Frame->data, Frame->linesize, Frame->buf[0]->data,
+        static_cast<AVPixelFormat>(pixFmt), width, height, FRAME_POOL_ALIGN) < 0) {
+        av_buffer_unref(&Frame->buf[0]);
+        return false;
+    }
+    return true;
+}
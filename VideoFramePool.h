@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+
+// FFmpeg类型前向声明
+struct AVFrame;
+struct AVBufferPool;
+
+/// <summary>
+/// 视频帧池
+/// 所有帧共享同一个AVBufferPool，帧数据按32字节对齐，引用计数归零后缓冲区回到池中复用，
+/// 编码器持有引用期间采集线程会拿到新的缓冲区，不会覆盖正在编码的数据
+/// </summary>
+class VideoFramePool
+{
+public:
+    VideoFramePool();
+    ~VideoFramePool();
+    VideoFramePool(const VideoFramePool&) = delete;
+    VideoFramePool& operator=(const VideoFramePool&) = delete;
+
+    /// <summary>
+    /// 按指定格式与宽高初始化帧池
+    /// </summary>
+    /// <param name="PixFmt">像素格式(AVPixelFormat)</param>
+    /// <param name="Width">帧宽</param>
+    /// <param name="Height">帧高</param>
+    /// <returns>是否初始化成功</returns>
+    bool Init(int PixFmt, int Width, int Height);
+
+    /// <summary>
+    /// 释放帧池，已取出的帧在自身释放后才会真正回收内存
+    /// </summary>
+    void UnInit();
+
+    /// <summary>
+    /// 从池中取出一帧，使用完后由调用者av_frame_free
+    /// </summary>
+    /// <returns>失败返回nullptr</returns>
+    AVFrame* GetFrame();
+
+    /// <summary>
+    /// 保证帧可写，若缓冲区仍被其他引用持有(如编码器)则换成池中新的缓冲区
+    /// </summary>
+    /// <param name="Frame">由本池取出的帧</param>
+    /// <param name="IsKeepData">换缓冲区时是否拷贝原有画面</param>
+    /// <returns>是否成功</returns>
+    bool MakeWritable(AVFrame* Frame, bool IsKeepData);
+
+    bool IsInit() const { return nullptr != pool; }
+    int GetPixFmt() const { return pixFmt; }
+    /// <summary>
+    /// 获取每帧的字节数
+    /// </summary>
+    int GetFrameBytes() const { return frameBytes; }
+
+    /// <summary>
+    /// 拷贝一块区域，支持YUV420P与NV12，两帧格式须相同，坐标与宽高按偶数对齐
+    /// </summary>
+    /// <returns>格式不支持或不一致时返回false</returns>
+    static bool CopyRect(const AVFrame* Src, int SrcX, int SrcY, AVFrame* Dst, int DstX, int DstY, int Width, int Height);
+
+private:
+    bool FillFrame(AVFrame* Frame);
+
+private:
+    AVBufferPool* pool{ nullptr };
+    int pixFmt{ -1 };
+    int width{ 0 };
+    int height{ 0 };
+    int frameBytes{ 0 };
+};
@@ -0,0 +1,263 @@
+#include "VideoSource.h"
+#include "VideoCapManager.h"
+#include "CameraProducer.h"
+#include "Log.h"
+
+extern "C" {
+#include "libavutil/frame.h"
+}
+extern "C" {
+#include <libyuv.h>
+}
+
+using namespace std;
+
+// 等待摄像头生产线程发布首帧的超时时间
+#define SOURCE_CAMERA_WAIT_MS 2000
+
+static FrameConverter::PixelFormat RawToConverterFormat(MediaFrameCapture::RawFormat Format) {
+    switch (Format) {
+    case MediaFrameCapture::RawFormat::NV12:
+        return FrameConverter::PixelFormat::NV12;
+    case MediaFrameCapture::RawFormat::MJPEG:
+        return FrameConverter::PixelFormat::MJPEG;
+    default:
+        return FrameConverter::PixelFormat::YUYV;
+    }
+}
+
+static string KeyToString(const VideoSource::Key& SourceKey) {
+    string name = (-1 == SourceKey.cameraNum) ? "桌面(" + to_string(SourceKey.x) + "," + to_string(SourceKey.y) + ")" : "摄像头(" + to_string(SourceKey.cameraNum) + ")";
+    return name + " " + to_string(SourceKey.width) + "x" + to_string(SourceKey.height) + "->" + to_string(SourceKey.outWidth) + "x" + to_string(SourceKey.outHeight)
+        + ((AV_PIX_FMT_NV12 == SourceKey.pixFmt) ? " NV12" : " I420");
+}
+
+VideoSource::VideoSource(const Key& SourceKey) : key(SourceKey)
+{
+    LOG_INFO("创建共享视频源:" + KeyToString(key));
+}
+
+VideoSource::~VideoSource()
+{
+    if (desktopCapture) desktopCapture->Close();
+    if (frame) av_frame_free(&frame);
+    framePool.UnInit();
+    LOG_INFO("释放共享视频源:" + KeyToString(key) + "，共采集转换" + to_string(captureNum) + "次");
+}
+
+bool VideoSource::Open()
+{
+    if (-1 != key.cameraNum) {
+        return true;
+    }
+    lock_guard<mutex> autoMutex{ captureMutex };
+    if (!desktopCapture) desktopCapture.reset(new DesktopCapture());
+    if (desktopCapture->IsOpened()) {
+        return true;
+    }
+    return desktopCapture->Open(key.x, key.y, key.width, key.height, key.isDamage);
+}
+
+AVFrame* VideoSource::Acquire(chrono::microseconds MaxAge, uint64_t& Seq, bool& IsPartial)
+{
+    lock_guard<mutex> autoMutex{ captureMutex };
+    auto now = chrono::steady_clock::now();
+    // 同一节拍内其他订阅者已经采集过，直接共享结果
+    if (!isCaptureOk || now - captureTime >= MaxAge) {
+        isCaptureOk = Capture();
+        captureTime = now;
+        captureNum++;
+    }
+    if (!isCaptureOk) {
+        return nullptr;
+    }
+    Seq = seq;
+    IsPartial = isPartial;
+    return av_frame_clone(frame);
+}
+
+void VideoSource::ResetCamera()
+{
+    lock_guard<mutex> autoMutex{ captureMutex };
+    cameraSeq = 0;
+    isFrameValid = false;
+    isCaptureOk = false;
+}
+
+int VideoSource::GetAvgGrabUs()
+{
+    lock_guard<mutex> autoMutex{ captureMutex };
+    if (!desktopCapture || !desktopCapture->IsOpened())
+        return -1;
+    return desktopCapture->GetAvgGrabUs();
+}
+
+bool VideoSource::IsShm()
+{
+    lock_guard<mutex> autoMutex{ captureMutex };
+    return desktopCapture && desktopCapture->IsShm();
+}
+
+unsigned long long VideoSource::GetCaptureNum()
+{
+    lock_guard<mutex> autoMutex{ captureMutex };
+    return captureNum;
+}
+
+bool VideoSource::Capture()
+{
+    if (!frame) {
+        if (!framePool.Init(key.pixFmt, key.outWidth, key.outHeight)) {
+            LOG_ERROR("共享视频源分配YUV帧池失败");
+            return false;
+        }
+        frame = framePool.GetFrame();
+        if (!frame) {
+            LOG_ERROR("共享视频源分配YUV帧的内存失败");
+            return false;
+        }
+    }
+    frameConverter.SetScaleFilter(static_cast<FrameConverter::ScaleFilter>(key.scaleFilter));
+    return (-1 == key.cameraNum) ? CaptureDesktop() : CaptureCamera();
+}
+
+bool VideoSource::CaptureDesktop()
+{
+    //截屏获取 (X11，优先MIT-SHM)
+    if (!desktopCapture) desktopCapture.reset(new DesktopCapture());
+    if (!desktopCapture->IsOpened()) {
+        desktopCapture->Open(key.x, key.y, key.width, key.height, key.isDamage);
+    }
+    if (!desktopCapture->IsOpened()) {
+        return false;
+    }
+    uint8_t* grabData = nullptr;
+    int grabStride = 0;
+    DesktopCapture::GrabResult grabResult = desktopCapture->GrabDamage(grabData, grabStride, damageRects);
+    if (DesktopCapture::GrabResult::Failed == grabResult) {
+        return false;
+    }
+    if (DesktopCapture::GrabResult::Unchanged == grabResult && isFrameValid) {
+        // 录制区域无变化，序号不变，订阅者沿用上一帧
+        return true;
+    }
+    const bool isSameSize = (key.width == key.outWidth && key.height == key.outHeight);
+    if (DesktopCapture::GrabResult::Partial == grabResult && isFrameValid && isSameSize
+        && framePool.MakeWritable(frame, true)) {
+        // 只转换变化区域，I420色度按2x2采样，区域需按偶数对齐
+        for (const DesktopCapture::DamageRect& rect : damageRects) {
+            int left = rect.x & ~1;
+            int top = rect.y & ~1;
+            int right = min(rect.x + rect.width + 1, key.outWidth) & ~1;
+            int bottom = min(rect.y + rect.height + 1, key.outHeight) & ~1;
+            if (right <= left || bottom <= top) continue;
+            if (AV_PIX_FMT_NV12 == key.pixFmt) {
+                libyuv::ARGBToNV12(grabData + top * grabStride + left * 4, grabStride,
+                                   frame->data[0] + top * frame->linesize[0] + left, frame->linesize[0],
+                                   frame->data[1] + (top / 2) * frame->linesize[1] + left, frame->linesize[1],
+                                   right - left, bottom - top);
+                continue;
+            }
+            libyuv::ARGBToI420(grabData + top * grabStride + left * 4, grabStride,
+                               frame->data[0] + top * frame->linesize[0] + left, frame->linesize[0],
+                               frame->data[1] + (top / 2) * frame->linesize[1] + left / 2, frame->linesize[1],
+                               frame->data[2] + (top / 2) * frame->linesize[2] + left / 2, frame->linesize[2],
+                               right - left, bottom - top);
+        }
+        isPartial = true;
+        seq++;
+        return true;
+    }
+    // X11的BGRA数据与libyuv的ARGB内存顺序一致
+    if (!framePool.MakeWritable(frame, false)
+        || !frameConverter.Convert(grabData, grabStride, key.width, key.height, FrameConverter::PixelFormat::BGRA, frame)) {
+        isFrameValid = false;
+        return false;
+    }
+    isFrameValid = true;
+    isPartial = false;
+    seq++;
+    return true;
+}
+
+bool VideoSource::CaptureCamera()
+{
+    // 摄像头由生产线程读取，这里只取其最新一帧
+    shared_ptr<const CameraFrame> cameraFrame = VideoCapManager::Default()->WaitFrameFromCamera(key.cameraNum, 0, SOURCE_CAMERA_WAIT_MS);
+    if (!cameraFrame) {
+        return false;
+    }
+    if (cameraFrame->seq == cameraSeq && isFrameValid) {
+        // 生产线程尚未发布新帧，无需重复转换
+        return true;
+    }
+    bool isConverted = false;
+    if (framePool.MakeWritable(frame, false)) {
+        if (cameraFrame->isRaw) {
+            const MediaFrameCapture::RawFrame& raw = cameraFrame->raw;
+            isConverted = frameConverter.Convert(raw.data, raw.stride, raw.width, raw.height, RawToConverterFormat(raw.format), frame, raw.bytes);
+        }
+        else if (!cameraFrame->bgr.empty() && 3 == cameraFrame->bgr.channels()) {
+            // OpenCV回退模式，BGR与libyuv的RGB24内存顺序一致
+            const cv::Mat& bgr = cameraFrame->bgr;
+            isConverted = frameConverter.Convert(bgr.data, static_cast<int>(bgr.step), bgr.cols, bgr.rows, FrameConverter::PixelFormat::BGR24, frame);
+        }
+    }
+    if (!isConverted) {
+        LOG_WARN("摄像头(" + to_string(key.cameraNum) + ")帧转换失败");
+        isFrameValid = false;
+        return false;
+    }
+    cameraSeq = cameraFrame->seq;
+    isFrameValid = true;
+    isPartial = false;
+    seq++;
+    return true;
+}
+
+VideoSourceManager* VideoSourceManager::Default()
+{
+    static VideoSourceManager instance;
+    return &instance;
+}
+
+shared_ptr<VideoSource> VideoSourceManager::Acquire(const VideoSource::Key& SourceKey)
+{
+    lock_guard<mutex> autoMutex{ sourceMutex };
+    // 顺便清理已无订阅者且已关闭的登记
+    for (auto iter = sourceMap.begin(); iter != sourceMap.end();) {
+        if (0 == iter->second.shareNum && iter->second.source.expired()) iter = sourceMap.erase(iter);
+        else ++iter;
+    }
+    Entry& entry = sourceMap[SourceKey];
+    shared_ptr<VideoSource> source = entry.source.lock();
+    if (!source) {
+        source = make_shared<VideoSource>(SourceKey);
+        entry.source = source;
+    }
+    entry.shareNum++;
+    // 每个订阅者一个句柄，句柄析构时减少订阅者数量并释放对源的引用
+    return shared_ptr<VideoSource>(source.get(), [this, SourceKey, source](VideoSource*) mutable {
+        Release(SourceKey);
+        source.reset();
+    });
+}
+
+void VideoSourceManager::Release(const VideoSource::Key& SourceKey)
+{
+    lock_guard<mutex> autoMutex{ sourceMutex };
+    auto iter = sourceMap.find(SourceKey);
+    if (iter != sourceMap.end() && iter->second.shareNum > 0) {
+        iter->second.shareNum--;
+    }
+}
+
+int VideoSourceManager::GetShareNum(const VideoSource::Key& SourceKey)
+{
+    lock_guard<mutex> autoMutex{ sourceMutex };
+    auto iter = sourceMap.find(SourceKey);
+    if (iter == sourceMap.end()) {
+        return 0;
+    }
+    return iter->second.shareNum;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <tuple>
+#include <cstdint>
+#include <vector>
+#include "DesktopCapture.h"
+#include "VideoFramePool.h"
+#include "FrameConverter.h"
+
+// FFmpeg类型前向声明
+struct AVFrame;
+
+/// <summary>
+/// 共享视频源
+/// 同一桌面区域或同一摄像头在一个采集节拍内只采集、转换一次，
+/// 结果为引用计数的I420或NV12帧，交给所有订阅它的模块各自编码
+/// </summary>
+class VideoSource
+{
+public:
+    /// <summary>
+    /// 视频源标识，采集区域、输出尺寸或转换参数任一不同即为不同的源
+    /// </summary>
+    struct Key
+    {
+        int cameraNum{ -1 };    //-1为桌面，否则为摄像头序号
+        int x{ 0 };             //桌面采集区域，摄像头时为0
+        int y{ 0 };
+        int width{ 0 };         //采集宽高，摄像头时为指定的分辨率
+        int height{ 0 };
+        int outWidth{ 0 };      //输出I420帧的宽高
+        int outHeight{ 0 };
+        int scaleFilter{ 0 };
+        bool isDamage{ true };  //桌面是否使用XDamage
+        int pixFmt{ 0 };        //输出帧格式(AVPixelFormat)，YUV420P或NV12
+
+        bool operator<(const Key& Other) const {
+            return std::tie(cameraNum, x, y, width, height, outWidth, outHeight, scaleFilter, isDamage, pixFmt)
+                < std::tie(Other.cameraNum, Other.x, Other.y, Other.width, Other.height, Other.outWidth, Other.outHeight, Other.scaleFilter, Other.isDamage, Other.pixFmt);
+        }
+        bool operator==(const Key& Other) const { return !(*this < Other) && !(Other < *this); }
+        bool operator!=(const Key& Other) const { return !(*this == Other); }
+    };
+
+    explicit VideoSource(const Key& SourceKey);
+    ~VideoSource();
+    VideoSource(const VideoSource&) = delete;
+    VideoSource& operator=(const VideoSource&) = delete;
+
+    /// <summary>
+    /// 预先打开采集设备，桌面为X11连接与共享内存，摄像头由VideoCapManager管理，直接返回true
+    /// </summary>
+    bool Open();
+
+    /// <summary>
+    /// 取得当前画面，若最近一次采集早于MaxAge则先重新采集、转换
+    /// </summary>
+    /// <param name="MaxAge">可接受的画面最大陈旧时间，一般取调用者帧间隔的一半</param>
+    /// <param name="Seq">返回画面序号，画面内容变化时才递增</param>
+    /// <param name="IsPartial">返回画面是否由桌面局部更新得到</param>
+    /// <returns>新的帧引用，由调用者av_frame_free；采集失败返回nullptr</returns>
+    AVFrame* Acquire(std::chrono::microseconds MaxAge, uint64_t& Seq, bool& IsPartial);
+
+    /// <summary>
+    /// 摄像头重新打开后调用，丢弃旧画面，下次取帧时重新转换
+    /// </summary>
+    void ResetCamera();
+
+    const Key& GetKey() const { return key; }
+    /// <summary>
+    /// 获取桌面平均抓取耗时(微秒)，非桌面或未打开返回-1
+    /// </summary>
+    int GetAvgGrabUs();
+    bool IsShm();
+    /// <summary>
+    /// 获取实际采集次数
+    /// </summary>
+    unsigned long long GetCaptureNum();
+    /// <summary>
+    /// 获取每帧转换(含缩放)耗时的滑动平均值(微秒)与最近一次切分的条带数
+    /// </summary>
+    int GetAvgConvertUs() const { return frameConverter.GetAvgConvertUs(); }
+    int GetConvertSliceNum() const { return frameConverter.GetSliceNum(); }
+
+private:
+    bool Capture();
+    bool CaptureDesktop();
+    bool CaptureCamera();
+
+private:
+    const Key key;
+    std::mutex captureMutex;
+    VideoFramePool framePool;
+    FrameConverter frameConverter;
+    AVFrame* frame{ nullptr };          //当前画面，由framePool取出
+    uint64_t seq{ 0 };
+    bool isPartial{ false };
+    bool isFrameValid{ false };         //frame中是否为本源的完整画面，局部更新以它为基础
+    bool isCaptureOk{ false };
+    std::chrono::steady_clock::time_point captureTime;
+    unsigned long long captureNum{ 0 };
+
+    std::unique_ptr<DesktopCapture> desktopCapture;
+    std::vector<DesktopCapture::DamageRect> damageRects;
+    uint64_t cameraSeq{ 0 };            //已转换的摄像头帧序号，生产线程未发布新帧时不再转换
+};
+
+/// <summary>
+/// 共享视频源管理器
+/// 以Key区分视频源，源只以弱引用登记，最后一个订阅者释放后自动关闭
+/// 每次订阅返回一个独立的句柄，句柄的拷贝不计入订阅者，最后一个拷贝释放时订阅者数量减一
+/// </summary>
+class VideoSourceManager
+{
+private:
+    VideoSourceManager() = default;
+    ~VideoSourceManager() = default;
+
+public:
+    static VideoSourceManager* Default();
+    VideoSourceManager(const VideoSourceManager&) = delete;
+    VideoSourceManager& operator=(const VideoSourceManager&) = delete;
+
+    /// <summary>
+    /// 订阅视频源，相同Key的订阅者共享同一个源
+    /// </summary>
+    std::shared_ptr<VideoSource> Acquire(const VideoSource::Key& SourceKey);
+
+    /// <summary>
+    /// 获取视频源当前的订阅者数量
+    /// </summary>
+    int GetShareNum(const VideoSource::Key& SourceKey);
+
+private:
+    void Release(const VideoSource::Key& SourceKey);
+
+private:
+    struct Entry
+    {
+        std::weak_ptr<VideoSource> source;
+        int shareNum{ 0 };      //订阅者数量，不含临时的shared_ptr拷贝
+    };
+    std::mutex sourceMutex;
+    std::map<VideoSource::Key, Entry> sourceMap;
+};
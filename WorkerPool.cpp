@@ -0,0 +1,135 @@
+#include "WorkerPool.h"
+#include "Log.h"
+
+#include <algorithm>
+
+using namespace std;
+
+// 工作线程数上限
+#define WORKER_POOL_MAX_THREAD 16
+
+WorkerPool::WorkerPool()
+{
+    // 默认串行，与以前的行为一致，由SetThreadNum开启
+}
+
+WorkerPool::~WorkerPool()
+{
+    StopThreads();
+}
+
+WorkerPool* WorkerPool::Default()
+{
+    static WorkerPool instance;
+    return &instance;
+}
+
+void WorkerPool::SetThreadNum(int Num)
+{
+    if (Num < 0) {
+        // 调用线程也参与计算，工作线程取核数减一
+        Num = static_cast<int>(thread::hardware_concurrency()) - 1;
+    }
+    Num = max(0, min(Num, WORKER_POOL_MAX_THREAD));
+    lock_guard<mutex> autoMutex{ configMutex };
+    if (Num == threadNum) {
+        return;
+    }
+    StopThreads();
+    StartThreads(Num);
+    LOG_INFO("工作线程池线程数:" + to_string(Num));
+}
+
+void WorkerPool::ParallelFor(int Count, const function<void(int)>& Task)
+{
+    if (Count <= 0) {
+        return;
+    }
+    taskNum += Count;
+    if (1 == Count || 0 == threadNum) {
+        for (int i = 0; i < Count; i++) Task(i);
+        return;
+    }
+    shared_ptr<Job> job = make_shared<Job>();
+    job->task = &Task;
+    job->count = Count;
+    {
+        lock_guard<mutex> autoMutex{ jobMutex };
+        jobs.push_back(job);
+    }
+    jobCondition.notify_all();
+
+    // 调用线程也领取序号，工作线程被其他模块占满时由自己做完
+    int index;
+    while ((index = job->next++) < Count) {
+        RunIndex(*job, index);
+    }
+    {
+        lock_guard<mutex> autoMutex{ jobMutex };
+        auto iter = find(jobs.begin(), jobs.end(), job);
+        if (iter != jobs.end()) jobs.erase(iter);
+    }
+    unique_lock<mutex> doneLock{ job->doneMutex };
+    job->doneCondition.wait(doneLock, [&job] { return job->done >= job->count; });
+}
+
+void WorkerPool::RunIndex(Job& CurJob, int Index)
+{
+    (*CurJob.task)(Index);
+    if (++CurJob.done == CurJob.count) {
+        // 加锁后再通知，避免调用线程检查条件与进入等待之间漏掉通知
+        lock_guard<mutex> autoMutex{ CurJob.doneMutex };
+        CurJob.doneCondition.notify_all();
+    }
+}
+
+void WorkerPool::StartThreads(int Num)
+{
+    {
+        lock_guard<mutex> autoMutex{ jobMutex };
+        isStop = false;
+    }
+    for (int i = 0; i < Num; i++) {
+        threads.emplace_back(&WorkerPool::ThreadRun, this);
+    }
+    threadNum = Num;
+}
+
+void WorkerPool::StopThreads()
+{
+    {
+        lock_guard<mutex> autoMutex{ jobMutex };
+        isStop = true;
+    }
+    jobCondition.notify_all();
+    for (thread& worker : threads) {
+        if (worker.joinable()) worker.join();
+    }
+    threads.clear();
+    threadNum = 0;
+}
+
+void WorkerPool::ThreadRun()
+{
+    while (true) {
+        shared_ptr<Job> job;
+        int index = 0;
+        {
+            unique_lock<mutex> jobLock{ jobMutex };
+            jobCondition.wait(jobLock, [this] { return isStop || !jobs.empty(); });
+            if (isStop) {
+                // 未领取的序号由各自的调用线程完成
+                break;
+            }
+            job = jobs.front();
+            index = job->next++;
+            if (index >= job->count) {
+                // 序号已领完，移出队列，等待下一个任务
+                jobs.pop_front();
+                continue;
+            }
+        }
+        RunIndex(*job, index);
+        workerTaskNum++;
+    }
+}
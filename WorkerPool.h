@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+/// <summary>
+/// 常驻工作线程池，所有模块共享
+/// 用于把一帧的转换、缩放按行切分成若干条带并行处理；
+/// 调用线程自己也领取条带，工作线程全忙或线程数为0时退化为串行，不会死等
+/// </summary>
+class WorkerPool
+{
+private:
+    WorkerPool();
+    ~WorkerPool();
+
+public:
+    static WorkerPool* Default();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /// <summary>
+    /// 设置工作线程数[0,16]，0为串行，-1按CPU核数自动选择，正在执行的任务不受影响
+    /// </summary>
+    void SetThreadNum(int Num);
+
+    /// <summary>
+    /// 获取工作线程数，不含调用线程
+    /// </summary>
+    int GetThreadNum() const { return threadNum; }
+
+    /// <summary>
+    /// 并行执行Task(0)到Task(Count-1)，全部完成后返回
+    /// </summary>
+    /// <param name="Count">任务数</param>
+    /// <param name="Task">任务，参数为序号，不同序号之间不能有数据依赖</param>
+    void ParallelFor(int Count, const std::function<void(int)>& Task);
+
+    /// <summary>
+    /// 获取累计执行的任务数与其中由工作线程执行的数量
+    /// </summary>
+    unsigned long long GetTaskNum() const { return taskNum; }
+    unsigned long long GetWorkerTaskNum() const { return workerTaskNum; }
+
+private:
+    /// <summary>
+    /// 一次ParallelFor，序号由调用线程与工作线程共同领取
+    /// </summary>
+    struct Job
+    {
+        const std::function<void(int)>* task{ nullptr };
+        int count{ 0 };
+        std::atomic<int> next{ 0 };
+        std::atomic<int> done{ 0 };
+        std::mutex doneMutex;
+        std::condition_variable doneCondition;
+    };
+
+    static void RunIndex(Job& CurJob, int Index);
+    void StartThreads(int Num);
+    void StopThreads();
+    void ThreadRun();
+
+private:
+    std::mutex configMutex;                     //保护线程的启停
+    std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    std::deque<std::shared_ptr<Job>> jobs;
+    std::vector<std::thread> threads;
+    bool isStop{ false };
+    std::atomic<int> threadNum{ 0 };
+    std::atomic<unsigned long long> taskNum{ 0 };
+    std::atomic<unsigned long long> workerTaskNum{ 0 };
+};
@@ -0,0 +1,99 @@
+// 对比SampleRing与原先AVAudioFifo加互斥锁、每次读取都分配帧缓冲区的做法
+// 单线程交替写入与读出一帧，输出每帧耗时
+// 用法: SampleRingBench [采样率] [声道数] [每帧样本数] [次数]，默认48000 2 1024 20000，格式为FLTP
+#include "SampleRing.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+extern "C" {
+#include "libavutil/audio_fifo.h"
+#include "libavutil/channel_layout.h"
+#include "libavutil/frame.h"
+#include "libavutil/samplefmt.h"
+}
+
+using namespace std;
+
+static long long steady_now_us() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char* argv[])
+{
+    const AVSampleFormat fmt = AV_SAMPLE_FMT_FLTP;
+    const int sampleRate = (argc > 1) ? atoi(argv[1]) : 48000;
+    const int channels = (argc > 2) ? atoi(argv[2]) : 2;
+    const int frameSamples = (argc > 3) ? atoi(argv[3]) : 1024;
+    const int loops = (argc > 4) ? atoi(argv[4]) : 20000;
+    const int capacity = frameSamples * 4;
+    const int isPlanar = av_sample_fmt_is_planar(fmt);
+    long long ringUs = 0;
+    long long fifoUs = 0;
+    int ret = 1;
+    AVFrame* src = av_frame_alloc();
+    AVFrame* dst = av_frame_alloc();
+    AVFrame* out = av_frame_alloc();
+    AVAudioFifo* fifo = av_audio_fifo_alloc(fmt, channels, capacity);
+    if (channels <= 0 || frameSamples <= 0 || loops <= 0 || !src || !dst || !out || !fifo) {
+        fprintf(stderr, "参数无效或分配内存失败\n");
+        goto END;
+    }
+    for (AVFrame* frame : { src, dst }) {
+        frame->format = fmt;
+        frame->channels = channels;
+        frame->channel_layout = av_get_default_channel_layout(channels);
+        frame->nb_samples = frameSamples;
+        if (av_frame_get_buffer(frame, 0) < 0) {
+            fprintf(stderr, "分配帧缓冲区失败\n");
+            goto END;
+        }
+    }
+    av_samples_set_silence(src->data, 0, frameSamples, channels, fmt);
+
+    // 新做法：读入预先分配好的帧，不加锁也不分配内存
+    {
+        SampleRing ring(isPlanar ? channels : 1, av_get_bytes_per_sample(fmt) * (isPlanar ? 1 : channels), capacity);
+        long long begin = steady_now_us();
+        for (int i = 0; i < loops; i++) {
+            ring.Write(src->data, frameSamples);
+            ring.Read(dst->data, frameSamples);
+        }
+        ringUs = steady_now_us() - begin;
+    }
+    // 原做法：读写各加一次锁，每次读取前分配帧缓冲区，用完释放
+    {
+        mutex fifoMutex;
+        long long begin = steady_now_us();
+        for (int i = 0; i < loops; i++) {
+            {
+                lock_guard<mutex> lock(fifoMutex);
+                av_audio_fifo_write(fifo, (void**)src->data, frameSamples);
+            }
+            out->format = fmt;
+            out->channels = channels;
+            out->channel_layout = src->channel_layout;
+            out->nb_samples = frameSamples;
+            av_frame_get_buffer(out, 0);
+            {
+                lock_guard<mutex> lock(fifoMutex);
+                av_audio_fifo_read(fifo, (void**)out->data, frameSamples);
+            }
+            av_frame_unref(out);
+        }
+        fifoUs = steady_now_us() - begin;
+    }
+    printf("%s %d声道 %dHz，每帧%d个样本，%d次写入读出\n", av_get_sample_fmt_name(fmt), channels, sampleRate, frameSamples, loops);
+    printf("SampleRing:                 每帧%lldns\n", ringUs * 1000 / loops);
+    printf("AVAudioFifo+互斥锁+每次分配: 每帧%lldns\n", fifoUs * 1000 / loops);
+    ret = 0;
+
+END:
+    av_frame_free(&src);
+    av_frame_free(&dst);
+    av_frame_free(&out);
+    if (fifo) av_audio_fifo_free(fifo);
+    return ret;
+}